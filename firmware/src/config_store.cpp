@@ -0,0 +1,181 @@
+#include "config_store.h"
+
+const char* const CONFIG_BLOB_KEYS[2] = {"cfgA", "cfgB"};
+
+String boardId = "";
+String boardName = "VDA IR Controller";
+bool adopted = false;
+
+bool configDirty = false;
+unsigned long configDirtySince = 0;
+unsigned long configLastChange = 0;
+uint32_t configGeneration = 0;
+int configSlot = -1;
+
+ConfigSaveStats configStats = {0, 0, 0, 0, 0, 0, 0, 0, "defaults"};
+
+uint32_t crc32(const uint8_t* data, size_t len) {
+  // Nibble-wise CRC-32 (IEEE 802.3), small enough to not need a 1 KB table
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+bool configBlobValid(const ConfigBlob& blob) {
+  return blob.magic == CONFIG_BLOB_MAGIC &&
+         blob.version == CONFIG_BLOB_VERSION &&
+         blob.size == sizeof(ConfigBlob) &&
+         blob.crc == crc32((const uint8_t*)&blob, offsetof(ConfigBlob, crc));
+}
+
+// Read both copies and return the slot of the newest valid one (-1 if none)
+int readConfigBlob(Preferences& prefs, ConfigBlob& blob) {
+  static ConfigBlob candidate;
+  int best = -1;
+
+  for (int slot = 0; slot < 2; slot++) {
+    if (!prefs.isKey(CONFIG_BLOB_KEYS[slot])) continue;
+    size_t len = prefs.getBytes(CONFIG_BLOB_KEYS[slot], &candidate, sizeof(candidate));
+    if (len != sizeof(candidate) || !configBlobValid(candidate)) {
+      Serial.printf("Config copy %s is invalid, ignoring\n", CONFIG_BLOB_KEYS[slot]);
+      continue;
+    }
+    if (best < 0 || candidate.generation > blob.generation) {
+      memcpy(&blob, &candidate, sizeof(blob));
+      best = slot;
+    }
+  }
+  return best;
+}
+
+void applyConfigBlob(ConfigBlob& blob) {
+  blob.boardId[BOARD_ID_MAX_LEN] = '\0';
+  blob.boardName[BOARD_NAME_MAX_LEN] = '\0';
+  boardId = blob.boardId;
+  boardName = blob.boardName;
+  adopted = blob.adopted != 0;
+  portCount = min((int)blob.portCount, MAX_PORTS);
+
+  for (int i = 0; i < portCount; i++) {
+    const StoredPort& stored = blob.ports[i];
+    PortMode mode = stored.mode <= PORT_IR_INPUT ? (PortMode)stored.mode : PORT_DISABLED;
+    blob.ports[i].name[PORT_NAME_MAX_LEN] = '\0';
+    setPort(i, stored.gpio, mode, stored.name);
+  }
+}
+
+void buildConfigBlob(ConfigBlob& blob, uint32_t generation) {
+  memset(&blob, 0, sizeof(blob));
+  blob.magic = CONFIG_BLOB_MAGIC;
+  blob.version = CONFIG_BLOB_VERSION;
+  blob.size = sizeof(ConfigBlob);
+  blob.generation = generation;
+  strlcpy(blob.boardId, boardId.c_str(), sizeof(blob.boardId));
+  strlcpy(blob.boardName, boardName.c_str(), sizeof(blob.boardName));
+  blob.adopted = adopted ? 1 : 0;
+  blob.portCount = portCount;
+
+  for (int i = 0; i < portCount; i++) {
+    blob.ports[i].gpio = ports[i].gpio;
+    blob.ports[i].mode = ports[i].mode;
+    memcpy(blob.ports[i].name, ports[i].name, sizeof(blob.ports[i].name));
+  }
+  blob.crc = crc32((const uint8_t*)&blob, offsetof(ConfigBlob, crc));
+}
+
+// Pre-blob firmware stored every field under its own key
+void loadLegacyConfig(Preferences& prefs) {
+  boardId = prefs.getString("boardId", "");
+  boardName = prefs.getString("boardName", "VDA IR Controller");
+  adopted = prefs.getBool("adopted", false);
+  portCount = min((int)prefs.getInt("portCount", 0), MAX_PORTS);
+
+  for (int i = 0; i < portCount; i++) {
+    String key = "port" + String(i);
+    int mode = parsePortMode(prefs.getString((key + "_mode").c_str(), "disabled").c_str());
+    setPort(i, prefs.getInt((key + "_gpio").c_str(), 0), mode < 0 ? PORT_DISABLED : (PortMode)mode,
+            prefs.getString((key + "_name").c_str(), "").c_str());
+  }
+}
+
+// Load board and port settings from the open namespace: the newest blob copy,
+// else the legacy per-key layout. Returns true if the result should be
+// written back right away (a migration).
+bool loadStoredConfig(Preferences& prefs) {
+  static ConfigBlob blob;
+
+  configSlot = readConfigBlob(prefs, blob);
+  if (configSlot >= 0) {
+    applyConfigBlob(blob);
+    configGeneration = blob.generation;
+    configStats.loadSource = "blob";
+    return false;
+  }
+  if (prefs.isKey("portCount")) {
+    // Migrate the per-key layout; the old keys are left in place so a
+    // downgrade still finds its configuration
+    loadLegacyConfig(prefs);
+    configStats.loadSource = "legacy";
+    Serial.println("Migrating configuration to blob format");
+    return true;
+  }
+  return false;
+}
+
+void markConfigDirty() {
+  if (!configDirty) {
+    configDirtySince = millis();
+  }
+  configDirty = true;
+  configLastChange = millis();
+}
+
+// Commit once changes have been quiet for the debounce period, or after the
+// max delay if they keep coming
+bool configSaveDue() {
+  if (!configDirty) {
+    return false;
+  }
+  unsigned long now = millis();
+  return now - configLastChange >= CONFIG_SAVE_DEBOUNCE_MS || now - configDirtySince >= CONFIG_SAVE_MAX_DELAY_MS;
+}
+
+// Serialize the whole configuration and write it to the older of the two
+// slots. Returns false if nothing was pending or the write failed.
+bool commitConfig(Preferences& prefs) {
+  if (!configDirty) {
+    return false;
+  }
+
+  unsigned long start = micros();
+  static ConfigBlob blob;
+  buildConfigBlob(blob, configGeneration + 1);
+
+  int slot = (configSlot == 0) ? 1 : 0;
+  prefs.begin(CONFIG_NAMESPACE, false);
+  size_t written = prefs.putBytes(CONFIG_BLOB_KEYS[slot], &blob, sizeof(blob));
+  prefs.end();
+  configStats.nvsWrites++;
+
+  if (written != sizeof(blob)) {
+    // Keep the change pending and retry after another debounce period
+    Serial.println("ERROR: Failed to save configuration");
+    configLastChange = millis();
+    return false;
+  }
+
+  configSlot = slot;
+  configGeneration = blob.generation;
+  configDirty = false;
+  configStats.commits++;
+  configStats.lastCommitUs = micros() - start;
+  Serial.printf("Configuration saved (generation %u, slot %s)\n", configGeneration, CONFIG_BLOB_KEYS[slot]);
+  return true;
+}
@@ -0,0 +1,74 @@
+// Board and port settings are stored as one CRC-protected binary blob. Commits
+// alternate between two NVS keys, so a power loss mid-write always leaves the
+// previous copy intact; the newest valid copy wins at boot. Changes are
+// debounced so a burst of port updates costs a single write.
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "port_table.h"
+
+#define CONFIG_NAMESPACE "vda-ir"
+#define CONFIG_SAVE_DEBOUNCE_MS 2000
+#define CONFIG_SAVE_MAX_DELAY_MS 10000
+
+#define CONFIG_BLOB_MAGIC 0x43414456  // "VDAC"
+#define CONFIG_BLOB_VERSION 1
+#define BOARD_ID_MAX_LEN 32
+#define BOARD_NAME_MAX_LEN 48
+struct __attribute__((packed)) StoredPort {
+  uint8_t gpio;
+  uint8_t mode;  // PortMode
+  char name[PORT_NAME_MAX_LEN + 1];
+};
+
+struct __attribute__((packed)) ConfigBlob {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;        // sizeof(ConfigBlob) when written
+  uint32_t generation;  // Incremented on every commit
+  char boardId[BOARD_ID_MAX_LEN + 1];
+  char boardName[BOARD_NAME_MAX_LEN + 1];
+  uint8_t adopted;
+  uint8_t portCount;
+  StoredPort ports[MAX_PORTS];
+  uint32_t crc;         // CRC-32 of all preceding bytes
+};
+
+extern const char* const CONFIG_BLOB_KEYS[2];
+
+// ============ Board Configuration ============
+extern String boardId;
+extern String boardName;
+extern bool adopted;
+
+extern bool configDirty;
+extern unsigned long configDirtySince;
+extern unsigned long configLastChange;
+extern uint32_t configGeneration;
+extern int configSlot;  // Slot of the current copy, -1 if none stored yet
+
+struct ConfigSaveStats {
+  uint32_t nvsWrites;
+  uint32_t commits;
+  uint32_t lastCommitUs;
+  uint32_t lastConfigureUs;  // Duration of the last /ports/configure request
+  uint32_t maxConfigureUs;
+  uint32_t lastBulkUs;       // Duration of the last /ports/configure_bulk request
+  uint8_t lastBulkChanged;   // Ports re-initialized by that request
+  uint32_t loadUs;           // Boot-time loadConfig() duration
+  const char* loadSource;    // "blob", "legacy" or "defaults"
+};
+extern ConfigSaveStats configStats;
+
+uint32_t crc32(const uint8_t* data, size_t len);
+bool configBlobValid(const ConfigBlob& blob);
+int readConfigBlob(Preferences& prefs, ConfigBlob& blob);
+void applyConfigBlob(ConfigBlob& blob);
+void buildConfigBlob(ConfigBlob& blob, uint32_t generation);
+void loadLegacyConfig(Preferences& prefs);
+bool loadStoredConfig(Preferences& prefs);
+void markConfigDirty();
+bool configSaveDue();
+bool commitConfig(Preferences& prefs);
@@ -0,0 +1,110 @@
+#include "ir_tx.h"
+
+const char* irTxKindName(IrTxKind kind) {
+  static const char* const names[] = {
+    "nec", "samsung", "sony", "rc5", "rc6", "lg", "panasonic", "pioneer", "raw", "test"
+  };
+  return kind <= IR_TX_TEST ? names[kind] : "unknown";
+}
+
+IrTxKind parseIrProtocol(const String& protocol) {
+  if (protocol == "samsung") return IR_TX_SAMSUNG;
+  if (protocol == "sony") return IR_TX_SONY;
+  if (protocol == "rc5") return IR_TX_RC5;
+  if (protocol == "rc6") return IR_TX_RC6;
+  if (protocol == "lg") return IR_TX_LG;
+  if (protocol == "panasonic") return IR_TX_PANASONIC;
+  if (protocol == "pioneer") return IR_TX_PIONEER;
+  if (protocol == "raw") return IR_TX_RAW;
+  return IR_TX_NEC;  // Send as NEC by default
+}
+
+// Encode and send one job on sender. IR_TX_TEST bursts are bit-banged by the
+// caller and are ignored here.
+void sendIrJob(IRsend& sender, const IrTxJob& job) {
+  int freqKHz = job.frequency / 1000;  // Convert Hz to kHz for library
+
+  switch (job.kind) {
+    case IR_TX_NEC:
+      if (job.frequency != 38000) {
+        // Use sendGeneric for custom carrier frequency (e.g., 56kHz for Samsung SMT boxes)
+        // NEC timings: HDR=9000/4500, BIT=562, ONE=1687, ZERO=562
+        Serial.printf("Sending NEC at %dkHz via GPIO%d\n", freqKHz, job.gpio);
+        sender.sendGeneric(
+          9000, 4500,       // Header mark/space
+          562, 1687,        // Bit mark, one space
+          562, 562,         // Zero mark (same as bit), zero space
+          562, 40000,       // Footer mark, gap
+          job.code, 32,     // Data and bits
+          freqKHz, true, 0, 33  // Freq, MSB first, repeats, duty cycle
+        );
+      } else {
+        sender.sendNEC(job.code);
+      }
+      break;
+
+    case IR_TX_SAMSUNG:
+      if (job.frequency != 38000) {
+        // Use sendGeneric for custom carrier frequency
+        // Samsung timings: HDR=4500/4500, BIT=560, ONE=1690, ZERO=560
+        Serial.printf("Sending Samsung at %dkHz via GPIO%d\n", freqKHz, job.gpio);
+        sender.sendGeneric(
+          4500, 4500,       // Header mark/space
+          560, 1690,        // Bit mark, one space
+          560, 560,         // Zero mark (same as bit), zero space
+          560, 40000,       // Footer mark, gap
+          job.code, 32,     // Data and bits
+          freqKHz, true, 0, 33  // Freq, MSB first, repeats, duty cycle
+        );
+      } else {
+        sender.sendSAMSUNG(job.code);
+      }
+      break;
+
+    case IR_TX_SONY:
+      sender.sendSony(job.code);
+      break;
+
+    case IR_TX_RC5:
+      sender.sendRC5(job.code);
+      break;
+
+    case IR_TX_RC6:
+      sender.sendRC6(job.code);
+      break;
+
+    case IR_TX_LG:
+      sender.sendLG(job.code);
+      break;
+
+    case IR_TX_PANASONIC:
+      sender.sendPanasonic(0x4004, job.code);  // Standard Panasonic address
+      break;
+
+    case IR_TX_PIONEER:
+      // Pioneer codes in "AAAACCCC" format need to be encoded as 64-bit Pioneer protocol
+      // The first 4 hex digits are the address, the last 4 are the command
+      // e.g., "A55A38C7" = address 0xA55A, command 0x38C7
+      if (job.code <= 0xFFFFFFFF) {
+        // 32-bit code in Address+Command format - encode it properly
+        uint16_t address = (job.code >> 16) & 0xFFFF;
+        uint16_t command = job.code & 0xFFFF;
+        uint64_t encodedValue = sender.encodePioneer(address, command);
+        Serial.printf("Pioneer: encoding 0x%08llX as address=0x%04X command=0x%04X -> 0x%016llX\n",
+                      (unsigned long long)job.code, address, command, (unsigned long long)encodedValue);
+        sender.sendPioneer(encodedValue, 64);
+      } else {
+        // Already a 64-bit code - send as-is
+        sender.sendPioneer(job.code, 64);
+      }
+      break;
+
+    case IR_TX_RAW:
+      Serial.printf("Sending raw IR: %d values at %dHz via GPIO%d\n", job.rawLen, job.frequency, job.gpio);
+      sender.sendRaw(job.raw, job.rawLen, freqKHz);
+      break;
+
+    case IR_TX_TEST:
+      break;
+  }
+}
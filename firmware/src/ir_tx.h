@@ -0,0 +1,32 @@
+// IR transmit jobs: what /send_ir, /test_output and MQTT hand to the IR
+// transmit task.
+#pragma once
+
+#include <Arduino.h>
+#include <IRsend.h>
+
+#define IR_RAW_MAX 512
+#define IR_RAW_MAX_MS 2000     // Longest raw frame; the IR task has an 8 s watchdog
+#define IR_FREQ_MIN 10000      // Carrier limits accepted by /send_ir
+#define IR_FREQ_MAX 100000
+#define TEST_OUTPUT_MAX_MS 1000
+
+enum IrTxKind : uint8_t {
+  IR_TX_NEC, IR_TX_SAMSUNG, IR_TX_SONY, IR_TX_RC5, IR_TX_RC6, IR_TX_LG,
+  IR_TX_PANASONIC, IR_TX_PIONEER, IR_TX_RAW, IR_TX_TEST
+};
+
+struct IrTxJob {
+  IrTxKind kind;
+  uint8_t portIndex;
+  uint8_t gpio;
+  uint64_t code;
+  uint32_t frequency;   // Carrier in Hz
+  uint32_t durationMs;  // IR_TX_TEST only
+  uint16_t rawLen;
+  uint16_t raw[IR_RAW_MAX];
+};
+
+const char* irTxKindName(IrTxKind kind);
+IrTxKind parseIrProtocol(const String& protocol);
+void sendIrJob(IRsend& sender, const IrTxJob& job);
@@ -0,0 +1,59 @@
+#include "ir_tx_queue.h"
+
+IrTxJob irTxJob;
+QueueHandle_t irTxQueue = nullptr;
+SemaphoreHandle_t irTxDone = nullptr;
+volatile bool irTxBusy = false;
+static portMUX_TYPE irTxMux = portMUX_INITIALIZER_UNLOCKED;
+
+void initIrTxQueue() {
+  irTxQueue = xQueueCreate(1, sizeof(IrTxJob*));
+  irTxDone = xSemaphoreCreateBinary();
+}
+
+// Take irTxJob for the caller until the transmit task is done with it. The
+// HTTP and MQTT tasks both send, so the check and the claim are one step.
+bool claimIrTx() {
+  portENTER_CRITICAL(&irTxMux);
+  bool claimed = !irTxBusy;
+  irTxBusy = true;
+  portEXIT_CRITICAL(&irTxMux);
+  return claimed;
+}
+
+// Hand irTxJob to the transmit task and wait for it to finish. Returns the
+// HTTP status to report.
+int runIrTxJob() {
+  xSemaphoreTake(irTxDone, 0);  // Drop a completion left over from a timed-out job
+  IrTxJob* job = &irTxJob;
+  if (xQueueSend(irTxQueue, &job, 0) != pdTRUE) {
+    irTxBusy = false;
+    return 503;
+  }
+  return xSemaphoreTake(irTxDone, pdMS_TO_TICKS(IR_TX_TIMEOUT_MS)) == pdTRUE ? 200 : 504;
+}
+
+// Response body for a runIrTxJob() status
+const char* irTxResultJson(int status) {
+  if (status == 200) return "{\"success\":true}";
+  if (status == 503) return "{\"error\":\"IR transmitter busy\"}";
+  return "{\"error\":\"IR transmit timed out\"}";
+}
+
+// Transmit task side: waits up to waitMs for the next job
+bool irTxNextJob(IrTxJob*& job, uint32_t waitMs) {
+  return xQueueReceive(irTxQueue, &job, pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+
+// Transmits job under the IR mutex, then frees the slot. Returns whether
+// it was sent.
+bool irTxRunJob(IrTxJob& job, SemaphoreHandle_t irMutex, IrTxTransmit transmit) {
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  bool sent = transmit(job);
+  xSemaphoreGive(irMutex);
+
+  // Signal before clearing busy so a stale completion can't satisfy the next job
+  xSemaphoreGive(irTxDone);
+  irTxBusy = false;
+  return sent;
+}
@@ -0,0 +1,30 @@
+// Hand-off between the tasks that send IR (HTTP and MQTT) and the IR transmit
+// task. There is a single job slot: a sender claims it, fills irTxJob, queues
+// it and waits for the transmit task to finish it before the slot is reused.
+// The transmit task bit-bangs each frame under the IR mutex, which the OTA
+// writer also takes around flash operations.
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include "ir_tx.h"
+
+#define IR_TX_TIMEOUT_MS 5000
+
+// Transmits a job on its port; false if it was skipped
+typedef bool (*IrTxTransmit)(IrTxJob& job);
+
+extern IrTxJob irTxJob;
+extern QueueHandle_t irTxQueue;      // IrTxJob* from the HTTP or MQTT task
+extern SemaphoreHandle_t irTxDone;   // Given by the transmit task when a job finishes
+extern volatile bool irTxBusy;       // irTxJob is claimed; see claimIrTx()
+
+void initIrTxQueue();
+bool claimIrTx();
+int runIrTxJob();
+const char* irTxResultJson(int status);
+bool irTxNextJob(IrTxJob*& job, uint32_t waitMs);
+bool irTxRunJob(IrTxJob& job, SemaphoreHandle_t irMutex, IrTxTransmit transmit);
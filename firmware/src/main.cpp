@@ -8,7 +8,8 @@
  * - HTTP REST API for Home Assistant integration
  * - IR transmission on configurable GPIO pins
  * - IR learning/receiving on input-only GPIO pins
- * - mDNS discovery
+ * - mDNS discovery and a UDP multicast fleet beacon
+ * - MQTT client with Home Assistant discovery
  * - Persistent configuration storage
  * - Captive portal for WiFi setup (WiFi boards)
  * - LED status indication
@@ -26,11 +27,39 @@
 #include <DNSServer.h>
 #include <Update.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_freertos_hooks.h>
+#include <lwip/sockets.h>
+#include <esp_ipc.h>
+#include <driver/gpio.h>
+#include <mbedtls/sha256.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <HTTPClient.h>
+#include <mqtt_client.h>
+
+#include "request_arena.h"
+#include "port_table.h"
+#include "port_plan.h"
+#include "config_store.h"
+#include "metrics.h"
+#include "metrics_web_server.h"
+#include "payload_codec.h"
+#include "serial_script.h"
+#include "ir_tx.h"
+#include "ir_tx_queue.h"
+#include "request_checks.h"
+#include "tx_check.h"
+#include "ota_delta.h"
+#include "ota_gzip.h"
+#include "ota_queue.h"
+#include "wifi_reconnect.h"
 
 #ifdef USE_ETHERNET
   #include <ETH.h>
 #else
   #include <WiFi.h>
+  #include <ping/ping_sock.h>
 #endif
 
 // ============ LED Configuration ============
@@ -58,8 +87,9 @@ enum LedState {
 };
 
 LedState currentLedState = LED_OFF;
-unsigned long lastLedToggle = 0;
 bool ledOn = false;
+uint8_t ledPatternStep = 0;
+esp_timer_handle_t ledTimer = nullptr;  // Drives blinking; stopped while solid on/off
 
 // ============ Captive Portal ============
 #ifdef USE_WIFI
@@ -75,51 +105,132 @@ bool ledOn = false;
   String wifiPassword = "";
   bool wifiConfigured = false;
 
-  // WiFi reconnect with backoff
-  bool wifiNeedsReconnect = false;
-  unsigned long wifiReconnectTime = 0;
-  int wifiReconnectAttempts = 0;
-  // Backoff: 3s for first min (~20 attempts), 5s until 5min (~68 attempts), then 20s
-  #define WIFI_RECONNECT_MAX_ATTEMPTS 120
+  // Optional static address, which skips DHCP
+  bool wifiStaticIp = false;
+  IPAddress wifiIp, wifiGateway, wifiSubnet, wifiDns;
+
+  // The AP (BSSID and channel) of the last connection is kept in RTC memory
+  // and NVS, so (re)connects can skip the all-channel scan. A failed attempt
+  // through the cache falls back to a full scan.
+  #define WIFI_CACHE_MAGIC 0x57494643  // "WIFC"
+
+  struct WifiCache {
+    uint32_t magic;
+    uint32_t ssidCrc;  // Of the SSID it was made for
+    uint8_t bssid[6];
+    uint8_t channel;
+  };
+
+  WifiCache wifiCache = {};
+  RTC_NOINIT_ATTR WifiCache wifiRtcCache;
+  volatile bool wifiCacheDirty = false;  // Set on connect, written to NVS by the net task
+
+  // WiFi reconnect: the retry delay and whether to use the cache depend on
+  // why the connection dropped (see wifi_reconnect.h)
+  #define WIFI_RSSI_SAMPLE_MS 5000
+
+  WifiReconnect wifiReconnect = {false, 0, 0, 0, WIFI_FAIL_OTHER, true};
+  int8_t wifiLastRssi = 0;
+  unsigned long wifiRssiSampleMs = 0;
+
+  struct WifiStats {
+    uint32_t bootConnectMs;  // First connection, from WiFi.begin to an address
+    uint32_t lastConnectMs;
+    uint32_t connects;
+    uint32_t fastConnects;   // Through the cached BSSID and channel
+    uint32_t fullScans;      // Attempts that scanned all channels
+    uint32_t reconnects;     // Connections after a drop
+    uint32_t disconnects[WIFI_FAIL_KINDS];
+    uint8_t lastReason;      // wifi_err_reason_t of the last drop
+    unsigned long attemptStartMs;
+    bool attemptFast;
+  };
+  WifiStats wifiStats = {};
 #endif
 
-// ============ Available GPIO Pins for IR ============
-#ifdef USE_ETHERNET
-  // Olimex ESP32-POE-ISO pins (Ethernet reserves some GPIOs)
-  const int OUTPUT_CAPABLE_PINS[] = {0, 1, 2, 3, 4, 5, 13, 14, 15, 16, 32, 33};
-  const int OUTPUT_CAPABLE_COUNT = 12;
-#else
-  // ESP32 DevKit - more GPIOs available (no Ethernet)
-  // Note: GPIO2 is used for LED, so we exclude it from IR use when LED is enabled
-  const int OUTPUT_CAPABLE_PINS[] = {4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33};
-  const int OUTPUT_CAPABLE_COUNT = 18;
-#endif
-
-// Input-only pins (for IR receiver) - same on both boards
-const int INPUT_ONLY_PINS[] = {34, 35, 36, 39};
-const int INPUT_ONLY_COUNT = 4;
-
-// ============ Port Configuration ============
-struct PortConfig {
-  int gpio;
-  String mode;  // "ir_output", "ir_input", "disabled"
-  String name;
-};
-
-#ifdef USE_ETHERNET
-  #define MAX_PORTS 16
-#else
-  #define MAX_PORTS 22
-#endif
-
-PortConfig ports[MAX_PORTS];
-int portCount = 0;
-
 // ============ IR Objects ============
 IRsend* irSenders[MAX_PORTS] = {nullptr};
 IRrecv* irReceiver = nullptr;
 decode_results irResults;
 int activeReceiverPort = -1;
+SemaphoreHandle_t irMutex = nullptr;  // Guards irSenders, irReceiver and learnedCode across tasks
+
+// Last code decoded by the receive task, consumed by /learning/status
+struct LearnedCode {
+  bool available;
+  decode_type_t protocol;
+  uint64_t value;
+  uint16_t bits;
+};
+LearnedCode learnedCode = {false, UNKNOWN, 0, 0};
+
+// Transmit requests are queued to the IR transmit task through the single
+// job slot in ir_tx_queue.h.
+
+// ============ Tasks ============
+// Work is split across pinned FreeRTOS tasks so a slow HTTP request or serial
+// exchange can't starve IR timing or the status LED. Core 0 is shared with the
+// WiFi/Ethernet stack; core 1 carries HTTP and the bit-banged IR transmit path,
+// with transmit on top so a carrier burst is never preempted mid-frame.
+// Each task subscribes itself to the task watchdog. Tasks sleep until they
+// have work: socket readiness, a queued job or a notification. The status
+// LED runs from an esp_timer.
+#define TASK_IDLE_WAIT_MS 1000  // Longest block time, so idle tasks still feed the watchdog
+#define NET_SERVICE_WAIT_MS 100 // While a request, reconnect or config commit is pending
+#define IR_RX_POLL_MS 20        // Decode poll while a receiver is active
+
+enum TaskId : uint8_t { TASK_NET, TASK_IR_TX, TASK_IR_RX, TASK_SERIAL, TASK_OTA, TASK_OTA_WRITE, TASK_MQTT, TASK_COUNT };
+
+struct TaskInfo {
+  const char* name;
+  uint32_t stackSize;
+  UBaseType_t priority;
+  BaseType_t core;
+  TaskHandle_t handle;
+  uint64_t busyUs;   // Time spent working, accounted by the task itself
+  uint32_t wakeups;
+};
+
+TaskInfo tasks[TASK_COUNT] = {
+  {"net",           8192, 3, 1, nullptr, 0, 0},  // HTTP, captive DNS, reconnect, config commits
+  {"ir_tx",         4096, 5, 1, nullptr, 0, 0},
+  {"ir_rx",         4096, 2, 0, nullptr, 0, 0},
+  {"serial_bridge", 4096, 2, 0, nullptr, 0, 0},  // Started on first /serial/config
+  {"ota",           8192, 1, 0, nullptr, 0, 0},  // Upload port, firmware health check and pull updates
+  {"ota_write",     6144, 1, 0, nullptr, 0, 0},  // Decompression and flash writes for updates
+  {"mqtt",          6144, 1, 0, nullptr, 0, 0},  // Started when MQTT is enabled
+};
+
+// Listening sockets the net task waits on, found after the servers start
+int httpListenFd = -1;
+int dnsListenFd = -1;
+int otaListenFd = -1;  // Waited on by the OTA task
+
+// CPU load, sampled every LOAD_SAMPLE_MS. Idle time is the run time FreeRTOS
+// accounts to each core's idle task, so time other tasks spend preempting it
+// never counts as idle. Cores built without run-time stats fall back to
+// timing the idle hook, which runs once per interrupt while a core is idle:
+// a gap no longer than one tick plus slack between two calls counts as idle.
+#define LOAD_SAMPLE_MS 5000
+#define IDLE_RUN_TIME_STATS (configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1)
+#define IDLE_HOOK_MAX_GAP_US 1200
+
+struct LoadStats {
+#if IDLE_RUN_TIME_STATS
+  uint32_t sampledIdle[2];        // Idle task run-time counters, wrap
+  uint32_t sampledTotal;
+#else
+  volatile uint32_t idleUs[2];    // Accumulated per core, wraps
+  int64_t lastIdleHookUs[2];
+  uint32_t sampledIdleUs[2];
+#endif
+  uint32_t sampledWakeups;
+  volatile uint32_t timerWakeups;  // esp_timer callbacks (LED, sampling)
+  float idlePercent[2];
+  float wakeupsPerSec;
+};
+LoadStats loadStats = {};
+esp_timer_handle_t loadTimer = nullptr;
 
 // ============ Serial Bridge Configuration ============
 HardwareSerial SerialBridge(1);  // UART1 for serial bridge
@@ -127,38 +238,577 @@ bool serialBridgeEnabled = false;
 int serialBridgeRxPin = -1;
 int serialBridgeTxPin = -1;
 int serialBridgeBaud = 115200;
-String serialBridgeBuffer = "";
 
-// ============ Board Configuration ============
-String boardId = "";
-String boardName = "VDA IR Controller";
-bool adopted = false;
+// Fixed buffers for binary-safe payload handling (HTTP task only)
+#define SERIAL_RESPONSE_MAX 1024
+uint8_t serialRxBuffer[SERIAL_RESPONSE_MAX + 1];      // +1 for NUL in text mode
+char serialEncodeBuffer[SERIAL_RESPONSE_MAX * 2 + 1];  // Hex is the widest encoding
+
+// Timing of the last /serial/send, reported by /serial/status
+struct SerialPayloadStats {
+  uint32_t bytesSent;
+  uint32_t decodeUs;      // Decode + UART write
+  uint32_t bytesReceived;
+  uint32_t encodeUs;      // Response encoding
+};
+SerialPayloadStats serialStats = {0, 0, 0, 0};
+
+// ============ Serial Batch Scripts ============
+// Parsed by the HTTP and MQTT handlers, run by the serial bridge task with
+// runSerialScript() (serial_script.h).
+
+// BATCH_CLAIMED holds the port while a /serial/send runs or a batch is being
+// parsed, since the HTTP and MQTT tasks both use it
+enum SerialBatchState : uint8_t { BATCH_IDLE, BATCH_QUEUED, BATCH_RUNNING, BATCH_DONE, BATCH_FAILED, BATCH_CLAIMED };
+
+SerialScript serialBatch;
+volatile SerialBatchState serialBatchState = BATCH_IDLE;
+uint32_t serialBatchId = 0;
+bool serialBatchFromMqtt = false;  // Result is published by the bridge task
+char serialBatchResponseFormat[8] = "text";  // Encoding of wait responses in GET /serial/batch
+portMUX_TYPE serialBatchMux = portMUX_INITIALIZER_UNLOCKED;
+
+// ============ OTA Update ============
+// Uploads may be a plain .bin or a gzip-compressed one (detected by its magic
+// bytes). Compressed images are inflated on the fly through the ROM inflater
+// into a 32 KB window, so only the compressed size crosses the network. A
+// SHA-256 of the firmware image (the decompressed bytes) can be passed as
+// /update?sha256=<hex>; the update is aborted if it doesn't match.
+//
+// The (decompressed) upload may also be a delta against the running firmware,
+// made by tools/ota_delta.py (ota_delta.h), rebuilt into the inactive OTA slot
+// while the upload streams in. The first 4 payload bytes decide which it is.
+//
+// The task receiving an image only copies it into a small pool of chunks;
+// the ota_write task decompresses and writes it. A flash operation stalls
+// both cores, so the writer waits for IR transmits in flight and holds the
+// IR mutex while it touches flash, and it can be throttled to a configured
+// rate. Uploads are served by the OTA task on their own port so the control
+// API on port 80 keeps answering while one is in progress (POST /update on
+// port 80 still works, but holds the HTTP server until it is done).
+#define OTA_REPORT_MAGIC 0x4F544152  // "OTAR"
+#define OTA_UPLOAD_PORT 8266
+#define OTA_UPLOAD_STALE_MS 10000    // An upload without data this long may be replaced
+#define OTA_RESTART_DELAY_MS 1000    // Lets the response reach the client
+#define OTA_WRITE_LIMIT_MIN_KBPS 16
+
+enum OtaSource : uint8_t { OTA_UPLOAD, OTA_PULL };
+
+struct OtaSession {
+  bool active;             // Claimed under otaMux
+  OtaSource source;
+  bool gzip;
+  const char* error;       // First failure; later chunks are ignored
+  GzipStream gz;
+  uint32_t payload;        // Decompressed upload bytes
+  uint8_t lead[4];         // First payload bytes, until they show whether it is a delta
+  OtaDelta* delta;         // Set if the upload is a delta
+  const esp_partition_t* deltaSource;  // Running firmware
+  mbedtls_sha256_context sha;
+  bool checkSha;
+  uint8_t expectedSha[32];
+  uint32_t received;       // Bytes uploaded
+  uint32_t written;        // Image bytes written to flash
+  uint32_t flashUs;
+  unsigned long startMs;
+  unsigned long lastDataMs;
+  uint32_t queueWaitUs;    // Receiver waiting for a free chunk
+  uint32_t irWaitUs;       // Writer waiting for IR transmits
+  OtaThrottle throttle;
+};
+
+// Outcome of the last update. Kept in RTC memory so it survives the restart
+// into the new firmware.
+struct OtaReport {
+  uint32_t magic;
+  bool success;
+  bool gzip;
+  bool delta;
+  bool pulled;
+  uint32_t received;
+  uint32_t written;
+  uint32_t flashUs;
+  uint32_t sourceReadUs;   // Delta only
+  uint32_t queueWaitMs;
+  uint32_t irWaitMs;
+  uint32_t throttleMs;
+  uint32_t totalMs;
+  char sha256[65];
+  char error[48];
+};
+
+OtaSession ota = {};
+RTC_NOINIT_ATTR OtaReport otaReport;
+portMUX_TYPE otaMux = portMUX_INITIALIZER_UNLOCKED;
+bool otaUploadAccepted = false;      // Upload on port 80
+bool otaPortUploadAccepted = false;  // Upload on OTA_UPLOAD_PORT
+
+const char* otaFinishError = nullptr;      // Failure on the receiving side
+
+// Pull updates: when enabled, the OTA task fetches a JSON manifest from a
+// local HTTP server at a jittered interval and installs newer firmware
+// through the same pipeline as uploads. Interrupted downloads resume with
+// HTTP Range requests. "rollout_percent" in the manifest stages a release
+// across the fleet by a stable per-board bucket.
+//
+// New firmware, pulled or uploaded, boots pending verification: it is
+// confirmed once it has stayed connected with the HTTP task running for
+// OTA_HEALTH_DELAY_MS, and rolled back if it can't get there within
+// OTA_HEALTH_TIMEOUT_MS (or crashes first, which the bootloader handles).
+#define OTA_PULL_URL_MAX 128
+#define OTA_PULL_DEFAULT_INTERVAL_S 21600  // 6 hours
+#define OTA_PULL_MIN_INTERVAL_S 300
+#define OTA_PULL_FIRST_CHECK_S 60          // After boot, with the same jitter
+#define OTA_PULL_JITTER_PERCENT 25
+#define OTA_PULL_MAX_RESUMES 5
+#define OTA_PULL_TIMEOUT_MS 5000           // Without data; below the watchdog timeout
+#define OTA_HEALTH_DELAY_MS 60000
+#define OTA_HEALTH_TIMEOUT_MS 300000
+
+struct OtaPullConfig {
+  bool enabled;
+  char manifestUrl[OTA_PULL_URL_MAX];
+  uint32_t intervalS;
+  uint32_t writeLimitKbps;  // Flash write limit for pulls and uploads, 0 for none
+};
+
+struct OtaManifest {
+  char version[16];
+  char url[OTA_PULL_URL_MAX];
+  char sha256[65];
+  uint32_t size;          // 0 to use Content-Length
+  uint8_t rolloutPercent;
+};
+
+enum OtaPullState : uint8_t { PULL_HEALTH_CHECK, PULL_IDLE, PULL_CHECKING, PULL_DOWNLOADING };
+
+struct OtaPullStats {
+  OtaPullState state;
+  const char* firmwareState;   // "confirmed", "pending" or "unverified"
+  uint32_t checks;
+  uint32_t failures;
+  uint32_t updates;
+  uint32_t resumes;            // Downloads continued with a Range request
+  uint32_t restarts;           // Server ignored the range, download started over
+  uint32_t downloadBytes;      // Last download
+  uint32_t downloadMs;
+  unsigned long nextCheckMs;
+  char manifestVersion[16];
+  char lastResult[64];
+};
+
+OtaPullConfig otaPullConfig = {false, "", OTA_PULL_DEFAULT_INTERVAL_S, 0};
+OtaPullStats otaPull = {PULL_IDLE, "unverified", 0, 0, 0, 0, 0, 0, 0, 0, "", ""};
+uint8_t otaPullBuffer[2048];  // OTA task only
+
+// ============ Deferred Restart ============
+// Restart requested by a handler or task, performed by the net task once
+// the delay has passed, after committing pending config changes
+volatile bool restartPending = false;
+unsigned long restartAtMs = 0;
+
+// ============ Fleet Beacon ============
+// Boards announce their state to a UDP multicast group at a jittered
+// interval, and again soon after it changes (config commit, adoption, OTA).
+// A controller can also multicast a query; every matching board answers with
+// the same status packet, unicast to the querier after a random delay within
+// the reply window the query asks for. Packets are packed little-endian
+// structs ending in a CRC-32 of the preceding bytes (see tools/fleet_beacon.py).
+#define BEACON_GROUP "239.255.86.73"
+#define BEACON_PORT 48673
+#define BEACON_TTL 1                    // Raise to route across VLANs
+#define BEACON_MAGIC 0x42414456         // "VDAB"
+#define BEACON_VERSION 1
+#define BEACON_INTERVAL_MS 30000
+#define BEACON_JITTER_PERCENT 20
+#define BEACON_MIN_GAP_MS 1000          // Between announcements triggered by changes
+#define BEACON_REPLY_WINDOW_MAX_MS 5000
+#define BEACON_PENDING_MAX 4            // Queries awaiting their delayed reply
+
+enum BeaconType : uint8_t { BEACON_ANNOUNCE = 1, BEACON_QUERY = 2, BEACON_RESPONSE = 3 };
+
+#define BEACON_FLAG_ADOPTED          (1 << 0)
+#define BEACON_FLAG_ETHERNET         (1 << 1)
+#define BEACON_FLAG_AP_MODE          (1 << 2)
+#define BEACON_FLAG_OTA_ACTIVE       (1 << 3)
+#define BEACON_FLAG_CONFIG_PENDING   (1 << 4)
+#define BEACON_FLAG_FIRMWARE_PENDING (1 << 5)  // New firmware not yet confirmed healthy
+
+struct __attribute__((packed)) BeaconHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t type;    // BeaconType
+  uint16_t size;   // Whole packet, CRC included
+  uint32_t nonce;  // From the query; 0 in announcements
+};
+
+struct __attribute__((packed)) BeaconStatus {
+  BeaconHeader header;
+  uint8_t mac[6];
+  uint8_t flags;          // BEACON_FLAG_*
+  uint8_t resetReason;    // esp_reset_reason_t
+  char boardId[BOARD_ID_MAX_LEN + 1];
+  char firmware[12];
+  uint32_t configGeneration;
+  uint32_t uptimeS;
+  uint64_t outputMask;    // Bit n set if GPIO n is an IR output
+  uint64_t inputMask;
+  uint8_t portCount;
+  uint8_t outputCount;
+  uint8_t inputCount;
+  int8_t rssi;            // 0 on Ethernet
+  uint8_t idlePercent[2]; // Per core
+  uint16_t seq;           // Incremented per packet sent
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  uint32_t largestBlock;
+  uint32_t crc;
+};
+
+struct __attribute__((packed)) BeaconQuery {
+  BeaconHeader header;
+  uint16_t replyWindowMs;
+  char boardId[BOARD_ID_MAX_LEN + 1];  // Empty to ask every board
+  uint32_t crc;
+};
+
+struct BeaconReply {
+  uint32_t addr;     // Network order
+  uint16_t port;
+  uint32_t nonce;
+  unsigned long dueMs;
+};
+
+struct BeaconState {
+  int fd;
+  uint16_t seq;
+  unsigned long nextAnnounceMs;
+  unsigned long lastAnnounceMs;
+  uint8_t announcedFlags;
+  uint32_t announcedGeneration;
+  BeaconReply pending[BEACON_PENDING_MAX];
+  uint8_t pendingCount;
+  uint32_t announcements;
+  uint32_t queries;
+  uint32_t responses;
+  uint32_t ignored;      // Queries for another board
+  uint32_t invalid;      // Bad magic, version, size or CRC
+  uint32_t dropped;      // Queries with no free reply slot
+  uint32_t sendErrors;
+};
+BeaconState beacon = {-1};
+
+static_assert(sizeof(BeaconStatus) == 113, "BeaconStatus layout is shared with tools/fleet_beacon.py");
+static_assert(sizeof(BeaconQuery) == 51, "BeaconQuery layout is shared with tools/fleet_beacon.py");
+
+// ============ mDNS ============
+// The http and vda-ir services carry TXT records with what a controller
+// would otherwise fetch from /info, so a browse alone tells it which
+// firmware and ports a board has and whether its cached copy is current
+// ("gen" is the config generation). The records are replaced in place after
+// every config commit, and adoption renames the host without restarting
+// the responder.
+#define MDNS_TXT_VERSION "1"
+#define MDNS_TXT_ITEMS 11
+
+#ifdef USE_ETHERNET
+  #define BOARD_TYPE "esp32-poe-iso"
+#else
+  #define BOARD_TYPE "esp32-devkit"
+#endif
+
+struct MdnsStats {
+  bool started;
+  uint32_t txtUpdates;
+  uint32_t lastTxtUpdateUs;
+  uint32_t renames;
+};
+MdnsStats mdnsStats = {};
+
+// ============ MQTT ============
+// Optional push channel to a broker, so Home Assistant doesn't have to poll
+// every board. The esp-mqtt client runs its own task; the "mqtt" task owns the
+// client and is the only one that publishes. Other tasks hand it messages
+// through a bounded outbox queue without ever blocking (a message that doesn't
+// fit is dropped and counted), and the client's event handler hands commands
+// to it through the inbox. Publishes are QoS 1 with at most MQTT_INFLIGHT_MAX
+// unacknowledged at a time. The client id is stable and the session is
+// persistent, so subscriptions and unacknowledged commands survive a
+// reconnect.
+#define MQTT_URI_MAX 96
+#define MQTT_CREDENTIAL_MAX 64
+#define MQTT_BASE_TOPIC_MAX 64
+#define MQTT_PREFIX_MAX 32
+#define MQTT_TOPIC_MAX 128
+#define MQTT_PAYLOAD_MAX 512          // Outbox messages; longer serial responses are truncated
+#define MQTT_COMMAND_MAX 2048         // Inbound command payloads
+#define MQTT_OUTBOX_LEN 8
+#define MQTT_INBOX_LEN 2
+#define MQTT_INFLIGHT_MAX 8
+#define MQTT_KEEPALIVE_S 30
+#define MQTT_RECONNECT_MIN_MS 1000
+#define MQTT_RECONNECT_MAX_MS 60000
+#define MQTT_STATUS_INTERVAL_MS 60000
+#define MQTT_CLIENT_PRIORITY 1        // Below ir_tx, so broker traffic never delays a frame
+
+struct MqttConfig {
+  bool enabled;
+  bool discovery;                              // Publish Home Assistant discovery configs
+  char uri[MQTT_URI_MAX];                      // mqtt://host[:port]
+  char username[MQTT_CREDENTIAL_MAX];
+  char password[MQTT_CREDENTIAL_MAX];
+  char baseTopic[MQTT_BASE_TOPIC_MAX];         // Empty for vda-ir/<mac>
+  char discoveryPrefix[MQTT_PREFIX_MAX];
+};
+
+struct MqttMessage {
+  char topic[MQTT_TOPIC_MAX];                  // Relative to the base topic
+  char payload[MQTT_PAYLOAD_MAX];
+  uint16_t len;
+  bool retain;
+};
+
+struct MqttCommand {
+  char topic[MQTT_TOPIC_MAX];                  // Full topic, as received
+  char payload[MQTT_COMMAND_MAX + 1];
+  uint16_t len;
+};
+
+struct MqttStats {
+  bool connected;
+  bool sessionPresent;
+  uint32_t connects;
+  uint32_t connectFailures;
+  uint32_t disconnects;
+  uint32_t published;
+  uint32_t acked;
+  uint32_t dropped;           // Outbox full, or the publish failed
+  uint32_t commands;
+  uint32_t commandErrors;
+  uint32_t commandsDropped;   // Inbox full or payload too large
+  uint32_t discoveryPublished;
+  uint32_t reconnectDelayMs;
+  unsigned long connectedMs;
+  char lastError[48];
+};
+
+MqttConfig mqttConfig = {false, true, "", "", "", "", "homeassistant"};
+MqttStats mqttStats = {};
+QueueHandle_t mqttOutbox = nullptr;   // MqttMessage from any task
+QueueHandle_t mqttInbox = nullptr;    // MqttCommand from the client's event handler
+volatile int mqttInflight = 0;
+volatile bool mqttRestart = false;    // Set by POST /mqtt, handled by the mqtt task
+portMUX_TYPE mqttMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Owned by the mqtt task; the event handler only sets the flags
+struct MqttSession {
+  esp_mqtt_client_handle_t client;
+  esp_mqtt_client_config_t clientConfig;
+  MqttConfig config;                       // Copy the client was started with
+  char baseTopic[MQTT_BASE_TOPIC_MAX];
+  char nodeId[24];                         // vda_ir_<mac>, also the client id
+  char willTopic[MQTT_TOPIC_MAX];
+  uint32_t backoffMs;
+  volatile bool connectedEvent;            // Announce online and rediscover
+  int discoveryStep;                       // -1 when no pass is running
+  uint8_t discovered[MAX_PORTS];           // PortMode announced, 0xFF if unknown
+  uint32_t discoveredGeneration;
+  unsigned long lastStatusMs;
+};
+MqttSession mqtt = {};
+
+// Set by the mqtt task with a serial command, read by the bridge task
+struct MqttSerialRequest {
+  char id[32];
+  bool hex;
+};
+MqttSerialRequest mqttSerialRequest = {};
+
+// ============ Metrics ============
+// Operation histograms next to the per-route ones in metrics.h
+enum MetricId : uint8_t { METRIC_IR_SEND, METRIC_IR_RECEIVE, METRIC_SERIAL_SEND, METRIC_SERIAL_BATCH, METRIC_COUNT };
+const char* const METRIC_NAMES[METRIC_COUNT] = {"ir_send", "ir_receive", "serial_send", "serial_batch"};
+
+LatencyHistogram opMetrics[METRIC_COUNT];
+uint32_t metricsRecordNs = 0;  // Measured cost of recordLatency() at boot
+
+static const char* methodName(HTTPMethod method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    default: return "ANY";
+  }
+}
+
+// JSON document for HTTP handlers (request_arena.h); only valid until the
+// handler returns
+typedef BasicJsonDocument<ArenaAllocator> RequestJsonDocument;
+
+// ============ WiFi Power Profiles ============
+#ifdef USE_WIFI
+  // Modem sleep turns the radio off between AP beacons and the AP buffers
+  // frames for the board meanwhile, so the first packet of a request waits
+  // up to a DTIM period (WIFI_PS_MIN_MODEM) or listen_interval beacons
+  // (WIFI_PS_MAX_MODEM, ~102ms each). Selected with POST /wifi/power.
+  enum WifiPowerProfile : uint8_t { WIFI_POWER_LOWEST_LATENCY, WIFI_POWER_BALANCED, WIFI_POWER_LOW_POWER, WIFI_POWER_PROFILES };
+
+  struct WifiPowerSettings {
+    const char* name;
+    wifi_ps_type_t sleep;
+    uint8_t listenInterval;  // Beacons; sent to the AP when associating
+    wifi_power_t txPower;
+    float txPowerDbm;
+  };
+
+  const WifiPowerSettings WIFI_POWER_SETTINGS[WIFI_POWER_PROFILES] = {
+    {"lowest_latency", WIFI_PS_NONE, 3, WIFI_POWER_19_5dBm, 19.5},
+    {"balanced", WIFI_PS_MIN_MODEM, 3, WIFI_POWER_19_5dBm, 19.5},  // Arduino core defaults
+    {"low_power", WIFI_PS_MAX_MODEM, 10, WIFI_POWER_13dBm, 13},
+  };
+
+  // The gateway is pinged periodically as a link round-trip probe. Timeouts
+  // are recorded as errors, except while disconnected.
+  #define WIFI_PROBE_INTERVAL_MS 10000
+  #define WIFI_PROBE_TIMEOUT_MS 1000
+
+  struct WifiPowerStats {
+    uint64_t activeMs;          // Time in the profile, not counting the current stint
+    LatencyHistogram requests;  // HTTP handling time (net task)
+    LatencyHistogram probe;     // Gateway ping round trip (ping task)
+  };
+
+  volatile WifiPowerProfile wifiPowerProfile = WIFI_POWER_BALANCED;
+  WifiPowerStats wifiPowerStats[WIFI_POWER_PROFILES];
+  unsigned long wifiPowerSinceMs = 0;
+  bool wifiPowerReassociate = false;       // For a new listen interval, done by the net task
+  esp_ping_handle_t wifiProbe = nullptr;
+  volatile bool wifiProbeRestart = false;  // Set on every connect, the gateway may have changed
+#endif
+
+// ============ Heap Tracking ============
+// malloc/calloc/realloc are wrapped at link time (see platformio.ini) so
+// allocations made by the net task while a route runs are charged to it.
+// Only the net task writes these counters.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static inline void IRAM_ATTR countAllocation(size_t size) {
+  int route = currentRoute;
+  if (route >= 0 && xTaskGetCurrentTaskHandle() == tasks[TASK_NET].handle) {
+    routeMetrics[route].allocs++;
+    routeMetrics[route].allocBytes += size;
+  }
+}
+
+void* IRAM_ATTR __wrap_malloc(size_t size) {
+  countAllocation(size);
+  return __real_malloc(size);
+}
+
+void* IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+  countAllocation(count * size);
+  return __real_calloc(count, size);
+}
+
+void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size) {
+  countAllocation(size);
+  return __real_realloc(ptr, size);
+}
+}
 
 // ============ Global Objects ============
-WebServer server(80);  // Changed to port 80 for captive portal compatibility
+MetricsWebServer server(80);  // Changed to port 80 for captive portal compatibility
+WebServer otaServer(OTA_UPLOAD_PORT);  // Firmware uploads, served by the OTA task
 Preferences preferences;
 bool networkConnected = false;
 bool apMode = false;
 
+// ============ Boot Timeline ============
+// IR ports come up from the saved configuration before the network, which
+// starts in the background. The net task starts HTTP, mDNS and the upload
+// port as soon as there is an address. Each phase records when it finished,
+// in ms since power-on, for /diagnostics.
+#define NETWORK_WAIT_MS 10000  // Then fall back to AP mode (WiFi) or report an error
+
+enum BootPhase : uint8_t { BOOT_INIT, BOOT_CONFIG, BOOT_PORTS, BOOT_NETWORK, BOOT_IP, BOOT_SERVICES, BOOT_PHASES };
+const char* const BOOT_PHASE_NAMES[BOOT_PHASES] = {"init", "config", "ports", "network_start", "ip", "services"};
+
+uint32_t bootSetupStartMs = 0;
+uint32_t bootPhaseMs[BOOT_PHASES] = {};  // 0 until reached
+bool bootNetworkTimedOut = false;
+volatile bool networkServicesStarted = false;
+
+void markBootPhase(BootPhase phase) {
+  if (bootPhaseMs[phase] == 0) bootPhaseMs[phase] = millis();
+}
+
+// Serialize into the request arena and send without building a String
+void sendJson(int code, const JsonDocument& doc) {
+  size_t len = measureJson(doc);
+  char* buffer = (char*)arenaAlloc(len + 1);
+  if (buffer == nullptr) {
+    server.send(500, "application/json", "{\"error\":\"Out of memory\"}");
+    return;
+  }
+  serializeJson(doc, buffer, len + 1);
+  server.send_P(code, "application/json", buffer, len);
+  arenaFree(buffer);
+}
+
+void sendJsonError(int code, const char* message) {
+  StaticJsonDocument<128> response;
+  response["error"] = message;
+  sendJson(code, response);
+}
+
 // ============ Function Declarations ============
 void initNetwork();
 void setupWebServer();
 void loadConfig();
 void saveConfig();
+void serviceConfigSave();
+void scheduleRestart(uint32_t delayMs);
+void serviceRestart();
 void initPorts();
 void initIRSender(int portIndex);
+void releaseIRSender(int portIndex);
 void initIRReceiver(int gpio);
+void stopIRReceiver();
+void initTasks();
+void serviceNetworkStartup();
+void startBeacon();
+void serviceBeacon();
+void startMdns();
+void updateMdnsTxt();
+void renameMdnsHost();
+void initMetrics();
+void initTxCheck();
+void startTask(TaskId id, TaskFunction_t fn);
+void networkTask(void* param);
+void irTransmitTask(void* param);
+void irReceiveTask(void* param);
+bool transmitIrJob(const IrTxJob& job);
+void startTxCapture(uint8_t gpio);
+void finishTxCapture(const IrTxJob& job);
 String getLocalIP();
 String getMacAddress();
 void initLED();
 void setLedState(LedState state);
-void updateLED();
+void ledTimerCallback(void* arg);
 
 #ifdef USE_ETHERNET
   void onEthEvent(WiFiEvent_t event);
 #else
-  void onWiFiEvent(WiFiEvent_t event);
+  void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
   void handleWiFiConfig();
+  void beginWiFiConnect(bool useCache);
+  void serviceWiFiReconnect();
+  void applyWifiPowerProfile();
+  void serviceWifiPower();
+  void handleWifiPowerStatus();
+  void handleWifiPowerConfig();
   void startAPMode();
   void handleCaptivePortal();
   String generateSetupPage();
@@ -171,12 +821,17 @@ void handleInfo();
 void handleStatus();
 void handlePorts();
 void handleConfigurePort();
+void handleConfigurePortsBulk();
 void handleAdopt();
 void handleSendIR();
 void handleTestOutput();
 void handleLearningStart();
 void handleLearningStop();
 void handleLearningStatus();
+void handleDiagnostics();
+void handleMetrics();
+void handleTxCheck();
+void handleSelfTest();
 void handleNotFound();
 
 // Serial Bridge Handlers
@@ -184,15 +839,37 @@ void handleSerialConfig();
 void handleSerialSend();
 void handleSerialRead();
 void handleSerialStatus();
+void handleSerialBatch();
+void handleSerialBatchResult();
 void handleOTAPage();
 void handleOTAUpload();
 void handleOTAComplete();
+void handleOTAPortUpload();
+void handleOTAPortComplete();
+void handleOtaPullStatus();
+void handleOtaPullConfig();
+void loadOtaPullConfig();
+void handleMqttStatus();
+void handleMqttConfig();
+void loadMqttConfig();
+void startMqtt();
+void mqttTask(void* param);
+void mqttPublishIrCode(uint8_t gpio, decode_type_t protocol, uint64_t value, uint16_t bits);
+void mqttPublishSerialResult(bool ok);
+void addMqttStats(JsonObject obj);
+void otaTask(void* param);
+void otaWriteTask(void* param);
 void initSerialBridge(int rxPin, int txPin, int baud);
+void serialBridgeTask(void* param);
+bool serialBatchActive();
+bool claimSerialBridge(SerialBatchState& prior);
+void releaseSerialBridge(SerialBatchState prior);
+void queueSerialBatch(bool fromMqtt);
 
 // ============ Setup ============
 void setup() {
+  bootSetupStartMs = millis();
   Serial.begin(115200);
-  delay(1000);
 
   // Initialize LED first for visual feedback
   initLED();
@@ -207,497 +884,1255 @@ void setup() {
 #endif
   Serial.println("========================================\n");
 
+  // Queues and locks must exist before ports are initialized
+  initTasks();
+  initMetrics();
+  initTxCheck();
+  markBootPhase(BOOT_INIT);
+
   // Load saved configuration
   loadConfig();
+  loadOtaPullConfig();
+  loadMqttConfig();
+  markBootPhase(BOOT_CONFIG);
 
-  // Initialize network
-  initNetwork();
+  // Initialize hardware watchdog - reboots if any task hangs
+  esp_task_wdt_init(WDT_TIMEOUT_SECONDS, true);
+  Serial.printf("Watchdog enabled: %d second timeout\n", WDT_TIMEOUT_SECONDS);
 
-  // Wait for network connection
-  Serial.println("Waiting for network...");
-  int timeout = 0;
-  int maxTimeout = 100;  // 10 seconds for Ethernet, will be longer for WiFi AP mode
+  // IR is usable before the network is up, e.g. for scenes fired right
+  // after a power blip
+  startTask(TASK_IR_TX, irTransmitTask);
+  startTask(TASK_IR_RX, irReceiveTask);
+  initPorts();
+  markBootPhase(BOOT_PORTS);
 
+  // Initialize network; the net task starts services once it is up
+  initNetwork();
 #ifdef USE_WIFI
   if (!wifiConfigured) {
     Serial.println("No WiFi configured - starting AP mode...");
     startAPMode();
-    maxTimeout = 50;  // Shorter wait for AP mode
-  }
-#endif
-
-  while (!networkConnected && timeout < maxTimeout) {
-    delay(100);
-    updateLED();
-    timeout++;
   }
-
-  if (networkConnected) {
-    // Setup mDNS
-    String mdnsName = boardId.length() > 0 ? boardId : "vda-ir-" + String((uint32_t)ESP.getEfuseMac(), HEX);
-    if (MDNS.begin(mdnsName.c_str())) {
-      MDNS.addService("http", "tcp", 80);
-      MDNS.addService("vda-ir", "tcp", 80);
-      Serial.printf("mDNS: %s.local\n", mdnsName.c_str());
-    }
-
-    // Setup web server
-    setupWebServer();
-
-    // Initialize ports
-    initPorts();
-
-    // Set LED state based on mode
-    if (apMode) {
-      setLedState(LED_BLINK_FAST);  // AP mode ready
-      Serial.println("\n=== AP Mode Ready! ===");
-      Serial.println("Connect to WiFi network shown above");
-      Serial.println("Then open http://192.168.4.1 in your browser");
-    } else {
-      setLedState(LED_ON);  // Connected and ready
-      Serial.println("\n=== Ready! ===");
-    }
-
-    Serial.printf("IP Address: %s\n", getLocalIP().c_str());
-    Serial.printf("Board ID: %s\n", boardId.c_str());
-    Serial.printf("HTTP Server: http://%s/\n", getLocalIP().c_str());
-  } else {
-    Serial.println("ERROR: Network connection failed!");
-    setLedState(LED_BLINK_PATTERN);  // Error state
-#ifdef USE_WIFI
-    Serial.println("Starting AP mode for configuration...");
-    startAPMode();
-    setupWebServer();
-    setLedState(LED_BLINK_FAST);
 #endif
-  }
+  markBootPhase(BOOT_NETWORK);
 
-  // Initialize hardware watchdog - reboots if loop hangs
-  esp_task_wdt_init(WDT_TIMEOUT_SECONDS, true);
-  esp_task_wdt_add(NULL);
-  Serial.printf("Watchdog enabled: %d second timeout\n", WDT_TIMEOUT_SECONDS);
+  startTask(TASK_NET, networkTask);
+  startTask(TASK_OTA, otaTask);
+  startTask(TASK_OTA_WRITE, otaWriteTask);
 }
 
 // ============ Loop ============
 void loop() {
-  // Feed watchdog to prevent reboot
-  esp_task_wdt_reset();
-  // Handle DNS for captive portal
-#ifdef USE_WIFI
-  if (captivePortalActive) {
-    dnsServer.processNextRequest();
-  }
-
-  // Handle WiFi reconnect with backoff
-  if (wifiNeedsReconnect && !networkConnected) {
-    // Determine delay based on attempt count
-    // 3s for first ~20 attempts (1 min), 5s for next ~48 (until 5 min), then 20s
-    unsigned long reconnectDelay;
-    if (wifiReconnectAttempts < 20) {
-      reconnectDelay = 3000;
-    } else if (wifiReconnectAttempts < 68) {
-      reconnectDelay = 5000;
-    } else {
-      reconnectDelay = 20000;
-    }
+  // All work runs in the tasks started by setup()
+  vTaskDelete(NULL);
+}
+
+// ============ Tasks ============
+#if !IDLE_RUN_TIME_STATS
+static bool idleHook(int core) {
+  int64_t now = esp_timer_get_time();
+  int64_t gap = now - loadStats.lastIdleHookUs[core];
+  if (gap <= IDLE_HOOK_MAX_GAP_US) {
+    loadStats.idleUs[core] += gap;
+  }
+  loadStats.lastIdleHookUs[core] = now;
+  return true;  // Call again after the next interrupt
+}
 
-    if (millis() - wifiReconnectTime >= reconnectDelay) {
-      wifiReconnectAttempts++;
+static bool idleHookCore0() { return idleHook(0); }
+static bool idleHookCore1() { return idleHook(1); }
+#endif
 
-      if (wifiReconnectAttempts >= WIFI_RECONNECT_MAX_ATTEMPTS) {
-        Serial.println("WiFi: Max reconnect attempts reached, rebooting...");
-        delay(100);
-        ESP.restart();
-      }
+static void sampleLoad(void* arg) {
+  loadStats.timerWakeups++;
 
-      WiFi.reconnect();
-      wifiReconnectTime = millis();
-    }
+  uint32_t wakeups = loadStats.timerWakeups;
+  for (int i = 0; i < TASK_COUNT; i++) {
+    wakeups += tasks[i].wakeups;
+  }
+  loadStats.wakeupsPerSec = (wakeups - loadStats.sampledWakeups) * 1000.0f / LOAD_SAMPLE_MS;
+  loadStats.sampledWakeups = wakeups;
+
+#if IDLE_RUN_TIME_STATS
+  uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+  uint32_t elapsed = total - loadStats.sampledTotal;
+  for (int core = 0; core < 2; core++) {
+    TaskStatus_t idleTask;
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &idleTask, pdFALSE, eInvalid);
+    uint32_t idle = idleTask.ulRunTimeCounter;
+    loadStats.idlePercent[core] = elapsed ? min(100.0f, 100.0f * (idle - loadStats.sampledIdle[core]) / elapsed) : 0.0f;
+    loadStats.sampledIdle[core] = idle;
+  }
+  loadStats.sampledTotal = total;
+#else
+  for (int core = 0; core < 2; core++) {
+    uint32_t idle = loadStats.idleUs[core];
+    loadStats.idlePercent[core] = (idle - loadStats.sampledIdleUs[core]) / (LOAD_SAMPLE_MS * 10.0f);
+    loadStats.sampledIdleUs[core] = idle;
   }
 #endif
+}
 
-  server.handleClient();
+void initTasks() {
+  irMutex = xSemaphoreCreateMutex();
+  initIrTxQueue();
 
-  // Check for IR signals if receiver is active
-  if (irReceiver != nullptr && irReceiver->decode(&irResults)) {
-    Serial.println("IR Signal Received!");
-    serialPrintUint64(irResults.value, HEX);
-    Serial.println();
-    irReceiver->resume();
-  }
+  initOtaQueue();
 
-  // Update LED state
-  updateLED();
+#if !IDLE_RUN_TIME_STATS
+  esp_register_freertos_idle_hook_for_cpu(idleHookCore0, 0);
+  esp_register_freertos_idle_hook_for_cpu(idleHookCore1, 1);
+#endif
 
-  delay(1);
+  esp_timer_create_args_t args = {};
+  args.callback = sampleLoad;
+  args.name = "load";
+  esp_timer_create(&args, &loadTimer);
+  esp_timer_start_periodic(loadTimer, LOAD_SAMPLE_MS * 1000ULL);
 }
 
-// ============ LED Functions ============
-void initLED() {
-#if STATUS_LED_PIN >= 0
-  pinMode(STATUS_LED_PIN, OUTPUT);
-  digitalWrite(STATUS_LED_PIN, LOW);
-  Serial.printf("Status LED initialized on GPIO%d\n", STATUS_LED_PIN);
-#endif
+void startTask(TaskId id, TaskFunction_t fn) {
+  if (tasks[id].handle != nullptr) return;
+  xTaskCreatePinnedToCore(fn, tasks[id].name, tasks[id].stackSize, nullptr,
+                          tasks[id].priority, &tasks[id].handle, tasks[id].core);
 }
 
-void setLedState(LedState state) {
-  currentLedState = state;
-  lastLedToggle = millis();
+inline void accountTask(TaskId id, unsigned long startUs) {
+  tasks[id].busyUs += micros() - startUs;
+  tasks[id].wakeups++;
+}
 
-#if STATUS_LED_PIN >= 0
-  if (state == LED_OFF) {
-    digitalWrite(STATUS_LED_PIN, LOW);
-    ledOn = false;
-  } else if (state == LED_ON) {
-    digitalWrite(STATUS_LED_PIN, HIGH);
-    ledOn = true;
-  }
-#endif
+#ifdef USE_WIFI
+static bool wifiCacheValid() {
+  return wifiCache.magic == WIFI_CACHE_MAGIC && wifiCache.channel > 0 &&
+         wifiCache.ssidCrc == crc32((const uint8_t*)wifiSSID.c_str(), wifiSSID.length());
 }
 
-void updateLED() {
-#if STATUS_LED_PIN >= 0
-  unsigned long now = millis();
+void recordWifiRequest(uint32_t us, bool error) {
+  recordLatency(wifiPowerStats[wifiPowerProfile].requests, us, error);
+}
 
-  switch (currentLedState) {
-    case LED_BLINK_SLOW:
-      if (now - lastLedToggle >= 500) {
-        ledOn = !ledOn;
-        digitalWrite(STATUS_LED_PIN, ledOn ? HIGH : LOW);
-        lastLedToggle = now;
-      }
-      break;
+// Sleep mode and TX power take effect immediately; the listen interval only
+// on the next association (see beginWiFiConnect)
+void applyWifiPowerProfile() {
+  const WifiPowerSettings& settings = WIFI_POWER_SETTINGS[wifiPowerProfile];
+  WiFi.setSleep(settings.sleep);
+  WiFi.setTxPower(settings.txPower);
+}
 
-    case LED_BLINK_FAST:
-      if (now - lastLedToggle >= 150) {
-        ledOn = !ledOn;
-        digitalWrite(STATUS_LED_PIN, ledOn ? HIGH : LOW);
-        lastLedToggle = now;
-      }
-      break;
+// Called by the net task; persists the profile
+static void setWifiPowerProfile(WifiPowerProfile profile) {
+  if (profile == wifiPowerProfile) return;
 
-    case LED_BLINK_PATTERN:
-      // Double blink pattern for error
-      {
-        unsigned long cycle = (now / 100) % 10;
-        bool shouldBeOn = (cycle == 0 || cycle == 2);
-        if (shouldBeOn != ledOn) {
-          ledOn = shouldBeOn;
-          digitalWrite(STATUS_LED_PIN, ledOn ? HIGH : LOW);
-        }
-      }
-      break;
+  bool reassociate = WIFI_POWER_SETTINGS[profile].listenInterval != WIFI_POWER_SETTINGS[wifiPowerProfile].listenInterval;
+  wifiPowerStats[wifiPowerProfile].activeMs += millis() - wifiPowerSinceMs;
+  wifiPowerSinceMs = millis();
+  wifiPowerProfile = profile;
+  Serial.printf("WiFi: Power profile %s\n", WIFI_POWER_SETTINGS[profile].name);
 
-    default:
-      break;
+  if (!apMode) {
+    applyWifiPowerProfile();
+    wifiPowerReassociate = reassociate && networkConnected;
   }
-#endif
+
+  preferences.begin(CONFIG_NAMESPACE, false);
+  preferences.putUChar("wifiPower", profile);
+  preferences.end();
 }
 
-// ============ Network Initialization ============
-#ifdef USE_ETHERNET
+static void onWifiProbeReply(esp_ping_handle_t handle, void* args) {
+  uint32_t ms = 0;
+  esp_ping_get_profile(handle, ESP_PING_PROF_TIMEGAP, &ms, sizeof(ms));
+  recordLatency(wifiPowerStats[wifiPowerProfile].probe, ms * 1000, false);
+}
 
-void initNetwork() {
-  WiFi.onEvent(onEthEvent);
-  ETH.begin(ETH_PHY_ADDR, ETH_PHY_POWER, ETH_PHY_MDC, ETH_PHY_MDIO, ETH_PHY_TYPE, ETH_CLK_MODE);
+static void onWifiProbeTimeout(esp_ping_handle_t handle, void* args) {
+  if (!networkConnected || apMode) return;
+  recordLatency(wifiPowerStats[wifiPowerProfile].probe, WIFI_PROBE_TIMEOUT_MS * 1000, true);
 }
 
-void onEthEvent(WiFiEvent_t event) {
-  switch (event) {
-    case ARDUINO_EVENT_ETH_START:
-      Serial.println("ETH: Started");
-      ETH.setHostname(boardId.length() > 0 ? boardId.c_str() : "vda-ir-controller");
-      break;
-    case ARDUINO_EVENT_ETH_CONNECTED:
-      Serial.println("ETH: Connected");
-      break;
-    case ARDUINO_EVENT_ETH_GOT_IP:
-      Serial.printf("ETH: Got IP - %s\n", ETH.localIP().toString().c_str());
-      Serial.printf("ETH: MAC - %s\n", ETH.macAddress().c_str());
-      networkConnected = true;
-      setLedState(LED_ON);
-      break;
-    case ARDUINO_EVENT_ETH_DISCONNECTED:
-      Serial.println("ETH: Disconnected");
-      networkConnected = false;
-      setLedState(LED_BLINK_SLOW);
-      break;
-    case ARDUINO_EVENT_ETH_STOP:
-      Serial.println("ETH: Stopped");
-      networkConnected = false;
-      setLedState(LED_OFF);
-      break;
-    default:
-      break;
+static void startWifiProbe() {
+  IPAddress gateway = WiFi.gatewayIP();
+  if ((uint32_t)gateway == 0) return;
+
+  esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+  IP_ADDR4(&config.target_addr, gateway[0], gateway[1], gateway[2], gateway[3]);
+  config.count = ESP_PING_COUNT_INFINITE;
+  config.interval_ms = WIFI_PROBE_INTERVAL_MS;
+  config.timeout_ms = WIFI_PROBE_TIMEOUT_MS;
+
+  esp_ping_callbacks_t callbacks = {};
+  callbacks.on_ping_success = onWifiProbeReply;
+  callbacks.on_ping_timeout = onWifiProbeTimeout;
+  if (esp_ping_new_session(&config, &callbacks, &wifiProbe) != ESP_OK) {
+    wifiProbe = nullptr;
+    return;
   }
+  esp_ping_start(wifiProbe);
 }
 
-String getLocalIP() {
-  return ETH.localIP().toString();
-}
+void serviceWifiPower() {
+  if (wifiPowerReassociate) {
+    // Leaving isn't treated as a drop; the new association carries the
+    // listen interval of the current profile
+    wifiPowerReassociate = false;
+    Serial.println("WiFi: Reassociating for the new listen interval");
+    esp_wifi_disconnect();
+    beginWiFiConnect(true);
+  }
 
-String getMacAddress() {
-  return ETH.macAddress();
+  if (wifiProbeRestart && wifiProbe != nullptr) {
+    esp_ping_stop(wifiProbe);
+    esp_ping_delete_session(wifiProbe);
+    wifiProbe = nullptr;
+  }
+  wifiProbeRestart = false;
+  if (wifiProbe == nullptr && networkConnected && !apMode) {
+    startWifiProbe();
+  }
 }
 
-#else  // USE_WIFI
-
-void initNetwork() {
-  WiFi.onEvent(onWiFiEvent);
+static void addLatencySummary(JsonObject obj, const LatencyHistogram& h) {
+  obj["count"] = h.count;
+  obj["errors"] = h.errors;
+  obj["mean_ms"] = h.count ? h.sumUs / 1000.0 / h.count : 0;
+  obj["p50_ms"] = latencyPercentileUs(h, 50) / 1000.0;
+  obj["p95_ms"] = latencyPercentileUs(h, 95) / 1000.0;
+}
 
-  if (wifiConfigured && wifiSSID.length() > 0) {
-    Serial.printf("Connecting to WiFi: %s\n", wifiSSID.c_str());
-    WiFi.mode(WIFI_STA);
-    WiFi.setAutoReconnect(true);  // Enable automatic reconnection
-    WiFi.setHostname(boardId.length() > 0 ? boardId.c_str() : "vda-ir-controller");
-    WiFi.begin(wifiSSID.c_str(), wifiPassword.c_str());
+static void addWifiPowerStats(JsonObject obj) {
+  const WifiPowerSettings& current = WIFI_POWER_SETTINGS[wifiPowerProfile];
+  obj["profile"] = current.name;
+  obj["listen_interval"] = current.listenInterval;
+  obj["tx_power_dbm"] = current.txPowerDbm;
+
+  JsonArray profiles = obj.createNestedArray("profiles");
+  for (int i = 0; i < WIFI_POWER_PROFILES; i++) {
+    uint64_t activeMs = wifiPowerStats[i].activeMs;
+    if (i == wifiPowerProfile) activeMs += millis() - wifiPowerSinceMs;
+    if (activeMs == 0) continue;
+
+    JsonObject profile = profiles.createNestedObject();
+    profile["profile"] = WIFI_POWER_SETTINGS[i].name;
+    profile["active_s"] = (uint32_t)(activeMs / 1000);
+    addLatencySummary(profile.createNestedObject("requests"), wifiPowerStats[i].requests);
+    addLatencySummary(profile.createNestedObject("probe"), wifiPowerStats[i].probe);
   }
 }
 
-void onWiFiEvent(WiFiEvent_t event) {
-  switch (event) {
-    case ARDUINO_EVENT_WIFI_STA_START:
-      Serial.println("WiFi: Started");
-      break;
-    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
-      Serial.println("WiFi: Connected");
-      break;
-    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
-      Serial.printf("WiFi: Got IP - %s\n", WiFi.localIP().toString().c_str());
-      Serial.printf("WiFi: MAC - %s\n", WiFi.macAddress().c_str());
-      networkConnected = true;
-      apMode = false;
-      wifiNeedsReconnect = false;
-      wifiReconnectAttempts = 0;
-      setLedState(LED_ON);
-      break;
-    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
-      Serial.println("WiFi: Disconnected");
-      networkConnected = false;
-      setLedState(LED_BLINK_SLOW);
-      // Schedule reconnect with backoff (handled in loop)
-      if (wifiConfigured && wifiSSID.length() > 0 && !apMode) {
-        wifiNeedsReconnect = true;
-        wifiReconnectTime = millis();  // Start timer for first attempt
-      }
-      break;
-    case ARDUINO_EVENT_WIFI_AP_START:
-      Serial.println("WiFi AP: Started");
-      networkConnected = true;
-      apMode = true;
-      break;
-    case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
-      Serial.println("WiFi AP: Client connected");
-      break;
-    default:
-      break;
+// Connect through the cached AP if allowed and known, else scan all channels.
+// The listen interval is set between configuring and connecting, as the AP
+// learns it from the association request.
+void beginWiFiConnect(bool useCache) {
+  wifiStats.attemptStartMs = millis();
+  wifiStats.attemptFast = useCache && wifiCacheValid();
+  if (wifiStats.attemptFast) {
+    WiFi.begin(wifiSSID.c_str(), wifiPassword.c_str(), wifiCache.channel, wifiCache.bssid, false);
+  } else {
+    wifiStats.fullScans++;
+    WiFi.begin(wifiSSID.c_str(), wifiPassword.c_str(), 0, NULL, false);
   }
+
+  wifi_config_t conf;
+  if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+    conf.sta.listen_interval = WIFI_POWER_SETTINGS[wifiPowerProfile].listenInterval;
+    esp_wifi_set_config(WIFI_IF_STA, &conf);
+  }
+  esp_wifi_connect();
 }
 
-void startAPMode() {
-  String apName = "VDA-IR-" + String((uint32_t)ESP.getEfuseMac(), HEX);
-  apName.toUpperCase();
+// Called from the WiFi event task on a drop or a failed attempt
+static void scheduleWiFiReconnect(uint8_t reason) {
+  WifiFailure failure = wifiReconnectFailed(wifiReconnect, reason, wifiLastRssi, wifiStats.attemptFast);
+  wifiStats.lastReason = reason;
+  wifiStats.disconnects[failure]++;
+}
 
-  Serial.printf("Starting AP: %s (password: vda-ir-setup)\n", apName.c_str());
+void serviceWiFiReconnect() {
+  if (networkConnected && !apMode && millis() - wifiRssiSampleMs >= WIFI_RSSI_SAMPLE_MS) {
+    wifiRssiSampleMs = millis();
+    wifiLastRssi = WiFi.RSSI();
+  }
 
-  WiFi.mode(WIFI_AP);
-  WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
-  WiFi.softAP(apName.c_str(), "vda-ir-setup");
+  if (wifiCacheDirty) {
+    wifiCacheDirty = false;
+    preferences.begin(CONFIG_NAMESPACE, false);
+    preferences.putBytes("wifiCache", &wifiCache, sizeof(wifiCache));
+    preferences.end();
+  }
 
-  // Start DNS server for captive portal
-  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
-  dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
-  captivePortalActive = true;
+  if (networkConnected || apMode) return;
+  WifiReconnectStep step = wifiReconnectDue(wifiReconnect);
+  if (step == WIFI_RECONNECT_WAIT) return;
+  if (step == WIFI_RECONNECT_REBOOT) {
+    Serial.println("WiFi: Max reconnect attempts reached, rebooting...");
+    saveConfig();
+    delay(100);
+    ESP.restart();
+  }
 
-  Serial.printf("AP IP: %s\n", WiFi.softAPIP().toString().c_str());
-  Serial.println("Captive portal DNS started - all domains redirect to setup page");
+  Serial.printf("WiFi: Reconnect attempt %d (%s)\n", wifiReconnect.total,
+                wifiReconnect.withCache && wifiCacheValid() ? "cached AP" : "scan");
+  beginWiFiConnect(wifiReconnect.withCache);
+}
 
-  networkConnected = true;
-  apMode = true;
-  setLedState(LED_BLINK_FAST);
+static void addWifiStats(JsonObject obj) {
+  obj["static_ip"] = wifiStaticIp;
+  obj["cached_ap"] = wifiCacheValid();
+  if (networkConnected && !apMode) {
+    obj["bssid"] = WiFi.BSSIDstr();
+    obj["channel"] = WiFi.channel();
+  }
+  obj["boot_connect_ms"] = wifiStats.bootConnectMs;
+  obj["last_connect_ms"] = wifiStats.lastConnectMs;
+  obj["connects"] = wifiStats.connects;
+  obj["fast_connects"] = wifiStats.fastConnects;
+  obj["full_scans"] = wifiStats.fullScans;
+  obj["reconnects"] = wifiStats.reconnects;
+  obj["reconnect_attempts"] = wifiReconnect.total;
+  if (wifiReconnect.pending && !networkConnected) {
+    obj["next_attempt_ms"] = max(0L, (long)(wifiReconnect.dueMs - millis()));
+  }
+  JsonObject disconnects = obj.createNestedObject("disconnects");
+  for (int i = 0; i < WIFI_FAIL_KINDS; i++) {
+    disconnects[WIFI_FAILURE_NAMES[i]] = wifiStats.disconnects[i];
+  }
+  obj["last_disconnect_reason"] = wifiStats.lastReason;
 }
+#endif
 
-String getLocalIP() {
-  if (WiFi.getMode() == WIFI_AP || apMode) {
-    return WiFi.softAPIP().toString();
+// Arduino's WebServer and DNSServer don't expose their sockets, so find them
+// by local port: a bound socket without a peer is the listener.
+static int findListeningSocket(uint16_t port) {
+  for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0 || ntohs(addr.sin_port) != port) continue;
+    len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr*)&addr, &len) != 0) return fd;
   }
-  return WiFi.localIP().toString();
+  return -1;
 }
 
-String getMacAddress() {
-  return WiFi.macAddress();
+// Revalidate a cached listener, which changes if the server is restarted
+static int listeningSocket(int& cached, uint16_t port) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (cached < 0 || getsockname(cached, (struct sockaddr*)&addr, &len) != 0 || ntohs(addr.sin_port) != port) {
+    cached = findListeningSocket(port);
+  }
+  return cached;
 }
 
-// ============ Captive Portal Page ============
-String generateSetupPage() {
-  String apName = "VDA-IR-" + String((uint32_t)ESP.getEfuseMac(), HEX);
-  apName.toUpperCase();
+static void watchSocket(int fd, fd_set& set, int& maxFd) {
+  if (fd < 0) return;
+  FD_SET(fd, &set);
+  if (fd > maxFd) maxFd = fd;
+}
 
-  String html = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-  <meta charset="UTF-8">
-  <meta name="viewport" content="width=device-width, initial-scale=1.0">
-  <title>VDA IR Control Setup</title>
-  <style>
-    * { box-sizing: border-box; margin: 0; padding: 0; }
-    body {
-      font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif;
-      background: linear-gradient(135deg, #1a1a2e 0%, #16213e 100%);
-      min-height: 100vh;
-      display: flex;
-      align-items: center;
-      justify-content: center;
-      padding: 20px;
-    }
-    .container {
-      background: white;
-      border-radius: 16px;
-      padding: 32px;
-      width: 100%;
-      max-width: 400px;
-      box-shadow: 0 20px 60px rgba(0,0,0,0.3);
-    }
-    .logo {
-      text-align: center;
-      margin-bottom: 24px;
-    }
-    .logo h1 {
-      color: #1a1a2e;
-      font-size: 24px;
-      margin-bottom: 8px;
-    }
-    .logo p {
-      color: #666;
-      font-size: 14px;
+// Sleep until a new connection, data on the current client, a DNS query or a
+// beacon packet arrives, or until timeoutMs passes
+static void waitForNetworkEvent(uint32_t timeoutMs) {
+  fd_set readable;
+  FD_ZERO(&readable);
+  int maxFd = -1;
+
+  watchSocket(listeningSocket(httpListenFd, 80), readable, maxFd);
+  watchSocket(server.client().fd(), readable, maxFd);
+#ifdef USE_WIFI
+  if (captivePortalActive) {
+    watchSocket(listeningSocket(dnsListenFd, DNS_PORT), readable, maxFd);
+  }
+#endif
+  watchSocket(beacon.fd, readable, maxFd);
+
+  if (maxFd < 0) {
+    // Server not listening yet (no network); network events notify
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    return;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  select(maxFd + 1, &readable, nullptr, nullptr, &tv);
+}
+
+static void startNetworkServices() {
+  startMdns();
+  startBeacon();
+  startMqtt();
+
+  // Setup web server
+  setupWebServer();
+  networkServicesStarted = true;
+  markBootPhase(BOOT_SERVICES);
+
+  // Set LED state based on mode
+  if (apMode) {
+    setLedState(LED_BLINK_FAST);  // AP mode ready
+    Serial.println("\n=== AP Mode Ready! ===");
+    Serial.println("Connect to WiFi network shown above");
+    Serial.println("Then open http://192.168.4.1 in your browser");
+  } else {
+    setLedState(LED_ON);  // Connected and ready
+    Serial.println("\n=== Ready! ===");
+  }
+
+  Serial.printf("IP Address: %s\n", getLocalIP().c_str());
+  Serial.printf("Board ID: %s\n", boardId.c_str());
+  Serial.printf("HTTP Server: http://%s/\n", getLocalIP().c_str());
+  Serial.printf("Boot: IR ready at %ums, IP at %ums, services at %ums\n",
+                bootPhaseMs[BOOT_PORTS], bootPhaseMs[BOOT_IP], bootPhaseMs[BOOT_SERVICES]);
+}
+
+// Start services once the network has an address. Without one after
+// NETWORK_WAIT_MS, WiFi boards fall back to AP mode for configuration;
+// Ethernet boards keep waiting for a link.
+void serviceNetworkStartup() {
+  if (networkServicesStarted) {
+    return;
+  }
+
+  if (!networkConnected && !bootNetworkTimedOut && millis() - bootPhaseMs[BOOT_NETWORK] >= NETWORK_WAIT_MS) {
+    bootNetworkTimedOut = true;
+    Serial.println("ERROR: Network connection failed!");
+    setLedState(LED_BLINK_PATTERN);  // Error state
+#ifdef USE_WIFI
+    Serial.println("Starting AP mode for configuration...");
+    startAPMode();
+#endif
+  }
+
+  if (networkConnected) {
+    startNetworkServices();
+  }
+}
+
+// ============ Fleet Beacon ============
+static void scheduleBeacon(uint32_t baseMs) {
+  uint32_t jitterMs = baseMs * BEACON_JITTER_PERCENT / 100;
+  beacon.nextAnnounceMs = millis() + baseMs - jitterMs + (jitterMs > 0 ? esp_random() % (2 * jitterMs + 1) : 0);
+}
+
+static uint8_t beaconFlags() {
+  uint8_t flags = 0;
+  if (adopted) flags |= BEACON_FLAG_ADOPTED;
+#ifdef USE_ETHERNET
+  flags |= BEACON_FLAG_ETHERNET;
+#endif
+  if (apMode) flags |= BEACON_FLAG_AP_MODE;
+  if (ota.active) flags |= BEACON_FLAG_OTA_ACTIVE;
+  if (configDirty) flags |= BEACON_FLAG_CONFIG_PENDING;
+  if (strcmp(otaPull.firmwareState, "pending") == 0) flags |= BEACON_FLAG_FIRMWARE_PENDING;
+  return flags;
+}
+
+// Fills in the header of a packet of `size` bytes and appends its CRC
+void sealBeacon(BeaconHeader& header, BeaconType type, uint32_t nonce, size_t size) {
+  header.magic = BEACON_MAGIC;
+  header.version = BEACON_VERSION;
+  header.type = type;
+  header.size = size;
+  header.nonce = nonce;
+  uint32_t crc = crc32((const uint8_t*)&header, size - sizeof(uint32_t));
+  memcpy((uint8_t*)&header + size - sizeof(uint32_t), &crc, sizeof(crc));
+}
+
+// Copies a received packet into out if it is a valid packet of the given type
+bool decodeBeacon(const uint8_t* data, size_t len, BeaconType type, void* out, size_t size) {
+  if (len != size) return false;
+  BeaconHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != BEACON_MAGIC || header.version != BEACON_VERSION || header.type != type || header.size != size) {
+    return false;
+  }
+  uint32_t crc;
+  memcpy(&crc, data + size - sizeof(uint32_t), sizeof(crc));
+  if (crc != crc32(data, size - sizeof(uint32_t))) return false;
+  memcpy(out, data, size);
+  return true;
+}
+
+void buildBeaconStatus(BeaconStatus& status, BeaconType type, uint32_t nonce) {
+  memset(&status, 0, sizeof(status));
+  uint64_t mac = ESP.getEfuseMac();
+  memcpy(status.mac, &mac, sizeof(status.mac));
+  status.flags = beaconFlags();
+  status.resetReason = esp_reset_reason();
+  strlcpy(status.boardId, boardId.c_str(), sizeof(status.boardId));
+  strlcpy(status.firmware, FIRMWARE_VERSION, sizeof(status.firmware));
+  status.configGeneration = configGeneration;
+  status.uptimeS = millis() / 1000;
+  status.portCount = portCount;
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].mode == PORT_IR_OUTPUT) {
+      status.outputMask |= 1ULL << ports[i].gpio;
+      status.outputCount++;
+    } else if (ports[i].mode == PORT_IR_INPUT) {
+      status.inputMask |= 1ULL << ports[i].gpio;
+      status.inputCount++;
     }
-    .device-id {
-      background: #f0f4f8;
-      border-radius: 8px;
-      padding: 12px;
-      text-align: center;
-      margin-bottom: 24px;
-      font-family: monospace;
-      font-size: 14px;
-      color: #1a1a2e;
+  }
+#ifdef USE_WIFI
+  status.rssi = apMode ? 0 : WiFi.RSSI();
+#endif
+  status.idlePercent[0] = loadStats.idlePercent[0];
+  status.idlePercent[1] = loadStats.idlePercent[1];
+  status.seq = ++beacon.seq;
+  status.freeHeap = ESP.getFreeHeap();
+  status.minFreeHeap = ESP.getMinFreeHeap();
+  status.largestBlock = ESP.getMaxAllocHeap();
+  sealBeacon(status.header, type, nonce, sizeof(status));
+}
+
+static bool sendBeacon(BeaconType type, uint32_t nonce, uint32_t addr, uint16_t port) {
+  static BeaconStatus status;
+  buildBeaconStatus(status, type, nonce);
+
+  struct sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = addr;
+  to.sin_port = htons(port);
+  if (sendto(beacon.fd, &status, sizeof(status), 0, (struct sockaddr*)&to, sizeof(to)) != sizeof(status)) {
+    beacon.sendErrors++;
+    return false;
+  }
+  return true;
+}
+
+// Joins the beacon group. The first announcement goes out within a few
+// seconds, spread so a fleet powering up together doesn't burst.
+void startBeacon() {
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    Serial.println("Beacon: socket failed");
+    return;
+  }
+
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(BEACON_PORT);
+
+  struct ip_mreq group = {};
+  group.imr_multiaddr.s_addr = inet_addr(BEACON_GROUP);
+  group.imr_interface.s_addr = htonl(INADDR_ANY);
+
+  if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0) {
+    Serial.println("Beacon: bind or group join failed");
+    close(fd);
+    return;
+  }
+  uint8_t ttl = BEACON_TTL;
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+  beacon.fd = fd;
+  beacon.announcedFlags = beaconFlags();
+  beacon.announcedGeneration = configGeneration;
+  scheduleBeacon(2000);
+  Serial.printf("Beacon: %s:%d\n", BEACON_GROUP, BEACON_PORT);
+}
+
+static void receiveBeaconQueries() {
+  uint8_t packet[sizeof(BeaconStatus)];  // Larger than any valid query
+  BeaconQuery query;
+  struct sockaddr_in from;
+  socklen_t fromLen = sizeof(from);
+  int len;
+
+  while ((len = recvfrom(beacon.fd, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLen)) >= 0) {
+    fromLen = sizeof(from);
+    if (len == sizeof(BeaconStatus)) {
+      continue;  // Another board's status, also delivered to the group
     }
-    .form-group {
-      margin-bottom: 20px;
+    if (!decodeBeacon(packet, len, BEACON_QUERY, &query, sizeof(query))) {
+      beacon.invalid++;
+      continue;
     }
-    label {
-      display: block;
-      margin-bottom: 8px;
-      color: #333;
-      font-weight: 500;
+    beacon.queries++;
+    query.boardId[BOARD_ID_MAX_LEN] = '\0';
+    if (query.boardId[0] != '\0' && strcmp(query.boardId, boardId.c_str()) != 0) {
+      beacon.ignored++;
+      continue;
     }
-    select, input[type="password"], input[type="text"] {
-      width: 100%;
-      padding: 12px 16px;
-      border: 2px solid #e0e0e0;
-      border-radius: 8px;
-      font-size: 16px;
-      transition: border-color 0.2s;
+    if (beacon.pendingCount >= BEACON_PENDING_MAX) {
+      beacon.dropped++;
+      continue;
     }
-    select:focus, input:focus {
-      outline: none;
-      border-color: #4a90d9;
+    uint32_t window = query.replyWindowMs;
+    window = min(window, (uint32_t)BEACON_REPLY_WINDOW_MAX_MS);
+    BeaconReply& reply = beacon.pending[beacon.pendingCount++];
+    reply.addr = from.sin_addr.s_addr;
+    reply.port = ntohs(from.sin_port);
+    reply.nonce = query.header.nonce;
+    reply.dueMs = millis() + (window > 0 ? esp_random() % window : 0);
+  }
+}
+
+// Called from the net task: answers queries whose delay has passed, and
+// announces when the interval is up or the board's state has changed
+void serviceBeacon() {
+  if (beacon.fd < 0 || apMode || !networkConnected) {
+    return;
+  }
+
+  receiveBeaconQueries();
+
+  unsigned long now = millis();
+  for (int i = 0; i < beacon.pendingCount;) {
+    if ((long)(now - beacon.pending[i].dueMs) < 0) {
+      i++;
+      continue;
     }
-    .password-container {
-      position: relative;
+    if (sendBeacon(BEACON_RESPONSE, beacon.pending[i].nonce, beacon.pending[i].addr, beacon.pending[i].port)) {
+      beacon.responses++;
     }
-    .toggle-password {
-      position: absolute;
-      right: 12px;
-      top: 50%;
-      transform: translateY(-50%);
-      background: none;
-      border: none;
-      cursor: pointer;
-      color: #666;
-      font-size: 14px;
+    beacon.pending[i] = beacon.pending[--beacon.pendingCount];
+  }
+
+  uint8_t flags = beaconFlags();
+  bool changed = flags != beacon.announcedFlags || configGeneration != beacon.announcedGeneration;
+  bool due = (long)(now - beacon.nextAnnounceMs) >= 0;
+  if (!due && !(changed && now - beacon.lastAnnounceMs >= BEACON_MIN_GAP_MS)) {
+    return;
+  }
+
+  if (sendBeacon(BEACON_ANNOUNCE, 0, inet_addr(BEACON_GROUP), BEACON_PORT)) {
+    beacon.announcements++;
+  }
+  beacon.announcedFlags = flags;
+  beacon.announcedGeneration = configGeneration;
+  beacon.lastAnnounceMs = now;
+  scheduleBeacon(BEACON_INTERVAL_MS);
+}
+
+static void addBeaconStats(JsonObject obj) {
+  obj["group"] = BEACON_GROUP;
+  obj["port"] = BEACON_PORT;
+  obj["active"] = beacon.fd >= 0;
+  obj["packet_bytes"] = sizeof(BeaconStatus);
+  obj["announcements"] = beacon.announcements;
+  obj["queries"] = beacon.queries;
+  obj["responses"] = beacon.responses;
+  obj["ignored"] = beacon.ignored;
+  obj["invalid"] = beacon.invalid;
+  obj["dropped"] = beacon.dropped;
+  obj["send_errors"] = beacon.sendErrors;
+}
+
+// ============ mDNS ============
+static String mdnsHostname() {
+  return boardId.length() > 0 ? boardId : "vda-ir-" + String((uint32_t)ESP.getEfuseMac(), HEX);
+}
+
+void startMdns() {
+  String hostname = mdnsHostname();
+  if (!MDNS.begin(hostname.c_str())) {
+    Serial.println("mDNS: start failed");
+    return;
+  }
+  if (adopted) {
+    MDNS.setInstanceName(boardName);  // Otherwise the hostname, which is unique
+  }
+  MDNS.addService("http", "tcp", 80);
+  MDNS.addService("vda-ir", "tcp", 80);
+  mdnsStats.started = true;
+  updateMdnsTxt();
+  Serial.printf("mDNS: %s.local\n", hostname.c_str());
+}
+
+// Replaces the TXT records of both services in one update each, so
+// listeners see a single consistent set
+void updateMdnsTxt() {
+  if (!mdnsStats.started) {
+    return;
+  }
+
+  unsigned long start = micros();
+  int outputCount = 0, inputCount = 0;
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].mode == PORT_IR_OUTPUT) outputCount++;
+    if (ports[i].mode == PORT_IR_INPUT) inputCount++;
+  }
+
+  char total[4], outputs[4], inputs[4], generation[11];
+  snprintf(total, sizeof(total), "%d", portCount);
+  snprintf(outputs, sizeof(outputs), "%d", outputCount);
+  snprintf(inputs, sizeof(inputs), "%d", inputCount);
+  snprintf(generation, sizeof(generation), "%u", configGeneration);
+  String mac = getMacAddress();
+
+  mdns_txt_item_t items[MDNS_TXT_ITEMS] = {
+    {"txtvers", MDNS_TXT_VERSION},
+    {"id", boardId.c_str()},
+    {"fw", FIRMWARE_VERSION},
+    {"board", BOARD_TYPE},
+#ifdef USE_ETHERNET
+    {"conn", "ethernet"},
+#else
+    {"conn", "wifi"},
+#endif
+    {"mac", mac.c_str()},
+    {"adopted", adopted ? "1" : "0"},
+    {"ports", total},
+    {"out", outputs},
+    {"in", inputs},
+    {"gen", generation},
+  };
+  mdns_service_txt_set("_http", "_tcp", items, MDNS_TXT_ITEMS);
+  mdns_service_txt_set("_vda-ir", "_tcp", items, MDNS_TXT_ITEMS);
+
+  mdnsStats.txtUpdates++;
+  mdnsStats.lastTxtUpdateUs = micros() - start;
+}
+
+// After adoption: announce the new hostname and instance name, keeping
+// both services and their TXT records registered
+void renameMdnsHost() {
+  if (!mdnsStats.started) {
+    return;
+  }
+  String hostname = mdnsHostname();
+  mdns_hostname_set(hostname.c_str());
+  mdns_instance_name_set(boardName.c_str());
+  mdnsStats.renames++;
+  Serial.printf("mDNS: renamed to %s.local\n", hostname.c_str());
+}
+
+static void addMdnsStats(JsonObject obj) {
+  obj["hostname"] = mdnsHostname() + ".local";
+  obj["started"] = mdnsStats.started;
+  obj["txt_updates"] = mdnsStats.txtUpdates;
+  obj["last_txt_update_us"] = mdnsStats.lastTxtUpdateUs;
+  obj["renames"] = mdnsStats.renames;
+}
+
+// HTTP, captive portal DNS, WiFi reconnect, the fleet beacon and config
+// commits. Configuration is only mutated and persisted from this task.
+void networkTask(void* param) {
+  esp_task_wdt_add(NULL);
+
+  for (;;) {
+    esp_task_wdt_reset();
+    unsigned long start = micros();
+
+    serviceNetworkStartup();
+
+#ifdef USE_WIFI
+    if (captivePortalActive) {
+      dnsServer.processNextRequest();
     }
-    button[type="submit"] {
-      width: 100%;
-      padding: 14px;
-      background: linear-gradient(135deg, #4a90d9 0%, #357abd 100%);
-      color: white;
-      border: none;
-      border-radius: 8px;
-      font-size: 16px;
-      font-weight: 600;
-      cursor: pointer;
-      transition: transform 0.2s, box-shadow 0.2s;
+    serviceWiFiReconnect();
+    serviceWifiPower();
+#endif
+
+    server.handleClient();
+    serviceBeacon();
+
+    // Commit pending configuration changes once they settle
+    serviceConfigSave();
+    serviceRestart();
+
+    accountTask(TASK_NET, start);
+
+    // Wake up periodically only while something time-based is pending:
+    // an open client (server-side timeouts), a reconnect, a config commit
+    // or a restart
+    bool pending = configDirty || restartPending || server.client().connected() || beacon.pendingCount > 0;
+#ifdef USE_WIFI
+    pending = pending || (wifiReconnect.pending && !networkConnected) || wifiPowerReassociate;
+#endif
+    waitForNetworkEvent(pending ? NET_SERVICE_WAIT_MS : TASK_IDLE_WAIT_MS);
+  }
+}
+
+// Transmits a job, capturing the frame for /tx_check if it is enabled
+static bool transmitCheckedJob(IrTxJob& job) {
+  bool capture = txCheck.enabled && job.kind != IR_TX_TEST && irSenders[job.portIndex] != nullptr;
+  if (capture) startTxCapture(job.gpio);
+  bool sent = transmitIrJob(job);
+  if (capture) finishTxCapture(job);
+  return sent;
+}
+
+void irTransmitTask(void* param) {
+  esp_task_wdt_add(NULL);
+
+  for (;;) {
+    esp_task_wdt_reset();
+
+    IrTxJob* job;
+    if (!irTxNextJob(job, TASK_IDLE_WAIT_MS)) continue;
+
+    unsigned long start = micros();
+    bool sent = irTxRunJob(*job, irMutex, transmitCheckedJob);
+    accountTask(TASK_IR_TX, start);
+    recordLatency(opMetrics[METRIC_IR_SEND], micros() - start, !sent);
+  }
+}
+
+void irReceiveTask(void* param) {
+  esp_task_wdt_add(NULL);
+
+  for (;;) {
+    esp_task_wdt_reset();
+
+    // Sleep until initIRReceiver() starts a receiver
+    if (activeReceiverPort < 0) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TASK_IDLE_WAIT_MS));
+      continue;
     }
-    button[type="submit"]:hover {
-      transform: translateY(-2px);
-      box-shadow: 0 4px 12px rgba(74, 144, 217, 0.4);
+    vTaskDelay(pdMS_TO_TICKS(IR_RX_POLL_MS));
+
+    unsigned long start = micros();
+    int receivedGpio = -1;
+    LearnedCode received = {};
+    xSemaphoreTake(irMutex, portMAX_DELAY);
+    if (irReceiver != nullptr && activeReceiverPort >= 0 && irReceiver->decode(&irResults)) {
+      recordLatency(opMetrics[METRIC_IR_RECEIVE], micros() - start, irResults.overflow);
+      learnedCode.protocol = irResults.decode_type;
+      learnedCode.value = irResults.value;
+      learnedCode.bits = irResults.bits;
+      learnedCode.available = true;
+      received = learnedCode;
+      receivedGpio = activeReceiverPort;
+      irReceiver->resume();
+
+      Serial.printf("IR Signal Received: %s 0x%s\n", typeToString(irResults.decode_type).c_str(),
+                    uint64ToString(irResults.value, HEX).c_str());
     }
-    button[type="submit"]:disabled {
-      background: #ccc;
-      cursor: not-allowed;
-      transform: none;
-      box-shadow: none;
+    xSemaphoreGive(irMutex);
+    if (receivedGpio >= 0) {
+      mqttPublishIrCode(receivedGpio, received.protocol, received.value, received.bits);
     }
-    .scanning {
-      text-align: center;
-      padding: 20px;
-      color: #666;
-    }
-    .spinner {
-      border: 3px solid #f3f3f3;
-      border-top: 3px solid #4a90d9;
-      border-radius: 50%;
-      width: 24px;
-      height: 24px;
-      animation: spin 1s linear infinite;
-      margin: 0 auto 12px;
-    }
-    @keyframes spin {
-      0% { transform: rotate(0deg); }
-      100% { transform: rotate(360deg); }
+    accountTask(TASK_IR_RX, start);
+  }
+}
+
+// ============ LED Functions ============
+void initLED() {
+#if STATUS_LED_PIN >= 0
+  pinMode(STATUS_LED_PIN, OUTPUT);
+  digitalWrite(STATUS_LED_PIN, LOW);
+
+  esp_timer_create_args_t args = {};
+  args.callback = ledTimerCallback;
+  args.name = "led";
+  esp_timer_create(&args, &ledTimer);
+  Serial.printf("Status LED initialized on GPIO%d\n", STATUS_LED_PIN);
+#endif
+}
+
+void setLedState(LedState state) {
+  currentLedState = state;
+
+#if STATUS_LED_PIN >= 0
+  esp_timer_stop(ledTimer);
+  ledPatternStep = 0;
+
+  switch (state) {
+    case LED_OFF:
+      digitalWrite(STATUS_LED_PIN, LOW);
+      ledOn = false;
+      break;
+
+    case LED_ON:
+      digitalWrite(STATUS_LED_PIN, HIGH);
+      ledOn = true;
+      break;
+
+    case LED_BLINK_SLOW:
+      esp_timer_start_periodic(ledTimer, 500 * 1000);
+      break;
+
+    case LED_BLINK_FAST:
+      esp_timer_start_periodic(ledTimer, 150 * 1000);
+      break;
+
+    case LED_BLINK_PATTERN:
+      esp_timer_start_periodic(ledTimer, 100 * 1000);
+      break;
+  }
+#endif
+}
+
+// Runs from the esp_timer task at the blink period of the current state
+void ledTimerCallback(void* arg) {
+#if STATUS_LED_PIN >= 0
+  loadStats.timerWakeups++;
+
+  if (currentLedState == LED_BLINK_PATTERN) {
+    // Double blink pattern for error: on at steps 0 and 2 of every 10
+    ledOn = (ledPatternStep == 0 || ledPatternStep == 2);
+    ledPatternStep = (ledPatternStep + 1) % 10;
+  } else {
+    ledOn = !ledOn;
+  }
+  digitalWrite(STATUS_LED_PIN, ledOn ? HIGH : LOW);
+#endif
+}
+
+// ============ Network Initialization ============
+// Called from network events, so the net task starts services without
+// waiting out its idle sleep
+static void wakeNetworkTask() {
+  if (tasks[TASK_NET].handle != nullptr) {
+    xTaskNotifyGive(tasks[TASK_NET].handle);
+  }
+}
+
+#ifdef USE_ETHERNET
+
+void initNetwork() {
+  WiFi.onEvent(onEthEvent);
+  ETH.begin(ETH_PHY_ADDR, ETH_PHY_POWER, ETH_PHY_MDC, ETH_PHY_MDIO, ETH_PHY_TYPE, ETH_CLK_MODE);
+}
+
+void onEthEvent(WiFiEvent_t event) {
+  switch (event) {
+    case ARDUINO_EVENT_ETH_START:
+      Serial.println("ETH: Started");
+      ETH.setHostname(boardId.length() > 0 ? boardId.c_str() : "vda-ir-controller");
+      break;
+    case ARDUINO_EVENT_ETH_CONNECTED:
+      Serial.println("ETH: Connected");
+      break;
+    case ARDUINO_EVENT_ETH_GOT_IP:
+      Serial.printf("ETH: Got IP - %s\n", ETH.localIP().toString().c_str());
+      Serial.printf("ETH: MAC - %s\n", ETH.macAddress().c_str());
+      networkConnected = true;
+      markBootPhase(BOOT_IP);
+      setLedState(LED_ON);
+      wakeNetworkTask();
+      break;
+    case ARDUINO_EVENT_ETH_DISCONNECTED:
+      Serial.println("ETH: Disconnected");
+      networkConnected = false;
+      setLedState(LED_BLINK_SLOW);
+      break;
+    case ARDUINO_EVENT_ETH_STOP:
+      Serial.println("ETH: Stopped");
+      networkConnected = false;
+      setLedState(LED_OFF);
+      break;
+    default:
+      break;
+  }
+}
+
+String getLocalIP() {
+  return ETH.localIP().toString();
+}
+
+String getMacAddress() {
+  return ETH.macAddress();
+}
+
+#else  // USE_WIFI
+
+void initNetwork() {
+  WiFi.onEvent(onWiFiEvent);
+
+  if (wifiConfigured && wifiSSID.length() > 0) {
+    // RTC memory survives a restart and is newer than NVS if it is valid
+    if (wifiRtcCache.magic == WIFI_CACHE_MAGIC) wifiCache = wifiRtcCache;
+
+    Serial.printf("Connecting to WiFi: %s%s\n", wifiSSID.c_str(), wifiCacheValid() ? " (cached AP)" : "");
+    WiFi.persistent(false);        // Credentials live in our own NVS keys
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);  // Reconnects are scheduled by serviceWiFiReconnect()
+    WiFi.setHostname(boardId.length() > 0 ? boardId.c_str() : "vda-ir-controller");
+    applyWifiPowerProfile();
+    if (wifiStaticIp) {
+      WiFi.config(wifiIp, wifiGateway, wifiSubnet, wifiDns);
     }
-    .network-item {
+    beginWiFiConnect(true);
+  }
+}
+
+// Remember the AP for the next connect; called on every connection
+static void updateWifiCache() {
+  WifiCache cache = {};
+  cache.magic = WIFI_CACHE_MAGIC;
+  cache.ssidCrc = crc32((const uint8_t*)wifiSSID.c_str(), wifiSSID.length());
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid == nullptr) return;
+  memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+
+  wifiRtcCache = cache;
+  if (memcmp(&cache, &wifiCache, sizeof(cache)) != 0) {
+    wifiCache = cache;
+    wifiCacheDirty = true;
+  }
+}
+
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_START:
+      Serial.println("WiFi: Started");
+      break;
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+      Serial.println("WiFi: Connected");
+      break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      Serial.printf("WiFi: Got IP - %s\n", WiFi.localIP().toString().c_str());
+      Serial.printf("WiFi: MAC - %s\n", WiFi.macAddress().c_str());
+      networkConnected = true;
+      apMode = false;
+      wifiStats.lastConnectMs = millis() - wifiStats.attemptStartMs;
+      if (wifiStats.connects++ == 0) {
+        wifiStats.bootConnectMs = wifiStats.lastConnectMs;
+      } else {
+        wifiStats.reconnects++;
+      }
+      if (wifiStats.attemptFast) wifiStats.fastConnects++;
+      Serial.printf("WiFi: Connected in %ums (%s)\n", wifiStats.lastConnectMs,
+                    wifiStats.attemptFast ? "cached AP" : "scan");
+      wifiStats.attemptFast = false;  // A later drop isn't a failed cached attempt
+      updateWifiCache();
+      wifiReconnectReset(wifiReconnect);
+      wifiProbeRestart = true;
+      markBootPhase(BOOT_IP);
+      setLedState(LED_ON);
+      wakeNetworkTask();
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      // Also reported for every failed connection attempt
+      Serial.printf("WiFi: Disconnected (reason %u)\n", info.wifi_sta_disconnected.reason);
+      networkConnected = false;
+      setLedState(LED_BLINK_SLOW);
+      // Schedule reconnect with backoff (handled by the net task). Leaving
+      // is our own doing, e.g. WiFi.begin() switching to another AP.
+      if (wifiConfigured && wifiSSID.length() > 0 && !apMode &&
+          info.wifi_sta_disconnected.reason != WIFI_REASON_ASSOC_LEAVE) {
+        scheduleWiFiReconnect(info.wifi_sta_disconnected.reason);
+      }
+      break;
+    case ARDUINO_EVENT_WIFI_AP_START:
+      Serial.println("WiFi AP: Started");
+      networkConnected = true;
+      apMode = true;
+      break;
+    case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
+      Serial.println("WiFi AP: Client connected");
+      break;
+    default:
+      break;
+  }
+}
+
+void startAPMode() {
+  String apName = "VDA-IR-" + String((uint32_t)ESP.getEfuseMac(), HEX);
+  apName.toUpperCase();
+
+  Serial.printf("Starting AP: %s (password: vda-ir-setup)\n", apName.c_str());
+
+  WiFi.mode(WIFI_AP);
+  WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+  WiFi.softAP(apName.c_str(), "vda-ir-setup");
+
+  // Start DNS server for captive portal
+  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+  dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
+  captivePortalActive = true;
+
+  Serial.printf("AP IP: %s\n", WiFi.softAPIP().toString().c_str());
+  Serial.println("Captive portal DNS started - all domains redirect to setup page");
+
+  networkConnected = true;
+  apMode = true;
+  markBootPhase(BOOT_IP);
+  setLedState(LED_BLINK_FAST);
+  wakeNetworkTask();
+}
+
+String getLocalIP() {
+  if (WiFi.getMode() == WIFI_AP || apMode) {
+    return WiFi.softAPIP().toString();
+  }
+  return WiFi.localIP().toString();
+}
+
+String getMacAddress() {
+  return WiFi.macAddress();
+}
+
+// ============ Captive Portal Page ============
+String generateSetupPage() {
+  String apName = "VDA-IR-" + String((uint32_t)ESP.getEfuseMac(), HEX);
+  apName.toUpperCase();
+
+  String html = R"rawliteral(
+<!DOCTYPE html>
+<html>
+<head>
+  <meta charset="UTF-8">
+  <meta name="viewport" content="width=device-width, initial-scale=1.0">
+  <title>VDA IR Control Setup</title>
+  <style>
+    * { box-sizing: border-box; margin: 0; padding: 0; }
+    body {
+      font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif;
+      background: linear-gradient(135deg, #1a1a2e 0%, #16213e 100%);
+      min-height: 100vh;
       display: flex;
       align-items: center;
-      padding: 12px;
-      border: 2px solid #e0e0e0;
-      border-radius: 8px;
-      margin-bottom: 8px;
-      cursor: pointer;
-      transition: border-color 0.2s, background 0.2s;
+      justify-content: center;
+      padding: 20px;
     }
-    .network-item:hover {
-      border-color: #4a90d9;
-      background: #f8fafc;
+    .container {
+      background: white;
+      border-radius: 16px;
+      padding: 32px;
+      width: 100%;
+      max-width: 400px;
+      box-shadow: 0 20px 60px rgba(0,0,0,0.3);
     }
-    .network-item.selected {
-      border-color: #4a90d9;
-      background: #e8f4fd;
+    .logo {
+      text-align: center;
+      margin-bottom: 24px;
     }
-    .network-name {
-      flex: 1;
-      font-weight: 500;
+    .logo h1 {
+      color: #1a1a2e;
+      font-size: 24px;
+      margin-bottom: 8px;
     }
-    .network-signal {
+    .logo p {
       color: #666;
-      font-size: 12px;
-    }
-    .signal-icon {
-      margin-left: 8px;
-    }
-    .refresh-btn {
-      background: none;
-      border: none;
-      color: #4a90d9;
-      cursor: pointer;
       font-size: 14px;
-      margin-bottom: 12px;
     }
-    .error {
-      background: #fee;
-      color: #c00;
+    .device-id {
+      background: #f0f4f8;
+      border-radius: 8px;
+      padding: 12px;
+      text-align: center;
+      margin-bottom: 24px;
+      font-family: monospace;
+      font-size: 14px;
+      color: #1a1a2e;
+    }
+    .form-group {
+      margin-bottom: 20px;
+    }
+    label {
+      display: block;
+      margin-bottom: 8px;
+      color: #333;
+      font-weight: 500;
+    }
+    select, input[type="password"], input[type="text"] {
+      width: 100%;
+      padding: 12px 16px;
+      border: 2px solid #e0e0e0;
+      border-radius: 8px;
+      font-size: 16px;
+      transition: border-color 0.2s;
+    }
+    select:focus, input:focus {
+      outline: none;
+      border-color: #4a90d9;
+    }
+    .password-container {
+      position: relative;
+    }
+    .toggle-password {
+      position: absolute;
+      right: 12px;
+      top: 50%;
+      transform: translateY(-50%);
+      background: none;
+      border: none;
+      cursor: pointer;
+      color: #666;
+      font-size: 14px;
+    }
+    button[type="submit"] {
+      width: 100%;
+      padding: 14px;
+      background: linear-gradient(135deg, #4a90d9 0%, #357abd 100%);
+      color: white;
+      border: none;
+      border-radius: 8px;
+      font-size: 16px;
+      font-weight: 600;
+      cursor: pointer;
+      transition: transform 0.2s, box-shadow 0.2s;
+    }
+    button[type="submit"]:hover {
+      transform: translateY(-2px);
+      box-shadow: 0 4px 12px rgba(74, 144, 217, 0.4);
+    }
+    button[type="submit"]:disabled {
+      background: #ccc;
+      cursor: not-allowed;
+      transform: none;
+      box-shadow: none;
+    }
+    .scanning {
+      text-align: center;
+      padding: 20px;
+      color: #666;
+    }
+    .spinner {
+      border: 3px solid #f3f3f3;
+      border-top: 3px solid #4a90d9;
+      border-radius: 50%;
+      width: 24px;
+      height: 24px;
+      animation: spin 1s linear infinite;
+      margin: 0 auto 12px;
+    }
+    @keyframes spin {
+      0% { transform: rotate(0deg); }
+      100% { transform: rotate(360deg); }
+    }
+    .network-item {
+      display: flex;
+      align-items: center;
+      padding: 12px;
+      border: 2px solid #e0e0e0;
+      border-radius: 8px;
+      margin-bottom: 8px;
+      cursor: pointer;
+      transition: border-color 0.2s, background 0.2s;
+    }
+    .network-item:hover {
+      border-color: #4a90d9;
+      background: #f8fafc;
+    }
+    .network-item.selected {
+      border-color: #4a90d9;
+      background: #e8f4fd;
+    }
+    .network-name {
+      flex: 1;
+      font-weight: 500;
+    }
+    .network-signal {
+      color: #666;
+      font-size: 12px;
+    }
+    .signal-icon {
+      margin-left: 8px;
+    }
+    .refresh-btn {
+      background: none;
+      border: none;
+      color: #4a90d9;
+      cursor: pointer;
+      font-size: 14px;
+      margin-bottom: 12px;
+    }
+    .error {
+      background: #fee;
+      color: #c00;
       padding: 12px;
       border-radius: 8px;
       margin-bottom: 16px;
@@ -725,1153 +2160,3556 @@ String generateSetupPage() {
       <p>WiFi Setup</p>
     </div>
 
-    <div class="device-id">
-      <span class="led-indicator"></span>
-      )rawliteral" + apName + R"rawliteral(
-    </div>
+    <div class="device-id">
+      <span class="led-indicator"></span>
+      )rawliteral" + apName + R"rawliteral(
+    </div>
+
+    <div id="networks-container">
+      <div class="scanning">
+        <div class="spinner"></div>
+        Scanning for networks...
+      </div>
+    </div>
+
+    <form id="wifi-form" style="display:none;">
+      <div class="form-group">
+        <label>WiFi Network</label>
+        <select id="ssid" name="ssid" required>
+          <option value="">Select a network...</option>
+        </select>
+      </div>
+
+      <div class="form-group">
+        <label>Password</label>
+        <div class="password-container">
+          <input type="password" id="password" name="password" placeholder="Enter WiFi password">
+          <button type="button" class="toggle-password" onclick="togglePassword()">Show</button>
+        </div>
+      </div>
+
+      <button type="submit" id="connect-btn">Connect</button>
+    </form>
+  </div>
+
+  <script>
+    let networks = [];
+
+    async function scanNetworks() {
+      try {
+        const response = await fetch('/wifi/scan');
+        const data = await response.json();
+        networks = data.networks || [];
+        displayNetworks();
+      } catch (error) {
+        document.getElementById('networks-container').innerHTML =
+          '<div class="error">Failed to scan networks. Please refresh the page.</div>';
+      }
+    }
+
+    function displayNetworks() {
+      const container = document.getElementById('networks-container');
+      const form = document.getElementById('wifi-form');
+      const select = document.getElementById('ssid');
+
+      if (networks.length === 0) {
+        container.innerHTML = '<div class="error">No networks found. Please try again.</div>' +
+          '<button class="refresh-btn" onclick="scanNetworks()">🔄 Scan Again</button>';
+        return;
+      }
+
+      container.innerHTML = '<button class="refresh-btn" onclick="scanNetworks()">🔄 Scan Again</button>';
+
+      select.innerHTML = '<option value="">Select a network...</option>';
+      networks.forEach(net => {
+        const signal = net.rssi > -50 ? '▓▓▓▓' : net.rssi > -70 ? '▓▓▓░' : net.rssi > -80 ? '▓▓░░' : '▓░░░';
+        const option = document.createElement('option');
+        option.value = net.ssid;
+        option.textContent = net.ssid + ' ' + signal + (net.secure ? ' 🔒' : '');
+        select.appendChild(option);
+      });
+
+      form.style.display = 'block';
+    }
+
+    function togglePassword() {
+      const input = document.getElementById('password');
+      const btn = document.querySelector('.toggle-password');
+      if (input.type === 'password') {
+        input.type = 'text';
+        btn.textContent = 'Hide';
+      } else {
+        input.type = 'password';
+        btn.textContent = 'Show';
+      }
+    }
+
+    document.getElementById('wifi-form').addEventListener('submit', async (e) => {
+      e.preventDefault();
+      const btn = document.getElementById('connect-btn');
+      const ssid = document.getElementById('ssid').value;
+      const password = document.getElementById('password').value;
+
+      if (!ssid) {
+        alert('Please select a network');
+        return;
+      }
+
+      btn.disabled = true;
+      btn.textContent = 'Connecting...';
+
+      try {
+        const response = await fetch('/wifi/config', {
+          method: 'POST',
+          headers: { 'Content-Type': 'application/json' },
+          body: JSON.stringify({ ssid, password })
+        });
+
+        const data = await response.json();
+
+        if (data.success) {
+          document.querySelector('.container').innerHTML = `
+            <div class="logo">
+              <h1>✅ WiFi Configured!</h1>
+              <p>The device is restarting...</p>
+            </div>
+            <div style="text-align:center; color:#666; margin-top:20px;">
+              <p>The device will connect to <strong>${ssid}</strong></p>
+              <p style="margin-top:12px;">You can close this page and find the device on your network.</p>
+              <p style="margin-top:12px; font-size:12px;">Look for it at: <code>vda-ir-XXXXXX.local</code></p>
+            </div>
+          `;
+        } else {
+          throw new Error(data.error || 'Configuration failed');
+        }
+      } catch (error) {
+        btn.disabled = false;
+        btn.textContent = 'Connect';
+        alert('Failed to configure WiFi: ' + error.message);
+      }
+    });
+
+    // Start scanning on page load
+    scanNetworks();
+  </script>
+</body>
+</html>
+)rawliteral";
+
+  return html;
+}
+
+void handleWiFiConfig() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  String newSSID = doc["ssid"] | "";
+  String newPassword = doc["password"] | "";
+
+  if (newSSID.length() == 0) {
+    server.send(400, "application/json", "{\"error\":\"SSID required\"}");
+    return;
+  }
+
+  // Optional static address; without static_ip the board uses DHCP
+  IPAddress ip, gateway, subnet(255, 255, 255, 0), dns;
+  bool staticIp = doc.containsKey("static_ip");
+  if (staticIp) {
+    bool valid = ip.fromString(doc["static_ip"] | "") && gateway.fromString(doc["gateway"] | "");
+    if (doc.containsKey("subnet")) valid = valid && subnet.fromString(doc["subnet"] | "");
+    if (doc.containsKey("dns")) {
+      valid = valid && dns.fromString(doc["dns"] | "");
+    } else {
+      dns = gateway;
+    }
+    if (!valid || (uint32_t)ip == 0) {
+      server.send(400, "application/json", "{\"error\":\"static_ip and gateway required as dotted addresses\"}");
+      return;
+    }
+  }
+
+  wifiSSID = newSSID;
+  wifiPassword = newPassword;
+  wifiConfigured = true;
+
+  // Save to preferences
+  preferences.begin(CONFIG_NAMESPACE, false);
+  preferences.putString("wifiSSID", wifiSSID);
+  preferences.putString("wifiPass", wifiPassword);
+  preferences.putBool("wifiConf", true);
+  preferences.putUInt("wifiIp", staticIp ? (uint32_t)ip : 0);
+  preferences.putUInt("wifiGw", staticIp ? (uint32_t)gateway : 0);
+  preferences.putUInt("wifiMask", staticIp ? (uint32_t)subnet : 0);
+  preferences.putUInt("wifiDns", staticIp ? (uint32_t)dns : 0);
+  preferences.end();
+
+  StaticJsonDocument<128> response;
+  response["success"] = true;
+  response["message"] = "WiFi configured. Rebooting...";
+
+  sendJson(200, response);
+
+  Serial.println("WiFi configured. Rebooting...");
+  setLedState(LED_BLINK_SLOW);
+  scheduleRestart(1000);
+}
+
+void handleWifiPowerStatus() {
+  RequestJsonDocument doc(1536);
+  addWifiPowerStats(doc.to<JsonObject>());
+  sendJson(200, doc);
+}
+
+void handleWifiPowerConfig() {
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, server.body(), server.bodyLength())) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  const char* name = doc["profile"] | "";
+  int profile = 0;
+  while (profile < WIFI_POWER_PROFILES && strcmp(name, WIFI_POWER_SETTINGS[profile].name) != 0) profile++;
+  if (profile == WIFI_POWER_PROFILES) {
+    server.send(400, "application/json", "{\"error\":\"profile must be lowest_latency, balanced or low_power\"}");
+    return;
+  }
+
+  setWifiPowerProfile((WifiPowerProfile)profile);
+  handleWifiPowerStatus();
+}
+
+void handleCaptivePortal() {
+  // Serve the setup page for captive portal detection URLs
+  server.send(200, "text/html", generateSetupPage());
+}
+
+#endif
+
+// ============ Configuration ============
+void loadConfig() {
+  unsigned long start = micros();
+
+  preferences.begin(CONFIG_NAMESPACE, true);
+
+#ifdef USE_WIFI
+  wifiSSID = preferences.getString("wifiSSID", "");
+  wifiPassword = preferences.getString("wifiPass", "");
+  wifiConfigured = preferences.getBool("wifiConf", false);
+  wifiStaticIp = preferences.getUInt("wifiIp", 0) != 0;
+  wifiIp = preferences.getUInt("wifiIp", 0);
+  wifiGateway = preferences.getUInt("wifiGw", 0);
+  wifiSubnet = preferences.getUInt("wifiMask", 0);
+  wifiDns = preferences.getUInt("wifiDns", 0);
+  if (preferences.getBytes("wifiCache", &wifiCache, sizeof(wifiCache)) != sizeof(wifiCache)) {
+    wifiCache.magic = 0;
+  }
+  wifiPowerProfile = (WifiPowerProfile)min((int)preferences.getUChar("wifiPower", WIFI_POWER_BALANCED), WIFI_POWER_PROFILES - 1);
+#endif
+
+  bool persistNow = loadStoredConfig(preferences);
+
+  preferences.end();
+
+  // Generate default board ID if not set
+  if (boardId.length() == 0) {
+    boardId = "vda-ir-" + String((uint32_t)ESP.getEfuseMac(), HEX);
+  }
+
+  // No ports yet: add every available pin, disabled, and persist the default
+  // table with the first commit. Otherwise add pins a firmware update brought.
+  bool fresh = portCount == 0;
+  int added = addMissingPorts();
+  if (fresh) {
+    markConfigDirty();
+  } else if (added > 0) {
+    Serial.printf("Expanding ports to %d\n", portCount);
+    persistNow = true;
+  }
+
+  rebuildGpioIndex();
+
+  // Migrations and expansions are written right away
+  if (persistNow) {
+    markConfigDirty();
+    saveConfig();
+  }
+
+  configStats.loadUs = micros() - start;
+  Serial.printf("Loaded config: boardId=%s, ports=%d, source=%s (%uus)\n",
+                boardId.c_str(), portCount, configStats.loadSource, configStats.loadUs);
+}
+
+// Commit pending changes to the older blob slot and let mDNS and MQTT
+// announce the new generation
+void saveConfig() {
+  if (!commitConfig(preferences)) {
+    return;
+  }
+  updateMdnsTxt();
+  if (tasks[TASK_MQTT].handle != nullptr) {
+    xTaskNotifyGive(tasks[TASK_MQTT].handle);  // Republishes discovery for the new generation
+  }
+}
+
+// Called from loop() once the debounce period has passed
+void serviceConfigSave() {
+  if (configSaveDue()) {
+    saveConfig();
+  }
+}
+
+// Restart from the net task after delayMs, without blocking the caller
+void scheduleRestart(uint32_t delayMs) {
+  restartAtMs = millis() + delayMs;
+  restartPending = true;
+}
+
+void serviceRestart() {
+  if (!restartPending || (long)(millis() - restartAtMs) < 0) {
+    return;
+  }
+  saveConfig();  // Don't lose debounced changes
+  ESP.restart();
+}
+
+// ============ Port Initialization ============
+void initPorts() {
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].mode == PORT_IR_OUTPUT) {
+      initIRSender(i);
+    } else if (ports[i].mode == PORT_IR_INPUT) {
+      initIRReceiver(ports[i].gpio);
+    }
+  }
+}
+
+void initIRSender(int portIndex) {
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  if (irSenders[portIndex] != nullptr) {
+    delete irSenders[portIndex];
+  }
+  irSenders[portIndex] = new IRsend(ports[portIndex].gpio);
+  irSenders[portIndex]->begin();
+  xSemaphoreGive(irMutex);
+  Serial.printf("IR Sender initialized on GPIO%d\n", ports[portIndex].gpio);
+}
+
+void initIRReceiver(int gpio) {
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  if (irReceiver != nullptr) {
+    delete irReceiver;
+  }
+  irReceiver = new IRrecv(gpio);
+  irReceiver->enableIRIn();
+  activeReceiverPort = gpio;
+  learnedCode.available = false;
+  xSemaphoreGive(irMutex);
+
+  if (tasks[TASK_IR_RX].handle != nullptr) {
+    xTaskNotifyGive(tasks[TASK_IR_RX].handle);
+  }
+  Serial.printf("IR Receiver initialized on GPIO%d\n", gpio);
+}
+
+void releaseIRSender(int portIndex) {
+  if (irSenders[portIndex] == nullptr) {
+    return;
+  }
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  delete irSenders[portIndex];
+  irSenders[portIndex] = nullptr;
+  xSemaphoreGive(irMutex);
+}
+
+// Stop and free the receiver; the receive task goes back to sleep
+void stopIRReceiver() {
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  if (irReceiver != nullptr) {
+    irReceiver->disableIRIn();
+    delete irReceiver;
+    irReceiver = nullptr;
+  }
+  activeReceiverPort = -1;
+  learnedCode.available = false;
+  xSemaphoreGive(irMutex);
+  Serial.println("IR Receiver stopped");
+}
+
+// ============ Web Server Setup ============
+void setupWebServer() {
+  // The net task sleeps in select() instead of WebServer's idle delay(1)
+  server.enableDelay(false);
+
+  // Body routes size their buffer from Content-Length (see MetricsWebServer)
+  const char* collected[] = {"Content-Length"};
+  server.collectHeaders(collected, 1);
+
+  // Root handler - serve setup page in AP mode, info otherwise
+  server.on("/", HTTP_GET, handleRoot);
+
+  // API endpoints
+  server.on("/info", HTTP_GET, handleInfo);
+  server.on("/status", HTTP_GET, handleStatus);
+  server.on("/diagnostics", HTTP_GET, handleDiagnostics);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/diagnostics/selftest", HTTP_POST, handleSelfTest);
+  server.on("/ports", HTTP_GET, handlePorts);
+  server.on("/ports/configure", HTTP_POST, handleConfigurePort);
+  server.on("/ports/configure_bulk", HTTP_POST, handleConfigurePortsBulk);
+  server.on("/adopt", HTTP_POST, handleAdopt);
+  server.on("/reboot", HTTP_POST, []() {
+    saveConfig();  // Don't lose debounced changes
+    server.send(200, "application/json", "{\"success\":true,\"message\":\"Rebooting...\"}");
+    delay(500);
+    ESP.restart();
+  });
+  server.on("/send_ir", HTTP_POST, handleSendIR);
+  server.on("/test_output", HTTP_POST, handleTestOutput);
+  server.on("/learning/start", HTTP_POST, handleLearningStart);
+  server.on("/learning/stop", HTTP_POST, handleLearningStop);
+  server.on("/learning/status", HTTP_GET, handleLearningStatus);
+  server.on("/ir/self_check", HTTP_POST, handleTxCheck);
+
+  // Serial bridge endpoints
+  server.on("/serial/config", HTTP_POST, handleSerialConfig);
+  server.on("/serial/send", HTTP_POST, handleSerialSend);
+  server.on("/serial/read", HTTP_GET, handleSerialRead);
+  server.on("/serial/status", HTTP_GET, handleSerialStatus);
+  server.on("/serial/batch", HTTP_POST, handleSerialBatch);
+  server.on("/serial/batch", HTTP_GET, handleSerialBatchResult);
+
+  // OTA Update routes (available for both WiFi and Ethernet)
+  server.on("/update", HTTP_GET, handleOTAPage);
+  server.on("/update", HTTP_POST, handleOTAComplete, handleOTAUpload);
+  server.on("/ota/pull", HTTP_GET, handleOtaPullStatus);
+  server.on("/ota/pull", HTTP_POST, handleOtaPullConfig);
+  server.on("/mqtt", HTTP_GET, handleMqttStatus);
+  server.on("/mqtt", HTTP_POST, handleMqttConfig);
+
+#ifdef USE_WIFI
+  server.on("/wifi/config", HTTP_POST, handleWiFiConfig);
+  server.on("/wifi/power", HTTP_GET, handleWifiPowerStatus);
+  server.on("/wifi/power", HTTP_POST, handleWifiPowerConfig);
+  server.on("/wifi/scan", HTTP_GET, []() {
+    Serial.println("Scanning WiFi networks...");
+    int n = WiFi.scanNetworks();
+    Serial.printf("Found %d networks\n", n);
+
+    RequestJsonDocument doc(2048);
+    JsonArray networks = doc.createNestedArray("networks");
+    for (int i = 0; i < n && i < 20; i++) {
+      JsonObject net = networks.createNestedObject();
+      net["ssid"] = WiFi.SSID(i);
+      net["rssi"] = WiFi.RSSI(i);
+      net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
+    }
+    sendJson(200, doc);
+  });
+
+  // Captive portal detection endpoints
+  server.on("/generate_204", HTTP_GET, handleCaptivePortal);  // Android
+  server.on("/gen_204", HTTP_GET, handleCaptivePortal);        // Android
+  server.on("/hotspot-detect.html", HTTP_GET, handleCaptivePortal);  // Apple
+  server.on("/library/test/success.html", HTTP_GET, handleCaptivePortal);  // Apple
+  server.on("/ncsi.txt", HTTP_GET, handleCaptivePortal);       // Windows
+  server.on("/connecttest.txt", HTTP_GET, handleCaptivePortal); // Windows
+  server.on("/fwlink", HTTP_GET, handleCaptivePortal);         // Windows
+#endif
+
+  server.onNotFound(handleNotFound);
+
+  server.enableCORS(true);
+  server.begin();
+  Serial.println("HTTP server started on port 80");
+
+  // Upload port, served by the OTA task. The update page posts here from
+  // port 80; the progress listener makes browsers send a preflight first.
+  otaServer.enableDelay(false);
+  otaServer.enableCORS(true);
+  otaServer.on("/update", HTTP_POST, handleOTAPortComplete, handleOTAPortUpload);
+  otaServer.on("/update", HTTP_OPTIONS, []() {
+    otaServer.sendHeader("Access-Control-Allow-Methods", "POST");
+    otaServer.sendHeader("Access-Control-Allow-Headers", "*");
+    otaServer.send(204);
+  });
+  otaServer.begin();
+  Serial.printf("Firmware upload server started on port %d\n", OTA_UPLOAD_PORT);
+}
+
+// ============ OTA Update Handlers ============
+void handleOTAPage() {
+  String html = R"rawliteral(
+<!DOCTYPE html>
+<html>
+<head>
+  <meta name="viewport" content="width=device-width, initial-scale=1">
+  <title>Firmware Update</title>
+  <style>
+    body { font-family: Arial, sans-serif; margin: 40px; background: #1a1a2e; color: #eee; }
+    .container { max-width: 500px; margin: 0 auto; background: #16213e; padding: 30px; border-radius: 10px; }
+    h1 { color: #e94560; margin-top: 0; }
+    form { margin-top: 20px; }
+    input[type="file"] { margin: 15px 0; color: #eee; }
+    input[type="submit"] { background: #e94560; color: white; border: none; padding: 12px 30px; border-radius: 5px; cursor: pointer; font-size: 16px; }
+    input[type="submit"]:hover { background: #ff6b6b; }
+    .info { background: #0f3460; padding: 15px; border-radius: 5px; margin-bottom: 20px; }
+    .warning { background: #614a19; padding: 10px; border-radius: 5px; margin-top: 15px; font-size: 14px; }
+    #progress { display: none; margin-top: 20px; }
+    .progress-bar { background: #0f3460; border-radius: 5px; height: 30px; overflow: hidden; }
+    .progress-fill { background: #e94560; height: 100%; width: 0%; transition: width 0.3s; }
+    .progress-text { text-align: center; margin-top: 10px; }
+  </style>
+</head>
+<body>
+  <div class="container">
+    <h1>Firmware Update</h1>
+    <div class="info">
+      <strong>Current Version:</strong> )rawliteral" + String(FIRMWARE_VERSION) + R"rawliteral(<br>
+      <strong>Device:</strong> )rawliteral" + boardName + R"rawliteral(
+    </div>
+    <form method="POST" action="/update" enctype="multipart/form-data" id="uploadForm">
+      <div>Select firmware file (.bin or .bin.gz):</div>
+      <input type="file" name="firmware" accept=".bin,.gz" required>
+      <br>
+      <input type="submit" value="Upload & Update">
+    </form>
+    <div class="warning">
+      ⚠️ Do not disconnect power during update. Settings will be preserved.
+    </div>
+    <div id="progress">
+      <div class="progress-bar"><div class="progress-fill" id="progressFill"></div></div>
+      <div class="progress-text" id="progressText">Uploading... 0%</div>
+    </div>
+  </div>
+  <script>
+    document.getElementById('uploadForm').addEventListener('submit', function(e) {
+      e.preventDefault();
+      var form = e.target;
+      var formData = new FormData(form);
+      var xhr = new XMLHttpRequest();
+      document.getElementById('progress').style.display = 'block';
+      xhr.upload.addEventListener('progress', function(e) {
+        if (e.lengthComputable) {
+          var pct = Math.round((e.loaded / e.total) * 100);
+          document.getElementById('progressFill').style.width = pct + '%';
+          document.getElementById('progressText').textContent = 'Uploading... ' + pct + '%';
+        }
+      });
+      xhr.addEventListener('load', function() {
+        if (xhr.status === 200) {
+          document.getElementById('progressText').textContent = 'Update complete! Rebooting...';
+          setTimeout(function() { location.reload(); }, 5000);
+        } else {
+          document.getElementById('progressText').textContent = 'Update failed: ' + xhr.responseText;
+        }
+      });
+      xhr.addEventListener('error', function() {
+        document.getElementById('progressText').textContent = 'Upload failed. Please try again.';
+      });
+      // The upload port keeps the rest of the API responsive during the update
+      xhr.open('POST', 'http://' + location.hostname + ':)rawliteral" + String(OTA_UPLOAD_PORT) + R"rawliteral(/update');
+      xhr.send(formData);
+    });
+  </script>
+</body>
+</html>
+)rawliteral";
+  server.send(200, "text/html", html);
+}
+
+static void otaFail(const char* error) {
+  if (ota.error == nullptr) {
+    ota.error = error;
+    Serial.printf("OTA Update failed: %s\n", error);
+  }
+  if (Update.isRunning()) Update.abort();
+}
+
+static void otaRelease() {
+  gzipRelease(ota.gz);
+  free(ota.delta);
+  ota.delta = nullptr;
+  mbedtls_sha256_free(&ota.sha);
+}
+
+// Flash operations hold the IR mutex; see otaTakeIrMutex()
+static void otaLockFlash() {
+  ota.irWaitUs += otaTakeIrMutex(irMutex, irTxBusy);
+}
+
+static void otaUnlockFlash() {
+  xSemaphoreGive(irMutex);
+}
+
+// Bytes of the new firmware image
+static void otaWriteImage(uint8_t* data, size_t len) {
+  if (len == 0 || ota.error != nullptr) return;
+  mbedtls_sha256_update_ret(&ota.sha, data, len);
+
+  otaLockFlash();
+  unsigned long start = micros();
+  size_t written = Update.write(data, len);
+  ota.flashUs += micros() - start;
+  otaUnlockFlash();
+  ota.written += written;
+  if (written != len) otaFail(Update.errorString());
+}
+
+// Partition read and image write for the delta applier
+static bool otaDeltaRead(uint32_t pos, uint8_t* out, size_t len) {
+  otaLockFlash();
+  esp_err_t err = esp_partition_read(ota.deltaSource, pos, out, len);
+  otaUnlockFlash();
+  return err == ESP_OK;
+}
+
+static bool otaDeltaWrite(uint8_t* data, size_t len) {
+  otaWriteImage(data, len);
+  return ota.error == nullptr;
+}
+
+static void otaApplyDelta(uint8_t* data, size_t len) {
+  const char* error = deltaApply(*ota.delta, data, len);
+  if (error) otaFail(error);
+}
+
+// Sets up the delta applier if the first payload bytes are a delta's
+static void otaDetectDelta() {
+  if (!isDeltaMagic(ota.lead)) return;
+  ota.delta = (OtaDelta*)malloc(sizeof(OtaDelta));
+  if (ota.delta == nullptr) {
+    otaFail("Out of memory for delta");
+    return;
+  }
+  ota.deltaSource = esp_ota_get_running_partition();
+  deltaBegin(*ota.delta, ota.deltaSource ? ota.deltaSource->size : 0, otaDeltaRead, otaDeltaWrite);
+}
+
+// Uploaded bytes after any decompression: a firmware image or a delta. The
+// inflater can hand over fewer than 4 bytes at a time, so they are gathered
+// in ota.lead before deciding.
+static void otaPayload(uint8_t* data, size_t len) {
+  if (len == 0 || ota.error != nullptr) return;
+  if (ota.payload < sizeof(ota.lead)) {
+    size_t n = min(len, sizeof(ota.lead) - ota.payload);
+    memcpy(ota.lead + ota.payload, data, n);
+    ota.payload += n;
+    data += n;
+    len -= n;
+    if (ota.payload < sizeof(ota.lead)) return;
+
+    otaDetectDelta();
+    if (ota.error != nullptr) return;
+    if (ota.delta) otaApplyDelta(ota.lead, sizeof(ota.lead));
+    else otaWriteImage(ota.lead, sizeof(ota.lead));
+    if (len == 0 || ota.error != nullptr) return;
+  }
+  ota.payload += len;
+
+  if (ota.delta) otaApplyDelta(data, len);
+  else otaWriteImage(data, len);
+}
+
+static void otaInflate(const uint8_t* data, size_t len) {
+  const char* error = gzipInflate(ota.gz, data, len, otaPayload);
+  if (error) otaFail(error);
+}
+
+static bool parseSha256(const String& hex, uint8_t* out) {
+  return hex.length() == 64 && decodeHex(hex.c_str(), 64, out) == 32;
+}
+
+// Uploads and pulls share one session. A new upload replaces one that has
+// stalled (the client went away); anything else waits its turn.
+static bool otaClaim(OtaSource source) {
+  portENTER_CRITICAL(&otaMux);
+  bool stale = ota.source == OTA_UPLOAD && millis() - ota.lastDataMs > OTA_UPLOAD_STALE_MS;
+  bool claimed = !ota.active || (source == OTA_UPLOAD && stale);
+  if (claimed) {
+    ota.active = true;
+    ota.source = source;
+  }
+  portEXIT_CRITICAL(&otaMux);
+  return claimed;
+}
+
+// (Re)start the claimed session from the first byte
+static void otaStart(const String& sha256) {
+  otaDrainChunks();
+  if (Update.isRunning()) Update.abort();
+  otaRelease();
+
+  OtaSource source = ota.source;
+  portENTER_CRITICAL(&otaMux);
+  memset(&ota, 0, sizeof(ota));
+  ota.active = true;
+  ota.source = source;
+  portEXIT_CRITICAL(&otaMux);
+
+  otaReport.magic = 0;
+  ota.startMs = millis();
+  ota.lastDataMs = ota.startMs;
+  mbedtls_sha256_init(&ota.sha);
+  mbedtls_sha256_starts_ret(&ota.sha, 0);
+
+  if (sha256.length() > 0) {
+    ota.checkSha = true;
+    if (!parseSha256(sha256, ota.expectedSha)) {
+      otaFail("Invalid sha256");
+      return;
+    }
+  }
+
+  if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
+    otaFail(Update.errorString());
+  }
+}
+
+static bool otaBegin(OtaSource source, const String& sha256) {
+  if (!otaClaim(source)) return false;
+  otaStart(sha256);
+  return true;
+}
+
+// Bytes as received, compressed or not
+static void otaData(uint8_t* data, size_t len) {
+  if (ota.received == 0 && len >= 2 && data[0] == 0x1F && data[1] == 0x8B) {
+    ota.gzip = true;
+    if (!gzipBegin(ota.gz)) otaFail("Out of memory for decompression");
+  }
+  ota.received += len;
+  if (ota.error != nullptr) return;
+
+  if (ota.gzip) otaInflate(data, len);
+  else otaPayload(data, len);
+}
+
+static void otaFinish() {
+  if (ota.gzip && ota.error == nullptr) {
+    const char* error = gzipFinish(ota.gz);
+    if (error) otaFail(error);
+  }
+
+  // Too short to tell apart from a delta; Update.end() rejects it
+  if (ota.payload < sizeof(ota.lead)) otaWriteImage(ota.lead, ota.payload);
+
+  if (ota.delta && ota.error == nullptr) {
+    const char* error = deltaFinish(*ota.delta);
+    if (error) otaFail(error);
+  }
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&ota.sha, digest);
+  if (ota.checkSha && memcmp(digest, ota.expectedSha, sizeof(digest)) != 0) {
+    otaFail("SHA-256 mismatch");
+  }
+  if (ota.delta && memcmp(digest, ota.delta->header.newSha, sizeof(digest)) != 0) {
+    otaFail("Delta result mismatch");
+  }
+
+  if (ota.error == nullptr) {
+    otaLockFlash();
+    bool ended = Update.end(true);
+    otaUnlockFlash();
+    if (!ended) otaFail(Update.errorString());
+  }
+
+  otaReport.magic = OTA_REPORT_MAGIC;
+  otaReport.success = ota.error == nullptr;
+  otaReport.gzip = ota.gzip;
+  otaReport.delta = ota.delta != nullptr;
+  otaReport.pulled = ota.source == OTA_PULL;
+  otaReport.sourceReadUs = ota.delta ? ota.delta->readUs : 0;
+  otaReport.received = ota.received;
+  otaReport.written = ota.written;
+  otaReport.flashUs = ota.flashUs;
+  otaReport.queueWaitMs = ota.queueWaitUs / 1000;
+  otaReport.irWaitMs = ota.irWaitUs / 1000;
+  otaReport.throttleMs = ota.throttle.waitedUs / 1000;
+  otaReport.totalMs = millis() - ota.startMs;
+  encodeHex(digest, sizeof(digest), otaReport.sha256);
+  strlcpy(otaReport.error, ota.error ? ota.error : "", sizeof(otaReport.error));
+  otaRelease();
+  ota.active = false;
+}
+
+// Receiving side: blocks while the writer is behind
+static void otaQueueData(const uint8_t* data, size_t len) {
+  ota.lastDataMs = millis();
+  ota.queueWaitUs += otaQueuePut(data, len, ota.error);
+}
+
+// Ends the image, failing it with error if set, and waits for the writer
+// to finish it; the outcome is in otaReport
+static void otaQueueFinish(const char* error) {
+  otaFinishError = error;
+  otaQueueEnd();
+}
+
+// Writer callbacks for otaWriteNext()
+static uint32_t otaWriteChunk(uint8_t* data, size_t len) {
+  unsigned long start = micros();
+  uint32_t written = ota.written;
+  otaData(data, len);
+  accountTask(TASK_OTA_WRITE, start);
+  return ota.written - written;
+}
+
+static void otaWriteEnd() {
+  unsigned long start = micros();
+  if (otaFinishError != nullptr) otaFail(otaFinishError);
+  otaFinish();
+  accountTask(TASK_OTA_WRITE, start);
+}
+
+// Decompression and flash writes for uploads and pulls, fed by otaQueueData()
+void otaWriteTask(void* param) {
+  esp_task_wdt_add(NULL);
+
+  for (;;) {
+    esp_task_wdt_reset();
+    otaWriteNext(otaWriteChunk, otaWriteEnd, ota.throttle, otaPullConfig.writeLimitKbps);
+  }
+}
+
+// Upload and completion handlers for port 80 and OTA_UPLOAD_PORT
+template <typename Server>
+static void serveOTAUpload(Server& web, bool& accepted) {
+  HTTPUpload& upload = web.upload();
+  esp_task_wdt_reset();  // The whole upload is received within one handleClient()
+
+  if (upload.status == UPLOAD_FILE_START) {
+    Serial.printf("OTA Update Start: %s\n", upload.filename.c_str());
+    accepted = otaBegin(OTA_UPLOAD, web.hasArg("sha256") ? web.arg("sha256") : String());
+    if (!accepted) Serial.println("OTA Update refused: another update is in progress");
+    return;
+  }
+  if (!accepted || !ota.active) return;
+
+  if (upload.status == UPLOAD_FILE_WRITE) {
+    otaQueueData(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    otaQueueFinish(nullptr);
+    if (otaReport.success) {
+      Serial.printf("OTA Update Success: %u bytes received, %u written in %ums\n",
+                    otaReport.received, otaReport.written, otaReport.totalMs);
+    }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    otaQueueFinish("Upload aborted");
+  }
+}
+
+template <typename Server>
+static void serveOTAComplete(Server& web, bool accepted) {
+  if (!accepted) {
+    web.send(409, "text/plain", "Update failed: another update is in progress");
+    return;
+  }
+
+  bool ok = otaReport.magic == OTA_REPORT_MAGIC && otaReport.success && Update.isFinished();
+  char message[160];
+  if (!ok) {
+    snprintf(message, sizeof(message), "Update failed: %s",
+             otaReport.magic == OTA_REPORT_MAGIC && otaReport.error[0] ? otaReport.error : "no firmware received");
+    web.send(500, "text/plain", message);
+    return;
+  }
+
+  snprintf(message, sizeof(message), "Update successful! Rebooting... (%u bytes received, %u written in %ums)",
+           otaReport.received, otaReport.written, otaReport.totalMs);
+  web.send(200, "text/plain", message);
+  scheduleRestart(OTA_RESTART_DELAY_MS);
+}
+
+void handleOTAUpload() {
+  serveOTAUpload(server, otaUploadAccepted);
+}
+
+void handleOTAComplete() {
+  serveOTAComplete(server, otaUploadAccepted);
+}
+
+void handleOTAPortUpload() {
+  serveOTAUpload(otaServer, otaPortUploadAccepted);
+}
+
+void handleOTAPortComplete() {
+  serveOTAComplete(otaServer, otaPortUploadAccepted);
+}
+
+static void addOtaStats(JsonObject obj) {
+  if (otaReport.magic != OTA_REPORT_MAGIC) return;
+  const OtaReport& r = otaReport;
+  obj["success"] = r.success;
+  obj["compressed"] = r.gzip;
+  obj["delta"] = r.delta;
+  obj["pulled"] = r.pulled;
+  obj["received_bytes"] = r.received;
+  obj["image_bytes"] = r.written;
+  obj["flash_write_kbps"] = r.flashUs > 0 ? (uint32_t)((uint64_t)r.written * 1000 / r.flashUs) : 0;
+  if (r.delta) obj["source_read_ms"] = r.sourceReadUs / 1000;
+  obj["queue_wait_ms"] = r.queueWaitMs;
+  obj["ir_wait_ms"] = r.irWaitMs;
+  obj["throttle_ms"] = r.throttleMs;
+  obj["total_ms"] = r.totalMs;
+  obj["sha256"] = r.sha256;
+  if (r.error[0]) obj["error"] = r.error;
+}
+
+// ============ OTA Pull ============
+// Keep the new firmware pending until the health check in the OTA task
+// confirms it, instead of letting the core accept it at startup
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+void loadOtaPullConfig() {
+  Preferences store;
+  if (!store.begin("vda-ota", true)) return;
+  otaPullConfig.enabled = store.getBool("enabled", false);
+  otaPullConfig.intervalS = store.getUInt("interval", OTA_PULL_DEFAULT_INTERVAL_S);
+  store.getString("url", otaPullConfig.manifestUrl, sizeof(otaPullConfig.manifestUrl));
+  otaPullConfig.writeLimitKbps = store.getUInt("write_kbps", 0);
+  store.end();
+}
+
+static void saveOtaPullConfig(const OtaPullConfig& config) {
+  Preferences store;
+  if (!store.begin("vda-ota", false)) return;
+  store.putBool("enabled", config.enabled);
+  store.putUInt("interval", config.intervalS);
+  store.putString("url", config.manifestUrl);
+  store.putUInt("write_kbps", config.writeLimitKbps);
+  store.end();
+}
+
+// Stable 0-99 bucket for staged rollouts
+static uint8_t rolloutBucket() {
+  uint64_t mac = ESP.getEfuseMac();
+  return crc32((const uint8_t*)&mac, 6) % 100;
+}
+
+static void scheduleOtaCheck(uint32_t baseS) {
+  // +/- OTA_PULL_JITTER_PERCENT so a fleet booted together spreads out
+  uint32_t jitterS = baseS * OTA_PULL_JITTER_PERCENT / 100;
+  uint32_t delayS = baseS - jitterS + (jitterS > 0 ? esp_random() % (2 * jitterS + 1) : 0);
+  otaPull.nextCheckMs = millis() + delayS * 1000;
+}
+
+// Compares dotted versions numerically; returns > 0 if a is newer
+static int compareVersions(const char* a, const char* b) {
+  int va[3] = {0, 0, 0}, vb[3] = {0, 0, 0};
+  sscanf(a, "%d.%d.%d", &va[0], &va[1], &va[2]);
+  sscanf(b, "%d.%d.%d", &vb[0], &vb[1], &vb[2]);
+  for (int i = 0; i < 3; i++) {
+    if (va[i] != vb[i]) return va[i] - vb[i];
+  }
+  return 0;
+}
+
+static void setPullResult(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(otaPull.lastResult, sizeof(otaPull.lastResult), format, args);
+  va_end(args);
+  Serial.printf("OTA pull: %s\n", otaPull.lastResult);
+}
+
+static bool fetchOtaManifest(const char* manifestUrl, OtaManifest& m) {
+  HTTPClient http;
+  http.setTimeout(OTA_PULL_TIMEOUT_MS);
+  if (!http.begin(manifestUrl)) {
+    setPullResult("Invalid manifest URL");
+    return false;
+  }
+  int code = http.GET();
+  if (code != 200) {
+    setPullResult("Manifest request failed (%d)", code);
+    http.end();
+    return false;
+  }
+
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, http.getStream());
+  http.end();
+  const char* version = doc["version"] | "";
+  const char* url = doc["url"] | "";
+  if (error || !version[0] || !url[0]) {
+    setPullResult("Invalid manifest");
+    return false;
+  }
+
+  memset(&m, 0, sizeof(m));
+  strlcpy(m.version, version, sizeof(m.version));
+  strlcpy(m.sha256, doc["sha256"] | "", sizeof(m.sha256));
+  m.size = doc["size"] | 0;
+  m.rolloutPercent = min(doc["rollout_percent"] | 100, 100);
+
+  // Relative image URLs are resolved against the manifest
+  if (strstr(url, "://") != nullptr) {
+    strlcpy(m.url, url, sizeof(m.url));
+  } else {
+    const char* slash = strrchr(manifestUrl, '/');
+    int baseLen = slash ? slash - manifestUrl + 1 : strlen(manifestUrl);
+    snprintf(m.url, sizeof(m.url), "%.*s%s", baseLen, manifestUrl, url[0] == '/' ? url + 1 : url);
+  }
+  return true;
+}
+
+// Streams the image into the OTA session, resuming with Range requests
+// after a dropped connection. Returns why the download failed, if it did.
+static const char* downloadOtaImage(const OtaManifest& m) {
+  uint32_t total = m.size;
+  uint32_t offset = 0;
+  int resumes = 0;
+  const char* error = nullptr;
+  unsigned long start = millis();
+
+  while (ota.error == nullptr && error == nullptr) {
+    esp_task_wdt_reset();
+    HTTPClient http;
+    http.setTimeout(OTA_PULL_TIMEOUT_MS);
+    http.begin(m.url);
+    if (offset > 0) http.addHeader("Range", "bytes=" + String(offset) + "-");
+    int code = http.GET();
+
+    if (code == 200 && offset > 0) {
+      // No range support: start over from the first byte
+      otaPull.restarts++;
+      otaStart(m.sha256);
+      offset = 0;
+    }
+    if (code == 200 && total == 0) {
+      total = http.getSize() > 0 ? http.getSize() : 0;
+      if (total == 0) error = "Image size unknown";
+    }
+
+    if (code == 200 || code == 206) {
+      WiFiClient* stream = http.getStreamPtr();
+      unsigned long lastData = millis();
+      while (offset < total && ota.error == nullptr && millis() - lastData < OTA_PULL_TIMEOUT_MS) {
+        esp_task_wdt_reset();
+        size_t available = stream->available();
+        if (available == 0) {
+          if (!stream->connected()) break;
+          vTaskDelay(pdMS_TO_TICKS(5));
+          continue;
+        }
+        size_t n = stream->readBytes(otaPullBuffer, min(available, min(sizeof(otaPullBuffer), (size_t)(total - offset))));
+        otaQueueData(otaPullBuffer, n);
+        offset += n;
+        lastData = millis();
+      }
+    }
+    http.end();
+
+    if (ota.error != nullptr || error != nullptr || (total > 0 && offset >= total)) break;
+    if (resumes++ >= OTA_PULL_MAX_RESUMES) {
+      error = code == 200 || code == 206 ? "Download interrupted" : "Image request failed";
+      break;
+    }
+    otaPull.resumes++;
+    // Back off 2, 4, ... 10 s, in slices so the watchdog stays fed
+    for (uint32_t remaining = 2000 * resumes; remaining > 0;) {
+      uint32_t slice = min(remaining, (uint32_t)TASK_IDLE_WAIT_MS);
+      esp_task_wdt_reset();
+      vTaskDelay(pdMS_TO_TICKS(slice));
+      remaining -= slice;
+    }
+  }
+
+  otaPull.downloadBytes = offset;
+  otaPull.downloadMs = millis() - start;
+  return error;
+}
+
+static void runOtaPullCheck() {
+  OtaPullConfig config;
+  portENTER_CRITICAL(&otaMux);
+  config = otaPullConfig;
+  portEXIT_CRITICAL(&otaMux);
+  if (!config.manifestUrl[0] || !networkConnected) return;
+
+  otaPull.state = PULL_CHECKING;
+  otaPull.checks++;
+  OtaManifest m;
+  if (!fetchOtaManifest(config.manifestUrl, m)) {
+    otaPull.failures++;
+    otaPull.state = PULL_IDLE;
+    return;
+  }
+  strlcpy(otaPull.manifestVersion, m.version, sizeof(otaPull.manifestVersion));
+
+  if (compareVersions(m.version, FIRMWARE_VERSION) <= 0) {
+    setPullResult("Up to date (%s)", FIRMWARE_VERSION);
+  } else if (rolloutBucket() >= m.rolloutPercent) {
+    setPullResult("%s not rolled out to this board yet", m.version);
+  } else if (!otaBegin(OTA_PULL, m.sha256)) {
+    setPullResult("Upload in progress");
+  } else {
+    otaPull.state = PULL_DOWNLOADING;
+    Serial.printf("OTA pull: downloading %s from %s\n", m.version, m.url);
+    otaQueueFinish(downloadOtaImage(m));
+    if (otaReport.success) {
+      otaPull.updates++;
+      setPullResult("Installed %s, rebooting", m.version);
+      scheduleRestart(0);
+    } else {
+      otaPull.failures++;
+      setPullResult("Update to %s failed: %s", m.version, otaReport.error);
+    }
+  }
+  otaPull.state = PULL_IDLE;
+}
+
+// Freshly installed firmware is confirmed once it has proven itself, or
+// rolled back
+static void initFirmwareHealth() {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  esp_ota_img_states_t imageState;
+  if (esp_ota_get_state_partition(running, &imageState) != ESP_OK) return;
+  if (imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+    otaPull.state = PULL_HEALTH_CHECK;
+    otaPull.firmwareState = "pending";
+  } else {
+    otaPull.firmwareState = imageState == ESP_OTA_IMG_VALID ? "confirmed" : "unverified";
+  }
+}
+
+static void serviceFirmwareHealth() {
+  static unsigned long lastSampleMs = 0;
+  static unsigned long healthySinceMs = 0;
+  static uint32_t netWakeups = 0;
+  if (otaPull.state != PULL_HEALTH_CHECK || millis() - lastSampleMs < TASK_IDLE_WAIT_MS) return;
+  lastSampleMs = millis();
+
+  // The net task wakes at least once per TASK_IDLE_WAIT_MS while it runs
+  bool netAlive = tasks[TASK_NET].wakeups != netWakeups;
+  netWakeups = tasks[TASK_NET].wakeups;
+  if (!networkConnected || !netAlive) {
+    healthySinceMs = 0;
+  } else if (healthySinceMs == 0) {
+    healthySinceMs = millis();
+  } else if (millis() - healthySinceMs >= OTA_HEALTH_DELAY_MS) {
+    esp_ota_mark_app_valid_cancel_rollback();
+    otaPull.firmwareState = "confirmed";
+    otaPull.state = PULL_IDLE;
+    Serial.println("New firmware confirmed");
+    return;
+  }
+
+  if (millis() >= OTA_HEALTH_TIMEOUT_MS) {
+    Serial.println("New firmware failed its health check, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
+// Sleep until an upload connection or data arrives, or timeoutMs passes.
+// Returns true if a pull check was requested.
+static bool waitForOtaEvent(uint32_t timeoutMs) {
+  fd_set readable;
+  FD_ZERO(&readable);
+  int maxFd = -1;
+  watchSocket(listeningSocket(otaListenFd, OTA_UPLOAD_PORT), readable, maxFd);
+  watchSocket(otaServer.client().fd(), readable, maxFd);
+
+  if (maxFd < 0) {
+    // Upload server not started (no network)
+    return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) > 0;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  select(maxFd + 1, &readable, nullptr, nullptr, &tv);
+  return ulTaskNotifyTake(pdTRUE, 0) > 0;
+}
+
+void otaTask(void* param) {
+  esp_task_wdt_add(NULL);
+  initFirmwareHealth();
+  scheduleOtaCheck(OTA_PULL_FIRST_CHECK_S);
+  bool requested = false;
+
+  for (;;) {
+    esp_task_wdt_reset();
+    // Notified for "check now"
+    if (waitForOtaEvent(TASK_IDLE_WAIT_MS)) requested = true;
+
+    unsigned long start = micros();
+    if (networkServicesStarted) otaServer.handleClient();
+    serviceFirmwareHealth();
+
+    // Pulls wait until the running firmware is confirmed
+    bool due = otaPullConfig.enabled && (long)(millis() - otaPull.nextCheckMs) >= 0;
+    if ((requested || due) && otaPull.state == PULL_IDLE) {
+      requested = false;
+      runOtaPullCheck();
+      scheduleOtaCheck(otaPullConfig.intervalS);
+    }
+    accountTask(TASK_OTA, start);
+  }
+}
+
+static void addOtaPullStats(JsonObject obj) {
+  static const char* const stateNames[] = {"health_check", "idle", "checking", "downloading"};
+  obj["enabled"] = otaPullConfig.enabled;
+  obj["manifest_url"] = otaPullConfig.manifestUrl;
+  obj["interval_s"] = otaPullConfig.intervalS;
+  obj["write_limit_kbps"] = otaPullConfig.writeLimitKbps;
+  obj["state"] = stateNames[otaPull.state];
+  obj["firmware"] = otaPull.firmwareState;
+  obj["rollout_bucket"] = rolloutBucket();
+  obj["next_check_s"] = otaPullConfig.enabled ? max(0L, (long)(otaPull.nextCheckMs - millis())) / 1000 : 0;
+  obj["checks"] = otaPull.checks;
+  obj["failures"] = otaPull.failures;
+  obj["updates"] = otaPull.updates;
+  obj["manifest_version"] = otaPull.manifestVersion;
+  obj["last_result"] = otaPull.lastResult;
+
+  JsonObject download = obj.createNestedObject("download");
+  download["bytes"] = otaPull.downloadBytes;
+  download["ms"] = otaPull.downloadMs;
+  download["kbps"] = otaPull.downloadMs > 0 ? otaPull.downloadBytes / otaPull.downloadMs : 0;
+  download["resumes"] = otaPull.resumes;
+  download["restarts"] = otaPull.restarts;
+}
+
+void handleOtaPullStatus() {
+  RequestJsonDocument doc(1024);
+  addOtaPullStats(doc.to<JsonObject>());
+  sendJson(200, doc);
+}
+
+void handleOtaPullConfig() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  StaticJsonDocument<384> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  OtaPullConfig config = otaPullConfig;
+  config.enabled = doc["enabled"] | config.enabled;
+  config.intervalS = doc["interval_s"] | config.intervalS;
+  config.writeLimitKbps = doc["write_limit_kbps"] | config.writeLimitKbps;
+  if (doc.containsKey("manifest_url")) {
+    const char* url = doc["manifest_url"] | "";
+    if (strlen(url) >= OTA_PULL_URL_MAX || (url[0] && strncmp(url, "http://", 7) != 0)) {
+      server.send(400, "application/json", "{\"error\":\"manifest_url must be an http:// URL (max 127 chars)\"}");
+      return;
+    }
+    strlcpy(config.manifestUrl, url, sizeof(config.manifestUrl));
+  }
+  if (config.intervalS < OTA_PULL_MIN_INTERVAL_S) {
+    server.send(400, "application/json", "{\"error\":\"interval_s must be at least 300\"}");
+    return;
+  }
+  if (config.writeLimitKbps > 0 && config.writeLimitKbps < OTA_WRITE_LIMIT_MIN_KBPS) {
+    server.send(400, "application/json", "{\"error\":\"write_limit_kbps must be 0 (no limit) or at least 16\"}");
+    return;
+  }
+  if (config.enabled && !config.manifestUrl[0]) {
+    server.send(400, "application/json", "{\"error\":\"manifest_url required\"}");
+    return;
+  }
+
+  bool intervalChanged = config.intervalS != otaPullConfig.intervalS;
+  portENTER_CRITICAL(&otaMux);
+  otaPullConfig = config;
+  portEXIT_CRITICAL(&otaMux);
+  saveOtaPullConfig(config);
+  if (intervalChanged) scheduleOtaCheck(config.intervalS);
+
+  if ((doc["check_now"] | false) && tasks[TASK_OTA].handle != nullptr) {
+    xTaskNotifyGive(tasks[TASK_OTA].handle);
+  }
+
+  handleOtaPullStatus();
+}
+
+// ============ HTTP Handlers ============
+void handleRoot() {
+#ifdef USE_WIFI
+  if (apMode) {
+    server.send(200, "text/html", generateSetupPage());
+    return;
+  }
+#endif
+  // In normal mode, redirect to /info or show a simple status
+  handleInfo();
+}
+
+void handleInfo() {
+  StaticJsonDocument<512> doc;
+
+  doc["board_id"] = boardId;
+  doc["board_name"] = boardName;
+  doc["mac_address"] = getMacAddress();
+  doc["ip_address"] = getLocalIP();
+  doc["firmware_version"] = FIRMWARE_VERSION;
+  doc["board_type"] = BOARD_TYPE;
+  doc["adopted"] = adopted;
+  doc["total_ports"] = portCount;
+  doc["config_generation"] = configGeneration;
+
+#ifdef USE_ETHERNET
+  doc["connection_type"] = "ethernet";
+#else
+  doc["connection_type"] = "wifi";
+  doc["wifi_configured"] = wifiConfigured;
+  if (apMode) {
+    doc["wifi_mode"] = "ap";
+  } else {
+    doc["wifi_mode"] = "station";
+    doc["wifi_ssid"] = wifiSSID;
+  }
+#endif
+
+  int outputCount = 0, inputCount = 0;
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].mode == PORT_IR_OUTPUT) outputCount++;
+    if (ports[i].mode == PORT_IR_INPUT) inputCount++;
+  }
+  doc["output_count"] = outputCount;
+  doc["input_count"] = inputCount;
+
+  sendJson(200, doc);
+}
+
+void handleStatus() {
+  StaticJsonDocument<256> doc;
+
+  doc["board_id"] = boardId;
+  doc["online"] = true;
+  doc["uptime_seconds"] = millis() / 1000;
+  doc["free_heap"] = ESP.getFreeHeap();
+  doc["network_connected"] = networkConnected;
+
+#ifdef USE_WIFI
+  if (!apMode && WiFi.getMode() == WIFI_STA) {
+    doc["wifi_rssi"] = WiFi.RSSI();
+  }
+#endif
+
+  sendJson(200, doc);
+}
+
+static void addTxCheckStats(JsonObject check) {
+  check["enabled"] = txCheck.enabled;
+  check["frames"] = txCheck.frames;
+  check["compared"] = txCheck.compared;
+  check["length_mismatches"] = txCheck.lengthMismatches;
+  check["unchecked"] = txCheck.unchecked;
+  check["worst_mark_error_us"] = txCheck.worstMarkErrUs;
+  check["worst_space_error_us"] = txCheck.worstSpaceErrUs;
+  check["mean_mark_error_us"] = txCheck.compared ? txCheck.sumMeanMarkErrUs / txCheck.compared : 0;
+  check["mean_space_error_us"] = txCheck.compared ? txCheck.sumMeanSpaceErrUs / txCheck.compared : 0;
+  check["worst_carrier_error_percent"] = txCheck.worstCarrierErrPercent;
+
+  JsonArray protocols = check.createNestedArray("protocols");
+  for (int k = 0; k <= IR_TX_TEST; k++) {
+    const TxProtocolTiming& t = txTiming[k];
+    if (t.frames == 0) continue;
+    JsonObject p = protocols.createNestedObject();
+    p["protocol"] = irTxKindName((IrTxKind)k);
+    p["frames"] = t.frames;
+    p["mean_setup_us"] = (uint32_t)(t.setupUs / t.frames);
+    p["max_setup_us"] = t.maxSetupUs;
+    p["mean_airtime_us"] = (uint32_t)(t.airtimeUs / t.frames);
+  }
+
+  if (txCheck.frames == 0) return;
+  const TxFrameCheck& f = txCheck.last;
+  JsonObject last = check.createNestedObject("last_frame");
+  last["expected"] = f.expected;
+  last["captured"] = f.captured;
+  last["compared"] = f.compared;
+  last["max_mark_error_us"] = f.maxMarkErrUs;
+  last["max_space_error_us"] = f.maxSpaceErrUs;
+  last["mean_mark_error_us"] = f.meanMarkErrUs;
+  last["mean_space_error_us"] = f.meanSpaceErrUs;
+  last["carrier_hz"] = f.carrierHz;
+  last["carrier_error_percent"] = f.carrierErrPercent;
+  last["duty_percent"] = f.dutyPercent;
+}
+
+void handleDiagnostics() {
+  RequestJsonDocument doc(8192);
+
+  doc["uptime_seconds"] = millis() / 1000;
+  doc["free_heap"] = ESP.getFreeHeap();
+
+  // Phases in order; "ms" is the time since the previous one finished
+  JsonObject boot = doc.createNestedObject("boot");
+  boot["setup_start_ms"] = bootSetupStartMs;
+  boot["ir_ready_ms"] = bootPhaseMs[BOOT_PORTS];
+  boot["ready_ms"] = bootPhaseMs[BOOT_SERVICES];
+  boot["network_timed_out"] = bootNetworkTimedOut;
+  JsonArray phases = boot.createNestedArray("phases");
+  uint32_t previousMs = bootSetupStartMs;
+  for (int i = 0; i < BOOT_PHASES; i++) {
+    if (bootPhaseMs[i] == 0) continue;
+    JsonObject phase = phases.createNestedObject();
+    phase["phase"] = BOOT_PHASE_NAMES[i];
+    phase["at_ms"] = bootPhaseMs[i];
+    phase["ms"] = bootPhaseMs[i] - previousMs;
+    previousMs = bootPhaseMs[i];
+  }
+
+  // Fragmentation: share of free heap not usable by a single allocation
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largestBlock = ESP.getMaxAllocHeap();
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["free"] = freeHeap;
+  heap["min_free"] = ESP.getMinFreeHeap();
+  heap["largest_block"] = largestBlock;
+  heap["fragmentation_percent"] = freeHeap > 0 ? 100.0f * (freeHeap - largestBlock) / freeHeap : 0.0f;
+  if (psramFound()) {
+    heap["psram_size"] = ESP.getPsramSize();
+    heap["psram_free"] = ESP.getFreePsram();
+    heap["psram_min_free"] = ESP.getMinFreePsram();
+  }
+
+  JsonObject arena = heap.createNestedObject("request_arena");
+  arena["size"] = REQUEST_ARENA_SIZE;
+  arena["high_water"] = requestArena.highWater;
+  arena["requests"] = requestArena.requests;
+  arena["overflows"] = requestArena.overflows;
+  arena["fallback_bytes"] = requestArena.fallbackBytes;
+
+  // Allocation counts per route hit so far
+  JsonArray allocations = heap.createNestedArray("routes");
+  for (int i = 0; i < routeMetricsCount; i++) {
+    if (routeMetrics[i].latency.count == 0) continue;
+    JsonObject route = allocations.createNestedObject();
+    route["path"] = (const char*)routeMetrics[i].path;
+    route["method"] = methodName(routeMetrics[i].method);
+    route["requests"] = routeMetrics[i].latency.count;
+    route["allocs"] = routeMetrics[i].allocs;
+    route["alloc_bytes"] = (uint32_t)min(routeMetrics[i].allocBytes, (uint64_t)UINT32_MAX);
+  }
+
+  JsonObject config = doc.createNestedObject("config_save");
+  config["nvs_writes"] = configStats.nvsWrites;
+  config["commits"] = configStats.commits;
+  config["pending"] = configDirty;
+  config["generation"] = configGeneration;
+  config["load_source"] = configStats.loadSource;
+  config["load_us"] = configStats.loadUs;
+  config["last_commit_us"] = configStats.lastCommitUs;
+  config["last_configure_us"] = configStats.lastConfigureUs;
+  config["max_configure_us"] = configStats.maxConfigureUs;
+  config["last_bulk_us"] = configStats.lastBulkUs;
+  config["last_bulk_changed"] = configStats.lastBulkChanged;
+
+  addOtaStats(doc.createNestedObject("last_ota"));
+  addBeaconStats(doc.createNestedObject("beacon"));
+  addMdnsStats(doc.createNestedObject("mdns"));
+  addMqttStats(doc.createNestedObject("mqtt"));
+
+  // stack_free is the high-water mark in bytes; cpu_percent is busy time
+  // as accounted by each task over the whole uptime
+  uint64_t uptimeUs = (uint64_t)millis() * 1000;
+
+  addTxCheckStats(doc.createNestedObject("ir_tx_check"));
+
+  JsonObject load = doc.createNestedObject("load");
+  JsonArray idle = load.createNestedArray("idle_percent");
+  idle.add(loadStats.idlePercent[0]);
+  idle.add(loadStats.idlePercent[1]);
+  load["wakeups_per_sec"] = loadStats.wakeupsPerSec;
+  load["window_ms"] = LOAD_SAMPLE_MS;
+
+  JsonArray taskArray = doc.createNestedArray("tasks");
+  for (int i = 0; i < TASK_COUNT; i++) {
+    if (tasks[i].handle == nullptr) continue;
+    JsonObject task = taskArray.createNestedObject();
+    task["name"] = tasks[i].name;
+    task["core"] = tasks[i].core;
+    task["priority"] = tasks[i].priority;
+    task["stack_size"] = tasks[i].stackSize;
+    task["stack_free"] = uxTaskGetStackHighWaterMark(tasks[i].handle);
+    task["busy_ms"] = (uint32_t)(tasks[i].busyUs / 1000);
+    task["cpu_percent"] = uptimeUs > 0 ? (float)(tasks[i].busyUs * 1000 / uptimeUs) / 10.0f : 0.0f;
+    task["wakeups"] = tasks[i].wakeups;
+  }
+
+#ifdef USE_WIFI
+  JsonObject wifi = doc.createNestedObject("wifi");
+  addWifiStats(wifi);
+  addWifiPowerStats(wifi.createNestedObject("power"));
+#endif
+
+  sendJson(200, doc);
+}
+
+// ============ Metrics Export ============
+// Sink for the boot-time cost measurement. Global, and recorded through a call
+// the compiler can't inline, so the measured loop can't be optimized away.
+LatencyHistogram metricsProbe;
+volatile uint32_t metricsProbeStepUs = 37;
+
+static void __attribute__((noinline)) recordLatencyProbe(uint32_t us, bool error) {
+  recordLatency(metricsProbe, us, error);
+}
+
+void initMetrics() {
+  // Measure the recording cost once
+  uint32_t step = metricsProbeStepUs;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < 1000; i++) {
+    recordLatencyProbe(i * step, (i & 7) == 0);
+  }
+  metricsRecordNs = (uint32_t)(esp_timer_get_time() - start);  // 1000 calls: us total == ns each
+}
+
+static char metricsBuffer[1024];
+static size_t metricsLen = 0;
+
+static void metricsFlush() {
+  if (metricsLen == 0) return;
+  server.sendContent(metricsBuffer, metricsLen);
+  metricsLen = 0;
+}
+
+static void metricsPrintf(const char* fmt, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(metricsBuffer + metricsLen, sizeof(metricsBuffer) - metricsLen, fmt, args);
+    va_end(args);
+    if (n >= 0 && metricsLen + n < sizeof(metricsBuffer)) {
+      metricsLen += n;
+      return;
+    }
+    metricsFlush();  // Didn't fit; retry in an empty buffer
+  }
+}
+
+static void writeHistogram(const char* name, const char* labels, const LatencyHistogram& h) {
+  uint32_t cumulative = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    metricsPrintf("%s_bucket{%s,le=\"%.6f\"} %u\n", name, labels, (1UL << (LATENCY_MIN_SHIFT + i)) / 1e6, cumulative);
+  }
+  metricsPrintf("%s_bucket{%s,le=\"+Inf\"} %u\n", name, labels, h.count);
+  metricsPrintf("%s_sum{%s} %.6f\n", name, labels, h.sumUs / 1e6);
+  metricsPrintf("%s_count{%s} %u\n", name, labels, h.count);
+}
+
+void handleMetrics() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  metricsPrintf("# TYPE vda_ir_info gauge\n");
+  metricsPrintf("vda_ir_info{version=\"%s\",board_id=\"%s\"} 1\n", FIRMWARE_VERSION, boardId.c_str());
+  metricsPrintf("# TYPE vda_ir_uptime_seconds counter\n");
+  metricsPrintf("vda_ir_uptime_seconds %lu\n", millis() / 1000);
+  metricsPrintf("# TYPE vda_ir_free_heap_bytes gauge\n");
+  metricsPrintf("vda_ir_free_heap_bytes %u\n", ESP.getFreeHeap());
+  metricsPrintf("# TYPE vda_ir_min_free_heap_bytes gauge\n");
+  metricsPrintf("vda_ir_min_free_heap_bytes %u\n", ESP.getMinFreeHeap());
+  metricsPrintf("# TYPE vda_ir_largest_free_block_bytes gauge\n");
+  metricsPrintf("vda_ir_largest_free_block_bytes %u\n", ESP.getMaxAllocHeap());
+#ifdef USE_WIFI
+  metricsPrintf("# TYPE vda_ir_wifi_rssi_dbm gauge\n");
+  metricsPrintf("vda_ir_wifi_rssi_dbm %d\n", WiFi.RSSI());
+#endif
+  metricsPrintf("# TYPE vda_ir_config_commits_total counter\n");
+  metricsPrintf("vda_ir_config_commits_total %u\n", configStats.commits);
+  metricsPrintf("# TYPE vda_ir_metrics_record_nanoseconds gauge\n");
+  metricsPrintf("vda_ir_metrics_record_nanoseconds %u\n", metricsRecordNs);
+
+  // Routes that have not been hit yet are left out
+  char labels[96];
+  metricsPrintf("# TYPE vda_ir_http_request_duration_seconds histogram\n");
+  for (int i = 0; i < routeMetricsCount; i++) {
+    if (routeMetrics[i].latency.count == 0) continue;
+    snprintf(labels, sizeof(labels), "path=\"%s\",method=\"%s\"", routeMetrics[i].path, methodName(routeMetrics[i].method));
+    writeHistogram("vda_ir_http_request_duration_seconds", labels, routeMetrics[i].latency);
+  }
+  metricsPrintf("# TYPE vda_ir_http_request_errors_total counter\n");
+  for (int i = 0; i < routeMetricsCount; i++) {
+    if (routeMetrics[i].latency.count == 0) continue;
+    metricsPrintf("vda_ir_http_request_errors_total{path=\"%s\",method=\"%s\"} %u\n",
+                  routeMetrics[i].path, methodName(routeMetrics[i].method), routeMetrics[i].latency.errors);
+  }
+
+  metricsPrintf("# TYPE vda_ir_operation_duration_seconds histogram\n");
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "op=\"%s\"", METRIC_NAMES[i]);
+    writeHistogram("vda_ir_operation_duration_seconds", labels, opMetrics[i]);
+  }
+  metricsPrintf("# TYPE vda_ir_operation_errors_total counter\n");
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    metricsPrintf("vda_ir_operation_errors_total{op=\"%s\"} %u\n", METRIC_NAMES[i], opMetrics[i].errors);
+  }
+
+#ifdef USE_WIFI
+  // Per WiFi power profile, for profiles that have been used
+  metricsPrintf("# TYPE vda_ir_wifi_request_duration_seconds histogram\n");
+  for (int i = 0; i < WIFI_POWER_PROFILES; i++) {
+    if (wifiPowerStats[i].requests.count == 0) continue;
+    snprintf(labels, sizeof(labels), "profile=\"%s\"", WIFI_POWER_SETTINGS[i].name);
+    writeHistogram("vda_ir_wifi_request_duration_seconds", labels, wifiPowerStats[i].requests);
+  }
+  metricsPrintf("# TYPE vda_ir_wifi_probe_duration_seconds histogram\n");
+  for (int i = 0; i < WIFI_POWER_PROFILES; i++) {
+    if (wifiPowerStats[i].probe.count == 0) continue;
+    snprintf(labels, sizeof(labels), "profile=\"%s\"", WIFI_POWER_SETTINGS[i].name);
+    writeHistogram("vda_ir_wifi_probe_duration_seconds", labels, wifiPowerStats[i].probe);
+  }
+#endif
+
+  metricsFlush();
+  server.sendContent("");
+}
+
+void handlePorts() {
+  RequestJsonDocument doc(4096);  // Increased for 22+ ports
+
+  doc["total_ports"] = portCount;
+  JsonArray portsArray = doc.createNestedArray("ports");
+
+  for (int i = 0; i < portCount; i++) {
+    JsonObject port = portsArray.createNestedObject();
+    port["port"] = ports[i].gpio;
+    port["gpio"] = ports[i].gpio;
+    port["mode"] = portModeName(ports[i].mode);
+    port["name"] = (const char*)ports[i].name;
+    port["gpio_name"] = "GPIO" + String(ports[i].gpio);
+    port["can_input"] = (ports[i].caps & PORT_CAP_INPUT) != 0;
+    port["can_output"] = (ports[i].caps & PORT_CAP_OUTPUT) != 0;
+  }
 
-    <div id="networks-container">
-      <div class="scanning">
-        <div class="spinner"></div>
-        Scanning for networks...
-      </div>
-    </div>
+  sendJson(200, doc);
+}
 
-    <form id="wifi-form" style="display:none;">
-      <div class="form-group">
-        <label>WiFi Network</label>
-        <select id="ssid" name="ssid" required>
-          <option value="">Select a network...</option>
-        </select>
-      </div>
+void handleConfigurePort() {
+  unsigned long start = micros();
 
-      <div class="form-group">
-        <label>Password</label>
-        <div class="password-container">
-          <input type="password" id="password" name="password" placeholder="Enter WiFi password">
-          <button type="button" class="toggle-password" onclick="togglePassword()">Show</button>
-        </div>
-      </div>
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
 
-      <button type="submit" id="connect-btn">Connect</button>
-    </form>
-  </div>
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
 
-  <script>
-    let networks = [];
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
 
-    async function scanNetworks() {
-      try {
-        const response = await fetch('/wifi/scan');
-        const data = await response.json();
-        networks = data.networks || [];
-        displayNetworks();
-      } catch (error) {
-        document.getElementById('networks-container').innerHTML =
-          '<div class="error">Failed to scan networks. Please refresh the page.</div>';
-      }
-    }
+  int gpio = doc["port"] | -1;
+  int mode = parsePortMode(doc["mode"] | "");
+  const char* name = doc["name"] | "";
 
-    function displayNetworks() {
-      const container = document.getElementById('networks-container');
-      const form = document.getElementById('wifi-form');
-      const select = document.getElementById('ssid');
+  int portIndex = portForGpio(gpio);
+  if (portIndex == -1) {
+    server.send(400, "application/json", "{\"error\":\"Invalid GPIO\"}");
+    return;
+  }
 
-      if (networks.length === 0) {
-        container.innerHTML = '<div class="error">No networks found. Please try again.</div>' +
-          '<button class="refresh-btn" onclick="scanNetworks()">🔄 Scan Again</button>';
-        return;
-      }
+  if (mode < 0) {
+    server.send(400, "application/json", "{\"error\":\"Invalid mode\"}");
+    return;
+  }
 
-      container.innerHTML = '<button class="refresh-btn" onclick="scanNetworks()">🔄 Scan Again</button>';
+  if (strlen(name) > PORT_NAME_MAX_LEN) {
+    server.send(400, "application/json", "{\"error\":\"name too long (max 32)\"}");
+    return;
+  }
 
-      select.innerHTML = '<option value="">Select a network...</option>';
-      networks.forEach(net => {
-        const signal = net.rssi > -50 ? '▓▓▓▓' : net.rssi > -70 ? '▓▓▓░' : net.rssi > -80 ? '▓▓░░' : '▓░░░';
-        const option = document.createElement('option');
-        option.value = net.ssid;
-        option.textContent = net.ssid + ' ' + signal + (net.secure ? ' 🔒' : '');
-        select.appendChild(option);
-      });
+  // Check if trying to set output on input-only pin
+  if (mode == PORT_IR_OUTPUT && !(ports[portIndex].caps & PORT_CAP_OUTPUT)) {
+    server.send(400, "application/json", "{\"error\":\"GPIO is input-only\"}");
+    return;
+  }
 
-      form.style.display = 'block';
+  // Update port config
+  if (ports[portIndex].mode != mode || strcmp(ports[portIndex].name, name) != 0) {
+    ports[portIndex].mode = (PortMode)mode;
+    strlcpy(ports[portIndex].name, name, sizeof(ports[portIndex].name));
+    markConfigDirty();
+  }
+
+  // Reinitialize port
+  if (mode == PORT_IR_OUTPUT) {
+    initIRSender(portIndex);
+  } else if (mode == PORT_IR_INPUT) {
+    initIRReceiver(gpio);
+  }
+
+  // Config is committed by serviceConfigSave() once changes settle
+
+  StaticJsonDocument<256> response;
+  response["success"] = true;
+  response["port"] = gpio;
+  response["mode"] = portModeName((PortMode)mode);
+  response["name"] = name;
+
+  sendJson(200, response);
+
+  configStats.lastConfigureUs = micros() - start;
+  if (configStats.lastConfigureUs > configStats.maxConfigureUs) {
+    configStats.maxConfigureUs = configStats.lastConfigureUs;
+  }
+}
+
+// Apply a full port map in one request. Every entry is validated before
+// anything is touched, only ports whose mode or name differ are
+// re-initialized, and the result is committed with a single blob write.
+void handleConfigurePortsBulk() {
+  unsigned long start = micros();
+
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  RequestJsonDocument doc(4096);
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  JsonArray entries = doc["ports"];
+  if (entries.isNull() || entries.size() > (size_t)portCount) {
+    server.send(400, "application/json", "{\"error\":\"ports must be an array of at most one entry per port\"}");
+    return;
+  }
+
+  // Ports left out of the map keep their current config, or are disabled
+  // when "replace" is set
+  static PortPlan plan;
+  beginPortPlan(plan, doc["replace"] | false);
+
+  for (JsonObject entry : entries) {
+    int gpio = entry["port"] | -1;
+    const char* problem = addPortPlanEntry(plan, gpio, entry["mode"] | "", entry["name"] | "");
+    if (problem) {
+      StaticJsonDocument<128> err;
+      err["error"] = problem;
+      err["index"] = plan.received;
+      err["port"] = gpio;
+      sendJson(400, err);
+      return;
     }
+  }
 
-    function togglePassword() {
-      const input = document.getElementById('password');
-      const btn = document.querySelector('.toggle-password');
-      if (input.type === 'password') {
-        input.type = 'text';
-        btn.textContent = 'Hide';
-      } else {
-        input.type = 'password';
-        btn.textContent = 'Show';
-      }
+  // Diff against the current table and re-initialize only what changed
+  int changed = applyPortPlan(plan);
+
+  uint32_t commitUs = 0;
+  if (changed > 0) {
+    markConfigDirty();
+    saveConfig();
+    commitUs = configStats.lastCommitUs;
+  }
+
+  configStats.lastBulkUs = micros() - start;
+  configStats.lastBulkChanged = changed;
+
+  StaticJsonDocument<192> response;
+  response["success"] = true;
+  response["received"] = plan.received;
+  response["changed"] = changed;
+  response["unchanged"] = portCount - changed;
+  response["commit_us"] = commitUs;
+  response["elapsed_us"] = configStats.lastBulkUs;
+
+  sendJson(200, response);
+}
+
+void handleAdopt() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  const char* newBoardId;
+  const char* newBoardName;
+  const char* problem = checkAdoptRequest(doc.as<JsonObjectConst>(), newBoardId, newBoardName);
+  if (problem) {
+    sendJsonError(400, problem);
+    return;
+  }
+
+  boardId = newBoardId;
+  boardName = newBoardName[0] ? newBoardName : newBoardId;
+  adopted = true;
+
+  markConfigDirty();
+  saveConfig();
+
+  renameMdnsHost();
+
+  StaticJsonDocument<128> response;
+  response["success"] = true;
+  response["board_id"] = boardId;
+
+  sendJson(200, response);
+
+  Serial.printf("Board adopted as: %s (%s)\n", boardId.c_str(), boardName.c_str());
+}
+
+static void IRAM_ATTR txCaptureEdge(void* arg) {
+  txCaptureAddEdge(txCapture, micros());
+}
+
+// Install the GPIO ISR service from core 0 so capture interrupts (and the
+// receiver's) don't land on core 1 in the middle of a bit-banged carrier.
+// Arduino's attachInterrupt() accepts an already installed service.
+static void installIsrService(void* arg) {
+  gpio_install_isr_service(0);
+}
+
+void initTxCheck() {
+  esp_ipc_call_blocking(0, installIsrService, nullptr);
+}
+
+void startTxCapture(uint8_t gpio) {
+  memset(&txCapture, 0, sizeof(txCapture));
+  txCapture.startUs = micros();
+  gpio_set_direction((gpio_num_t)gpio, GPIO_MODE_INPUT_OUTPUT);
+  attachInterruptArg(gpio, txCaptureEdge, nullptr, CHANGE);
+}
+
+void finishTxCapture(const IrTxJob& job) {
+  detachInterrupt(job.gpio);
+  gpio_set_direction((gpio_num_t)job.gpio, GPIO_MODE_OUTPUT);
+  recordTxFrame(job, txCapture);
+}
+
+// Runs on the IR transmit task with irMutex held. Returns false if the job
+// could not be sent.
+bool transmitIrJob(const IrTxJob& job) {
+  IRsend* sender = irSenders[job.portIndex];
+
+  if (job.kind == IR_TX_TEST) {
+    // Send test pattern (simple carrier burst) for durationMs
+    pinMode(job.gpio, OUTPUT);
+    uint32_t start = micros();
+    while (micros() - start < job.durationMs * 1000) {
+      digitalWrite(job.gpio, HIGH);
+      delayMicroseconds(13);
+      digitalWrite(job.gpio, LOW);
+      delayMicroseconds(13);
     }
+    Serial.printf("Test signal sent on GPIO%d for %ums\n", job.gpio, job.durationMs);
+    return true;
+  }
 
-    document.getElementById('wifi-form').addEventListener('submit', async (e) => {
-      e.preventDefault();
-      const btn = document.getElementById('connect-btn');
-      const ssid = document.getElementById('ssid').value;
-      const password = document.getElementById('password').value;
+  if (sender == nullptr) {
+    Serial.printf("IR send skipped: GPIO%d no longer configured\n", job.gpio);
+    return false;
+  }
 
-      if (!ssid) {
-        alert('Please select a network');
-        return;
-      }
+  sendIrJob(*sender, job);
+  Serial.printf("Sent IR code 0x%llX via GPIO%d\n", job.code, job.gpio);
+  return true;
+}
 
-      btn.disabled = true;
-      btn.textContent = 'Connecting...';
+static void sendIrTxResult(int status) {
+  server.send(status, "application/json", irTxResultJson(status));
+}
 
-      try {
-        const response = await fetch('/wifi/config', {
-          method: 'POST',
-          headers: { 'Content-Type': 'application/json' },
-          body: JSON.stringify({ ssid, password })
-        });
+// Validate a send_ir body and transmit it. Returns the HTTP status to report;
+// for a 400, error is the message. Shared by POST /send_ir and MQTT commands.
+static int sendIrRequest(JsonObjectConst body, const char*& error) {
+  SendIrRequest request;
+  error = checkSendIrRequest(body, request);
+  if (error == nullptr && irSenders[request.portIndex] == nullptr) {
+    error = "Invalid output or not configured";
+  }
+  if (error) {
+    return 400;
+  }
 
-        const data = await response.json();
+  if (!claimIrTx()) {
+    return 503;
+  }
+  fillIrTxJob(request, irTxJob);
 
-        if (data.success) {
-          document.querySelector('.container').innerHTML = `
-            <div class="logo">
-              <h1>✅ WiFi Configured!</h1>
-              <p>The device is restarting...</p>
-            </div>
-            <div style="text-align:center; color:#666; margin-top:20px;">
-              <p>The device will connect to <strong>${ssid}</strong></p>
-              <p style="margin-top:12px;">You can close this page and find the device on your network.</p>
-              <p style="margin-top:12px; font-size:12px;">Look for it at: <code>vda-ir-XXXXXX.local</code></p>
-            </div>
-          `;
-        } else {
-          throw new Error(data.error || 'Configuration failed');
-        }
-      } catch (error) {
-        btn.disabled = false;
-        btn.textContent = 'Connect';
-        alert('Failed to configure WiFi: ' + error.message);
-      }
-    });
+  return runIrTxJob();
+}
 
-    // Start scanning on page load
-    scanNetworks();
-  </script>
-</body>
-</html>
-)rawliteral";
+void handleSendIR() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  RequestJsonDocument doc(SEND_IR_JSON_SIZE);
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  const char* message = nullptr;
+  int status = sendIrRequest(doc.as<JsonObjectConst>(), message);
+  if (status == 400) {
+    sendJsonError(400, message);
+    return;
+  }
+  sendIrTxResult(status);
+}
+
+void handleTestOutput() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
 
-  return html;
+  int portIndex;
+  uint32_t duration;
+  const char* problem = checkTestOutputRequest(doc.as<JsonObjectConst>(), portIndex, duration);
+  if (problem) {
+    sendJsonError(400, problem);
+    return;
+  }
+
+  if (!claimIrTx()) {
+    sendIrTxResult(503);
+    return;
+  }
+  irTxJob.kind = IR_TX_TEST;
+  irTxJob.portIndex = portIndex;
+  irTxJob.gpio = ports[portIndex].gpio;
+  irTxJob.code = 0;
+  irTxJob.frequency = 38000;
+  irTxJob.durationMs = duration;
+  irTxJob.rawLen = 0;
+
+  sendIrTxResult(runIrTxJob());
 }
 
-void handleWiFiConfig() {
-  if (!server.hasArg("plain")) {
+// Enable or disable capture of transmitted frames; "reset" clears the stats
+void handleTxCheck() {
+  if (!server.hasBody()) {
     server.send(400, "application/json", "{\"error\":\"No body\"}");
     return;
   }
 
-  StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, server.arg("plain"));
-
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
   if (error) {
     server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
     return;
   }
 
-  String newSSID = doc["ssid"] | "";
-  String newPassword = doc["password"] | "";
+  bool reset = doc["reset"] | false;
 
-  if (newSSID.length() == 0) {
-    server.send(400, "application/json", "{\"error\":\"SSID required\"}");
+  // The transmit task reads these under irMutex
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  if (reset) {
+    bool enabled = txCheck.enabled;
+    txCheck = TxCheckStats();
+    txCheck.enabled = enabled;
+  }
+  txCheck.enabled = doc["enabled"] | txCheck.enabled;
+  if (reset) memset(txTiming, 0, sizeof(txTiming));
+  xSemaphoreGive(irMutex);
+
+  RequestJsonDocument response(2048);
+  addTxCheckStats(response.to<JsonObject>());
+
+  sendJson(200, response);
+}
+
+void handleLearningStart() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
     return;
   }
 
-  wifiSSID = newSSID;
-  wifiPassword = newPassword;
-  wifiConfigured = true;
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
 
-  // Save to preferences
-  preferences.begin("vda-ir", false);
-  preferences.putString("wifiSSID", wifiSSID);
-  preferences.putString("wifiPass", wifiPassword);
-  preferences.putBool("wifiConf", true);
-  preferences.end();
+  int port;
+  const char* problem = checkLearningRequest(doc.as<JsonObjectConst>(), port);
+  if (problem) {
+    sendJsonError(400, problem);
+    return;
+  }
+
+  // Initialize receiver on specified port
+  initIRReceiver(port);
 
   StaticJsonDocument<128> response;
   response["success"] = true;
-  response["message"] = "WiFi configured. Rebooting...";
-
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  response["port"] = port;
 
-  Serial.println("WiFi configured. Rebooting...");
-  setLedState(LED_BLINK_SLOW);
-  delay(1000);
-  ESP.restart();
-}
+  sendJson(200, response);
 
-void handleCaptivePortal() {
-  // Serve the setup page for captive portal detection URLs
-  server.send(200, "text/html", generateSetupPage());
+  Serial.printf("Learning mode started on GPIO%d\n", port);
 }
 
-#endif
+void handleLearningStop() {
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  if (irReceiver != nullptr) {
+    irReceiver->disableIRIn();
+  }
+  activeReceiverPort = -1;
+  learnedCode.available = false;
+  xSemaphoreGive(irMutex);
 
-// ============ Configuration ============
-void loadConfig() {
-  preferences.begin("vda-ir", true);
+  server.send(200, "application/json", "{\"success\":true}");
+  Serial.println("Learning mode stopped");
+}
 
-  boardId = preferences.getString("boardId", "");
-  boardName = preferences.getString("boardName", "VDA IR Controller");
-  adopted = preferences.getBool("adopted", false);
-  portCount = preferences.getInt("portCount", 0);
+void handleLearningStatus() {
+  StaticJsonDocument<512> doc;
 
-#ifdef USE_WIFI
-  wifiSSID = preferences.getString("wifiSSID", "");
-  wifiPassword = preferences.getString("wifiPass", "");
-  wifiConfigured = preferences.getBool("wifiConf", false);
-#endif
+  // Take the code captured by the receive task, if any
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  LearnedCode code = learnedCode;
+  learnedCode.available = false;
+  int port = activeReceiverPort;
+  xSemaphoreGive(irMutex);
 
-  // Generate default board ID if not set
-  if (boardId.length() == 0) {
-    boardId = "vda-ir-" + String((uint32_t)ESP.getEfuseMac(), HEX);
-  }
+  doc["active"] = (port >= 0);
+  doc["port"] = port;
 
-  // Load port configurations
-  for (int i = 0; i < portCount && i < MAX_PORTS; i++) {
-    String key = "port" + String(i);
-    ports[i].gpio = preferences.getInt((key + "_gpio").c_str(), 0);
-    ports[i].mode = preferences.getString((key + "_mode").c_str(), "disabled");
-    ports[i].name = preferences.getString((key + "_name").c_str(), "");
+  if (code.available) {
+    JsonObject receivedCode = doc.createNestedObject("received_code");
+    receivedCode["protocol"] = typeToString(code.protocol);
+    receivedCode["code"] = "0x" + uint64ToString(code.value, HEX);
+    receivedCode["bits"] = code.bits;
   }
 
-  // If no ports configured, set up defaults
-  if (portCount == 0) {
-    // Add all available GPIO pins as disabled by default
-    for (int i = 0; i < OUTPUT_CAPABLE_COUNT && portCount < MAX_PORTS; i++) {
-      ports[portCount].gpio = OUTPUT_CAPABLE_PINS[i];
-      ports[portCount].mode = "disabled";
-      ports[portCount].name = "";
-      portCount++;
-    }
-    for (int i = 0; i < INPUT_ONLY_COUNT && portCount < MAX_PORTS; i++) {
-      ports[portCount].gpio = INPUT_ONLY_PINS[i];
-      ports[portCount].mode = "disabled";
-      ports[portCount].name = "";
-      portCount++;
-    }
-  } else {
-    // Check if there are more available pins than saved portCount
-    // This handles firmware updates that add new pins
-    int expectedCount = OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT;
-    if (portCount < expectedCount) {
-      Serial.printf("Expanding ports from %d to %d\n", portCount, expectedCount);
-      // Add any missing output-capable pins
-      for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
-        int gpio = OUTPUT_CAPABLE_PINS[i];
-        bool found = false;
-        for (int j = 0; j < portCount; j++) {
-          if (ports[j].gpio == gpio) { found = true; break; }
-        }
-        if (!found && portCount < MAX_PORTS) {
-          ports[portCount].gpio = gpio;
-          ports[portCount].mode = "disabled";
-          ports[portCount].name = "";
-          portCount++;
-        }
-      }
-      // Add any missing input-only pins
-      for (int i = 0; i < INPUT_ONLY_COUNT; i++) {
-        int gpio = INPUT_ONLY_PINS[i];
-        bool found = false;
-        for (int j = 0; j < portCount; j++) {
-          if (ports[j].gpio == gpio) { found = true; break; }
-        }
-        if (!found && portCount < MAX_PORTS) {
-          ports[portCount].gpio = gpio;
-          ports[portCount].mode = "disabled";
-          ports[portCount].name = "";
-          portCount++;
-        }
-      }
-      // Save the expanded config
-      preferences.end();
-      saveConfig();
-      preferences.begin("vda-ir", true);
-    }
-  }
+  sendJson(200, doc);
+}
 
-  preferences.end();
+// ============ Payload Encoding ============
+// Codecs for hex and base64 payloads are in payload_codec.h
 
-  Serial.printf("Loaded config: boardId=%s, ports=%d\n", boardId.c_str(), portCount);
+static const char* serialLineEnding(const String& lineEnding) {
+  if (lineEnding == "cr") return "\r";
+  if (lineEnding == "lf") return "\n";
+  if (lineEnding == "crlf") return "\r\n";
+  if (lineEnding == "!") return "!";
+  return "";
 }
 
-void saveConfig() {
-  preferences.begin("vda-ir", false);
+// ============ Self-Test ============
+// On-device checks and micro-benchmarks for the logic handlers rely on:
+// payload codecs against RFC 4648 vectors and random round trips, JSON parse
+// cost for representative request bodies, and the config blob CRC. Runs in
+// the net task using the request arena and finishes well within a second.
+#define SELFTEST_ROUNDTRIPS 64
+#define SELFTEST_MAX_PAYLOAD 256
+#define SELFTEST_PARSE_ITERATIONS 20
+
+struct CodecVector {
+  const char* plain;
+  const char* base64;
+  const char* hex;
+};
 
-  preferences.putString("boardId", boardId);
-  preferences.putString("boardName", boardName);
-  preferences.putBool("adopted", adopted);
-  preferences.putInt("portCount", portCount);
+static const CodecVector CODEC_VECTORS[] = {
+  {"", "", ""},
+  {"f", "Zg==", "66"},
+  {"fo", "Zm8=", "666F"},
+  {"foo", "Zm9v", "666F6F"},
+  {"foob", "Zm9vYg==", "666F6F62"},
+  {"fooba", "Zm9vYmE=", "666F6F6261"},
+  {"foobar", "Zm9vYmFy", "666F6F626172"},
+};
 
-  for (int i = 0; i < portCount; i++) {
-    String key = "port" + String(i);
-    preferences.putInt((key + "_gpio").c_str(), ports[i].gpio);
-    preferences.putString((key + "_mode").c_str(), ports[i].mode);
-    preferences.putString((key + "_name").c_str(), ports[i].name);
-  }
+// Inputs each decoder must reject
+static const char* const HEX_INVALID[] = {"6", "GG", "6 6"};
+static const char* const BASE64_INVALID[] = {"Zm9v!", "Zm 9v", "Zm9v\n", "Zg=x", "Zg=", "Zm9vY", "Zh==", "Zm9=", "===="};
 
-  preferences.end();
-  Serial.println("Configuration saved");
-}
+struct CodecResult {
+  uint32_t checks;
+  uint32_t failures;
+  uint32_t encodeNs[2];  // Per byte, hex then base64
+  uint32_t decodeNs[2];
+};
 
-// ============ Port Initialization ============
-void initPorts() {
-  for (int i = 0; i < portCount; i++) {
-    if (ports[i].mode == "ir_output") {
-      initIRSender(i);
-    } else if (ports[i].mode == "ir_input") {
-      initIRReceiver(ports[i].gpio);
-    }
-  }
+static bool checkCodecVector(const CodecVector& v, char* text, uint8_t* bytes) {
+  size_t len = strlen(v.plain);
+  bool ok = encodeHex((const uint8_t*)v.plain, len, text) == strlen(v.hex) && strcmp(text, v.hex) == 0;
+  ok = ok && encodeBase64((const uint8_t*)v.plain, len, text) == strlen(v.base64) && strcmp(text, v.base64) == 0;
+  ok = ok && decodeHex(v.hex, strlen(v.hex), bytes) == (int)len && memcmp(bytes, v.plain, len) == 0;
+  ok = ok && decodeBase64(v.base64, strlen(v.base64), bytes) == (int)len && memcmp(bytes, v.plain, len) == 0;
+  return ok;
 }
 
-void initIRSender(int portIndex) {
-  if (irSenders[portIndex] != nullptr) {
-    delete irSenders[portIndex];
+static void runCodecChecks(CodecResult& r, char* text, uint8_t* plain, uint8_t* decoded) {
+  for (size_t i = 0; i < sizeof(CODEC_VECTORS) / sizeof(CODEC_VECTORS[0]); i++) {
+    r.checks++;
+    if (!checkCodecVector(CODEC_VECTORS[i], text, decoded)) r.failures++;
   }
-  irSenders[portIndex] = new IRsend(ports[portIndex].gpio);
-  irSenders[portIndex]->begin();
-  Serial.printf("IR Sender initialized on GPIO%d\n", ports[portIndex].gpio);
-}
-
-void initIRReceiver(int gpio) {
-  if (irReceiver != nullptr) {
-    delete irReceiver;
+  for (size_t i = 0; i < sizeof(HEX_INVALID) / sizeof(HEX_INVALID[0]); i++) {
+    r.checks++;
+    if (decodeHex(HEX_INVALID[i], strlen(HEX_INVALID[i]), decoded) >= 0) r.failures++;
+  }
+  for (size_t i = 0; i < sizeof(BASE64_INVALID) / sizeof(BASE64_INVALID[0]); i++) {
+    r.checks++;
+    if (decodeBase64(BASE64_INVALID[i], strlen(BASE64_INVALID[i]), decoded) >= 0) r.failures++;
   }
-  irReceiver = new IRrecv(gpio);
-  irReceiver->enableIRIn();
-  activeReceiverPort = gpio;
-  Serial.printf("IR Receiver initialized on GPIO%d\n", gpio);
-}
-
-// ============ Web Server Setup ============
-void setupWebServer() {
-  // Root handler - serve setup page in AP mode, info otherwise
-  server.on("/", HTTP_GET, handleRoot);
-
-  // API endpoints
-  server.on("/info", HTTP_GET, handleInfo);
-  server.on("/status", HTTP_GET, handleStatus);
-  server.on("/ports", HTTP_GET, handlePorts);
-  server.on("/ports/configure", HTTP_POST, handleConfigurePort);
-  server.on("/adopt", HTTP_POST, handleAdopt);
-  server.on("/reboot", HTTP_POST, []() {
-    server.send(200, "application/json", "{\"success\":true,\"message\":\"Rebooting...\"}");
-    delay(500);
-    ESP.restart();
-  });
-  server.on("/send_ir", HTTP_POST, handleSendIR);
-  server.on("/test_output", HTTP_POST, handleTestOutput);
-  server.on("/learning/start", HTTP_POST, handleLearningStart);
-  server.on("/learning/stop", HTTP_POST, handleLearningStop);
-  server.on("/learning/status", HTTP_GET, handleLearningStatus);
 
-  // Serial bridge endpoints
-  server.on("/serial/config", HTTP_POST, handleSerialConfig);
-  server.on("/serial/send", HTTP_POST, handleSerialSend);
-  server.on("/serial/read", HTTP_GET, handleSerialRead);
-  server.on("/serial/status", HTTP_GET, handleSerialStatus);
+  // Random round trips, timed
+  uint32_t bytes = 0, encodeUs[2] = {0, 0}, decodeUs[2] = {0, 0};
+  for (int i = 0; i < SELFTEST_ROUNDTRIPS; i++) {
+    size_t len = 1 + esp_random() % SELFTEST_MAX_PAYLOAD;
+    esp_fill_random(plain, len);
+    bytes += len;
 
-  // OTA Update routes (available for both WiFi and Ethernet)
-  server.on("/update", HTTP_GET, handleOTAPage);
-  server.on("/update", HTTP_POST, handleOTAComplete, handleOTAUpload);
+    for (int format = 0; format < 2; format++) {
+      unsigned long start = micros();
+      size_t textLen = format == 0 ? encodeHex(plain, len, text) : encodeBase64(plain, len, text);
+      encodeUs[format] += micros() - start;
 
-#ifdef USE_WIFI
-  server.on("/wifi/config", HTTP_POST, handleWiFiConfig);
-  server.on("/wifi/scan", HTTP_GET, []() {
-    Serial.println("Scanning WiFi networks...");
-    int n = WiFi.scanNetworks();
-    Serial.printf("Found %d networks\n", n);
+      start = micros();
+      int decodedLen = format == 0 ? decodeHex(text, textLen, decoded) : decodeBase64(text, textLen, decoded);
+      decodeUs[format] += micros() - start;
 
-    StaticJsonDocument<2048> doc;
-    JsonArray networks = doc.createNestedArray("networks");
-    for (int i = 0; i < n && i < 20; i++) {
-      JsonObject net = networks.createNestedObject();
-      net["ssid"] = WiFi.SSID(i);
-      net["rssi"] = WiFi.RSSI(i);
-      net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
+      r.checks++;
+      if (decodedLen != (int)len || memcmp(decoded, plain, len) != 0) r.failures++;
     }
-    String response;
-    serializeJson(doc, response);
-    server.send(200, "application/json", response);
-  });
-
-  // Captive portal detection endpoints
-  server.on("/generate_204", HTTP_GET, handleCaptivePortal);  // Android
-  server.on("/gen_204", HTTP_GET, handleCaptivePortal);        // Android
-  server.on("/hotspot-detect.html", HTTP_GET, handleCaptivePortal);  // Apple
-  server.on("/library/test/success.html", HTTP_GET, handleCaptivePortal);  // Apple
-  server.on("/ncsi.txt", HTTP_GET, handleCaptivePortal);       // Windows
-  server.on("/connecttest.txt", HTTP_GET, handleCaptivePortal); // Windows
-  server.on("/fwlink", HTTP_GET, handleCaptivePortal);         // Windows
-#endif
-
-  server.onNotFound(handleNotFound);
-
-  server.enableCORS(true);
-  server.begin();
-  Serial.println("HTTP server started on port 80");
-}
+  }
 
-// ============ OTA Update Handlers ============
-void handleOTAPage() {
-  String html = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-  <meta name="viewport" content="width=device-width, initial-scale=1">
-  <title>Firmware Update</title>
-  <style>
-    body { font-family: Arial, sans-serif; margin: 40px; background: #1a1a2e; color: #eee; }
-    .container { max-width: 500px; margin: 0 auto; background: #16213e; padding: 30px; border-radius: 10px; }
-    h1 { color: #e94560; margin-top: 0; }
-    form { margin-top: 20px; }
-    input[type="file"] { margin: 15px 0; color: #eee; }
-    input[type="submit"] { background: #e94560; color: white; border: none; padding: 12px 30px; border-radius: 5px; cursor: pointer; font-size: 16px; }
-    input[type="submit"]:hover { background: #ff6b6b; }
-    .info { background: #0f3460; padding: 15px; border-radius: 5px; margin-bottom: 20px; }
-    .warning { background: #614a19; padding: 10px; border-radius: 5px; margin-top: 15px; font-size: 14px; }
-    #progress { display: none; margin-top: 20px; }
-    .progress-bar { background: #0f3460; border-radius: 5px; height: 30px; overflow: hidden; }
-    .progress-fill { background: #e94560; height: 100%; width: 0%; transition: width 0.3s; }
-    .progress-text { text-align: center; margin-top: 10px; }
-  </style>
-</head>
-<body>
-  <div class="container">
-    <h1>Firmware Update</h1>
-    <div class="info">
-      <strong>Current Version:</strong> )rawliteral" + String(FIRMWARE_VERSION) + R"rawliteral(<br>
-      <strong>Device:</strong> )rawliteral" + boardName + R"rawliteral(
-    </div>
-    <form method="POST" action="/update" enctype="multipart/form-data" id="uploadForm">
-      <div>Select firmware file (.bin):</div>
-      <input type="file" name="firmware" accept=".bin" required>
-      <br>
-      <input type="submit" value="Upload & Update">
-    </form>
-    <div class="warning">
-      ⚠️ Do not disconnect power during update. Settings will be preserved.
-    </div>
-    <div id="progress">
-      <div class="progress-bar"><div class="progress-fill" id="progressFill"></div></div>
-      <div class="progress-text" id="progressText">Uploading... 0%</div>
-    </div>
-  </div>
-  <script>
-    document.getElementById('uploadForm').addEventListener('submit', function(e) {
-      e.preventDefault();
-      var form = e.target;
-      var formData = new FormData(form);
-      var xhr = new XMLHttpRequest();
-      document.getElementById('progress').style.display = 'block';
-      xhr.upload.addEventListener('progress', function(e) {
-        if (e.lengthComputable) {
-          var pct = Math.round((e.loaded / e.total) * 100);
-          document.getElementById('progressFill').style.width = pct + '%';
-          document.getElementById('progressText').textContent = 'Uploading... ' + pct + '%';
-        }
-      });
-      xhr.addEventListener('load', function() {
-        if (xhr.status === 200) {
-          document.getElementById('progressText').textContent = 'Update complete! Rebooting...';
-          setTimeout(function() { location.reload(); }, 5000);
-        } else {
-          document.getElementById('progressText').textContent = 'Update failed: ' + xhr.responseText;
-        }
-      });
-      xhr.addEventListener('error', function() {
-        document.getElementById('progressText').textContent = 'Upload failed. Please try again.';
-      });
-      xhr.open('POST', '/update');
-      xhr.send(formData);
-    });
-  </script>
-</body>
-</html>
-)rawliteral";
-  server.send(200, "text/html", html);
+  for (int format = 0; format < 2; format++) {
+    r.encodeNs[format] = (uint64_t)encodeUs[format] * 1000 / bytes;
+    r.decodeNs[format] = (uint64_t)decodeUs[format] * 1000 / bytes;
+  }
 }
 
-void handleOTAUpload() {
-  HTTPUpload& upload = server.upload();
+// Returns false if the buffers couldn't be allocated
+static bool runCodecSelfTest(CodecResult& r) {
+  memset(&r, 0, sizeof(r));
+  char* text = (char*)arenaAlloc(SELFTEST_MAX_PAYLOAD * 2 + 1);
+  uint8_t* plain = (uint8_t*)arenaAlloc(SELFTEST_MAX_PAYLOAD);
+  uint8_t* decoded = (uint8_t*)arenaAlloc(SELFTEST_MAX_PAYLOAD);
+  bool allocated = text != nullptr && plain != nullptr && decoded != nullptr;
+  if (allocated) runCodecChecks(r, text, plain, decoded);
+
+  // Latest first, so arena blocks are handed straight back
+  arenaFree(decoded);
+  arenaFree(plain);
+  arenaFree(text);
+  return allocated;
+}
 
-  if (upload.status == UPLOAD_FILE_START) {
-    Serial.printf("OTA Update Start: %s\n", upload.filename.c_str());
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-      Update.printError(Serial);
-    }
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-      Update.printError(Serial);
-    }
-  } else if (upload.status == UPLOAD_FILE_END) {
-    if (Update.end(true)) {
-      Serial.printf("OTA Update Success: %u bytes\n", upload.totalSize);
-    } else {
-      Update.printError(Serial);
-    }
+// Fleet beacon packets: a golden status packet that tools/fleet_beacon.py
+// encodes identically, a round trip of this board's status, and packets the
+// decoder must reject
+#define BEACON_GOLDEN_CRC 0x1D0C64EB
+
+struct BeaconResult {
+  uint32_t checks;
+  uint32_t failures;
+  uint32_t encodeNs;
+  uint32_t decodeNs;
+};
+
+static void runBeaconChecks(BeaconResult& r, BeaconStatus* status, BeaconStatus* decoded) {
+  memset(status, 0, sizeof(*status));
+  const uint8_t mac[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+  memcpy(status->mac, mac, sizeof(mac));
+  status->flags = BEACON_FLAG_ADOPTED | BEACON_FLAG_ETHERNET;
+  status->resetReason = 1;
+  strlcpy(status->boardId, "vda-ir-golden", sizeof(status->boardId));
+  strlcpy(status->firmware, "1.0.0", sizeof(status->firmware));
+  status->configGeneration = 42;
+  status->uptimeS = 3600;
+  status->outputMask = (1ULL << 4) | (1ULL << 5);
+  status->inputMask = 1ULL << 36;
+  status->portCount = 3;
+  status->outputCount = 2;
+  status->inputCount = 1;
+  status->rssi = -60;
+  status->idlePercent[0] = 90;
+  status->idlePercent[1] = 75;
+  status->seq = 7;
+  status->freeHeap = 180000;
+  status->minFreeHeap = 150000;
+  status->largestBlock = 110000;
+  sealBeacon(status->header, BEACON_ANNOUNCE, 0, sizeof(*status));
+  r.checks++;
+  if (status->crc != BEACON_GOLDEN_CRC) r.failures++;
+
+  uint16_t seq = beacon.seq;
+  unsigned long start = micros();
+  buildBeaconStatus(*status, BEACON_RESPONSE, 0x12345678);
+  r.encodeNs = (micros() - start) * 1000;
+  beacon.seq = seq;  // Not sent
+
+  start = micros();
+  bool ok = decodeBeacon((const uint8_t*)status, sizeof(*status), BEACON_RESPONSE, decoded, sizeof(*decoded));
+  r.decodeNs = (micros() - start) * 1000;
+  r.checks++;
+  if (!ok || memcmp(status, decoded, sizeof(*status)) != 0) r.failures++;
+
+  // Wrong type, truncated, corrupted byte, bad magic
+  r.checks += 4;
+  if (decodeBeacon((const uint8_t*)status, sizeof(*status), BEACON_ANNOUNCE, decoded, sizeof(*decoded))) r.failures++;
+  if (decodeBeacon((const uint8_t*)status, sizeof(*status) - 1, BEACON_RESPONSE, decoded, sizeof(*decoded))) r.failures++;
+  status->uptimeS ^= 1;
+  if (decodeBeacon((const uint8_t*)status, sizeof(*status), BEACON_RESPONSE, decoded, sizeof(*decoded))) r.failures++;
+  status->uptimeS ^= 1;
+  status->header.magic ^= 1;
+  status->crc = crc32((const uint8_t*)status, offsetof(BeaconStatus, crc));
+  if (decodeBeacon((const uint8_t*)status, sizeof(*status), BEACON_RESPONSE, decoded, sizeof(*decoded))) r.failures++;
+
+  BeaconQuery query = {};
+  strlcpy(query.boardId, "living-room", sizeof(query.boardId));
+  query.replyWindowMs = 1500;
+  sealBeacon(query.header, BEACON_QUERY, 0xDEADBEEF, sizeof(query));
+  BeaconQuery decodedQuery;
+  r.checks++;
+  if (!decodeBeacon((const uint8_t*)&query, sizeof(query), BEACON_QUERY, &decodedQuery, sizeof(decodedQuery)) ||
+      decodedQuery.header.nonce != 0xDEADBEEF || decodedQuery.replyWindowMs != 1500 ||
+      strcmp(decodedQuery.boardId, "living-room") != 0) {
+    r.failures++;
   }
 }
 
-void handleOTAComplete() {
-  if (Update.hasError()) {
-    server.send(500, "text/plain", "Update failed!");
-  } else {
-    server.send(200, "text/plain", "Update successful! Rebooting...");
-    delay(1000);
-    ESP.restart();
-  }
+// Returns false if the packets couldn't be allocated
+static bool runBeaconSelfTest(BeaconResult& r) {
+  memset(&r, 0, sizeof(r));
+  BeaconStatus* status = (BeaconStatus*)arenaAlloc(sizeof(BeaconStatus));
+  BeaconStatus* decoded = (BeaconStatus*)arenaAlloc(sizeof(BeaconStatus));
+  bool allocated = status != nullptr && decoded != nullptr;
+  if (allocated) runBeaconChecks(r, status, decoded);
+
+  arenaFree(decoded);
+  arenaFree(status);
+  return allocated;
 }
 
-// ============ HTTP Handlers ============
-void handleRoot() {
-#ifdef USE_WIFI
-  if (apMode) {
-    server.send(200, "text/html", generateSetupPage());
-    return;
+// Average time to parse body into a 4KB request document
+static uint32_t timeJsonParse(const char* body) {
+  RequestJsonDocument doc(4096);
+  unsigned long start = micros();
+  for (int i = 0; i < SELFTEST_PARSE_ITERATIONS; i++) {
+    deserializeJson(doc, body);
   }
-#endif
-  // In normal mode, redirect to /info or show a simple status
-  handleInfo();
+  return (micros() - start) / SELFTEST_PARSE_ITERATIONS;
 }
 
-void handleInfo() {
-  StaticJsonDocument<512> doc;
+void handleSelfTest() {
+  unsigned long start = millis();
+  RequestJsonDocument response(1024);
+
+  const size_t bodySize = 2048;
+  char* body = (char*)arenaAlloc(bodySize);
+  ConfigBlob* blob = (ConfigBlob*)arenaAlloc(sizeof(ConfigBlob));
+  CodecResult codec;
+  BeaconResult beaconResult;
+  if (body == nullptr || blob == nullptr || !runCodecSelfTest(codec) || !runBeaconSelfTest(beaconResult)) {
+    arenaFree(blob);
+    arenaFree(body);
+    server.send(500, "application/json", "{\"error\":\"Out of memory\"}");
+    return;
+  }
 
-  doc["board_id"] = boardId;
-  doc["board_name"] = boardName;
-  doc["mac_address"] = getMacAddress();
-  doc["ip_address"] = getLocalIP();
-  doc["firmware_version"] = FIRMWARE_VERSION;
-  doc["adopted"] = adopted;
-  doc["total_ports"] = portCount;
+  JsonObject codecObj = response.createNestedObject("codec");
+  codecObj["checks"] = codec.checks;
+  codecObj["failures"] = codec.failures;
+  codecObj["hex_encode_ns_per_byte"] = codec.encodeNs[0];
+  codecObj["hex_decode_ns_per_byte"] = codec.decodeNs[0];
+  codecObj["base64_encode_ns_per_byte"] = codec.encodeNs[1];
+  codecObj["base64_decode_ns_per_byte"] = codec.decodeNs[1];
+
+  JsonObject beaconObj = response.createNestedObject("beacon");
+  beaconObj["checks"] = beaconResult.checks;
+  beaconObj["failures"] = beaconResult.failures;
+  beaconObj["encode_ns"] = beaconResult.encodeNs;
+  beaconObj["decode_ns"] = beaconResult.decodeNs;
+
+  // Representative bodies: a plain send, a 200-value raw send and a bulk
+  // configure of every port on this board
+  JsonObject parse = response.createNestedObject("json_parse_us");
+
+  parse["send_ir"] = timeJsonParse("{\"output\":4,\"protocol\":\"nec\",\"code\":\"20DF10EF\",\"frequency\":38000}");
+
+  size_t len = snprintf(body, bodySize, "{\"output\":4,\"protocol\":\"raw\",\"frequency\":38000,\"raw_data\":[");
+  for (int i = 0; i < 200 && len < bodySize - 16; i++) {
+    len += snprintf(body + len, bodySize - len, i ? ",%d" : "%d", i & 1 ? 1690 : 560);
+  }
+  snprintf(body + len, bodySize - len, "]}");
+  parse["send_ir_raw"] = timeJsonParse(body);
 
-#ifdef USE_ETHERNET
-  doc["connection_type"] = "ethernet";
-#else
-  doc["connection_type"] = "wifi";
-  doc["wifi_configured"] = wifiConfigured;
-  if (apMode) {
-    doc["wifi_mode"] = "ap";
-  } else {
-    doc["wifi_mode"] = "station";
-    doc["wifi_ssid"] = wifiSSID;
+  len = snprintf(body, bodySize, "{\"ports\":[");
+  for (int i = 0; i < portCount && len < bodySize - 80; i++) {
+    len += snprintf(body + len, bodySize - len, "%s{\"port\":%d,\"mode\":\"%s\",\"name\":\"Port %d\"}",
+                    i ? "," : "", ports[i].gpio, portModeName(ports[i].mode), ports[i].gpio);
   }
-#endif
+  snprintf(body + len, bodySize - len, "]}");
+  parse["configure_bulk"] = timeJsonParse(body);
+
+  buildConfigBlob(*blob, configGeneration);
+  unsigned long crcStart = micros();
+  volatile uint32_t crc = crc32((const uint8_t*)blob, offsetof(ConfigBlob, crc));
+  (void)crc;
+  response["config_crc_us"] = micros() - crcStart;
+  response["config_blob_bytes"] = sizeof(ConfigBlob);
+  arenaFree(blob);
+  arenaFree(body);
+
+  response["passed"] = codec.failures == 0 && beaconResult.failures == 0;
+  response["elapsed_ms"] = millis() - start;
+  sendJson(200, response);
+}
 
-  int outputCount = 0, inputCount = 0;
-  for (int i = 0; i < portCount; i++) {
-    if (ports[i].mode == "ir_output") outputCount++;
-    if (ports[i].mode == "ir_input") inputCount++;
+// ============ Serial Bridge Handlers ============
+
+void initSerialBridge(int rxPin, int txPin, int baud) {
+  if (serialBridgeEnabled) {
+    SerialBridge.end();
   }
-  doc["output_count"] = outputCount;
-  doc["input_count"] = inputCount;
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  serialBridgeRxPin = rxPin;
+  serialBridgeTxPin = txPin;
+  serialBridgeBaud = baud;
+
+  SerialBridge.begin(baud, SERIAL_8N1, rxPin, txPin);
+  serialBridgeEnabled = true;
+
+  startTask(TASK_SERIAL, serialBridgeTask);
+
+  Serial.printf("Serial bridge initialized: RX=%d, TX=%d, Baud=%d\n", rxPin, txPin, baud);
 }
 
-void handleStatus() {
+void handleSerialConfig() {
+  if (serialBatchActive()) {
+    server.send(409, "application/json", "{\"error\":\"Serial batch in progress\"}");
+    return;
+  }
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
   StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
 
-  doc["board_id"] = boardId;
-  doc["online"] = true;
-  doc["uptime_seconds"] = millis() / 1000;
-  doc["free_heap"] = ESP.getFreeHeap();
-  doc["network_connected"] = networkConnected;
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
 
-#ifdef USE_WIFI
-  if (!apMode && WiFi.getMode() == WIFI_STA) {
-    doc["wifi_rssi"] = WiFi.RSSI();
+  int rxPin = doc["rx_pin"] | -1;
+  int txPin = doc["tx_pin"] | -1;
+  int baud = doc["baud_rate"] | 115200;
+
+  if (rxPin < 0 || txPin < 0) {
+    server.send(400, "application/json", "{\"error\":\"rx_pin and tx_pin required\"}");
+    return;
   }
-#endif
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
-}
+  // Validate pins based on board type
+#ifdef USE_ETHERNET
+  // Olimex: Recommended UART1 on GPIO9 (RX) / GPIO10 (TX)
+  Serial.printf("Olimex board: Configuring serial on RX=%d, TX=%d\n", rxPin, txPin);
+#else
+  // DevKit: UART1 on GPIO16/17 or UART2 on GPIO25/26
+  Serial.printf("DevKit board: Configuring serial on RX=%d, TX=%d\n", rxPin, txPin);
+#endif
 
-void handlePorts() {
-  StaticJsonDocument<4096> doc;  // Increased for 22+ ports
+  initSerialBridge(rxPin, txPin, baud);
 
-  doc["total_ports"] = portCount;
-  JsonArray portsArray = doc.createNestedArray("ports");
+  StaticJsonDocument<256> response;
+  response["success"] = true;
+  response["rx_pin"] = rxPin;
+  response["tx_pin"] = txPin;
+  response["baud_rate"] = baud;
 
-  for (int i = 0; i < portCount; i++) {
-    JsonObject port = portsArray.createNestedObject();
-    port["port"] = ports[i].gpio;
-    port["gpio"] = ports[i].gpio;
-    port["mode"] = ports[i].mode;
-    port["name"] = ports[i].name;
-    port["gpio_name"] = "GPIO" + String(ports[i].gpio);
+  sendJson(200, response);
+}
 
-    // Check if input-only
-    bool isInputOnly = false;
-    for (int j = 0; j < INPUT_ONLY_COUNT; j++) {
-      if (INPUT_ONLY_PINS[j] == ports[i].gpio) {
-        isInputOnly = true;
-        break;
-      }
-    }
-    port["can_input"] = true;
-    port["can_output"] = !isInputOnly;
+// Encode bytes for a JSON reply. Text is NUL-terminated in place (serialRxBuffer
+// has room for it); hex and base64 go to serialEncodeBuffer.
+static const char* encodeSerialResponse(const String& format, uint8_t* bytes, size_t len) {
+  if (format == "hex") {
+    encodeHex(bytes, len, serialEncodeBuffer);
+    return serialEncodeBuffer;
   }
-
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  if (format == "base64") {
+    encodeBase64(bytes, len, serialEncodeBuffer);
+    return serialEncodeBuffer;
+  }
+  bytes[len] = '\0';
+  return (const char*)bytes;
 }
 
-void handleConfigurePort() {
-  if (!server.hasArg("plain")) {
+void handleSerialSend() {
+  if (!serialBridgeEnabled) {
+    server.send(400, "application/json", "{\"error\":\"Serial bridge not configured\"}");
+    return;
+  }
+
+  if (!server.hasBody()) {
     server.send(400, "application/json", "{\"error\":\"No body\"}");
     return;
   }
 
+  // Parsing a mutable buffer puts ArduinoJson in zero-copy mode: strings stay in
+  // the body, so the payload is decoded and sent from there without copies
   StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  DeserializationError error = deserializeJson(doc, server.mutableBody(), server.bodyLength());
 
   if (error) {
     server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
     return;
   }
 
-  int gpio = doc["port"] | -1;
-  String mode = doc["mode"] | "";
-  String name = doc["name"] | "";
+  char* data = (char*)(doc["data"] | "");
+  String format = doc["format"] | "text";
+  String responseFormat = doc["response_format"] | "text";
+  const char* ending = serialLineEnding(doc["line_ending"] | "none");
+  int timeout = doc["timeout"] | 1000;  // Response timeout in ms
+  bool waitResponse = doc["wait_response"] | true;
 
-  // Find port by GPIO
-  int portIndex = -1;
-  for (int i = 0; i < portCount; i++) {
-    if (ports[i].gpio == gpio) {
-      portIndex = i;
-      break;
-    }
+  size_t dataLen = strlen(data);
+  if (dataLen == 0) {
+    server.send(400, "application/json", "{\"error\":\"data required\"}");
+    return;
   }
 
-  if (portIndex == -1) {
-    server.send(400, "application/json", "{\"error\":\"Invalid GPIO\"}");
+  SerialBatchState priorState;
+  if (!claimSerialBridge(priorState)) {
+    server.send(409, "application/json", "{\"error\":\"Serial batch in progress\"}");
     return;
   }
 
-  // Check if trying to set output on input-only pin
-  if (mode == "ir_output") {
-    for (int i = 0; i < INPUT_ONLY_COUNT; i++) {
-      if (INPUT_ONLY_PINS[i] == gpio) {
-        server.send(400, "application/json", "{\"error\":\"GPIO is input-only\"}");
-        return;
-      }
-    }
+  // Clear any pending data in the buffer
+  while (SerialBridge.available()) {
+    SerialBridge.read();
   }
 
-  // Update port config
-  ports[portIndex].mode = mode;
-  ports[portIndex].name = name;
+  unsigned long decodeStart = micros();
+  int payloadLen = decodePayload(format, data, dataLen, (uint8_t*)data);
+  if (payloadLen < 0) {
+    releaseSerialBridge(priorState);
+    server.send(400, "application/json", "{\"error\":\"Invalid payload encoding\"}");
+    return;
+  }
 
-  // Reinitialize port
-  if (mode == "ir_output") {
-    initIRSender(portIndex);
-  } else if (mode == "ir_input") {
-    initIRReceiver(gpio);
+  // The JSON string's closing quote and the delimiter after it leave at least
+  // two spare bytes behind the payload, enough for the line ending
+  size_t endingLen = strlen(ending);
+  memcpy(data + payloadLen, ending, endingLen);
+  SerialBridge.write((const uint8_t*)data, payloadLen + endingLen);
+  serialStats.decodeUs = micros() - decodeStart;
+  serialStats.bytesSent = payloadLen + endingLen;
+
+  Serial.printf("Serial sent: %d bytes (format=%s)\n", payloadLen + endingLen, format.c_str());
+
+  // Wait for response if requested
+  size_t responseLen = 0;
+  if (waitResponse && timeout > 0) {
+    responseLen = readSerialResponse(SerialBridge, serialRxBuffer, SERIAL_RESPONSE_MAX, timeout);
+  }
+  releaseSerialBridge(priorState);
+  recordLatency(opMetrics[METRIC_SERIAL_SEND], micros() - decodeStart, waitResponse && timeout > 0 && responseLen == 0);
+
+  unsigned long encodeStart = micros();
+  uint8_t* response = serialRxBuffer;
+  if (responseFormat == "text") {
+    // Trim surrounding whitespace, as text responses always have been
+    while (responseLen > 0 && isspace(response[0])) { response++; responseLen--; }
+    while (responseLen > 0 && isspace(response[responseLen - 1])) responseLen--;
   }
 
-  // Save config
-  saveConfig();
+  StaticJsonDocument<256> respDoc;
+  respDoc["success"] = true;
+  respDoc["response"] = encodeSerialResponse(responseFormat, response, responseLen);
+  respDoc["response_format"] = responseFormat;
+  respDoc["response_length"] = responseLen;
+  serialStats.encodeUs = micros() - encodeStart;
+  serialStats.bytesReceived = responseLen;
+
+  sendJson(200, respDoc);
+}
+
+void handleSerialRead() {
+  if (!serialBridgeEnabled) {
+    server.send(400, "application/json", "{\"error\":\"Serial bridge not configured\"}");
+    return;
+  }
+
+  if (serialBatchActive()) {
+    server.send(409, "application/json", "{\"error\":\"Serial batch in progress\"}");
+    return;
+  }
+
+  String format = server.hasArg("format") ? server.arg("format") : "text";
+
+  // Read whatever is buffered, up to one response buffer; the rest stays queued
+  size_t len = SerialBridge.read(serialRxBuffer, SERIAL_RESPONSE_MAX);
 
   StaticJsonDocument<256> response;
   response["success"] = true;
-  response["port"] = gpio;
-  response["mode"] = mode;
-  response["name"] = name;
+  response["data"] = encodeSerialResponse(format, serialRxBuffer, len);
+  response["format"] = format;
+  response["length"] = len;
+  response["more"] = SerialBridge.available() > 0;
 
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  sendJson(200, response);
 }
 
-void handleAdopt() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
+void handleSerialStatus() {
+  StaticJsonDocument<384> response;
+
+  response["enabled"] = serialBridgeEnabled;
+  response["rx_pin"] = serialBridgeRxPin;
+  response["tx_pin"] = serialBridgeTxPin;
+  response["baud_rate"] = serialBridgeBaud;
+  response["available"] = serialBridgeEnabled ? SerialBridge.available() : 0;
+
+  JsonObject payload = response.createNestedObject("last_payload");
+  payload["bytes_sent"] = serialStats.bytesSent;
+  payload["decode_us"] = serialStats.decodeUs;
+  payload["bytes_received"] = serialStats.bytesReceived;
+  payload["encode_us"] = serialStats.encodeUs;
+
+#ifdef USE_ETHERNET
+  response["board_type"] = "olimex_poe_iso";
+  JsonObject recommended = response.createNestedObject("recommended_pins");
+  recommended["uart1_rx"] = 9;
+  recommended["uart1_tx"] = 10;
+#else
+  response["board_type"] = "esp32_devkit";
+  JsonObject recommended = response.createNestedObject("recommended_pins");
+  recommended["uart1_rx"] = 16;
+  recommended["uart1_tx"] = 17;
+  recommended["uart2_rx"] = 25;
+  recommended["uart2_tx"] = 26;
+#endif
+
+  sendJson(200, response);
+}
+
+// ============ Serial Batch Execution ============
+
+bool serialBatchActive() {
+  return serialBatchState == BATCH_QUEUED || serialBatchState == BATCH_RUNNING || serialBatchState == BATCH_CLAIMED;
+}
+
+// Take the serial port for a send, or for a batch while it is parsed. On
+// success prior is the state to put back with releaseSerialBridge() if
+// nothing gets queued.
+bool claimSerialBridge(SerialBatchState& prior) {
+  portENTER_CRITICAL(&serialBatchMux);
+  prior = serialBatchState;
+  bool claimed = !serialBatchActive();
+  if (claimed) serialBatchState = BATCH_CLAIMED;
+  portEXIT_CRITICAL(&serialBatchMux);
+  return claimed;
+}
+
+void releaseSerialBridge(SerialBatchState prior) {
+  portENTER_CRITICAL(&serialBatchMux);
+  serialBatchState = prior;
+  portEXIT_CRITICAL(&serialBatchMux);
+}
+
+// Hand the claimed serialBatch to the bridge task
+void queueSerialBatch(bool fromMqtt) {
+  portENTER_CRITICAL(&serialBatchMux);
+  serialBatchId++;
+  serialBatchFromMqtt = fromMqtt;
+  serialBatchState = BATCH_QUEUED;
+  portEXIT_CRITICAL(&serialBatchMux);
+  xTaskNotifyGive(tasks[TASK_SERIAL].handle);
+}
+
+void serialBridgeTask(void* param) {
+  esp_task_wdt_add(NULL);
+
+  for (;;) {
+    esp_task_wdt_reset();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TASK_IDLE_WAIT_MS)) == 0) continue;
+
+    portENTER_CRITICAL(&serialBatchMux);
+    bool queued = serialBatchState == BATCH_QUEUED;
+    if (queued) serialBatchState = BATCH_RUNNING;
+    portEXIT_CRITICAL(&serialBatchMux);
+    if (!queued) continue;
+
+    // Start from a clean receive buffer, as /serial/send does
+    while (SerialBridge.available()) {
+      SerialBridge.read();
+    }
+
+    unsigned long start = millis();
+    unsigned long busyStart = micros();
+    bool ok = runSerialScript(SerialBridge, serialBatch);
+    serialBatch.elapsedMs = millis() - start;
+    accountTask(TASK_SERIAL, busyStart);
+    recordLatency(opMetrics[METRIC_SERIAL_BATCH], micros() - busyStart, !ok);
+
+    Serial.printf("Serial batch %u %s: %u steps in %ums\n", serialBatchId, ok ? "done" : "failed",
+                  serialBatch.resultCount, serialBatch.elapsedMs);
+
+    // Before the state changes, while nothing else can reuse serialBatch
+    if (serialBatchFromMqtt) mqttPublishSerialResult(ok);
+
+    portENTER_CRITICAL(&serialBatchMux);
+    serialBatchState = ok ? BATCH_DONE : BATCH_FAILED;
+    portEXIT_CRITICAL(&serialBatchMux);
+  }
+}
+
+// ============ Serial Batch Handlers ============
+
+// Parse "next" / "end" / "abort" or a step index; returns false if invalid
+static bool parseBatchTarget(JsonVariant value, int stepCount, int8_t fallback, int8_t& target) {
+  if (value.isNull()) {
+    target = fallback;
+    return true;
+  }
+  if (value.is<int>()) {
+    int index = value.as<int>();
+    if (index < 0 || index >= stepCount) return false;
+    target = index;
+    return true;
+  }
+  String name = value | "";
+  if (name == "next") target = BATCH_NEXT;
+  else if (name == "end") target = BATCH_END;
+  else if (name == "abort") target = BATCH_ABORT;
+  else return false;
+  return true;
+}
+
+static const char* parseBatchStep(JsonObject obj, int stepCount, SerialScript& script, SerialStep& step) {
+  String op = obj["op"] | "";
+  step.dataOffset = script.dataUsed;
+  step.dataLen = 0;
+  step.ms = 0;
+  step.onMatch = BATCH_NEXT;
+  step.onFail = BATCH_NEXT;
+
+  if (op == "send") {
+    step.op = STEP_SEND;
+    const char* data = obj["data"] | "";
+    String format = obj["format"] | "text";
+    size_t len = strlen(data);
+
+    // Decoded output is never longer than its encoding
+    if (script.dataUsed + len > SERIAL_BATCH_DATA_SIZE) return "Batch data too large";
+    int decoded = decodePayload(format, data, len, script.data + script.dataUsed);
+    if (decoded < 0) return "Invalid payload encoding";
+    script.dataUsed += decoded;
+
+    const char* ending = serialLineEnding(obj["line_ending"] | "none");
+    if (!appendBatchData(script, (const uint8_t*)ending, strlen(ending))) return "Batch data too large";
+    if (script.dataUsed == step.dataOffset) return "send requires data";
+  } else if (op == "wait" || op == "branch") {
+    step.op = (op == "wait") ? STEP_WAIT : STEP_BRANCH;
+    const char* pattern = obj["pattern"] | "";
+    if (!appendBatchData(script, (const uint8_t*)pattern, strlen(pattern))) return "Batch data too large";
+    if (step.op == STEP_WAIT) {
+      step.ms = obj["timeout_ms"] | 1000;
+      if (step.ms == 0 || step.ms > SERIAL_BATCH_MAX_WAIT_MS) return "timeout_ms out of range";
+    }
+    int8_t defaultFail = (step.op == STEP_WAIT) ? BATCH_ABORT : BATCH_NEXT;
+    if (!parseBatchTarget(obj["on_match"], stepCount, BATCH_NEXT, step.onMatch) ||
+        !parseBatchTarget(obj["on_fail"], stepCount, defaultFail, step.onFail)) {
+      return "Invalid on_match/on_fail target";
+    }
+  } else if (op == "delay") {
+    step.op = STEP_DELAY;
+    step.ms = obj["ms"] | 0;
+    if (step.ms > SERIAL_BATCH_MAX_WAIT_MS) return "delay out of range";
+  } else {
+    return "Unknown op";
+  }
+
+  step.dataLen = script.dataUsed - step.dataOffset;
+  return nullptr;
+}
+
+void handleSerialBatch() {
+  if (!serialBridgeEnabled) {
+    server.send(400, "application/json", "{\"error\":\"Serial bridge not configured\"}");
     return;
   }
 
-  StaticJsonDocument<256> doc;
-  deserializeJson(doc, server.arg("plain"));
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
 
-  String newBoardId = doc["board_id"] | "";
-  String newBoardName = doc["board_name"] | "";
+  RequestJsonDocument doc(4096);
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
 
-  if (newBoardId.length() == 0) {
-    server.send(400, "application/json", "{\"error\":\"board_id required\"}");
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
     return;
   }
 
-  boardId = newBoardId;
-  boardName = newBoardName.length() > 0 ? newBoardName : boardId;
-  adopted = true;
+  JsonArray steps = doc["steps"];
+  if (steps.size() == 0 || steps.size() > SERIAL_BATCH_MAX_STEPS) {
+    server.send(400, "application/json", "{\"error\":\"steps must contain 1-16 operations\"}");
+    return;
+  }
 
-  saveConfig();
+  // The bridge task only touches serialBatch while queued/running, and the
+  // claim keeps MQTT commands off it
+  SerialBatchState priorState;
+  if (!claimSerialBridge(priorState)) {
+    server.send(409, "application/json", "{\"error\":\"Serial batch in progress\"}");
+    return;
+  }
+  serialBatch.stepCount = 0;
+  serialBatch.dataUsed = 0;
+  serialBatch.resultCount = 0;
+  serialBatch.error = nullptr;
+  strlcpy(serialBatchResponseFormat, doc["response_format"] | "text", sizeof(serialBatchResponseFormat));
+
+  int stepCount = steps.size();
+  for (int i = 0; i < stepCount; i++) {
+    const char* stepError = parseBatchStep(steps[i].as<JsonObject>(), stepCount, serialBatch, serialBatch.steps[i]);
+    if (stepError != nullptr) {
+      releaseSerialBridge(priorState);
+      StaticJsonDocument<128> response;
+      response["error"] = stepError;
+      response["step"] = i;
+
+      sendJson(400, response);
+      return;
+    }
+    serialBatch.stepCount++;
+  }
 
-  // Update mDNS
-  MDNS.end();
-  MDNS.begin(boardId.c_str());
-  MDNS.addService("http", "tcp", 80);
+  queueSerialBatch(false);
 
   StaticJsonDocument<128> response;
   response["success"] = true;
-  response["board_id"] = boardId;
-
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  response["batch_id"] = serialBatchId;
+  response["steps"] = serialBatch.stepCount;
 
-  Serial.printf("Board adopted as: %s (%s)\n", boardId.c_str(), boardName.c_str());
+  sendJson(202, response);
 }
 
-void handleSendIR() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
-    return;
-  }
+void handleSerialBatchResult() {
+  static const char* const stateNames[] = {"idle", "queued", "running", "done", "failed", "busy"};
+  static const char* const opNames[] = {"send", "wait", "delay", "branch"};
 
-  // Use larger buffer for raw IR data
-  DynamicJsonDocument doc(4096);
-  deserializeJson(doc, server.arg("plain"));
+  SerialBatchState state = serialBatchState;
 
-  int output = doc["output"] | -1;
-  String code = doc["code"] | "";
-  String protocol = doc["protocol"] | "nec";
-  int frequency = doc["frequency"] | 38000;
+  RequestJsonDocument doc(4096);
+  doc["batch_id"] = serialBatchId;
+  doc["state"] = stateNames[state];
+  char* encoded = nullptr;
 
-  // Find port index
-  int portIndex = -1;
-  for (int i = 0; i < portCount; i++) {
-    if (ports[i].gpio == output && ports[i].mode == "ir_output") {
-      portIndex = i;
-      break;
+  // Results are only stable once the bridge task has finished with them
+  if (state == BATCH_DONE || state == BATCH_FAILED) {
+    doc["success"] = (state == BATCH_DONE);
+    if (serialBatch.error != nullptr) {
+      doc["error"] = serialBatch.error;
+    }
+    doc["elapsed_ms"] = serialBatch.elapsedMs;
+
+    // Hex and base64 responses are encoded into one arena block that outlives
+    // the document; text ones are already NUL-terminated in the pool. Every
+    // response takes len + 1 bytes of the pool, so twice that always fits.
+    String format = serialBatchResponseFormat;
+    if (format == "hex" || format == "base64") {
+      encoded = (char*)arenaAlloc(serialBatch.responsesUsed * 2 + serialBatch.resultCount);
+      if (encoded == nullptr) {
+        sendJsonError(500, "Out of memory");
+        return;
+      }
+      doc["response_format"] = (const char*)serialBatchResponseFormat;
+    } else {
+      doc["response_format"] = "text";
+    }
+    char* next = encoded;
+
+    JsonArray results = doc.createNestedArray("results");
+    for (int i = 0; i < serialBatch.resultCount; i++) {
+      const SerialStepResult& result = serialBatch.results[i];
+      const SerialStep& step = serialBatch.steps[result.step];
+
+      JsonObject entry = results.createNestedObject();
+      entry["step"] = result.step;
+      entry["op"] = opNames[step.op];
+      entry["elapsed_ms"] = result.elapsedMs;
+      if (step.op == STEP_WAIT || step.op == STEP_BRANCH) {
+        entry["matched"] = result.matched;
+      }
+      if (step.op == STEP_WAIT) {
+        const uint8_t* response = (const uint8_t*)serialBatch.responses + result.responseOffset;
+        if (encoded != nullptr) {
+          size_t len = format == "hex" ? encodeHex(response, result.responseLen, next)
+                                       : encodeBase64(response, result.responseLen, next);
+          entry["response"] = (const char*)next;
+          next += len + 1;
+        } else {
+          entry["response"] = (const char*)response;
+        }
+        entry["response_length"] = result.responseLen;
+      }
     }
   }
 
-  if (portIndex == -1 || irSenders[portIndex] == nullptr) {
-    server.send(400, "application/json", "{\"error\":\"Invalid output or not configured\"}");
-    return;
-  }
+  sendJson(200, doc);
+  if (encoded != nullptr) arenaFree(encoded);
+}
 
-  // Parse and send IR code
-  uint64_t codeValue = strtoull(code.c_str(), nullptr, 16);
-  int freqKHz = frequency / 1000;  // Convert Hz to kHz for library
+// ============ MQTT Client ============
+void loadMqttConfig() {
+  Preferences store;
+  if (!store.begin("vda-mqtt", true)) return;
+  mqttConfig.enabled = store.getBool("enabled", false);
+  mqttConfig.discovery = store.getBool("discovery", true);
+  store.getString("uri", mqttConfig.uri, sizeof(mqttConfig.uri));
+  store.getString("user", mqttConfig.username, sizeof(mqttConfig.username));
+  store.getString("pass", mqttConfig.password, sizeof(mqttConfig.password));
+  store.getString("base", mqttConfig.baseTopic, sizeof(mqttConfig.baseTopic));
+  store.getString("prefix", mqttConfig.discoveryPrefix, sizeof(mqttConfig.discoveryPrefix));
+  store.end();
+}
 
-  if (protocol == "nec") {
-    if (frequency != 38000) {
-      // Use sendGeneric for custom carrier frequency (e.g., 56kHz for Samsung SMT boxes)
-      // NEC timings: HDR=9000/4500, BIT=562, ONE=1687, ZERO=562
-      Serial.printf("Sending NEC at %dkHz via GPIO%d\n", freqKHz, output);
-      irSenders[portIndex]->sendGeneric(
-        9000, 4500,       // Header mark/space
-        562, 1687,        // Bit mark, one space
-        562, 562,         // Zero mark (same as bit), zero space
-        562, 40000,       // Footer mark, gap
-        codeValue, 32,    // Data and bits
-        freqKHz, true, 0, 33  // Freq, MSB first, repeats, duty cycle
-      );
-    } else {
-      irSenders[portIndex]->sendNEC(codeValue);
-    }
-  } else if (protocol == "samsung") {
-    if (frequency != 38000) {
-      // Use sendGeneric for custom carrier frequency
-      // Samsung timings: HDR=4500/4500, BIT=560, ONE=1690, ZERO=560
-      Serial.printf("Sending Samsung at %dkHz via GPIO%d\n", freqKHz, output);
-      irSenders[portIndex]->sendGeneric(
-        4500, 4500,       // Header mark/space
-        560, 1690,        // Bit mark, one space
-        560, 560,         // Zero mark (same as bit), zero space
-        560, 40000,       // Footer mark, gap
-        codeValue, 32,    // Data and bits
-        freqKHz, true, 0, 33  // Freq, MSB first, repeats, duty cycle
-      );
-    } else {
-      irSenders[portIndex]->sendSAMSUNG(codeValue);
-    }
-  } else if (protocol == "sony") {
-    irSenders[portIndex]->sendSony(codeValue);
-  } else if (protocol == "rc5") {
-    irSenders[portIndex]->sendRC5(codeValue);
-  } else if (protocol == "rc6") {
-    irSenders[portIndex]->sendRC6(codeValue);
-  } else if (protocol == "lg") {
-    irSenders[portIndex]->sendLG(codeValue);
-  } else if (protocol == "panasonic") {
-    irSenders[portIndex]->sendPanasonic(0x4004, codeValue);  // Standard Panasonic address
-  } else if (protocol == "pioneer") {
-    // Pioneer codes in "AAAACCCC" format need to be encoded as 64-bit Pioneer protocol
-    // The first 4 hex digits are the address, the last 4 are the command
-    // e.g., "A55A38C7" = address 0xA55A, command 0x38C7
-    if (codeValue <= 0xFFFFFFFF) {
-      // 32-bit code in Address+Command format - encode it properly
-      uint16_t address = (codeValue >> 16) & 0xFFFF;
-      uint16_t command = codeValue & 0xFFFF;
-      uint64_t encodedValue = irSenders[portIndex]->encodePioneer(address, command);
-      Serial.printf("Pioneer: encoding 0x%08llX as address=0x%04X command=0x%04X -> 0x%016llX\n",
-                    codeValue, address, command, encodedValue);
-      irSenders[portIndex]->sendPioneer(encodedValue, 64);
-    } else {
-      // Already a 64-bit code - send as-is
-      irSenders[portIndex]->sendPioneer(codeValue, 64);
-    }
-  } else if (protocol == "raw") {
-    // Raw IR - expects "raw_data" array of timing values in microseconds
-    JsonArray rawArray = doc["raw_data"];
-    if (rawArray.size() > 0) {
-      uint16_t rawData[512];  // Max 512 timing values
-      size_t rawLen = min((size_t)rawArray.size(), (size_t)512);
-
-      for (size_t i = 0; i < rawLen; i++) {
-        rawData[i] = rawArray[i];
-      }
+static void saveMqttConfig(const MqttConfig& config) {
+  Preferences store;
+  if (!store.begin("vda-mqtt", false)) return;
+  store.putBool("enabled", config.enabled);
+  store.putBool("discovery", config.discovery);
+  store.putString("uri", config.uri);
+  store.putString("user", config.username);
+  store.putString("pass", config.password);
+  store.putString("base", config.baseTopic);
+  store.putString("prefix", config.discoveryPrefix);
+  store.end();
+}
 
-      Serial.printf("Sending raw IR: %d values at %dHz via GPIO%d\n", rawLen, frequency, output);
-      irSenders[portIndex]->sendRaw(rawData, rawLen, frequency / 1000);
-    } else {
-      server.send(400, "application/json", "{\"error\":\"raw_data array required for raw protocol\"}");
-      return;
-    }
+// Node id (also the client id) and base topic, both from the factory MAC so
+// they survive adoption and renames
+static void formatMqttIds(const MqttConfig& config, char* nodeId, size_t nodeSize, char* base, size_t baseSize) {
+  uint64_t mac = ESP.getEfuseMac();
+  const uint8_t* b = (const uint8_t*)&mac;
+  char hex[13];
+  snprintf(hex, sizeof(hex), "%02x%02x%02x%02x%02x%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+  snprintf(nodeId, nodeSize, "vda_ir_%s", hex);
+  if (config.baseTopic[0]) {
+    strlcpy(base, config.baseTopic, baseSize);
   } else {
-    // Send as raw NEC by default
-    irSenders[portIndex]->sendNEC(codeValue);
+    snprintf(base, baseSize, "vda-ir/%s", hex);
   }
+}
 
-  Serial.printf("Sent IR code 0x%llX via GPIO%d\n", codeValue, output);
+static void mqttTopic(char* out, size_t size, const char* suffix) {
+  snprintf(out, size, "%s/%s", mqtt.baseTopic, suffix);
+}
 
-  server.send(200, "application/json", "{\"success\":true}");
+// Publish at QoS 1 from the mqtt task. A len of 0 publishes the payload as a
+// C string. Counted in flight before the call, since the ack can be handled
+// before it returns.
+static bool mqttPublishTo(const char* topic, const char* payload, size_t len, bool retain) {
+  portENTER_CRITICAL(&mqttMux);
+  mqttInflight++;
+  portEXIT_CRITICAL(&mqttMux);
+  if (esp_mqtt_client_publish(mqtt.client, topic, payload, len, 1, retain) < 0) {
+    portENTER_CRITICAL(&mqttMux);
+    if (mqttInflight > 0) mqttInflight--;
+    portEXIT_CRITICAL(&mqttMux);
+    strlcpy(mqttStats.lastError, "Publish failed", sizeof(mqttStats.lastError));
+    return false;
+  }
+  mqttStats.published++;
+  return true;
 }
 
-void handleTestOutput() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
-    return;
+// Queue a message for the mqtt task. Never blocks, so the IR and serial tasks
+// can call it; when the outbox is full the message is dropped and counted.
+static bool mqttEnqueueJson(const char* topic, const JsonDocument& doc, bool retain) {
+  if (tasks[TASK_MQTT].handle == nullptr || !mqttConfig.enabled) return false;
+
+  MqttMessage message;
+  strlcpy(message.topic, topic, sizeof(message.topic));
+  message.len = serializeJson(doc, message.payload, sizeof(message.payload));
+  message.retain = retain;
+  if (xQueueSend(mqttOutbox, &message, 0) != pdTRUE) {
+    portENTER_CRITICAL(&mqttMux);
+    mqttStats.dropped++;
+    portEXIT_CRITICAL(&mqttMux);
+    return false;
   }
+  xTaskNotifyGive(tasks[TASK_MQTT].handle);
+  return true;
+}
 
-  StaticJsonDocument<128> doc;
-  deserializeJson(doc, server.arg("plain"));
+// Called from the IR receive task
+void mqttPublishIrCode(uint8_t gpio, decode_type_t protocol, uint64_t value, uint16_t bits) {
+  if (tasks[TASK_MQTT].handle == nullptr) return;
 
-  int output = doc["output"] | -1;
-  int duration = doc["duration_ms"] | 500;
+  StaticJsonDocument<192> doc;
+  doc["port"] = gpio;
+  doc["protocol"] = typeToString(protocol);
+  doc["code"] = uint64ToString(value, HEX);
+  doc["bits"] = bits;
 
-  // Find port
-  int portIndex = -1;
-  for (int i = 0; i < portCount; i++) {
-    if (ports[i].gpio == output) {
-      portIndex = i;
-      break;
+  char topic[32];
+  snprintf(topic, sizeof(topic), "ir/%u/received", gpio);
+  mqttEnqueueJson(topic, doc, false);
+}
+
+// Called from the serial bridge task when a batch queued by an MQTT command
+// finishes. Reports the captured response, trimmed like /serial/send does
+// and shortened if it doesn't fit in an outbox message.
+void mqttPublishSerialResult(bool ok) {
+  static char encoded[MQTT_PAYLOAD_MAX];  // Bridge task only
+
+  const char* response = "";
+  size_t len = 0;
+  for (int i = 0; i < serialBatch.resultCount; i++) {
+    const SerialStepResult& result = serialBatch.results[i];
+    if (serialBatch.steps[result.step].op == STEP_WAIT) {
+      response = serialBatch.responses + result.responseOffset;
+      len = result.responseLen;
     }
   }
 
-  if (portIndex == -1) {
-    server.send(400, "application/json", "{\"error\":\"Invalid output\"}");
-    return;
+  size_t shown;
+  if (mqttSerialRequest.hex) {
+    shown = min(len, (size_t)(MQTT_PAYLOAD_MAX / 2 - 1));
+    encodeHex((const uint8_t*)response, shown, encoded);
+  } else {
+    while (len > 0 && isspace((unsigned char)response[0])) { response++; len--; }
+    while (len > 0 && isspace((unsigned char)response[len - 1])) len--;
+    shown = min(len, (size_t)(MQTT_PAYLOAD_MAX - 1));
+    memcpy(encoded, response, shown);
+    encoded[shown] = '\0';
   }
 
-  // Send test pattern (simple carrier burst)
-  pinMode(output, OUTPUT);
-  for (int i = 0; i < duration; i++) {
-    digitalWrite(output, HIGH);
-    delayMicroseconds(13);
-    digitalWrite(output, LOW);
-    delayMicroseconds(13);
+  StaticJsonDocument<256> doc;
+  if (mqttSerialRequest.id[0]) doc["id"] = (const char*)mqttSerialRequest.id;
+  doc["batch_id"] = serialBatchId;
+  doc["success"] = ok;
+  if (serialBatch.error != nullptr) doc["error"] = serialBatch.error;
+  doc["response"] = (const char*)encoded;
+  doc["response_format"] = mqttSerialRequest.hex ? "hex" : "text";
+  doc["response_length"] = len;
+  doc["truncated"] = shown < len;
+  doc["elapsed_ms"] = serialBatch.elapsedMs;
+
+  // Escaped control characters can still make it too long
+  while (measureJson(doc) >= MQTT_PAYLOAD_MAX && shown > 0) {
+    shown = mqttSerialRequest.hex ? shown / 2 : shown * 3 / 4;
+    encoded[mqttSerialRequest.hex ? shown * 2 : shown] = '\0';
+    doc["truncated"] = true;
   }
+  mqttEnqueueJson("serial/response", doc, false);
+}
 
-  Serial.printf("Test signal sent on GPIO%d for %dms\n", output, duration);
-
-  server.send(200, "application/json", "{\"success\":true}");
+// Runs in the esp-mqtt task. The wait after the disconnect that triggers this
+// is already set, so the doubled delay applies to the next one.
+static void setMqttBackoff(esp_mqtt_client_handle_t client, uint32_t delayMs) {
+  mqtt.backoffMs = delayMs;
+  uint32_t jitter = delayMs / 5;
+  mqtt.clientConfig.reconnect_timeout_ms = delayMs - jitter + esp_random() % (2 * jitter + 1);
+  esp_mqtt_set_config(client, &mqtt.clientConfig);
 }
 
-void handleLearningStart() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
+// Commands must arrive in one piece; the client buffer is sized for that
+static void receiveMqttCommand(esp_mqtt_event_handle_t event) {
+  static MqttCommand command;  // esp-mqtt task only
+
+  if (event->current_data_offset != 0) return;
+  if (event->data_len != event->total_data_len || event->data_len > MQTT_COMMAND_MAX ||
+      event->topic_len >= MQTT_TOPIC_MAX) {
+    mqttStats.commandsDropped++;
     return;
   }
+  memcpy(command.topic, event->topic, event->topic_len);
+  command.topic[event->topic_len] = '\0';
+  memcpy(command.payload, event->data, event->data_len);
+  command.payload[event->data_len] = '\0';
+  command.len = event->data_len;
+  if (xQueueSend(mqttInbox, &command, 0) != pdTRUE) {
+    mqttStats.commandsDropped++;
+  }
+}
 
-  StaticJsonDocument<128> doc;
-  deserializeJson(doc, server.arg("plain"));
+static void onMqttEvent(void* arg, esp_event_base_t base, int32_t eventId, void* eventData) {
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)eventData;
+  char topic[MQTT_TOPIC_MAX];
+
+  switch ((esp_mqtt_event_id_t)eventId) {
+    case MQTT_EVENT_CONNECTED:
+      mqttStats.connected = true;
+      mqttStats.sessionPresent = event->session_present;
+      mqttStats.connects++;
+      mqttStats.connectedMs = millis();
+      mqttStats.reconnectDelayMs = 0;
+      portENTER_CRITICAL(&mqttMux);
+      mqttInflight = 0;
+      portEXIT_CRITICAL(&mqttMux);
+
+      // Already in a resumed session, but a new one needs them
+      mqttTopic(topic, sizeof(topic), "cmd/#");
+      esp_mqtt_client_subscribe(event->client, topic, 1);
+      if (mqtt.config.discovery) {
+        snprintf(topic, sizeof(topic), "%s/status", mqtt.config.discoveryPrefix);
+        esp_mqtt_client_subscribe(event->client, topic, 1);
+      }
+      setMqttBackoff(event->client, MQTT_RECONNECT_MIN_MS);
+      mqtt.connectedEvent = true;
+      break;
 
-  int port = doc["port"] | 34;  // Default to GPIO34
+    case MQTT_EVENT_DISCONNECTED:
+      // Also sent for every failed connection attempt
+      if (mqttStats.connected) {
+        mqttStats.disconnects++;
+      } else {
+        mqttStats.connectFailures++;
+      }
+      mqttStats.connected = false;
+      mqttStats.reconnectDelayMs = mqtt.clientConfig.reconnect_timeout_ms;
+      portENTER_CRITICAL(&mqttMux);
+      mqttInflight = 0;
+      portEXIT_CRITICAL(&mqttMux);
+      setMqttBackoff(event->client, min(mqtt.backoffMs * 2, (uint32_t)MQTT_RECONNECT_MAX_MS));
+      break;
 
-  // Initialize receiver on specified port
-  initIRReceiver(port);
+    case MQTT_EVENT_PUBLISHED:
+      portENTER_CRITICAL(&mqttMux);
+      mqttStats.acked++;
+      if (mqttInflight > 0) mqttInflight--;
+      portEXIT_CRITICAL(&mqttMux);
+      break;
 
-  StaticJsonDocument<128> response;
-  response["success"] = true;
-  response["port"] = port;
+    case MQTT_EVENT_DATA:
+      receiveMqttCommand(event);
+      break;
 
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+    case MQTT_EVENT_ERROR:
+      if (event->error_handle->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED) {
+        snprintf(mqttStats.lastError, sizeof(mqttStats.lastError), "Connection refused (code %d)",
+                 (int)event->error_handle->connect_return_code);
+      } else {
+        snprintf(mqttStats.lastError, sizeof(mqttStats.lastError), "Transport error (errno %d)",
+                 event->error_handle->esp_transport_sock_errno);
+      }
+      break;
 
-  Serial.printf("Learning mode started on GPIO%d\n", port);
+    default:
+      break;
+  }
+  xTaskNotifyGive(tasks[TASK_MQTT].handle);
 }
 
-void handleLearningStop() {
-  if (irReceiver != nullptr) {
-    irReceiver->disableIRIn();
+// Stop the running client, if any, and start one with the current settings
+static void restartMqttClient() {
+  if (mqtt.client != nullptr) {
+    if (mqttStats.connected) {
+      // The broker only sends the will when the connection drops
+      esp_mqtt_client_publish(mqtt.client, mqtt.willTopic, "offline", 0, 1, true);
+    }
+    esp_mqtt_client_destroy(mqtt.client);
+    mqtt.client = nullptr;
+    mqttStats.connected = false;
+  }
+  portENTER_CRITICAL(&mqttMux);
+  mqtt.config = mqttConfig;
+  mqttInflight = 0;
+  portEXIT_CRITICAL(&mqttMux);
+  if (!mqtt.config.enabled) {
+    Serial.println("MQTT: stopped");
+    return;
   }
-  activeReceiverPort = -1;
 
-  server.send(200, "application/json", "{\"success\":true}");
-  Serial.println("Learning mode stopped");
+  formatMqttIds(mqtt.config, mqtt.nodeId, sizeof(mqtt.nodeId), mqtt.baseTopic, sizeof(mqtt.baseTopic));
+  mqttTopic(mqtt.willTopic, sizeof(mqtt.willTopic), "availability");
+  memset(mqtt.discovered, 0xFF, sizeof(mqtt.discovered));
+  mqtt.discoveryStep = -1;
+  mqtt.backoffMs = MQTT_RECONNECT_MIN_MS;
+
+  esp_mqtt_client_config_t& cfg = mqtt.clientConfig;
+  cfg = {};
+  cfg.uri = mqtt.config.uri;
+  cfg.client_id = mqtt.nodeId;
+  cfg.username = mqtt.config.username[0] ? mqtt.config.username : nullptr;
+  cfg.password = mqtt.config.password[0] ? mqtt.config.password : nullptr;
+  cfg.lwt_topic = mqtt.willTopic;
+  cfg.lwt_msg = "offline";
+  cfg.lwt_qos = 1;
+  cfg.lwt_retain = 1;
+  cfg.disable_clean_session = true;
+  cfg.keepalive = MQTT_KEEPALIVE_S;
+  cfg.task_prio = MQTT_CLIENT_PRIORITY;
+  cfg.buffer_size = MQTT_COMMAND_MAX + MQTT_TOPIC_MAX;
+  cfg.reconnect_timeout_ms = MQTT_RECONNECT_MIN_MS;
+  cfg.network_timeout_ms = 5000;  // Stopping waits for it; below the watchdog timeout
+
+  mqtt.client = esp_mqtt_client_init(&cfg);
+  if (mqtt.client == nullptr) {
+    strlcpy(mqttStats.lastError, "Client init failed", sizeof(mqttStats.lastError));
+    return;
+  }
+  esp_mqtt_client_register_event(mqtt.client, MQTT_EVENT_ANY, onMqttEvent, nullptr);
+  esp_mqtt_client_start(mqtt.client);
+  Serial.printf("MQTT: %s as %s, topics under %s/\n", mqtt.config.uri, mqtt.nodeId, mqtt.baseTopic);
 }
 
-void handleLearningStatus() {
-  StaticJsonDocument<512> doc;
-
-  doc["active"] = (activeReceiverPort >= 0);
-  doc["port"] = activeReceiverPort;
-
-  // Check if we received a code
-  if (irReceiver != nullptr && irReceiver->decode(&irResults)) {
-    JsonObject receivedCode = doc.createNestedObject("received_code");
-    receivedCode["protocol"] = typeToString(irResults.decode_type);
-    receivedCode["code"] = "0x" + uint64ToString(irResults.value, HEX);
-    receivedCode["bits"] = irResults.bits;
-
-    irReceiver->resume();
-  }
+static void startMqttDiscovery() {
+  mqtt.discoveredGeneration = configGeneration;
+  if (mqtt.config.discovery) mqtt.discoveryStep = 0;
+}
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+static void addMqttDevice(JsonObject dev) {
+  dev.createNestedArray("ids").add((const char*)mqtt.nodeId);
+  dev["name"] = boardName;
+  dev["mf"] = "VDA Solutions";
+  dev["mdl"] = BOARD_TYPE;
+  dev["sw"] = FIRMWARE_VERSION;
+  dev["cu"] = "http://" + getLocalIP() + "/";
 }
 
-// ============ Serial Bridge Handlers ============
+// One message of a discovery pass. Each port gets two steps: the text entity
+// used to send from an output and the sensor showing codes seen on an input.
+// The one that doesn't match the port's mode is cleared if the port may have
+// had that mode before. The board's status sensor comes last.
+static void publishDiscoveryStep() {
+  static char payload[1024];  // mqtt task only
+  char topic[MQTT_TOPIC_MAX];
+  char value[MQTT_TOPIC_MAX];
+  StaticJsonDocument<1024> doc;
+  int step = mqtt.discoveryStep;
+
+  doc["~"] = (const char*)mqtt.baseTopic;
+  doc["avty_t"] = "~/availability";
+
+  if (step >= portCount * 2) {
+    mqtt.discoveryStep = -1;
+    snprintf(topic, sizeof(topic), "%s/sensor/%s/status/config", mqtt.config.discoveryPrefix, mqtt.nodeId);
+    doc["name"] = "Uptime";
+    snprintf(value, sizeof(value), "%s_uptime", mqtt.nodeId);
+    doc["uniq_id"] = value;
+    doc["stat_t"] = "~/status";
+    doc["val_tpl"] = "{{ value_json.uptime_s }}";
+    doc["json_attr_t"] = "~/status";
+    doc["dev_cla"] = "duration";
+    doc["unit_of_meas"] = "s";
+    doc["ent_cat"] = "diagnostic";
+    addMqttDevice(doc.createNestedObject("dev"));
+  } else {
+    mqtt.discoveryStep++;
+    int i = step / 2;
+    PortMode component = (step % 2 == 0) ? PORT_IR_OUTPUT : PORT_IR_INPUT;
+    PortMode mode = ports[i].mode;
+    uint8_t gpio = ports[i].gpio;
+    uint8_t previous = mqtt.discovered[i];
+    if (step % 2 == 1) mqtt.discovered[i] = mode;
+
+    snprintf(topic, sizeof(topic), "%s/%s/%s/ir_%u/config", mqtt.config.discoveryPrefix,
+             component == PORT_IR_OUTPUT ? "text" : "sensor", mqtt.nodeId, gpio);
+    if (mode != component) {
+      if (previous == component || previous == 0xFF) {
+        mqttPublishTo(topic, "", 0, true);
+      }
+      return;
+    }
 
-void initSerialBridge(int rxPin, int txPin, int baud) {
-  if (serialBridgeEnabled) {
-    SerialBridge.end();
+    char name[PORT_NAME_MAX_LEN + 1];
+    strlcpy(name, ports[i].name, sizeof(name));
+    if (!name[0]) {
+      snprintf(name, sizeof(name), "IR %s GPIO%u", mode == PORT_IR_OUTPUT ? "output" : "input", gpio);
+    }
+    doc["name"] = name;
+    snprintf(value, sizeof(value), "%s_ir_%u", mqtt.nodeId, gpio);
+    doc["uniq_id"] = value;
+    doc["ic"] = "mdi:remote";
+    if (mode == PORT_IR_OUTPUT) {
+      snprintf(value, sizeof(value), "~/cmd/ir/%u", gpio);
+      doc["cmd_t"] = value;
+      doc["mode"] = "text";
+      doc["max"] = 255;
+    } else {
+      snprintf(value, sizeof(value), "~/ir/%u/received", gpio);
+      doc["stat_t"] = value;
+      doc["json_attr_t"] = value;
+      doc["val_tpl"] = "{{ value_json.code }}";
+    }
+    addMqttDevice(doc.createNestedObject("dev"));
   }
 
-  serialBridgeRxPin = rxPin;
-  serialBridgeTxPin = txPin;
-  serialBridgeBaud = baud;
-
-  SerialBridge.begin(baud, SERIAL_8N1, rxPin, txPin);
-  serialBridgeEnabled = true;
-  serialBridgeBuffer = "";
+  size_t len = serializeJson(doc, payload, sizeof(payload));
+  if (mqttPublishTo(topic, payload, len, true)) {
+    mqttStats.discoveryPublished++;
+  }
+}
 
-  Serial.printf("Serial bridge initialized: RX=%d, TX=%d, Baud=%d\n", rxPin, txPin, baud);
+// Retained health state, on connect and every MQTT_STATUS_INTERVAL_MS
+static void publishMqttStatus() {
+  StaticJsonDocument<512> doc;
+  doc["uptime_s"] = millis() / 1000;
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["board_id"] = boardId;
+  doc["ip"] = getLocalIP();
+  doc["config_generation"] = configGeneration;
+  doc["free_heap"] = ESP.getFreeHeap();
+  doc["min_free_heap"] = ESP.getMinFreeHeap();
+  JsonArray idle = doc.createNestedArray("idle_percent");
+  idle.add(loadStats.idlePercent[0]);
+  idle.add(loadStats.idlePercent[1]);
+#ifdef USE_WIFI
+  doc["rssi"] = WiFi.RSSI();
+#endif
+  doc["mqtt_dropped"] = mqttStats.dropped;
+
+  char payload[MQTT_PAYLOAD_MAX];
+  char topic[MQTT_TOPIC_MAX];
+  size_t len = serializeJson(doc, payload, sizeof(payload));
+  mqttTopic(topic, sizeof(topic), "status");
+  mqttPublishTo(topic, payload, len, true);
+  mqtt.lastStatusMs = millis();
 }
 
-void handleSerialConfig() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
-    return;
+// An MQTT serial/send command becomes a one- or two-step batch for the
+// bridge task, which publishes the response when it is done
+static int queueMqttSerialSend(JsonObject body, const char*& error, uint32_t& batchId) {
+  if (!serialBridgeEnabled) {
+    error = "Serial bridge not configured";
+    return 400;
   }
-
-  StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, server.arg("plain"));
-
-  if (error) {
-    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
-    return;
+  uint32_t timeout = body["timeout"] | 1000;
+  bool waitResponse = body["wait_response"] | true;
+  if (timeout > SERIAL_BATCH_MAX_WAIT_MS) {
+    error = "timeout out of range";
+    return 400;
   }
 
-  int rxPin = doc["rx_pin"] | -1;
-  int txPin = doc["tx_pin"] | -1;
-  int baud = doc["baud_rate"] | 115200;
-
-  if (rxPin < 0 || txPin < 0) {
-    server.send(400, "application/json", "{\"error\":\"rx_pin and tx_pin required\"}");
-    return;
+  SerialBatchState priorState;
+  if (!claimSerialBridge(priorState)) {
+    error = "Serial batch in progress";
+    return 409;
   }
+  serialBatch.stepCount = 0;
+  serialBatch.dataUsed = 0;
+  serialBatch.resultCount = 0;
+  serialBatch.error = nullptr;
+
+  body["op"] = "send";
+  error = parseBatchStep(body, 2, serialBatch, serialBatch.steps[0]);
+  if (error != nullptr) {
+    releaseSerialBridge(priorState);
+    return 400;
+  }
+  serialBatch.stepCount = 1;
 
-  // Validate pins based on board type
-#ifdef USE_ETHERNET
-  // Olimex: Recommended UART1 on GPIO9 (RX) / GPIO10 (TX)
-  Serial.printf("Olimex board: Configuring serial on RX=%d, TX=%d\n", rxPin, txPin);
-#else
-  // DevKit: UART1 on GPIO16/17 or UART2 on GPIO25/26
-  Serial.printf("DevKit board: Configuring serial on RX=%d, TX=%d\n", rxPin, txPin);
-#endif
-
-  initSerialBridge(rxPin, txPin, baud);
-
-  StaticJsonDocument<256> response;
-  response["success"] = true;
-  response["rx_pin"] = rxPin;
-  response["tx_pin"] = txPin;
-  response["baud_rate"] = baud;
+  if (waitResponse && timeout > 0) {
+    // No response before the timeout is not a failure, as with /serial/send
+    SerialStep& wait = serialBatch.steps[serialBatch.stepCount++];
+    wait.op = STEP_WAIT;
+    wait.dataOffset = serialBatch.dataUsed;
+    wait.dataLen = 0;
+    wait.ms = timeout;
+    wait.onMatch = BATCH_NEXT;
+    wait.onFail = BATCH_NEXT;
+  }
 
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  strlcpy(mqttSerialRequest.id, body["id"] | "", sizeof(mqttSerialRequest.id));
+  mqttSerialRequest.hex = strcmp(body["response_format"] | "text", "hex") == 0;
+  strlcpy(serialBatchResponseFormat, mqttSerialRequest.hex ? "hex" : "text", sizeof(serialBatchResponseFormat));
+  queueSerialBatch(true);
+  batchId = serialBatchId;
+  return 202;
 }
 
-void handleSerialSend() {
-  if (!serialBridgeEnabled) {
-    server.send(400, "application/json", "{\"error\":\"Serial bridge not configured\"}");
-    return;
+// A port command is a send_ir body without "output", or for the Home
+// Assistant text entity "protocol:code" or a bare NEC code
+static bool parseIrPortCommand(MqttCommand& command, JsonDocument& doc) {
+  if (command.payload[0] == '{') {
+    return deserializeJson(doc, command.payload, command.len) == DeserializationError::Ok && doc.is<JsonObject>();
   }
-
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"error\":\"No body\"}");
-    return;
+  char* colon = strchr(command.payload, ':');
+  if (colon != nullptr) {
+    *colon = '\0';
+    doc["protocol"] = (const char*)command.payload;
+    doc["code"] = (const char*)(colon + 1);
+  } else {
+    doc["code"] = (const char*)command.payload;
   }
+  return true;
+}
 
-  StaticJsonDocument<512> doc;
-  DeserializationError error = deserializeJson(doc, server.arg("plain"));
-
-  if (error) {
-    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+// Commands on <base>/cmd/... take the same bodies as the HTTP endpoints. The
+// outcome goes to <base>/result with the HTTP status the endpoint would give.
+static void handleMqttCommand(MqttCommand& command) {
+  char topic[MQTT_TOPIC_MAX];
+  snprintf(topic, sizeof(topic), "%s/status", mqtt.config.discoveryPrefix);
+  if (strcmp(command.topic, topic) == 0) {
+    // Home Assistant restarted and forgot retained discovery it didn't store
+    if (strcmp(command.payload, "online") == 0) startMqttDiscovery();
     return;
   }
 
-  String data = doc["data"] | "";
-  String format = doc["format"] | "text";
-  String lineEnding = doc["line_ending"] | "none";
-  int timeout = doc["timeout"] | 1000;  // Response timeout in ms
-  bool waitResponse = doc["wait_response"] | true;
-
-  if (data.length() == 0) {
-    server.send(400, "application/json", "{\"error\":\"data required\"}");
+  size_t baseLen = strlen(mqtt.baseTopic);
+  if (strncmp(command.topic, mqtt.baseTopic, baseLen) != 0 || strncmp(command.topic + baseLen, "/cmd/", 5) != 0) {
     return;
   }
-
-  // Clear any pending data in the buffer
-  while (SerialBridge.available()) {
-    SerialBridge.read();
-  }
-  serialBridgeBuffer = "";
-
-  // Send data
-  if (format == "hex") {
-    // Parse hex string and send bytes
-    for (size_t i = 0; i < data.length(); i += 2) {
-      if (i + 1 < data.length()) {
-        String byteStr = data.substring(i, i + 2);
-        uint8_t b = (uint8_t)strtol(byteStr.c_str(), nullptr, 16);
-        SerialBridge.write(b);
-      }
+  const char* name = command.topic + baseLen + 5;
+  mqttStats.commands++;
+
+  DynamicJsonDocument doc(SEND_IR_JSON_SIZE);
+  const char* error = nullptr;
+  uint32_t batchId = 0;
+  int status;
+
+  bool irSend = strcmp(name, "ir/send") == 0;
+  if (irSend || strcmp(name, "serial/send") == 0) {
+    if (deserializeJson(doc, command.payload, command.len) != DeserializationError::Ok || !doc.is<JsonObject>()) {
+      error = "Invalid JSON";
+      status = 400;
+    } else if (irSend) {
+      status = sendIrRequest(doc.as<JsonObjectConst>(), error);
+    } else {
+      status = queueMqttSerialSend(doc.as<JsonObject>(), error, batchId);
+    }
+  } else if (strncmp(name, "ir/", 3) == 0 && isdigit((unsigned char)name[3])) {
+    if (!parseIrPortCommand(command, doc)) {
+      error = "Invalid JSON";
+      status = 400;
+    } else {
+      doc["output"] = atoi(name + 3);
+      status = sendIrRequest(doc.as<JsonObjectConst>(), error);
     }
   } else {
-    // Send as text
-    SerialBridge.print(data);
+    error = "Unknown command";
+    status = 404;
   }
 
-  // Add line ending
-  if (lineEnding == "cr") {
-    SerialBridge.write('\r');
-  } else if (lineEnding == "lf") {
-    SerialBridge.write('\n');
-  } else if (lineEnding == "crlf") {
-    SerialBridge.write('\r');
-    SerialBridge.write('\n');
-  } else if (lineEnding == "!") {
-    SerialBridge.write('!');
+  if (error == nullptr && status == 503) error = "IR transmitter busy";
+  if (error == nullptr && status == 504) error = "IR transmit timed out";
+  if (status >= 300) mqttStats.commandErrors++;
+
+  StaticJsonDocument<256> result;
+  result["command"] = name;
+  if (!doc["id"].isNull()) result["id"] = doc["id"];
+  result["status"] = status;
+  result["success"] = status < 300;
+  if (error != nullptr) result["error"] = error;
+  if (batchId != 0) result["batch_id"] = batchId;
+  mqttEnqueueJson("result", result, false);
+}
+
+// Commands first, since the broker already has their acks; then queued
+// events, discovery and the periodic status while fewer than
+// MQTT_INFLIGHT_MAX publishes are unacknowledged
+static void serviceMqtt() {
+  static MqttCommand command;  // mqtt task only
+  static MqttMessage message;
+
+  while (xQueueReceive(mqttInbox, &command, 0) == pdTRUE) {
+    esp_task_wdt_reset();  // An IR command may wait up to IR_TX_TIMEOUT_MS
+    handleMqttCommand(command);
   }
+  if (!mqttStats.connected) return;
 
-  Serial.printf("Serial sent: %s (format=%s, ending=%s)\n", data.c_str(), format.c_str(), lineEnding.c_str());
+  if (mqtt.connectedEvent) {
+    mqtt.connectedEvent = false;
+    mqttPublishTo(mqtt.willTopic, "online", 0, true);
+    mqtt.lastStatusMs = millis() - MQTT_STATUS_INTERVAL_MS;
+    startMqttDiscovery();
+  }
+  if (configGeneration != mqtt.discoveredGeneration) {
+    startMqttDiscovery();
+  }
 
-  // Wait for response if requested
-  String response = "";
-  if (waitResponse && timeout > 0) {
-    unsigned long start = millis();
-    while (millis() - start < (unsigned long)timeout) {
-      while (SerialBridge.available()) {
-        char c = SerialBridge.read();
-        response += c;
-        // Check for common terminators
-        if (c == '\n' || c == '\r' || c == '!') {
-          // Give a little more time for additional data
-          delay(50);
-          while (SerialBridge.available()) {
-            response += (char)SerialBridge.read();
-          }
-          break;
-        }
-      }
-      if (response.length() > 0) {
+  while (mqttStats.connected && mqttInflight < MQTT_INFLIGHT_MAX) {
+    esp_task_wdt_reset();
+    if (xQueueReceive(mqttOutbox, &message, 0) == pdTRUE) {
+      char topic[MQTT_TOPIC_MAX];
+      mqttTopic(topic, sizeof(topic), message.topic);
+      if (!mqttPublishTo(topic, message.payload, message.len, message.retain)) {
+        portENTER_CRITICAL(&mqttMux);
+        mqttStats.dropped++;
+        portEXIT_CRITICAL(&mqttMux);
         break;
       }
-      delay(10);
+    } else if (mqtt.discoveryStep >= 0) {
+      publishDiscoveryStep();
+    } else if (millis() - mqtt.lastStatusMs >= MQTT_STATUS_INTERVAL_MS) {
+      publishMqttStatus();
+    } else {
+      break;
     }
   }
+}
 
-  // Trim response
-  response.trim();
-
-  Serial.printf("Serial response: %s\n", response.c_str());
+void mqttTask(void* param) {
+  esp_task_wdt_add(NULL);
 
-  StaticJsonDocument<512> respDoc;
-  respDoc["success"] = true;
-  respDoc["response"] = response;
-  respDoc["response_length"] = response.length();
+  for (;;) {
+    esp_task_wdt_reset();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TASK_IDLE_WAIT_MS));
 
-  String respStr;
-  serializeJson(respDoc, respStr);
-  server.send(200, "application/json", respStr);
+    unsigned long start = micros();
+    if (mqttRestart) {
+      mqttRestart = false;
+      restartMqttClient();
+    }
+    if (mqtt.client != nullptr) {
+      serviceMqtt();
+    }
+    accountTask(TASK_MQTT, start);
+  }
 }
 
-void handleSerialRead() {
-  if (!serialBridgeEnabled) {
-    server.send(400, "application/json", "{\"error\":\"Serial bridge not configured\"}");
+// Called by the net task when services start and after POST /mqtt. The
+// queues and the task are created the first time MQTT is enabled.
+void startMqtt() {
+  if (apMode || (!mqttConfig.enabled && tasks[TASK_MQTT].handle == nullptr)) {
     return;
   }
-
-  // Read any available data
-  String data = "";
-  while (SerialBridge.available()) {
-    data += (char)SerialBridge.read();
+  if (mqttOutbox == nullptr) {
+    mqttOutbox = xQueueCreate(MQTT_OUTBOX_LEN, sizeof(MqttMessage));
+    mqttInbox = xQueueCreate(MQTT_INBOX_LEN, sizeof(MqttCommand));
+  }
+  mqttRestart = true;
+  if (tasks[TASK_MQTT].handle == nullptr) {
+    startTask(TASK_MQTT, mqttTask);
+  } else {
+    xTaskNotifyGive(tasks[TASK_MQTT].handle);
   }
+}
 
-  StaticJsonDocument<512> response;
-  response["success"] = true;
-  response["data"] = data;
-  response["length"] = data.length();
+void addMqttStats(JsonObject obj) {
+  char nodeId[24];
+  char base[MQTT_BASE_TOPIC_MAX];
+  formatMqttIds(mqttConfig, nodeId, sizeof(nodeId), base, sizeof(base));
+
+  obj["enabled"] = mqttConfig.enabled;
+  obj["uri"] = mqttConfig.uri;
+  obj["username"] = mqttConfig.username;
+  obj["password_set"] = mqttConfig.password[0] != '\0';
+  obj["client_id"] = nodeId;
+  obj["base_topic"] = base;
+  obj["discovery"] = mqttConfig.discovery;
+  obj["discovery_prefix"] = mqttConfig.discoveryPrefix;
+  obj["connected"] = mqttStats.connected;
+  obj["session_present"] = mqttStats.sessionPresent;
+  obj["connected_s"] = mqttStats.connected ? (millis() - mqttStats.connectedMs) / 1000 : 0;
+  obj["connects"] = mqttStats.connects;
+  obj["connect_failures"] = mqttStats.connectFailures;
+  obj["disconnects"] = mqttStats.disconnects;
+  obj["reconnect_delay_ms"] = mqttStats.reconnectDelayMs;
+  obj["published"] = mqttStats.published;
+  obj["acked"] = mqttStats.acked;
+  obj["inflight"] = mqttInflight;
+  obj["outbox_queued"] = mqttOutbox != nullptr ? uxQueueMessagesWaiting(mqttOutbox) : 0;
+  obj["outbox_size"] = MQTT_OUTBOX_LEN;
+  obj["dropped"] = mqttStats.dropped;
+  obj["commands"] = mqttStats.commands;
+  obj["command_errors"] = mqttStats.commandErrors;
+  obj["commands_dropped"] = mqttStats.commandsDropped;
+  obj["discovery_published"] = mqttStats.discoveryPublished;
+  obj["last_error"] = mqttStats.lastError;
+}
 
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+void handleMqttStatus() {
+  RequestJsonDocument doc(1536);
+  addMqttStats(doc.to<JsonObject>());
+  sendJson(200, doc);
 }
 
-void handleSerialStatus() {
-  StaticJsonDocument<256> response;
+// Topics are used as given, so wildcards and stray separators are rejected
+static bool validMqttTopic(const char* topic) {
+  size_t len = strlen(topic);
+  return strpbrk(topic, "+#") == nullptr && (len == 0 || (topic[0] != '/' && topic[len - 1] != '/'));
+}
 
-  response["enabled"] = serialBridgeEnabled;
-  response["rx_pin"] = serialBridgeRxPin;
-  response["tx_pin"] = serialBridgeTxPin;
-  response["baud_rate"] = serialBridgeBaud;
-  response["available"] = serialBridgeEnabled ? SerialBridge.available() : 0;
+static bool copyMqttField(JsonDocument& doc, const char* key, char* out, size_t size) {
+  if (!doc.containsKey(key)) return true;
+  const char* value = doc[key] | "";
+  if (strlen(value) >= size) return false;
+  strlcpy(out, value, size);
+  return true;
+}
 
-#ifdef USE_ETHERNET
-  response["board_type"] = "olimex_poe_iso";
-  JsonObject recommended = response.createNestedObject("recommended_pins");
-  recommended["uart1_rx"] = 9;
-  recommended["uart1_tx"] = 10;
-#else
-  response["board_type"] = "esp32_devkit";
-  JsonObject recommended = response.createNestedObject("recommended_pins");
-  recommended["uart1_rx"] = 16;
-  recommended["uart1_tx"] = 17;
-  recommended["uart2_rx"] = 25;
-  recommended["uart2_tx"] = 26;
-#endif
+void handleMqttConfig() {
+  if (!server.hasBody()) {
+    server.send(400, "application/json", "{\"error\":\"No body\"}");
+    return;
+  }
+
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, server.body(), server.bodyLength());
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return;
+  }
+
+  MqttConfig config = mqttConfig;
+  config.enabled = doc["enabled"] | config.enabled;
+  config.discovery = doc["discovery"] | config.discovery;
+  if (!copyMqttField(doc, "uri", config.uri, sizeof(config.uri)) ||
+      !copyMqttField(doc, "username", config.username, sizeof(config.username)) ||
+      !copyMqttField(doc, "password", config.password, sizeof(config.password)) ||
+      !copyMqttField(doc, "base_topic", config.baseTopic, sizeof(config.baseTopic)) ||
+      !copyMqttField(doc, "discovery_prefix", config.discoveryPrefix, sizeof(config.discoveryPrefix))) {
+    server.send(400, "application/json", "{\"error\":\"Value too long\"}");
+    return;
+  }
+  if (config.uri[0] && strncmp(config.uri, "mqtt://", 7) != 0) {
+    server.send(400, "application/json", "{\"error\":\"uri must be an mqtt:// URI\"}");
+    return;
+  }
+  if (!validMqttTopic(config.baseTopic) || !validMqttTopic(config.discoveryPrefix) || !config.discoveryPrefix[0]) {
+    server.send(400, "application/json", "{\"error\":\"Topics must not contain wildcards or start or end with /\"}");
+    return;
+  }
+  if (config.enabled && !config.uri[0]) {
+    server.send(400, "application/json", "{\"error\":\"uri required\"}");
+    return;
+  }
+
+  portENTER_CRITICAL(&mqttMux);
+  mqttConfig = config;
+  portEXIT_CRITICAL(&mqttMux);
+  saveMqttConfig(config);
+  if (networkServicesStarted) startMqtt();
 
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  handleMqttStatus();
 }
 
 void handleNotFound() {
@@ -0,0 +1,19 @@
+#include "metrics.h"
+
+RouteMetrics routeMetrics[ROUTE_METRICS_MAX];
+int routeMetricsCount = 0;
+volatile int currentRoute = -1;
+
+// Upper bound of the bucket holding the given percentile, so within a factor
+// of two of the real value; 0 for an empty histogram
+uint32_t latencyPercentileUs(const LatencyHistogram& h, uint8_t percent) {
+  if (h.count == 0) return 0;
+  uint32_t rank = ((uint64_t)h.count * percent + 99) / 100;
+  uint32_t seen = 0;
+  int i = 0;
+  for (; i < LATENCY_BUCKETS; i++) {
+    seen += h.buckets[i];
+    if (seen >= rank) break;
+  }
+  return 1UL << (LATENCY_MIN_SHIFT + i);
+}
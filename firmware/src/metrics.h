@@ -0,0 +1,45 @@
+// Counters and log2-bucketed latency histograms in fixed memory, exported by
+// /metrics in Prometheus text format. Every histogram has a single writer task
+// (routes: net, ir_send: ir_tx, ir_receive: ir_rx, serial_batch: serial_bridge),
+// so recording is a few plain stores with no locking.
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+
+#define LATENCY_BUCKETS 16     // Upper bounds 2^6 us (64us) .. 2^21 us (~2.1s)
+#define LATENCY_MIN_SHIFT 6
+#define ROUTE_METRICS_MAX 40
+#define ROUTE_PATH_MAX 32
+
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t errors;
+  uint64_t sumUs;
+  uint32_t buckets[LATENCY_BUCKETS + 1];  // Per bucket, not cumulative; last is +Inf
+};
+
+struct RouteMetrics {
+  char path[ROUTE_PATH_MAX];
+  HTTPMethod method;
+  LatencyHistogram latency;
+  uint32_t allocs;      // Heap allocations made while handling the route
+  uint64_t allocBytes;
+};
+
+extern RouteMetrics routeMetrics[ROUTE_METRICS_MAX];
+extern int routeMetricsCount;
+extern volatile int currentRoute;  // Route being handled by the net task, -1 if none
+
+inline void recordLatency(LatencyHistogram& h, uint32_t us, bool error) {
+  uint32_t scaled = us > 0 ? (us - 1) >> LATENCY_MIN_SHIFT : 0;
+  uint32_t bucket = scaled ? 32 - __builtin_clz(scaled) : 0;
+  if (bucket > LATENCY_BUCKETS) bucket = LATENCY_BUCKETS;
+
+  h.buckets[bucket]++;
+  h.sumUs += us;
+  h.count++;
+  if (error) h.errors++;
+}
+
+uint32_t latencyPercentileUs(const LatencyHistogram& h, uint8_t percent);
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <utility>
+
+#include "metrics.h"
+#include "request_arena.h"
+
+#ifdef USE_WIFI
+void recordWifiRequest(uint32_t us, bool error);  // Per WiFi power profile
+#endif
+
+// Largest JSON body a route will parse; a full raw_data array fits easily
+#define REQUEST_BODY_MAX 8192
+
+// WebServer that records a latency histogram for every route registered with
+// on()/onNotFound() and remembers the status code of the last response, so
+// handlers keep using the plain WebServer API.
+//
+// Routes that take a body read it with body() instead of arg("plain"):
+// WebServer mallocs Content-Length bytes for arg("plain") and copies them into
+// a String before the route runs. Here the body goes through raw() into the
+// request arena, and one over REQUEST_BODY_MAX is refused from its
+// Content-Length header before any of it is read. POSTs to unknown paths are
+// drained the same way. Query arguments aren't parsed for body routes, and
+// multipart forms still go through WebServer (only /update takes one).
+class MetricsWebServer : public WebServer {
+ public:
+  explicit MetricsWebServer(int port) : WebServer(port) {}
+
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn) {
+    int id = addRoute(uri, method);
+    if (takesBody(method)) {
+      addHandler(new BodyRequestHandler(*this, uri, method, id, instrument(id, fn)));
+    } else {
+      WebServer::on(uri, method, instrument(id, fn));
+    }
+  }
+
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction upload) {
+    WebServer::on(uri, method, instrument(addRoute(uri, method), fn), upload);
+  }
+
+  // Register last: the catch-all takes body requests no route matched
+  void onNotFound(THandlerFunction fn) {
+    int id = addRoute("*", HTTP_ANY);
+    THandlerFunction handler = instrument(id, fn);
+    addHandler(new BodyRequestHandler(*this, "*", HTTP_ANY, id, handler));
+    WebServer::onNotFound(handler);
+  }
+
+  // Request body, NUL-terminated; valid until the route returns
+  bool hasBody() const { return bodyLen > 0; }
+  const char* body() const { return bodyLen > 0 ? bodyBuf : ""; }
+  char* mutableBody() { return bodyLen > 0 ? bodyBuf : nullptr; }  // For in-place parsing
+  size_t bodyLength() const { return bodyLen; }
+
+  template <typename... Args>
+  void send(int code, Args&&... args) {
+    responseCode = code;
+    WebServer::send(code, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  void send_P(int code, Args&&... args) {
+    responseCode = code;
+    WebServer::send_P(code, std::forward<Args>(args)...);
+  }
+
+ private:
+  class BodyRequestHandler : public RequestHandler {
+   public:
+    BodyRequestHandler(MetricsWebServer& server, const String& uri, HTTPMethod method, int route, THandlerFunction fn)
+        : server(server), uri(uri), method(method), route(route), fn(fn) {}
+
+    bool canHandle(HTTPMethod requestMethod, String requestUri) override {
+      if (!takesBody(requestMethod)) return false;
+      if (method != HTTP_ANY && requestMethod != method) return false;
+      return uri == "*" || requestUri == uri;
+    }
+
+    bool canRaw(String requestUri) override { return true; }
+
+    bool handle(WebServer& webServer, HTTPMethod requestMethod, String requestUri) override {
+      if (!canHandle(requestMethod, requestUri)) return false;
+      fn();
+      return true;
+    }
+
+    void raw(WebServer& webServer, String requestUri, HTTPRaw& raw) override {
+      server.captureBody(route, raw);
+    }
+
+   private:
+    MetricsWebServer& server;
+    String uri;
+    HTTPMethod method;
+    int route;
+    THandlerFunction fn;
+  };
+
+  int responseCode = 0;
+  char* bodyBuf = nullptr;
+  size_t bodyLen = 0;
+  size_t bodyCapacity = 0;
+  bool bodyRefused = false;
+
+  static bool takesBody(HTTPMethod method) {
+    return method == HTTP_POST || method == HTTP_PUT || method == HTTP_PATCH || method == HTTP_DELETE;
+  }
+
+  void captureBody(int route, HTTPRaw& raw) {
+    switch (raw.status) {
+      case RAW_START: {
+        unsigned long start = micros();
+        bodyBuf = nullptr;
+        bodyLen = 0;
+        bodyCapacity = 0;
+        bodyRefused = false;
+        // Content-Length is collected by setupWebServer(); WebServer reads
+        // exactly that many bytes
+        long length = header("Content-Length").toInt();
+        if (length <= 0) return;
+        if (length > REQUEST_BODY_MAX) {
+          refuseBody(route, start, 413, "{\"error\":\"Body too large\"}");
+          return;
+        }
+        bodyBuf = (char*)arenaAlloc(length + 1);
+        if (bodyBuf == nullptr) {
+          refuseBody(route, start, 500, "{\"error\":\"Out of memory\"}");
+          return;
+        }
+        bodyCapacity = length;
+        bodyBuf[0] = '\0';
+        break;
+      }
+      case RAW_WRITE: {
+        if (bodyRefused || bodyBuf == nullptr) return;
+        size_t n = std::min(raw.currentSize, bodyCapacity - bodyLen);
+        memcpy(bodyBuf + bodyLen, raw.buf, n);
+        bodyLen += n;
+        break;
+      }
+      case RAW_END:
+        if (bodyBuf != nullptr) bodyBuf[bodyLen] = '\0';
+        break;
+      case RAW_ABORTED:
+        releaseBody();
+        break;
+    }
+  }
+
+  // Answer from the headers and drop the connection, so WebServer gives up
+  // on the request instead of reading the body
+  void refuseBody(int route, unsigned long start, int code, const char* message) {
+    bodyRefused = true;
+    send(code, "application/json", message);
+    client().stop();
+    if (route >= 0) recordRequest(route, micros() - start);
+  }
+
+  void releaseBody() {
+    arenaFree(bodyBuf);
+    bodyBuf = nullptr;
+    bodyLen = 0;
+    bodyCapacity = 0;
+  }
+
+  void recordRequest(int id, uint32_t us) {
+    recordLatency(routeMetrics[id].latency, us, responseCode >= 400);
+#ifdef USE_WIFI
+    recordWifiRequest(us, responseCode >= 400);
+#endif
+  }
+
+  // Route id for the metrics table, -1 once it is full
+  int addRoute(const String& uri, HTTPMethod method) {
+    if (routeMetricsCount >= ROUTE_METRICS_MAX) return -1;
+
+    int id = routeMetricsCount++;
+    strlcpy(routeMetrics[id].path, uri.c_str(), ROUTE_PATH_MAX);
+    routeMetrics[id].method = method;
+    return id;
+  }
+
+  THandlerFunction instrument(int id, THandlerFunction fn) {
+    return [this, id, fn]() {
+      responseCode = 0;
+      currentRoute = id;
+      unsigned long start = micros();
+      fn();
+      if (id >= 0) recordRequest(id, micros() - start);
+      currentRoute = -1;
+      bodyBuf = nullptr;  // Freed with the rest of the arena
+      bodyLen = 0;
+      arenaReset();
+    };
+  }
+};
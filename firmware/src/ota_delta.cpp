@@ -0,0 +1,114 @@
+#include "ota_delta.h"
+
+#include <mbedtls/sha256.h>
+
+// True if the 4 bytes at data start a delta rather than a firmware image
+bool isDeltaMagic(const uint8_t* data) {
+  return memcmp(data, "VDAD", 4) == 0;
+}
+
+void deltaBegin(OtaDelta& d, uint32_t sourceSize, DeltaRead read, DeltaWrite write) {
+  memset(&d, 0, sizeof(d));
+  d.sourceSize = sourceSize;
+  d.read = read;
+  d.write = write;
+}
+
+// Check the delta was made against the firmware that is running
+static bool deltaSourceMatches(OtaDelta& d) {
+  if (d.header.oldSize > d.sourceSize) return false;
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  unsigned long start = micros();
+  for (uint32_t pos = 0; pos < d.header.oldSize; pos += OTA_DELTA_BLOCK) {
+    size_t n = min((uint32_t)OTA_DELTA_BLOCK, d.header.oldSize - pos);
+    if (!d.read(pos, d.block, n)) break;
+    mbedtls_sha256_update_ret(&sha, d.block, n);
+  }
+  d.readUs += micros() - start;
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  return memcmp(digest, d.header.oldSha, sizeof(digest)) == 0;
+}
+
+// Gathers a fixed-size header or record across chunk boundaries; returns
+// true once it is complete
+static bool deltaField(OtaDelta& d, uint8_t*& data, size_t& len, void* out, size_t size) {
+  size_t n = min(len, size - d.fieldLen);
+  memcpy(d.field + d.fieldLen, data, n);
+  d.fieldLen += n;
+  data += n;
+  len -= n;
+  if (d.fieldLen < size) return false;
+  memcpy(out, d.field, size);
+  d.fieldLen = 0;
+  return true;
+}
+
+// Feeds the next bytes of the delta; rebuilt image bytes go to d.write.
+// Returns the problem if the delta can't be applied.
+const char* deltaApply(OtaDelta& d, uint8_t* data, size_t len) {
+  while (len > 0) {
+    switch (d.state) {
+      case DELTA_HEADER:
+        if (!deltaField(d, data, len, &d.header, sizeof(DeltaHeader))) return nullptr;
+        if (d.header.version != OTA_DELTA_VERSION) return "Unsupported delta version";
+        if (!deltaSourceMatches(d)) return "Delta is for a different firmware";
+        d.state = DELTA_RECORD;
+        break;
+
+      case DELTA_RECORD:
+        if (!deltaField(d, data, len, &d.record, sizeof(DeltaRecord))) return nullptr;
+        // 64-bit sum: two lengths near 4 GB must not wrap past the check
+        if (d.record.diffLen > d.header.oldSize - d.readPos ||
+            (uint64_t)d.written + d.record.diffLen + d.record.extraLen > d.header.newSize) {
+          return "Corrupt delta";
+        }
+        d.state = d.record.diffLen ? DELTA_DIFF : DELTA_EXTRA;
+        break;
+
+      case DELTA_DIFF: {
+        size_t n = min(min(len, (size_t)d.record.diffLen), (size_t)OTA_DELTA_BLOCK);
+        unsigned long start = micros();
+        bool ok = d.read(d.readPos, d.block, n);
+        d.readUs += micros() - start;
+        if (!ok) return "Cannot read running firmware";
+        for (size_t i = 0; i < n; i++) d.block[i] += data[i];
+        if (!d.write(d.block, n)) return "Cannot write new firmware";
+        d.written += n;
+        d.readPos += n;
+        d.record.diffLen -= n;
+        data += n;
+        len -= n;
+        if (d.record.diffLen == 0) d.state = DELTA_EXTRA;
+        break;
+      }
+
+      case DELTA_EXTRA: {
+        size_t n = min(len, (size_t)d.record.extraLen);
+        if (n > 0 && !d.write(data, n)) return "Cannot write new firmware";
+        d.written += n;
+        d.record.extraLen -= n;
+        data += n;
+        len -= n;
+        if (d.record.extraLen > 0) break;
+        int64_t pos = (int64_t)d.readPos + d.record.seek;
+        if (pos < 0 || pos > d.header.oldSize) return "Corrupt delta";
+        d.readPos = pos;
+        d.state = DELTA_RECORD;
+        break;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// Called after the last byte; the problem if the delta stopped short
+const char* deltaFinish(const OtaDelta& d) {
+  if (d.state == DELTA_HEADER || d.fieldLen > 0 || d.written != d.header.newSize) return "Truncated delta";
+  return nullptr;
+}
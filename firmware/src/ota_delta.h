@@ -0,0 +1,55 @@
+// Streaming application of delta updates made by tools/ota_delta.py. A delta
+// rebuilds the new image from the running one: each record adds diffLen bytes
+// to the running image at the read position, then copies extraLen literal
+// bytes, then moves the read position by seek. Input can arrive in chunks of
+// any size; the running image is read through a 512-byte block, and the
+// partition read and the image write are passed in by the caller.
+#pragma once
+
+#include <Arduino.h>
+
+#define OTA_DELTA_VERSION 1
+#define OTA_DELTA_BLOCK 512
+
+struct __attribute__((packed)) DeltaHeader {
+  char magic[4];         // "VDAD"
+  uint8_t version;
+  uint8_t reserved[3];
+  uint32_t oldSize;
+  uint8_t oldSha[32];
+  uint32_t newSize;
+  uint8_t newSha[32];
+};
+
+struct __attribute__((packed)) DeltaRecord {
+  uint32_t diffLen;      // Bytes added to the running image at the read position
+  uint32_t extraLen;     // Literal bytes that follow
+  int32_t seek;          // Read position adjustment after the diff
+};
+
+enum DeltaState : uint8_t { DELTA_HEADER, DELTA_RECORD, DELTA_DIFF, DELTA_EXTRA };
+
+// Reads len bytes of the running image at pos; false on a flash error
+typedef bool (*DeltaRead)(uint32_t pos, uint8_t* out, size_t len);
+// Bytes of the new image; false if they couldn't be written
+typedef bool (*DeltaWrite)(uint8_t* data, size_t len);
+
+struct OtaDelta {
+  DeltaState state;
+  uint8_t field[sizeof(DeltaHeader)];  // Header or record being assembled
+  size_t fieldLen;
+  DeltaHeader header;
+  DeltaRecord record;
+  DeltaRead read;
+  DeltaWrite write;
+  uint32_t sourceSize;                 // Running partition
+  uint32_t readPos;
+  uint32_t written;                    // New image bytes
+  uint8_t block[OTA_DELTA_BLOCK];
+  uint32_t readUs;                     // Time reading the running image
+};
+
+bool isDeltaMagic(const uint8_t* data);
+void deltaBegin(OtaDelta& d, uint32_t sourceSize, DeltaRead read, DeltaWrite write);
+const char* deltaApply(OtaDelta& d, uint8_t* data, size_t len);
+const char* deltaFinish(const OtaDelta& d);
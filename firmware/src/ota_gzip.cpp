@@ -0,0 +1,96 @@
+#include "ota_gzip.h"
+
+#include <esp_rom_crc.h>
+
+// Returns the size of the gzip header (RFC 1952) at data, 0 if it isn't
+// complete within len bytes or -1 if it isn't a deflate member
+int gzipHeaderSize(const uint8_t* data, size_t len) {
+  if (len < 10 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 8) return -1;  // CM must be deflate
+  uint8_t flags = data[3];
+  size_t pos = 10;
+  if (flags & 0x04) {  // FEXTRA
+    if (pos + 2 > len) return 0;
+    pos += 2 + (data[pos] | (data[pos + 1] << 8));
+  }
+  for (uint8_t field = 0x08; field <= 0x10; field <<= 1) {  // FNAME, FCOMMENT
+    if (!(flags & field)) continue;
+    while (pos < len && data[pos] != 0) pos++;
+    pos++;
+  }
+  if (flags & 0x02) pos += 2;  // FHCRC
+  return pos <= len ? pos : 0;
+}
+
+// Allocates the inflater and its window; false if out of memory
+bool gzipBegin(GzipStream& gz) {
+  memset(&gz, 0, sizeof(gz));
+  gz.inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  gz.window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  if (gz.inflator == nullptr || gz.window == nullptr) {
+    gzipRelease(gz);
+    return false;
+  }
+  tinfl_init(gz.inflator);
+  return true;
+}
+
+void gzipRelease(GzipStream& gz) {
+  free(gz.inflator);
+  free(gz.window);
+  gz.inflator = nullptr;
+  gz.window = nullptr;
+}
+
+// Feeds the next bytes of the .gz file; decompressed bytes go to output.
+// Returns the problem if the data can't be decoded.
+const char* gzipInflate(GzipStream& gz, const uint8_t* data, size_t len, GzipOutput output) {
+  if (!gz.headerDone) {
+    // The header (with the original file name) arrives in the first chunk
+    int header = gzipHeaderSize(data, len);
+    if (header <= 0) return "Invalid gzip header";
+    data += header;
+    len -= header;
+    gz.headerDone = true;
+  }
+
+  while (len > 0 && !gz.inflateDone) {
+    size_t inBytes = len;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - gz.windowPos;
+    tinfl_status status = tinfl_decompress(gz.inflator, data, &inBytes, gz.window,
+                                           gz.window + gz.windowPos, &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inBytes;
+    len -= inBytes;
+    if (outBytes > 0) {
+      gz.crc = esp_rom_crc32_le(gz.crc, gz.window + gz.windowPos, outBytes);
+      gz.size += outBytes;
+      output(gz.window + gz.windowPos, outBytes);
+    }
+    gz.windowPos = (gz.windowPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE) {
+      gz.inflateDone = true;
+    } else if (status < TINFL_STATUS_DONE) {
+      return "Corrupt gzip data";
+    } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && inBytes == 0 && outBytes == 0) {
+      break;
+    }
+  }
+
+  // What follows the deflate stream is the 8-byte trailer
+  while (gz.inflateDone && len > 0 && gz.trailerLen < sizeof(gz.trailer)) {
+    gz.trailer[gz.trailerLen++] = *data++;
+    len--;
+  }
+  return nullptr;
+}
+
+// Once the upload is complete: the problem if the stream was cut short or
+// doesn't match its trailer
+const char* gzipFinish(const GzipStream& gz) {
+  const uint8_t* t = gz.trailer;
+  uint32_t crc = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t)t[3] << 24);
+  uint32_t size = t[4] | (t[5] << 8) | (t[6] << 16) | ((uint32_t)t[7] << 24);
+  if (!gz.inflateDone || gz.trailerLen < sizeof(gz.trailer)) return "Truncated gzip data";
+  if (crc != gz.crc || size != gz.size) return "gzip CRC mismatch";
+  return nullptr;
+}
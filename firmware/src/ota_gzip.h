@@ -0,0 +1,29 @@
+// Streaming gzip (RFC 1952) decoding for OTA images. The header is skipped,
+// the deflate stream is inflated by the ROM inflater into a TINFL_LZ_DICT_SIZE
+// ring, and each run of output is handed on as it is produced, so an image
+// of any size passes through a fixed 32 KB window. The CRC-32 and size of
+// the output are checked against the trailer at the end.
+#pragma once
+
+#include <Arduino.h>
+#include <rom/miniz.h>
+
+struct GzipStream {
+  bool headerDone;         // gzip header skipped
+  bool inflateDone;        // End of the deflate stream
+  tinfl_decompressor* inflator;
+  uint8_t* window;         // TINFL_LZ_DICT_SIZE output ring
+  size_t windowPos;
+  uint8_t trailer[8];      // CRC-32 and size of the output
+  uint8_t trailerLen;
+  uint32_t crc;            // Of the output so far
+  uint32_t size;
+};
+
+typedef void (*GzipOutput)(uint8_t* data, size_t len);
+
+int gzipHeaderSize(const uint8_t* data, size_t len);
+bool gzipBegin(GzipStream& gz);
+void gzipRelease(GzipStream& gz);
+const char* gzipInflate(GzipStream& gz, const uint8_t* data, size_t len, GzipOutput output);
+const char* gzipFinish(const GzipStream& gz);
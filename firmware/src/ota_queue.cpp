@@ -0,0 +1,123 @@
+#include "ota_queue.h"
+
+#include <esp_task_wdt.h>
+#include <freertos/task.h>
+
+OtaChunk otaChunks[OTA_QUEUE_CHUNKS];
+QueueHandle_t otaFreeChunks = nullptr;
+QueueHandle_t otaFilledChunks = nullptr;
+SemaphoreHandle_t otaWriteDone = nullptr;
+
+// Creates the queues with every chunk free
+void initOtaQueue() {
+  otaFreeChunks = xQueueCreate(OTA_QUEUE_CHUNKS, sizeof(OtaChunk*));
+  otaFilledChunks = xQueueCreate(OTA_QUEUE_CHUNKS + 1, sizeof(OtaChunk*));
+  otaWriteDone = xSemaphoreCreateBinary();
+  for (int i = 0; i < OTA_QUEUE_CHUNKS; i++) {
+    OtaChunk* chunk = &otaChunks[i];
+    xQueueSend(otaFreeChunks, &chunk, 0);
+  }
+}
+
+// Receiving side: copies data into free chunks for the writer, until error
+// is set. Returns the time spent waiting for free chunks.
+uint32_t otaQueuePut(const uint8_t* data, size_t len, const char* const& error) {
+  uint32_t waitedUs = 0;
+  while (len > 0 && error == nullptr) {
+    OtaChunk* chunk;
+    unsigned long start = micros();
+    bool got = xQueueReceive(otaFreeChunks, &chunk, pdMS_TO_TICKS(OTA_QUEUE_WAIT_MS)) == pdTRUE;
+    waitedUs += micros() - start;
+    esp_task_wdt_reset();
+    if (!got) continue;
+
+    chunk->len = min(len, (size_t)OTA_CHUNK_SIZE);
+    memcpy(chunk->data, data, chunk->len);
+    data += chunk->len;
+    len -= chunk->len;
+    xQueueSend(otaFilledChunks, &chunk, portMAX_DELAY);
+  }
+  return waitedUs;
+}
+
+// Ends the image and waits until the writer has finished it
+void otaQueueEnd() {
+  OtaChunk* end = nullptr;
+  xQueueSend(otaFilledChunks, &end, portMAX_DELAY);
+  while (xSemaphoreTake(otaWriteDone, pdMS_TO_TICKS(OTA_QUEUE_WAIT_MS)) != pdTRUE) {
+    esp_task_wdt_reset();
+  }
+}
+
+// Waits until the writer has handed back every chunk
+void otaDrainChunks() {
+  while (uxQueueMessagesWaiting(otaFreeChunks) < OTA_QUEUE_CHUNKS) {
+    esp_task_wdt_reset();
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+}
+
+// Writer side: waits up to OTA_QUEUE_WAIT_MS for the next chunk. A nullptr
+// chunk ends the image; give otaWriteDone once it is finished.
+bool otaNextChunk(OtaChunk*& chunk) {
+  return xQueueReceive(otaFilledChunks, &chunk, pdMS_TO_TICKS(OTA_QUEUE_WAIT_MS)) == pdTRUE;
+}
+
+// Hands a written chunk back to the receiver. Once every chunk is back,
+// otaDrainChunks() returns and the session may be cleared, so the writer
+// must be done with it, throttling included.
+void otaReturnChunk(OtaChunk* chunk) {
+  xQueueSend(otaFreeChunks, &chunk, 0);
+}
+
+// Holds the writer back to limitKbps (0 for none), averaged over the image
+// bytes written so far
+void otaThrottle(OtaThrottle& throttle, uint32_t limitKbps, uint32_t writtenBytes) {
+  if (limitKbps == 0) return;
+
+  unsigned long now = micros();
+  if ((long)(now - throttle.untilUs) > 0) throttle.untilUs = now;
+  throttle.untilUs += (uint64_t)writtenBytes * 1000 / limitKbps;
+
+  long wait;
+  while ((wait = (long)(throttle.untilUs - micros())) > 0) {
+    esp_task_wdt_reset();
+    // Rounded up, not past: oversleeping would restart the average above
+    vTaskDelay(pdMS_TO_TICKS(min((wait + 999) / 1000, (long)OTA_QUEUE_WAIT_MS)));
+  }
+  throttle.waitedUs += micros() - now;
+}
+
+// One turn of the writer task: writes the next chunk and holds the writer to
+// limitKbps, or finishes the image and gives otaWriteDone. Returns false if
+// nothing arrived within OTA_QUEUE_WAIT_MS.
+bool otaWriteNext(OtaChunkWrite write, OtaImageEnd end, OtaThrottle& throttle, uint32_t limitKbps) {
+  OtaChunk* chunk;
+  if (!otaNextChunk(chunk)) return false;
+
+  if (chunk == nullptr) {
+    end();
+    xSemaphoreGive(otaWriteDone);
+    return true;
+  }
+
+  uint32_t written = write(chunk->data, chunk->len);
+  // Before the chunk goes back: once every chunk is free, otaStart() may
+  // clear the session for the next update
+  otaThrottle(throttle, limitKbps, written);
+  otaReturnChunk(chunk);
+  return true;
+}
+
+// A flash operation stalls both cores, which would stretch an IR frame being
+// bit-banged on core 1. Lets a transmit in flight finish, then takes the IR
+// mutex for the operation. Returns the time waited.
+uint32_t otaTakeIrMutex(SemaphoreHandle_t irMutex, const volatile bool& irTxBusy) {
+  unsigned long start = micros();
+  while (irTxBusy) {
+    esp_task_wdt_reset();
+    vTaskDelay(1);
+  }
+  xSemaphoreTake(irMutex, portMAX_DELAY);
+  return micros() - start;
+}
@@ -0,0 +1,47 @@
+// Hand-off between the task receiving an OTA image (upload or pull) and the
+// OTA writer task. The receiver copies into a fixed pool of chunks and blocks
+// while all of them are in use, which holds the sender back through TCP flow
+// control; the writer decompresses and flashes each chunk, paced by the write
+// limit, and takes the IR mutex only around each flash operation. Neither
+// the web server nor IR transmits ever wait for a whole image.
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#define OTA_CHUNK_SIZE 2048      // Holds one WebServer upload buffer
+#define OTA_QUEUE_CHUNKS 4
+#define OTA_QUEUE_WAIT_MS 1000   // Longest block, as TASK_IDLE_WAIT_MS
+
+struct OtaChunk {
+  uint16_t len;
+  uint8_t data[OTA_CHUNK_SIZE];
+};
+
+// Writer callbacks: decompress and flash a chunk, returning the image bytes
+// written, and finish the image after the last one
+typedef uint32_t (*OtaChunkWrite)(uint8_t* data, size_t len);
+typedef void (*OtaImageEnd)();
+
+// Writer pacing for the flash write limit
+struct OtaThrottle {
+  unsigned long untilUs;   // When the bytes written so far are paid for
+  uint32_t waitedUs;       // Writer held back by the limit
+};
+
+extern OtaChunk otaChunks[OTA_QUEUE_CHUNKS];
+extern QueueHandle_t otaFreeChunks;
+extern QueueHandle_t otaFilledChunks;  // nullptr marks the end of the image
+extern SemaphoreHandle_t otaWriteDone;
+
+void initOtaQueue();
+uint32_t otaQueuePut(const uint8_t* data, size_t len, const char* const& error);
+void otaQueueEnd();
+void otaDrainChunks();
+bool otaNextChunk(OtaChunk*& chunk);
+void otaReturnChunk(OtaChunk* chunk);
+void otaThrottle(OtaThrottle& throttle, uint32_t limitKbps, uint32_t writtenBytes);
+bool otaWriteNext(OtaChunkWrite write, OtaImageEnd end, OtaThrottle& throttle, uint32_t limitKbps);
+uint32_t otaTakeIrMutex(SemaphoreHandle_t irMutex, const volatile bool& irTxBusy);
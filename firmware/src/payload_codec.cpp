@@ -0,0 +1,100 @@
+#include "payload_codec.h"
+
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+// Returns the decoded byte count, or -1 on malformed input
+int decodeHex(const char* in, size_t len, uint8_t* out) {
+  if (len % 2 != 0) return -1;
+  for (size_t i = 0; i < len; i += 2) {
+    int hi = hexNibble(in[i]);
+    int lo = hexNibble(in[i + 1]);
+    if (hi < 0 || lo < 0) return -1;
+    out[i / 2] = (uint8_t)((hi << 4) | lo);
+  }
+  return len / 2;
+}
+
+// Returns the decoded byte count, or -1 on malformed input. Padding is optional,
+// but only canonical RFC 4648 encodings are accepted.
+int decodeBase64(const char* in, size_t len, uint8_t* out) {
+  uint32_t acc = 0;
+  int bits = 0;
+  size_t outLen = 0;
+  size_t i = 0;
+
+  for (; i < len && in[i] != '='; i++) {
+    int value = base64Value(in[i]);
+    if (value < 0) return -1;
+    acc = (acc << 6) | value;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out[outLen++] = (uint8_t)(acc >> bits);
+    }
+  }
+
+  // A lone character in the last group can't encode a byte, and the bits a
+  // short group has left over must be zero
+  size_t dataLen = i;
+  if (dataLen % 4 == 1 || (acc & ((1u << bits) - 1)) != 0) return -1;
+
+  // Padding completes the last group and nothing follows it
+  size_t padding = len - dataLen;
+  if (padding > 0 && (padding > 2 || (dataLen + padding) % 4 != 0)) return -1;
+  for (; i < len; i++) {
+    if (in[i] != '=') return -1;
+  }
+  return outLen;
+}
+
+// out must hold 2 * len + 1 chars; returns the encoded length
+size_t encodeHex(const uint8_t* in, size_t len, char* out) {
+  for (size_t i = 0; i < len; i++) {
+    out[i * 2] = HEX_DIGITS[in[i] >> 4];
+    out[i * 2 + 1] = HEX_DIGITS[in[i] & 0x0F];
+  }
+  out[len * 2] = '\0';
+  return len * 2;
+}
+
+// out must hold 4 * ((len + 2) / 3) + 1 chars; returns the encoded length
+size_t encodeBase64(const uint8_t* in, size_t len, char* out) {
+  size_t o = 0;
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t chunk = (uint32_t)in[i] << 16;
+    if (i + 1 < len) chunk |= (uint32_t)in[i + 1] << 8;
+    if (i + 2 < len) chunk |= in[i + 2];
+
+    out[o++] = BASE64_ALPHABET[(chunk >> 18) & 0x3F];
+    out[o++] = BASE64_ALPHABET[(chunk >> 12) & 0x3F];
+    out[o++] = (i + 1 < len) ? BASE64_ALPHABET[(chunk >> 6) & 0x3F] : '=';
+    out[o++] = (i + 2 < len) ? BASE64_ALPHABET[chunk & 0x3F] : '=';
+  }
+  out[o] = '\0';
+  return o;
+}
+
+// Decode a payload in the given format ("text", "hex" or "base64") into out
+int decodePayload(const String& format, const char* in, size_t len, uint8_t* out) {
+  if (format == "hex") return decodeHex(in, len, out);
+  if (format == "base64") return decodeBase64(in, len, out);
+  if (out != (const uint8_t*)in) memmove(out, in, len);
+  return len;
+}
@@ -0,0 +1,12 @@
+// Binary-safe helpers for serial payloads. Decoders may be called with out == in:
+// the write position never overtakes the read position, so payloads can be
+// decoded in place.
+#pragma once
+
+#include <Arduino.h>
+
+int decodeHex(const char* in, size_t len, uint8_t* out);
+int decodeBase64(const char* in, size_t len, uint8_t* out);
+size_t encodeHex(const uint8_t* in, size_t len, char* out);
+size_t encodeBase64(const uint8_t* in, size_t len, char* out);
+int decodePayload(const String& format, const char* in, size_t len, uint8_t* out);
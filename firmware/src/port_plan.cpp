@@ -0,0 +1,69 @@
+#include "port_plan.h"
+
+// Start from the current table, or from all ports disabled when the map
+// replaces it: ports left out of the map keep their config otherwise
+void beginPortPlan(PortPlan& plan, bool replace) {
+  for (int i = 0; i < portCount; i++) {
+    plan.mode[i] = replace ? PORT_DISABLED : ports[i].mode;
+    plan.name[i] = replace ? "" : ports[i].name;
+    plan.seen[i] = false;
+  }
+  plan.received = 0;
+}
+
+// Returns nullptr if the entry was added, else the problem for the response
+const char* addPortPlanEntry(PortPlan& plan, int gpio, const char* mode, const char* name) {
+  int portMode = parsePortMode(mode);
+  int portIndex = portForGpio(gpio);
+
+  if (portIndex == -1) return "Invalid GPIO";
+  if (plan.seen[portIndex]) return "Duplicate GPIO";
+  if (portMode < 0) return "Invalid mode";
+  if (strlen(name) > PORT_NAME_MAX_LEN) return "name too long (max 32)";
+  if (portMode == PORT_IR_OUTPUT && !(ports[portIndex].caps & PORT_CAP_OUTPUT)) return "GPIO is input-only";
+
+  plan.seen[portIndex] = true;
+  plan.mode[portIndex] = portMode;
+  plan.name[portIndex] = name;
+  plan.received++;
+  return nullptr;
+}
+
+// Update the port table and IR hardware to match the plan. Returns the
+// number of ports that changed; the caller commits them.
+int applyPortPlan(const PortPlan& plan) {
+  int changed = 0;
+  int receiverIndex = -1;
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].mode == plan.mode[i] && strcmp(ports[i].name, plan.name[i]) == 0) {
+      continue;
+    }
+
+    bool modeChanged = ports[i].mode != plan.mode[i];
+    ports[i].mode = (PortMode)plan.mode[i];
+    if (plan.name[i] != ports[i].name) {
+      strlcpy(ports[i].name, plan.name[i], sizeof(ports[i].name));
+    }
+    changed++;
+
+    if (!modeChanged) continue;
+    if (ports[i].mode == PORT_IR_OUTPUT) {
+      initIRSender(i);
+    } else {
+      releaseIRSender(i);
+    }
+    if (ports[i].mode == PORT_IR_INPUT) {
+      receiverIndex = i;
+    } else if (ports[i].gpio == activeReceiverPort) {
+      // The active input was disabled, made an output or dropped by replace
+      stopIRReceiver();
+    }
+  }
+
+  // Only one receiver can be active; the last newly enabled input wins,
+  // matching what sequential /ports/configure calls would leave behind
+  if (receiverIndex >= 0) {
+    initIRReceiver(ports[receiverIndex].gpio);
+  }
+  return changed;
+}
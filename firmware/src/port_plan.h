@@ -0,0 +1,26 @@
+// Bulk port configuration: a desired port map is validated entry by entry,
+// then diffed against the port table so only ports whose mode or name differ
+// are touched, and only mode changes re-initialize IR hardware.
+#pragma once
+
+#include <Arduino.h>
+
+#include "port_table.h"
+
+struct PortPlan {
+  int8_t mode[MAX_PORTS];     // Desired PortMode per port index
+  const char* name[MAX_PORTS];  // Not copied; must outlive applyPortPlan()
+  bool seen[MAX_PORTS];
+  int received;
+};
+
+// IR driver, implemented in main.cpp
+extern int activeReceiverPort;  // GPIO of the running receiver, -1 if none
+void initIRSender(int portIndex);
+void releaseIRSender(int portIndex);
+void initIRReceiver(int gpio);
+void stopIRReceiver();
+
+void beginPortPlan(PortPlan& plan, bool replace);
+const char* addPortPlanEntry(PortPlan& plan, int gpio, const char* mode, const char* name);
+int applyPortPlan(const PortPlan& plan);
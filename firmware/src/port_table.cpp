@@ -0,0 +1,64 @@
+#include "port_table.h"
+
+PortConfig ports[MAX_PORTS];
+int portCount = 0;
+int8_t gpioToPort[GPIO_COUNT];
+
+// Returns the PortMode for an API/legacy mode name, or -1 if unknown
+int parsePortMode(const char* mode) {
+  if (strcmp(mode, "ir_output") == 0) return PORT_IR_OUTPUT;
+  if (strcmp(mode, "ir_input") == 0) return PORT_IR_INPUT;
+  if (strcmp(mode, "disabled") == 0 || mode[0] == '\0') return PORT_DISABLED;
+  return -1;
+}
+
+const char* portModeName(PortMode mode) {
+  switch (mode) {
+    case PORT_IR_OUTPUT: return "ir_output";
+    case PORT_IR_INPUT: return "ir_input";
+    default: return "disabled";
+  }
+}
+
+void setPort(int index, int gpio, PortMode mode, const char* name) {
+  ports[index].gpio = gpio;
+  ports[index].mode = mode;
+  ports[index].caps = (gpio >= 0 && gpio < GPIO_COUNT) ? GPIO_CAPS[gpio] : 0;
+  strlcpy(ports[index].name, name, sizeof(ports[index].name));
+}
+
+static bool portExists(int gpio) {
+  for (int j = 0; j < portCount; j++) {
+    if (ports[j].gpio == gpio) return true;
+  }
+  return false;
+}
+
+// Append a disabled port for every board pin not yet in the table: all of
+// them on first boot, and pins added by a firmware update later. Output-capable
+// pins come first. Returns the number of ports added.
+int addMissingPorts() {
+  int added = 0;
+  for (int i = 0; i < OUTPUT_CAPABLE_COUNT && portCount < MAX_PORTS; i++) {
+    if (!portExists(OUTPUT_CAPABLE_PINS[i])) {
+      setPort(portCount++, OUTPUT_CAPABLE_PINS[i], PORT_DISABLED, "");
+      added++;
+    }
+  }
+  for (int i = 0; i < INPUT_ONLY_COUNT && portCount < MAX_PORTS; i++) {
+    if (!portExists(INPUT_ONLY_PINS[i])) {
+      setPort(portCount++, INPUT_ONLY_PINS[i], PORT_DISABLED, "");
+      added++;
+    }
+  }
+  return added;
+}
+
+void rebuildGpioIndex() {
+  memset(gpioToPort, -1, sizeof(gpioToPort));
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].gpio < GPIO_COUNT) {
+      gpioToPort[ports[i].gpio] = i;
+    }
+  }
+}
@@ -0,0 +1,80 @@
+// IR port table: the board's IR-capable GPIOs, their capabilities computed at
+// compile time, and the configured ports with a GPIO-to-port index so handlers
+// resolve a port with a single array load.
+#pragma once
+
+#include <Arduino.h>
+
+// ============ Available GPIO Pins for IR ============
+#ifdef USE_ETHERNET
+  // Olimex ESP32-POE-ISO pins (Ethernet reserves some GPIOs)
+  constexpr int OUTPUT_CAPABLE_PINS[] = {0, 1, 2, 3, 4, 5, 13, 14, 15, 16, 32, 33};
+  const int OUTPUT_CAPABLE_COUNT = 12;
+#else
+  // ESP32 DevKit - more GPIOs available (no Ethernet)
+  // Note: GPIO2 is used for LED, so we exclude it from IR use when LED is enabled
+  constexpr int OUTPUT_CAPABLE_PINS[] = {4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33};
+  const int OUTPUT_CAPABLE_COUNT = 18;
+#endif
+
+// Input-only pins (for IR receiver) - same on both boards
+constexpr int INPUT_ONLY_PINS[] = {34, 35, 36, 39};
+const int INPUT_ONLY_COUNT = 4;
+
+static_assert(sizeof(OUTPUT_CAPABLE_PINS) / sizeof(OUTPUT_CAPABLE_PINS[0]) == OUTPUT_CAPABLE_COUNT,
+              "OUTPUT_CAPABLE_COUNT does not match OUTPUT_CAPABLE_PINS");
+static_assert(sizeof(INPUT_ONLY_PINS) / sizeof(INPUT_ONLY_PINS[0]) == INPUT_ONLY_COUNT,
+              "INPUT_ONLY_COUNT does not match INPUT_ONLY_PINS");
+
+// Pin capabilities, computed at compile time from the tables above
+#define GPIO_COUNT 40
+#define PORT_CAP_OUTPUT (1 << 0)
+#define PORT_CAP_INPUT  (1 << 1)
+
+constexpr bool pinInList(int gpio, const int* pins, int count) {
+  return count > 0 && (pins[0] == gpio || pinInList(gpio, pins + 1, count - 1));
+}
+
+constexpr uint8_t gpioCaps(int gpio) {
+  return pinInList(gpio, OUTPUT_CAPABLE_PINS, OUTPUT_CAPABLE_COUNT) ? (PORT_CAP_OUTPUT | PORT_CAP_INPUT)
+       : pinInList(gpio, INPUT_ONLY_PINS, INPUT_ONLY_COUNT) ? PORT_CAP_INPUT
+       : 0;
+}
+
+#define GPIO_CAPS_4(n) gpioCaps(n), gpioCaps(n + 1), gpioCaps(n + 2), gpioCaps(n + 3)
+constexpr uint8_t GPIO_CAPS[GPIO_COUNT] = {
+  GPIO_CAPS_4(0), GPIO_CAPS_4(4), GPIO_CAPS_4(8), GPIO_CAPS_4(12), GPIO_CAPS_4(16),
+  GPIO_CAPS_4(20), GPIO_CAPS_4(24), GPIO_CAPS_4(28), GPIO_CAPS_4(32), GPIO_CAPS_4(36)
+};
+
+// ============ Port Configuration ============
+#define PORT_NAME_MAX_LEN 32
+
+enum PortMode : uint8_t { PORT_DISABLED = 0, PORT_IR_OUTPUT = 1, PORT_IR_INPUT = 2 };
+
+struct PortConfig {
+  uint8_t gpio;
+  PortMode mode;
+  uint8_t caps;  // PORT_CAP_* of the GPIO
+  char name[PORT_NAME_MAX_LEN + 1];
+};
+
+#ifdef USE_ETHERNET
+  #define MAX_PORTS 16
+#else
+  #define MAX_PORTS 22
+#endif
+
+extern PortConfig ports[MAX_PORTS];
+extern int portCount;
+extern int8_t gpioToPort[GPIO_COUNT];  // Port index for each GPIO, -1 if none
+
+inline int portForGpio(int gpio) {
+  return (gpio >= 0 && gpio < GPIO_COUNT) ? gpioToPort[gpio] : -1;
+}
+
+int parsePortMode(const char* mode);
+const char* portModeName(PortMode mode);
+void setPort(int index, int gpio, PortMode mode, const char* name);
+int addMissingPorts();
+void rebuildGpioIndex();
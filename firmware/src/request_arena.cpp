@@ -0,0 +1,70 @@
+#include "request_arena.h"
+
+RequestArena requestArena;
+
+static inline size_t arenaBlockSize(size_t size) {
+  return (ARENA_HEADER + size + 7) & ~(size_t)7;
+}
+
+static inline bool inArena(const void* ptr) {
+  return ptr >= requestArena.buffer && ptr < requestArena.buffer + REQUEST_ARENA_SIZE;
+}
+
+void* arenaAlloc(size_t size) {
+  RequestArena& a = requestArena;
+  size_t need = arenaBlockSize(size);
+  if (a.used + need > REQUEST_ARENA_SIZE) {
+    a.overflows++;
+    a.fallbackBytes += size;
+    return malloc(size);
+  }
+
+  uint8_t* block = a.buffer + a.used;
+  *(uint32_t*)block = size;
+  a.used += need;
+  if (a.used > a.highWater) a.highWater = a.used;
+  return block + ARENA_HEADER;
+}
+
+// Arena blocks are released by arenaReset(); freeing the most recent block
+// hands its space straight back
+void arenaFree(void* ptr) {
+  if (ptr == nullptr) return;
+  if (!inArena(ptr)) {
+    free(ptr);
+    return;
+  }
+
+  uint8_t* block = (uint8_t*)ptr - ARENA_HEADER;
+  if (block + arenaBlockSize(*(uint32_t*)block) == requestArena.buffer + requestArena.used) {
+    requestArena.used = block - requestArena.buffer;
+  }
+}
+
+void* arenaRealloc(void* ptr, size_t size) {
+  if (ptr == nullptr) return arenaAlloc(size);
+  if (!inArena(ptr)) return realloc(ptr, size);
+
+  RequestArena& a = requestArena;
+  uint8_t* block = (uint8_t*)ptr - ARENA_HEADER;
+  uint32_t oldSize = *(uint32_t*)block;
+  size_t offset = block - a.buffer;
+
+  // The most recent block grows or shrinks in place
+  if (offset + arenaBlockSize(oldSize) == a.used && offset + arenaBlockSize(size) <= REQUEST_ARENA_SIZE) {
+    *(uint32_t*)block = size;
+    a.used = offset + arenaBlockSize(size);
+    if (a.used > a.highWater) a.highWater = a.used;
+    return ptr;
+  }
+  if (size <= oldSize) return ptr;
+
+  void* moved = arenaAlloc(size);
+  if (moved != nullptr) memcpy(moved, ptr, oldSize);
+  return moved;
+}
+
+void arenaReset() {
+  requestArena.used = 0;
+  requestArena.requests++;
+}
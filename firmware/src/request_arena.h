@@ -0,0 +1,31 @@
+// Per-request bump allocator for JSON documents and response buffers in HTTP
+// handlers. The net task resets it when a route returns, so request handling
+// doesn't leave holes in the general heap. Blocks carry an 8-byte size header;
+// allocations that don't fit fall back to malloc and are counted.
+#pragma once
+
+#include <Arduino.h>
+
+#define REQUEST_ARENA_SIZE 16384
+#define ARENA_HEADER 8
+
+struct RequestArena {
+  uint8_t buffer[REQUEST_ARENA_SIZE] __attribute__((aligned(8)));
+  size_t used;
+  size_t highWater;
+  uint32_t requests;
+  uint32_t overflows;
+  uint32_t fallbackBytes;
+};
+extern RequestArena requestArena;
+
+void* arenaAlloc(size_t size);
+void arenaFree(void* ptr);
+void* arenaRealloc(void* ptr, size_t size);
+void arenaReset();
+
+struct ArenaAllocator {
+  void* allocate(size_t size) { return arenaAlloc(size); }
+  void deallocate(void* ptr) { arenaFree(ptr); }
+  void* reallocate(void* ptr, size_t size) { return arenaRealloc(ptr, size); }
+};
@@ -0,0 +1,107 @@
+#include "request_checks.h"
+
+#include "config_store.h"
+#include "port_table.h"
+
+// Checks everything but whether the port has a sender yet, which only the
+// caller can see.
+const char* checkSendIrRequest(JsonObjectConst body, SendIrRequest& request) {
+  int output = body["output"] | -1;
+  long frequency = body["frequency"] | 38000;
+
+  if (frequency < IR_FREQ_MIN || frequency > IR_FREQ_MAX) {
+    return "frequency must be 10000-100000 Hz";
+  }
+
+  request.portIndex = portForGpio(output);
+  if (request.portIndex == -1 || ports[request.portIndex].mode != PORT_IR_OUTPUT) {
+    return "Invalid output or not configured";
+  }
+
+  String protocol = body["protocol"] | "nec";
+  request.kind = parseIrProtocol(protocol);
+  request.raw = body["raw_data"].as<JsonArrayConst>();
+  if (request.kind == IR_TX_RAW) {
+    // Raw IR - expects "raw_data" array of timing values in microseconds
+    if (request.raw.size() == 0) {
+      return "raw_data array required for raw protocol";
+    }
+    if (request.raw.size() > IR_RAW_MAX) {
+      return "raw_data too long (max 512)";
+    }
+    long totalUs = 0;
+    for (JsonVariantConst value : request.raw) {
+      long us = value.is<long>() ? value.as<long>() : 0;
+      if (us < 1 || us > 65535) {
+        return "raw_data values must be 1-65535";
+      }
+      totalUs += us;
+    }
+    if (totalUs > IR_RAW_MAX_MS * 1000L) {
+      return "raw_data may last at most 2000 ms";
+    }
+  }
+
+  request.gpio = output;
+  request.code = strtoull(body["code"] | "", nullptr, 16);
+  request.frequency = frequency;
+  return nullptr;
+}
+
+void fillIrTxJob(const SendIrRequest& request, IrTxJob& job) {
+  job.kind = request.kind;
+  job.portIndex = request.portIndex;
+  job.gpio = request.gpio;
+  job.code = request.code;
+  job.frequency = request.frequency;
+  job.durationMs = 0;
+  job.rawLen = 0;
+  if (request.kind == IR_TX_RAW) {
+    for (JsonVariantConst value : request.raw) {
+      job.raw[job.rawLen++] = value.as<uint16_t>();
+    }
+  }
+}
+
+const char* checkTestOutputRequest(JsonObjectConst body, int& portIndex, uint32_t& durationMs) {
+  int output = body["output"] | -1;
+  long duration = body["duration_ms"] | 500;
+
+  if (duration < 1 || duration > TEST_OUTPUT_MAX_MS) {
+    return "duration_ms must be 1-1000";
+  }
+
+  portIndex = portForGpio(output);
+  if (portIndex == -1) {
+    return "Invalid output";
+  }
+  if (!(ports[portIndex].caps & PORT_CAP_OUTPUT)) {
+    return "GPIO is input-only";
+  }
+
+  durationMs = duration;
+  return nullptr;
+}
+
+const char* checkAdoptRequest(JsonObjectConst body, const char*& id, const char*& name) {
+  id = body["board_id"] | "";
+  name = body["board_name"] | "";
+
+  if (id[0] == '\0') {
+    return "board_id required";
+  }
+  if (strlen(id) > BOARD_ID_MAX_LEN || strlen(name) > BOARD_NAME_MAX_LEN) {
+    return "board_id (max 32) or board_name (max 48) too long";
+  }
+  return nullptr;
+}
+
+const char* checkLearningRequest(JsonObjectConst body, int& gpio) {
+  gpio = body["port"] | 34;  // Default to GPIO34
+
+  int portIndex = portForGpio(gpio);
+  if (portIndex == -1 || !(ports[portIndex].caps & PORT_CAP_INPUT)) {
+    return "Invalid input port";
+  }
+  return nullptr;
+}
@@ -0,0 +1,28 @@
+// Validation of the JSON bodies of the IR and adoption routes, apart from the
+// handlers so the host fuzz harness runs the same checks on arbitrary input.
+// Each check returns the problem to report with a 400, or nullptr.
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "ir_tx.h"
+
+// Document size for a send_ir body: room for a full raw_data array
+// (16 bytes per element)
+#define SEND_IR_JSON_SIZE (IR_RAW_MAX * 16 + 256)
+
+struct SendIrRequest {
+  IrTxKind kind;
+  int portIndex;
+  uint8_t gpio;
+  uint64_t code;
+  uint32_t frequency;
+  JsonArrayConst raw;  // Points into the parsed body
+};
+
+const char* checkSendIrRequest(JsonObjectConst body, SendIrRequest& request);
+void fillIrTxJob(const SendIrRequest& request, IrTxJob& job);
+const char* checkTestOutputRequest(JsonObjectConst body, int& portIndex, uint32_t& durationMs);
+const char* checkAdoptRequest(JsonObjectConst body, const char*& id, const char*& name);
+const char* checkLearningRequest(JsonObjectConst body, int& gpio);
@@ -0,0 +1,175 @@
+#include "serial_script.h"
+
+#include <esp_task_wdt.h>
+
+#define SERIAL_DELAY_SLICE_MS 1000  // Well inside the task watchdog timeout
+
+// Adds c to a ring of the last patternLen bytes received (seen so far in
+// total) and returns true if they equal pattern
+static bool windowEndsWith(uint8_t* window, uint32_t& seen, uint8_t c, const uint8_t* pattern, size_t patternLen) {
+  window[seen++ % patternLen] = c;
+  if (seen < patternLen) return false;
+  for (size_t i = 0; i < patternLen; i++) {
+    if (window[(seen + i) % patternLen] != pattern[i]) return false;
+  }
+  return true;
+}
+
+bool containsPattern(const char* buf, size_t len, const uint8_t* pattern, size_t patternLen) {
+  if (patternLen == 0) return len > 0;
+  for (size_t i = 0; i + patternLen <= len; i++) {
+    if (memcmp(buf + i, pattern, patternLen) == 0) return true;
+  }
+  return false;
+}
+
+// Capture bytes into the script's response pool until the step's pattern is seen
+// (or, without a pattern, a line terminator as /serial/send does) or the timeout expires.
+// Matching runs on the bytes received, so it works however much of them fit.
+static bool captureSerialResponse(Stream& port, SerialScript& script, const SerialStep& step,
+                                  SerialStepResult& result) {
+  // Keep space for the NUL. Once the pool is full the wait still runs but stores
+  // nothing, and the result is the previous response's NUL: an empty string.
+  bool full = script.responsesUsed >= SERIAL_BATCH_RESPONSE_SIZE - 1;
+  if (full) result.responseOffset = script.responsesUsed - 1;
+  char* buf = script.responses + result.responseOffset;
+  size_t room = full ? 0 : SERIAL_BATCH_RESPONSE_SIZE - script.responsesUsed - 1;
+  const uint8_t* pattern = script.data + step.dataOffset;
+  size_t len = 0;
+  uint32_t seen = 0;
+  bool matched = false;
+
+  unsigned long start = millis();
+  while (!matched && millis() - start < step.ms) {
+    esp_task_wdt_reset();  // Waits may outlast the watchdog timeout
+    if (!port.available()) {
+      delay(5);
+      continue;
+    }
+    while (port.available() && !matched) {
+      int c = port.read();
+      if (len < room) buf[len++] = (char)c;
+
+      if (step.dataLen > 0) {
+        matched = windowEndsWith(script.window, seen, (uint8_t)c, pattern, step.dataLen);
+      } else if (c == '\n' || c == '\r' || c == '!') {
+        // Give a little more time for additional data
+        delay(50);
+        while (port.available()) {
+          c = port.read();
+          if (len < room) buf[len++] = (char)c;
+        }
+        matched = true;
+      }
+    }
+  }
+
+  buf[len] = '\0';
+  result.responseLen = len;
+  if (!full) script.responsesUsed += len + 1;
+  return matched;
+}
+
+bool runSerialScript(Stream& port, SerialScript& script) {
+  script.resultCount = 0;
+  script.responsesUsed = 0;
+  script.error = nullptr;
+
+  const SerialStepResult* lastCapture = nullptr;
+  int pc = 0;
+
+  while (pc < script.stepCount) {
+    if (script.resultCount >= SERIAL_BATCH_MAX_EXECUTED) {
+      script.error = "Step limit reached";
+      return false;
+    }
+
+    const SerialStep& step = script.steps[pc];
+    SerialStepResult& result = script.results[script.resultCount++];
+    result.step = pc;
+    result.matched = false;
+    result.responseOffset = script.responsesUsed;
+    result.responseLen = 0;
+
+    unsigned long start = millis();
+    int target = BATCH_NEXT;
+
+    switch (step.op) {
+      case STEP_SEND:
+        port.write(script.data + step.dataOffset, step.dataLen);
+        port.flush();
+        break;
+
+      case STEP_DELAY:
+        // Sleep in slices so long delays keep feeding the watchdog
+        for (uint32_t remaining = step.ms; remaining > 0;) {
+          uint32_t slice = min(remaining, (uint32_t)SERIAL_DELAY_SLICE_MS);
+          esp_task_wdt_reset();
+          delay(slice);
+          remaining -= slice;
+        }
+        break;
+
+      case STEP_WAIT:
+        result.matched = captureSerialResponse(port, script, step, result);
+        target = result.matched ? step.onMatch : step.onFail;
+        lastCapture = &result;
+        break;
+
+      case STEP_BRANCH:
+        result.matched = lastCapture != nullptr &&
+                         containsPattern(script.responses + lastCapture->responseOffset, lastCapture->responseLen,
+                                         script.data + step.dataOffset, step.dataLen);
+        target = result.matched ? step.onMatch : step.onFail;
+        break;
+    }
+
+    result.elapsedMs = millis() - start;
+
+    if (target == BATCH_ABORT) {
+      script.error = step.op == STEP_WAIT ? "Timed out waiting for response" : "Branch aborted";
+      return false;
+    }
+    if (target == BATCH_END) {
+      return true;
+    }
+    pc = (target == BATCH_NEXT) ? pc + 1 : target;
+  }
+
+  return true;
+}
+
+// Append bytes to the script data pool; returns false if the pool is full
+bool appendBatchData(SerialScript& script, const uint8_t* bytes, size_t len) {
+  if (script.dataUsed + len > SERIAL_BATCH_DATA_SIZE) return false;
+  memcpy(script.data + script.dataUsed, bytes, len);
+  script.dataUsed += len;
+  return true;
+}
+
+// Read a response into buf, returning with the first burst of data as
+// /serial/send always has: right away, or after a short grace period for
+// trailing bytes if the burst contains a terminator. 0 if nothing arrived
+// before the timeout.
+size_t readSerialResponse(HardwareSerial& port, uint8_t* buf, size_t size, unsigned long timeout) {
+  size_t len = 0;
+  unsigned long start = millis();
+
+  while (len == 0 && millis() - start < timeout) {
+    len = port.read(buf, size);
+    if (len == 0) {
+      delay(10);
+      continue;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+      if (buf[i] == '\n' || buf[i] == '\r' || buf[i] == '!') {
+        // Give a little more time for additional data
+        delay(50);
+        len += port.read(buf + len, size - len);
+        break;
+      }
+    }
+  }
+  return len;
+}
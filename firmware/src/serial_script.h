@@ -0,0 +1,60 @@
+// A batch is an ordered list of serial operations parsed by the HTTP handler and
+// executed by the serial bridge task, so multi-command sequences don't hold up
+// the web server. Results are collected afterwards with GET /serial/batch.
+#pragma once
+
+#include <Arduino.h>
+
+#define SERIAL_BATCH_MAX_STEPS 16
+#define SERIAL_BATCH_MAX_EXECUTED 48       // Guards against goto loops
+#define SERIAL_BATCH_DATA_SIZE 1024        // Send payloads and wait patterns
+#define SERIAL_BATCH_RESPONSE_SIZE 2048    // Captured responses for all steps
+#define SERIAL_BATCH_MAX_WAIT_MS 30000
+
+// Jump targets for wait/branch steps (values >= 0 are step indices)
+#define BATCH_NEXT  -1
+#define BATCH_END   -2
+#define BATCH_ABORT -3
+
+enum SerialStepOp : uint8_t {
+  STEP_SEND,    // Write payload
+  STEP_WAIT,    // Capture response until pattern (or terminator) or timeout
+  STEP_DELAY,   // Sleep for a fixed time
+  STEP_BRANCH   // Jump depending on whether the last response contains a pattern
+};
+
+struct SerialStep {
+  SerialStepOp op;
+  uint16_t dataOffset;  // Payload/pattern location in SerialScript::data
+  uint16_t dataLen;
+  uint32_t ms;          // Wait timeout or delay duration
+  int8_t onMatch;
+  int8_t onFail;
+};
+
+struct SerialStepResult {
+  uint8_t step;
+  bool matched;
+  uint16_t responseOffset;  // NUL-terminated response in SerialScript::responses
+  uint16_t responseLen;
+  uint32_t elapsedMs;
+};
+
+struct SerialScript {
+  SerialStep steps[SERIAL_BATCH_MAX_STEPS];
+  uint8_t stepCount;
+  uint8_t data[SERIAL_BATCH_DATA_SIZE];
+  uint16_t dataUsed;
+  SerialStepResult results[SERIAL_BATCH_MAX_EXECUTED];
+  uint8_t resultCount;
+  char responses[SERIAL_BATCH_RESPONSE_SIZE];
+  uint16_t responsesUsed;
+  uint8_t window[SERIAL_BATCH_DATA_SIZE];  // Last bytes received by a wait, for its pattern
+  const char* error;
+  uint32_t elapsedMs;
+};
+
+bool runSerialScript(Stream& port, SerialScript& script);
+bool appendBatchData(SerialScript& script, const uint8_t* bytes, size_t len);
+bool containsPattern(const char* buf, size_t len, const uint8_t* pattern, size_t patternLen);
+size_t readSerialResponse(HardwareSerial& port, uint8_t* buf, size_t size, unsigned long timeout);
@@ -0,0 +1,111 @@
+#include "tx_check.h"
+
+TxCapture txCapture;
+TxCheckStats txCheck = {};
+TxProtocolTiming txTiming[IR_TX_TEST + 1] = {};
+static uint16_t txExpected[IR_RAW_MAX];
+
+static void appendBits(uint16_t* out, int& n, uint64_t data, int bits, uint16_t bitMark,
+                       uint16_t oneSpace, uint16_t zeroSpace) {
+  for (int i = bits - 1; i >= 0; i--) {
+    out[n++] = bitMark;
+    out[n++] = ((data >> i) & 1) ? oneSpace : zeroSpace;
+  }
+}
+
+// Marks and spaces the job should produce, up to the final mark (the trailing
+// gap has no closing edge). Returns 0 for protocols without a reference.
+int buildExpectedTimings(const IrTxJob& job, uint16_t* out) {
+  int n = 0;
+  bool stock = job.frequency == 38000;  // Library timings; otherwise the sendGeneric() ones
+  switch (job.kind) {
+    case IR_TX_NEC:
+      out[n++] = stock ? 8960 : 9000;
+      out[n++] = stock ? 4480 : 4500;
+      appendBits(out, n, job.code, 32, stock ? 560 : 562, stock ? 1680 : 1687, stock ? 560 : 562);
+      out[n++] = stock ? 560 : 562;
+      return n;
+
+    case IR_TX_SAMSUNG:
+      out[n++] = stock ? 4480 : 4500;
+      out[n++] = stock ? 4480 : 4500;
+      appendBits(out, n, job.code, 32, 560, stock ? 1680 : 1690, 560);
+      out[n++] = 560;
+      return n;
+
+    case IR_TX_RAW:
+      // sendRaw() alternates mark/space, so drop a trailing space
+      n = (job.rawLen & 1) ? job.rawLen : job.rawLen - 1;
+      if (n < 0) n = 0;
+      memcpy(out, job.raw, n * sizeof(uint16_t));
+      return n;
+
+    default:
+      return 0;
+  }
+}
+
+// Close the capture of a finished frame, compare it with the expected
+// timings and fold the result into txCheck and txTiming
+void recordTxFrame(const IrTxJob& job, TxCapture& c) {
+  if (c.edges > 0 && c.count < IR_RAW_MAX) {
+    c.durations[c.count++] = c.lastEdgeUs - c.markStartUs;  // Final mark
+  }
+
+  TxFrameCheck frame = {};
+  frame.kind = job.kind;
+  frame.captured = c.count;
+  frame.expected = buildExpectedTimings(job, txExpected);
+
+  if (c.highCount > 0 && c.lowCount > 0) {
+    float high = (float)c.highUs / c.highCount;
+    float low = (float)c.lowUs / c.lowCount;
+    frame.carrierHz = (uint32_t)(1e6f / (high + low));
+    frame.dutyPercent = high * 100.0f / (high + low);
+    frame.carrierErrPercent = ((float)frame.carrierHz - job.frequency) * 100.0f / job.frequency;
+  }
+
+  txCheck.frames++;
+  float carrierErr = fabsf(frame.carrierErrPercent);
+  if (carrierErr > txCheck.worstCarrierErrPercent) txCheck.worstCarrierErrPercent = carrierErr;
+
+  if (frame.expected == 0) {
+    txCheck.unchecked++;
+  } else if (frame.expected != frame.captured || c.overflow) {
+    txCheck.lengthMismatches++;
+  } else {
+    uint32_t markSum = 0, spaceSum = 0;
+    for (int i = 0; i < c.count; i++) {
+      uint16_t err = abs((int)c.durations[i] - (int)txExpected[i]);
+      if (i & 1) {
+        spaceSum += err;
+        if (err > frame.maxSpaceErrUs) frame.maxSpaceErrUs = err;
+      } else {
+        markSum += err;
+        if (err > frame.maxMarkErrUs) frame.maxMarkErrUs = err;
+      }
+    }
+    int marks = (c.count + 1) / 2;
+    int spaces = c.count / 2;
+    frame.meanMarkErrUs = marks > 0 ? (float)markSum / marks : 0;
+    frame.meanSpaceErrUs = spaces > 0 ? (float)spaceSum / spaces : 0;
+    frame.compared = true;
+
+    txCheck.compared++;
+    txCheck.sumMeanMarkErrUs += frame.meanMarkErrUs;
+    txCheck.sumMeanSpaceErrUs += frame.meanSpaceErrUs;
+    if (frame.maxMarkErrUs > txCheck.worstMarkErrUs) txCheck.worstMarkErrUs = frame.maxMarkErrUs;
+    if (frame.maxSpaceErrUs > txCheck.worstSpaceErrUs) txCheck.worstSpaceErrUs = frame.maxSpaceErrUs;
+  }
+
+  txCheck.last = frame;
+
+  if (c.edges > 0 && job.kind <= IR_TX_TEST) {
+    TxProtocolTiming& t = txTiming[job.kind];
+    uint32_t setup = c.firstEdgeUs - c.startUs;
+    t.frames++;
+    t.setupUs += setup;
+    if (setup > t.maxSetupUs) t.maxSetupUs = setup;
+    t.airtimeUs += c.lastEdgeUs - c.firstEdgeUs;
+  }
+}
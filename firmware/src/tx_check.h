@@ -0,0 +1,99 @@
+// IR transmit self-check. When enabled, the transmit pin is also set up as an
+// input and a GPIO interrupt timestamps every carrier edge while a frame is
+// sent. The ISR folds edges into mark/space durations (a gap longer than
+// TX_CHECK_GAP_US ends a mark) and accumulates carrier high/low times. The
+// frame is then compared with the timings the protocol should have produced.
+#pragma once
+
+#include <Arduino.h>
+
+#include "ir_tx.h"
+
+#define TX_CHECK_GAP_US 100  // Longer than any carrier off-time, shorter than any space
+
+struct TxCapture {
+  uint32_t startUs;        // Capture armed, just before the encoder runs
+  uint32_t firstEdgeUs;
+  uint32_t edges;          // Even edges are rising, odd edges falling
+  uint32_t lastEdgeUs;
+  uint32_t markStartUs;
+  uint32_t highUs;
+  uint32_t highCount;
+  uint32_t lowUs;
+  uint32_t lowCount;
+  uint16_t count;
+  bool overflow;
+  uint16_t durations[IR_RAW_MAX];  // Mark, space, mark, ...
+};
+
+struct TxFrameCheck {
+  IrTxKind kind;
+  uint16_t expected;       // Expected durations, 0 if the protocol has no reference
+  uint16_t captured;
+  bool compared;           // Reference known and lengths matched
+  uint16_t maxMarkErrUs;
+  uint16_t maxSpaceErrUs;
+  float meanMarkErrUs;
+  float meanSpaceErrUs;
+  uint32_t carrierHz;
+  float carrierErrPercent;
+  float dutyPercent;
+};
+
+struct TxCheckStats {
+  bool enabled;
+  uint32_t frames;
+  uint32_t compared;
+  uint32_t lengthMismatches;
+  uint32_t unchecked;          // No reference timings for the protocol
+  uint16_t worstMarkErrUs;
+  uint16_t worstSpaceErrUs;
+  float sumMeanMarkErrUs;      // Over compared frames
+  float sumMeanSpaceErrUs;
+  float worstCarrierErrPercent;
+  TxFrameCheck last;
+};
+
+// Per-protocol cost of captured frames: setup is the time from starting the
+// encoder to the first carrier edge, airtime the first to the last edge
+struct TxProtocolTiming {
+  uint32_t frames;
+  uint64_t setupUs;
+  uint32_t maxSetupUs;
+  uint64_t airtimeUs;
+};
+
+extern TxCapture txCapture;
+extern TxCheckStats txCheck;
+extern TxProtocolTiming txTiming[IR_TX_TEST + 1];
+
+// Body of the capture ISR: fold one edge at time now into the capture
+inline void IRAM_ATTR txCaptureAddEdge(TxCapture& c, uint32_t now) {
+  uint32_t gap = now - c.lastEdgeUs;
+
+  if (c.edges == 0) {
+    c.firstEdgeUs = now;
+    c.markStartUs = now;
+  } else if (gap > TX_CHECK_GAP_US) {
+    // Rising edge after a space: close the previous mark and the space
+    if (c.count + 2 <= IR_RAW_MAX) {
+      c.durations[c.count++] = c.lastEdgeUs - c.markStartUs;
+      c.durations[c.count++] = gap;
+    } else {
+      c.overflow = true;
+    }
+    c.markStartUs = now;
+  } else if (c.edges & 1) {
+    c.highUs += gap;
+    c.highCount++;
+  } else {
+    c.lowUs += gap;
+    c.lowCount++;
+  }
+
+  c.edges++;
+  c.lastEdgeUs = now;
+}
+
+int buildExpectedTimings(const IrTxJob& job, uint16_t* out);
+void recordTxFrame(const IrTxJob& job, TxCapture& c);
@@ -0,0 +1,83 @@
+#include "wifi_reconnect.h"
+
+const char* const WIFI_FAILURE_NAMES[WIFI_FAIL_KINDS] = {"other", "ap_missing", "auth", "weak_signal"};
+
+// Delay before retrying after `attempts` consecutive failures (0 for the
+// first retry). Depends only on its arguments.
+// - AP missing: it may be rebooting or have moved channel; 2s doubling to 1 min
+// - Authentication: retrying fast won't fix a password; 10s doubling to 5 min
+// - Weak signal and other drops: 1s doubling to 30s
+uint32_t wifiRetryDelayMs(WifiFailure failure, int attempts) {
+  uint32_t base = 1000, cap = 30000;
+  if (failure == WIFI_FAIL_AP_MISSING) {
+    base = 2000;
+    cap = 60000;
+  } else if (failure == WIFI_FAIL_AUTH) {
+    base = 10000;
+    cap = 300000;
+  }
+  uint32_t delayMs = base << min(attempts, 8);
+  return min(delayMs, cap);
+}
+
+WifiFailure classifyWifiDisconnect(uint8_t reason, int8_t rssi) {
+  switch (reason) {
+    case WIFI_REASON_NO_AP_FOUND:
+      return WIFI_FAIL_AP_MISSING;
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_AUTH_EXPIRE:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_MIC_FAILURE:
+    case WIFI_REASON_802_1X_AUTH_FAILED:
+      return WIFI_FAIL_AUTH;
+    case WIFI_REASON_BEACON_TIMEOUT:
+      return WIFI_FAIL_WEAK_SIGNAL;
+    default:
+      return rssi != 0 && rssi < WIFI_WEAK_RSSI ? WIFI_FAIL_WEAK_SIGNAL : WIFI_FAIL_OTHER;
+  }
+}
+
+// Connected: nothing pending, counts cleared, next drop tries the cache
+void wifiReconnectReset(WifiReconnect& r) {
+  r.pending = false;
+  r.attempts = 0;
+  r.total = 0;
+  r.withCache = true;
+}
+
+// A drop or a failed attempt with the given disconnect reason; schedules the
+// next attempt and returns the cause. attemptWasFast: the attempt that
+// failed went through the cached AP.
+WifiFailure wifiReconnectFailed(WifiReconnect& r, uint8_t reason, int8_t rssi, bool attemptWasFast) {
+  WifiFailure failure = classifyWifiDisconnect(reason, rssi);
+  if (failure != r.lastFailure) r.attempts = 0;
+  r.lastFailure = failure;
+
+  if (attemptWasFast && failure != WIFI_FAIL_AUTH && r.attempts == 0) {
+    // The cached AP didn't answer: scan right away
+    r.withCache = false;
+    r.dueMs = millis();
+  } else {
+    // A missing AP may be back on another channel; on weak signal, scan
+    // after one retry so a stronger AP can be picked
+    r.withCache = failure == WIFI_FAIL_AUTH || failure == WIFI_FAIL_OTHER ||
+                  (failure == WIFI_FAIL_WEAK_SIGNAL && r.attempts == 0);
+    r.dueMs = millis() + wifiRetryDelayMs(failure, r.attempts);
+  }
+  r.pending = true;
+  return failure;
+}
+
+// Whether the scheduled attempt is due. WIFI_RECONNECT_NOW counts it and
+// clears pending until the next failure reschedules; WIFI_RECONNECT_REBOOT
+// means the attempt limit is reached.
+WifiReconnectStep wifiReconnectDue(WifiReconnect& r) {
+  if (!r.pending || (long)(millis() - r.dueMs) < 0) return WIFI_RECONNECT_WAIT;
+
+  r.attempts++;
+  r.total++;
+  if (r.total >= WIFI_RECONNECT_MAX_ATTEMPTS && r.lastFailure != WIFI_FAIL_AUTH) return WIFI_RECONNECT_REBOOT;
+  r.pending = false;
+  return WIFI_RECONNECT_NOW;
+}
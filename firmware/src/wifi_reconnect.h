@@ -0,0 +1,34 @@
+// WiFi reconnect scheduling. A drop is classified by its disconnect reason
+// (and the last RSSI) as AP missing, authentication, weak signal or other;
+// the cause sets the backoff and whether the next attempt goes through the
+// cached BSSID and channel or scans. The net task asks wifiReconnectDue()
+// when to connect, and gives up with a reboot after
+// WIFI_RECONNECT_MAX_ATTEMPTS attempts of any mix of causes, unless
+// authentication is failing, which a reboot won't fix.
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiType.h>
+
+#define WIFI_RECONNECT_MAX_ATTEMPTS 120  // Then reboot, unless authentication is failing
+#define WIFI_WEAK_RSSI -80               // Below this, a drop counts as weak signal
+
+enum WifiFailure : uint8_t { WIFI_FAIL_OTHER, WIFI_FAIL_AP_MISSING, WIFI_FAIL_AUTH, WIFI_FAIL_WEAK_SIGNAL, WIFI_FAIL_KINDS };
+extern const char* const WIFI_FAILURE_NAMES[WIFI_FAIL_KINDS];
+
+enum WifiReconnectStep : uint8_t { WIFI_RECONNECT_WAIT, WIFI_RECONNECT_NOW, WIFI_RECONNECT_REBOOT };
+
+struct WifiReconnect {
+  bool pending;            // An attempt is scheduled
+  unsigned long dueMs;     // When it is due
+  int attempts;            // Since the last change of cause; sets the backoff
+  int total;               // Since the last connection, for the reboot limit
+  WifiFailure lastFailure;
+  bool withCache;          // Next attempt through the cached AP
+};
+
+uint32_t wifiRetryDelayMs(WifiFailure failure, int attempts);
+WifiFailure classifyWifiDisconnect(uint8_t reason, int8_t rssi);
+void wifiReconnectReset(WifiReconnect& r);
+WifiFailure wifiReconnectFailed(WifiReconnect& r, uint8_t reason, int8_t rssi, bool attemptWasFast);
+WifiReconnectStep wifiReconnectDue(WifiReconnect& r);
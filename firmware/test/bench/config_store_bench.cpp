@@ -0,0 +1,73 @@
+// Boot-time configuration load from the in-memory NVS: the blob (two reads,
+// CRC check, copy) against the per-key layout it replaced, which looks up
+// three keys per port through temporary Strings. nvs_reads counts the
+// Preferences lookups, the part that costs flash reads on the device.
+#include <benchmark/benchmark.h>
+
+#include "alloc_counter.h"
+#include "config_store.h"
+
+namespace {
+void fillTable() {
+  fake_nvs::reset();
+  boardId = "vda-ir-bench";
+  boardName = "Rack 1";
+  portCount = 0;
+  addMissingPorts();
+  for (int i = 0; i < portCount; i++) {
+    setPort(i, ports[i].gpio, i % 2 ? PORT_IR_OUTPUT : PORT_DISABLED, "Living room TV");
+  }
+}
+
+void BM_LoadBlob(benchmark::State& state) {
+  fillTable();
+  Preferences prefs;
+  markConfigDirty();
+  commitConfig(prefs);
+  markConfigDirty();
+  commitConfig(prefs);  // Both slots hold a copy
+
+  uint64_t allocs = 0;
+  prefs.begin(CONFIG_NAMESPACE, true);
+  for (auto _ : state) {
+    uint64_t before = alloc_counter::allocations();
+    benchmark::DoNotOptimize(loadStoredConfig(prefs));
+    allocs += alloc_counter::allocations() - before;
+  }
+  prefs.end();
+  state.counters["ports"] = portCount;
+  state.counters["nvs_reads"] = 2 * 2;  // isKey + getBytes per slot
+  state.counters["heap_allocs"] = benchmark::Counter(allocs, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_LoadBlob);
+
+void BM_LoadLegacy(benchmark::State& state) {
+  fillTable();
+  Preferences prefs;
+  prefs.begin(CONFIG_NAMESPACE, false);
+  prefs.putString("boardId", boardId);
+  prefs.putString("boardName", boardName);
+  prefs.putBool("adopted", false);
+  prefs.putInt("portCount", portCount);
+  for (int i = 0; i < portCount; i++) {
+    String key = "port" + String(i);
+    prefs.putInt((key + "_gpio").c_str(), ports[i].gpio);
+    prefs.putString((key + "_mode").c_str(), portModeName(ports[i].mode));
+    prefs.putString((key + "_name").c_str(), ports[i].name);
+  }
+  prefs.end();
+
+  uint64_t allocs = 0;
+  prefs.begin(CONFIG_NAMESPACE, true);
+  for (auto _ : state) {
+    uint64_t before = alloc_counter::allocations();
+    benchmark::DoNotOptimize(loadStoredConfig(prefs));
+    allocs += alloc_counter::allocations() - before;
+  }
+  prefs.end();
+  state.counters["ports"] = portCount;
+  state.counters["nvs_reads"] = 3 + 4 + 3 * portCount;  // Slot and layout probes, board keys, port keys
+  state.counters["heap_allocs"] = benchmark::Counter(allocs, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_LoadLegacy);
+}  // namespace
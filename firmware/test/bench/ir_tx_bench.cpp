@@ -0,0 +1,83 @@
+// Encoding cost of one /send_ir job per protocol: sendIrJob() down to the
+// mark()/space() calls, with the carrier left out. On the target the library
+// bit-bangs the carrier inside mark(), so this is the CPU the IR transmit task
+// spends between pulses. Library protocols are measured only when the host
+// build uses IRremoteESP8266 itself.
+#include <benchmark/benchmark.h>
+
+#include "ir_tx.h"
+
+namespace {
+class CountingIRsend : public IRsend {
+ public:
+  CountingIRsend() : IRsend(4) {}
+  uint16_t mark(uint16_t usec) override {
+    onUs += usec;
+    return 1;
+  }
+  void space(uint32_t usec) override { offUs += usec; }
+  uint64_t onUs = 0, offUs = 0;
+};
+
+struct BenchCase {
+  const char* name;
+  IrTxKind kind;
+  uint64_t code;
+  uint32_t frequency;
+  bool library;
+};
+
+const BenchCase CASES[] = {
+  {"nec_56k", IR_TX_NEC, 0x20DF10EF, 56000, false},
+  {"samsung_56k", IR_TX_SAMSUNG, 0xE0E040BF, 56000, false},
+  {"raw_67", IR_TX_RAW, 0, 38000, false},
+  {"nec", IR_TX_NEC, 0x20DF10EF, 38000, true},
+  {"samsung", IR_TX_SAMSUNG, 0xE0E040BF, 38000, true},
+  {"sony", IR_TX_SONY, 0xA90, 38000, true},
+  {"rc5", IR_TX_RC5, 0x1A0C, 38000, true},
+  {"rc6", IR_TX_RC6, 0x1000C, 38000, true},
+  {"lg", IR_TX_LG, 0x88C0051, 38000, true},
+  {"panasonic", IR_TX_PANASONIC, 0x0100BCBD, 38000, true},
+  {"pioneer", IR_TX_PIONEER, 0xA55A38C7, 38000, true},
+};
+
+void BM_EncodeJob(benchmark::State& state) {
+  const BenchCase& c = CASES[state.range(0)];
+  static IrTxJob job;
+  job = {};
+  job.kind = c.kind;
+  job.gpio = 4;
+  job.code = c.code;
+  job.frequency = c.frequency;
+  if (c.kind == IR_TX_RAW) {
+    // A 32-bit NEC frame as captured: header, 32 bits, footer
+    job.raw[job.rawLen++] = 9000;
+    job.raw[job.rawLen++] = 4500;
+    for (int bit = 31; bit >= 0; bit--) {
+      job.raw[job.rawLen++] = 560;
+      job.raw[job.rawLen++] = (c.code >> bit) & 1 ? 1690 : 560;
+    }
+    job.raw[job.rawLen++] = 560;
+  }
+
+  CountingIRsend sender;
+  for (auto _ : state) {
+    sendIrJob(sender, job);
+    if (Serial.written().size() > 65536) Serial.reset();  // Transmit logging
+  }
+  benchmark::DoNotOptimize(sender.onUs + sender.offUs);
+  state.SetLabel(c.name);
+  Serial.reset();
+}
+
+void encodeCases(benchmark::internal::Benchmark* b) {
+  for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+#ifdef VDA_FAKE_IRSEND
+    if (CASES[i].library) continue;
+#endif
+    b->Arg((int64_t)i);
+  }
+}
+}  // namespace
+
+BENCHMARK(BM_EncodeJob)->Apply(encodeCases);
@@ -0,0 +1,39 @@
+// Cost of recording one latency sample, the per-request overhead of every
+// instrumented route and IR/serial operation. Inputs come from a table the
+// compiler can't see through, spread over all buckets, and the histogram is
+// a global so the stores can't be dropped.
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "metrics.h"
+
+namespace {
+LatencyHistogram sink;
+
+void BM_RecordLatency(benchmark::State& state) {
+  std::mt19937 rng(1);
+  std::vector<uint32_t> samples(4096);
+  for (uint32_t& us : samples) us = rng() >> (rng() % 32);
+  size_t next = 0;
+  for (auto _ : state) {
+    recordLatency(sink, samples[next], samples[next] & 1);
+    next = (next + 1) & (samples.size() - 1);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_RecordLatency);
+
+void BM_LatencyPercentile(benchmark::State& state) {
+  LatencyHistogram h = {};
+  std::mt19937 rng(2);
+  for (int i = 0; i < 100000; i++) recordLatency(h, rng() >> (rng() % 32), false);
+  uint8_t percent = 50;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(percent);
+    benchmark::DoNotOptimize(latencyPercentileUs(h, percent));
+  }
+}
+BENCHMARK(BM_LatencyPercentile);
+}  // namespace
@@ -0,0 +1,44 @@
+// Request handling cost through MetricsWebServer and the WebServer parser,
+// with heap calls per request as a counter
+#include <benchmark/benchmark.h>
+
+#include "alloc_counter.h"
+#include "http_request.h"
+#include "metrics_web_server.h"
+
+static void setupServer(MetricsWebServer& server) {
+  memset(routeMetrics, 0, sizeof(routeMetrics));
+  routeMetricsCount = 0;
+  const char* headers[] = {"Content-Length"};
+  server.collectHeaders(headers, 1);
+  server.on("/status", HTTP_GET, [&server]() { server.send(200, "application/json", "{\"ok\":true}"); });
+  server.on("/send_ir", HTTP_POST, [&server]() {
+    benchmark::DoNotOptimize(server.body());
+    server.send(200, "application/json", "{\"success\":true}");
+  });
+  server.onNotFound([&server]() { server.send(404, "application/json", "{}"); });
+}
+
+static void runRequests(benchmark::State& state, const std::string& request) {
+  MetricsWebServer server(80);
+  setupServer(server);
+  alloc_counter::Scope heap;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(server.handleRequest(request));
+  }
+  state.counters["allocs_per_request"] = benchmark::Counter((double)heap.allocations() / state.iterations());
+  state.SetBytesProcessed(state.iterations() * request.size());
+}
+
+static void BM_HandleGet(benchmark::State& state) { runRequests(state, httpRequest("GET", "/status")); }
+BENCHMARK(BM_HandleGet);
+
+static void BM_HandlePostBody(benchmark::State& state) {
+  runRequests(state, httpRequest("POST", "/send_ir", std::string(state.range(0), ' ')));
+}
+BENCHMARK(BM_HandlePostBody)->Arg(64)->Arg(1024)->Arg(8192);
+
+static void BM_HandleNotFound(benchmark::State& state) {
+  runRequests(state, httpRequest("POST", "/missing", std::string(512, ' ')));
+}
+BENCHMARK(BM_HandleNotFound);
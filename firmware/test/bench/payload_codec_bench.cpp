@@ -0,0 +1,83 @@
+// Serial payload codecs on 1 KB, the largest /serial/send response, with the
+// heap churned between iterations the way other tasks would. The codecs work
+// in caller buffers, so their cost shouldn't move with heap state, and
+// heap_allocs must stay 0.
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "payload_codec.h"
+
+#define PAYLOAD_SIZE 1024
+
+namespace {
+struct Buffers {
+  std::vector<uint8_t> plain = std::vector<uint8_t>(PAYLOAD_SIZE);
+  std::vector<uint8_t> decoded = std::vector<uint8_t>(PAYLOAD_SIZE);
+  std::vector<char> text = std::vector<char>(2 * PAYLOAD_SIZE + 1);
+
+  Buffers() {
+    std::mt19937 rng(42);
+    for (uint8_t& b : plain) b = rng();
+  }
+};
+
+// Allocations of mixed sizes kept alive in a ring, so the heap has holes
+class HeapChurn {
+ public:
+  void step() {
+    free(slots[next]);
+    slots[next] = malloc(16 + rng() % 2048);
+    next = (next + 1) % SLOTS;
+  }
+  ~HeapChurn() {
+    for (void* p : slots) free(p);
+  }
+
+ private:
+  static const int SLOTS = 64;
+  void* slots[SLOTS] = {};
+  int next = 0;
+  std::mt19937 rng{7};
+};
+
+void run(benchmark::State& state, bool churn, size_t (*work)(Buffers&)) {
+  Buffers b;
+  HeapChurn heap;
+  uint64_t codecAllocs = 0;
+  for (auto _ : state) {
+    if (churn) {
+      state.PauseTiming();
+      for (int i = 0; i < 8; i++) heap.step();
+      state.ResumeTiming();
+    }
+    alloc_counter::Scope scope;
+    benchmark::DoNotOptimize(work(b));
+    codecAllocs += scope.allocations();
+  }
+  state.SetBytesProcessed(state.iterations() * PAYLOAD_SIZE);
+  state.counters["heap_allocs"] = (double)codecAllocs;
+}
+
+size_t encodeHexWork(Buffers& b) { return encodeHex(b.plain.data(), PAYLOAD_SIZE, b.text.data()); }
+size_t encodeBase64Work(Buffers& b) { return encodeBase64(b.plain.data(), PAYLOAD_SIZE, b.text.data()); }
+size_t decodeHexWork(Buffers& b) {
+  size_t n = encodeHex(b.plain.data(), PAYLOAD_SIZE, b.text.data());
+  return decodeHex(b.text.data(), n, b.decoded.data());
+}
+size_t decodeBase64Work(Buffers& b) {
+  size_t n = encodeBase64(b.plain.data(), PAYLOAD_SIZE, b.text.data());
+  return decodeBase64(b.text.data(), n, b.decoded.data());
+}
+}  // namespace
+
+static void BM_EncodeHex1K(benchmark::State& state) { run(state, state.range(0), encodeHexWork); }
+static void BM_EncodeBase64_1K(benchmark::State& state) { run(state, state.range(0), encodeBase64Work); }
+static void BM_EncodeDecodeHex1K(benchmark::State& state) { run(state, state.range(0), decodeHexWork); }
+static void BM_EncodeDecodeBase64_1K(benchmark::State& state) { run(state, state.range(0), decodeBase64Work); }
+BENCHMARK(BM_EncodeHex1K)->ArgName("churn")->Arg(0)->Arg(1);
+BENCHMARK(BM_EncodeBase64_1K)->ArgName("churn")->Arg(0)->Arg(1);
+BENCHMARK(BM_EncodeDecodeHex1K)->ArgName("churn")->Arg(0)->Arg(1);
+BENCHMARK(BM_EncodeDecodeBase64_1K)->ArgName("churn")->Arg(0)->Arg(1);
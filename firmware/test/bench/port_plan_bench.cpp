@@ -0,0 +1,82 @@
+// Configuring all DevKit output ports: one bulk map with a single commit,
+// against one /ports/configure-style update per port with the commit each
+// call used to make. Senders are real IRsend objects, so re-initialization
+// costs what constructing and begin()-ing one does on the host.
+#include <benchmark/benchmark.h>
+
+#include "config_store.h"
+#include "port_plan.h"
+
+#include <IRsend.h>
+
+int activeReceiverPort = -1;
+static IRsend* senders[MAX_PORTS];
+
+void initIRSender(int portIndex) {
+  delete senders[portIndex];
+  senders[portIndex] = new IRsend(ports[portIndex].gpio);
+  senders[portIndex]->begin();
+}
+void releaseIRSender(int portIndex) {
+  delete senders[portIndex];
+  senders[portIndex] = nullptr;
+}
+void initIRReceiver(int gpio) { activeReceiverPort = gpio; }
+void stopIRReceiver() { activeReceiverPort = -1; }
+
+namespace {
+Preferences prefs;
+PortPlan plan;
+
+void resetTable() {
+  portCount = 0;
+  addMissingPorts();
+  rebuildGpioIndex();
+  for (int i = 0; i < portCount; i++) releaseIRSender(i);
+}
+
+void BM_ConfigureAllBulk(benchmark::State& state) {
+  fake_nvs::reset();
+  for (auto _ : state) {
+    state.PauseTiming();
+    resetTable();
+    uint32_t commits = fake_nvs::commits();
+    state.ResumeTiming();
+
+    beginPortPlan(plan, false);
+    for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
+      addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[i], "ir_output", "Living room TV");
+    }
+    if (applyPortPlan(plan) > 0) {
+      markConfigDirty();
+      commitConfig(prefs);
+    }
+
+    state.counters["nvs_commits"] = fake_nvs::commits() - commits;
+  }
+  state.counters["ports"] = OUTPUT_CAPABLE_COUNT;
+}
+BENCHMARK(BM_ConfigureAllBulk);
+
+void BM_ConfigureAllIndividual(benchmark::State& state) {
+  fake_nvs::reset();
+  for (auto _ : state) {
+    state.PauseTiming();
+    resetTable();
+    uint32_t commits = fake_nvs::commits();
+    state.ResumeTiming();
+
+    for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
+      beginPortPlan(plan, false);
+      addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[i], "ir_output", "Living room TV");
+      applyPortPlan(plan);
+      markConfigDirty();
+      commitConfig(prefs);
+    }
+
+    state.counters["nvs_commits"] = fake_nvs::commits() - commits;
+  }
+  state.counters["ports"] = OUTPUT_CAPABLE_COUNT;
+}
+BENCHMARK(BM_ConfigureAllIndividual);
+}  // namespace
@@ -0,0 +1,63 @@
+// Port resolution on the /send_ir path: the GPIO index against the linear
+// scan with String mode compares and the separate input-only pin scan that
+// it replaced. Looks up every output pin in turn, so the scan's average
+// position is mid-table.
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "port_table.h"
+
+namespace {
+// The pre-index table: mode and name as Strings
+struct StringPort {
+  int gpio;
+  String mode;
+  String name;
+};
+StringPort stringPorts[MAX_PORTS];
+int stringPortCount = 0;
+
+void fillTables() {
+  portCount = 0;
+  addMissingPorts();
+  for (int i = 0; i < portCount; i++) {
+    setPort(i, ports[i].gpio, (ports[i].caps & PORT_CAP_OUTPUT) ? PORT_IR_OUTPUT : PORT_IR_INPUT, "");
+    stringPorts[i] = {ports[i].gpio, portModeName(ports[i].mode), ""};
+  }
+  stringPortCount = portCount;
+  rebuildGpioIndex();
+}
+
+int scanForOutput(int gpio) {
+  for (int i = 0; i < INPUT_ONLY_COUNT; i++) {
+    if (INPUT_ONLY_PINS[i] == gpio) return -1;
+  }
+  for (int i = 0; i < stringPortCount; i++) {
+    if (stringPorts[i].gpio == gpio && stringPorts[i].mode == "ir_output") return i;
+  }
+  return -1;
+}
+
+int indexForOutput(int gpio) {
+  int index = portForGpio(gpio);
+  return (index >= 0 && ports[index].mode == PORT_IR_OUTPUT) ? index : -1;
+}
+
+void run(benchmark::State& state, int (*lookup)(int)) {
+  fillTables();
+  int next = 0;
+  for (auto _ : state) {
+    int gpio = OUTPUT_CAPABLE_PINS[next];
+    next = (next + 1) % OUTPUT_CAPABLE_COUNT;
+    benchmark::DoNotOptimize(gpio);
+    benchmark::DoNotOptimize(lookup(gpio));
+  }
+  state.counters["ports"] = portCount;
+}
+
+void BM_SendPortLookupIndex(benchmark::State& state) { run(state, indexForOutput); }
+void BM_SendPortLookupStringScan(benchmark::State& state) { run(state, scanForOutput); }
+BENCHMARK(BM_SendPortLookupIndex);
+BENCHMARK(BM_SendPortLookupStringScan);
+}  // namespace
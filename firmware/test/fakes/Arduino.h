@@ -0,0 +1,59 @@
+// Host stand-in for the Arduino-ESP32 core: just enough for the firmware
+// modules under firmware/src to build and run against the fakes
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HardwareSerial.h"
+#include "WString.h"
+#include "esp_attr.h"
+#include "fake_clock.h"
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PGM_P const char*
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define CHANGE 0x03
+
+inline unsigned long millis() { return (unsigned long)(fake_clock::nowUs() / 1000); }
+inline unsigned long micros() { return (unsigned long)fake_clock::nowUs(); }
+inline void delay(uint32_t ms) { fake_clock::sleepUs((uint64_t)ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { fake_clock::sleepUs(us); }
+inline void yield() {}
+
+// GPIO: levels are remembered per pin, interrupts only registered
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+inline int digitalPinToInterrupt(int pin) { return pin; }
+
+#ifndef VDA_HAVE_STRLCPY
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
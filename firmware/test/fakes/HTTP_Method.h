@@ -0,0 +1,14 @@
+#pragma once
+
+// Values from http_parser, which Arduino-ESP32 uses for HTTPMethod
+enum http_method {
+  HTTP_DELETE = 0,
+  HTTP_GET = 1,
+  HTTP_HEAD = 2,
+  HTTP_POST = 3,
+  HTTP_PUT = 4,
+  HTTP_OPTIONS = 6,
+  HTTP_PATCH = 28,
+};
+typedef enum http_method HTTPMethod;
+#define HTTP_ANY (HTTPMethod)(255)
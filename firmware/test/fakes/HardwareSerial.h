@@ -0,0 +1,68 @@
+// ESP32 HardwareSerial as a scripted UART. Bytes queued with receiveAt() or
+// replyTo() arrive once the fake clock reaches their time; written bytes are
+// kept for inspection. The RX buffer drops bytes past its size like the UART
+// driver does.
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Stream.h"
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int uartNum) : uartNum(uartNum) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1,
+             bool invert = false, unsigned long timeoutMs = 20000UL, uint8_t rxfifoFullThreshold = 112);
+  void end(bool fullyTerminate = true);
+  size_t setRxBufferSize(size_t size) { rxBufferSize = size; return size; }
+
+  int available() override;
+  int peek() override;
+  int read() override;
+  size_t read(uint8_t* buffer, size_t size);
+  size_t read(char* buffer, size_t size) { return read((uint8_t*)buffer, size); }
+  size_t readBytes(char* buffer, size_t length) override { return read((uint8_t*)buffer, length); }
+  using Stream::readBytes;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return started; }
+
+  // Test side
+  void receiveAt(unsigned long atMs, const std::string& bytes);   // Fake clock ms
+  void replyTo(const std::string& trigger, const std::string& reply, unsigned long afterMs = 0);
+  const std::string& written() const { return tx; }
+  void reset();
+  bool echo = false;  // Copy writes to stderr
+  unsigned long baud = 0;
+  uint32_t dropped = 0;
+
+ private:
+  struct Pending {
+    unsigned long atMs;
+    std::string bytes;
+  };
+  struct Reply {
+    std::string trigger;
+    std::string reply;
+    unsigned long afterMs;
+  };
+
+  int uartNum;
+  bool started = false;
+  size_t rxBufferSize = 256;
+  std::deque<uint8_t> rx;
+  std::vector<Pending> pending;
+  std::vector<Reply> replies;
+  std::string tx;
+  size_t txMatched = 0;  // Written bytes already checked against replies
+
+  void deliver();
+};
+
+extern HardwareSerial Serial;
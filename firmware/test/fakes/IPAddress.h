@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "WString.h"
+
+class IPAddress {
+ public:
+  IPAddress() : bytes{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+  explicit IPAddress(uint32_t address) { memcpy(bytes, &address, 4); }
+  operator uint32_t() const {
+    uint32_t v;
+    memcpy(&v, bytes, 4);
+    return v;
+  }
+  uint8_t operator[](int i) const { return bytes[i]; }
+  bool fromString(const char* s) {
+    unsigned a, b, c, d;
+    char extra;
+    if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+      return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buf);
+  }
+
+ private:
+  uint8_t bytes[4];
+};
@@ -0,0 +1,92 @@
+// In-memory NVS behind the Arduino Preferences API. Values are typed like NVS
+// (reading a key with the wrong getter returns the default), names and keys
+// are limited to 15 characters, and every successful put/remove/clear counts
+// as one flash commit. Storage is shared by all instances, like the NVS
+// partition.
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "WString.h"
+
+typedef enum { PT_I8, PT_U8, PT_I16, PT_U16, PT_I32, PT_U32, PT_I64, PT_U64, PT_STR, PT_BLOB, PT_INVALID } PreferenceType;
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+  PreferenceType getType(const char* key);
+
+  size_t putChar(const char* key, int8_t value) { return putValue(key, PT_I8, value); }
+  size_t putUChar(const char* key, uint8_t value) { return putValue(key, PT_U8, value); }
+  size_t putShort(const char* key, int16_t value) { return putValue(key, PT_I16, value); }
+  size_t putUShort(const char* key, uint16_t value) { return putValue(key, PT_U16, value); }
+  size_t putInt(const char* key, int32_t value) { return putValue(key, PT_I32, value); }
+  size_t putUInt(const char* key, uint32_t value) { return putValue(key, PT_U32, value); }
+  size_t putLong(const char* key, int32_t value) { return putValue(key, PT_I32, value); }
+  size_t putULong(const char* key, uint32_t value) { return putValue(key, PT_U32, value); }
+  size_t putLong64(const char* key, int64_t value) { return putValue(key, PT_I64, value); }
+  size_t putULong64(const char* key, uint64_t value) { return putValue(key, PT_U64, value); }
+  size_t putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+  size_t putFloat(const char* key, float value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t len);
+
+  int8_t getChar(const char* key, int8_t defaultValue = 0) { return getValue(key, PT_I8, defaultValue); }
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, PT_U8, defaultValue); }
+  int16_t getShort(const char* key, int16_t defaultValue = 0) { return getValue(key, PT_I16, defaultValue); }
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, PT_U16, defaultValue); }
+  int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, PT_I32, defaultValue); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, PT_U32, defaultValue); }
+  int32_t getLong(const char* key, int32_t defaultValue = 0) { return getValue(key, PT_I32, defaultValue); }
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getValue(key, PT_U32, defaultValue); }
+  int64_t getLong64(const char* key, int64_t defaultValue = 0) { return getValue(key, PT_I64, defaultValue); }
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, PT_U64, defaultValue); }
+  bool getBool(const char* key, bool defaultValue = false) { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+  float getFloat(const char* key, float defaultValue = NAN);
+  String getString(const char* key, String defaultValue = String());
+  size_t getString(const char* key, char* value, size_t maxLen);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t freeEntries() { return 500; }
+
+ private:
+  std::string space;
+  bool started = false;
+  bool readOnly = false;
+
+  template <typename T>
+  size_t putValue(const char* key, PreferenceType type, T value) {
+    return put(key, type, &value, sizeof(value)) ? sizeof(value) : 0;
+  }
+  template <typename T>
+  T getValue(const char* key, PreferenceType type, T defaultValue) {
+    T value;
+    return get(key, type, &value, sizeof(value)) ? value : defaultValue;
+  }
+  bool put(const char* key, PreferenceType type, const void* data, size_t len);
+  bool get(const char* key, PreferenceType type, void* out, size_t len);
+};
+
+// Test side: the whole store, commit counting and failure injection
+namespace fake_nvs {
+struct Entry {
+  PreferenceType type;
+  std::vector<uint8_t> data;
+};
+typedef std::map<std::string, std::map<std::string, Entry>> Store;
+
+Store& store();
+void reset();               // Erase everything and zero the counters
+uint32_t commits();         // Successful writes since reset()
+uint32_t commits(const char* key);
+void failWrites(bool fail);  // Make puts return 0, like a full partition
+}  // namespace fake_nvs
@@ -0,0 +1,31 @@
+// Arduino Stream. readBytes() returns what is buffered instead of waiting for
+// the stream timeout, so host runs never block.
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long ms) { timeoutMs = ms; }
+  unsigned long getTimeout() const { return timeoutMs; }
+
+  virtual size_t readBytes(char* buffer, size_t length) {
+    size_t n = 0;
+    for (int c; n < length && (c = read()) >= 0; n++) buffer[n] = (char)c;
+    return n;
+  }
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+  String readStringUntil(char terminator) {
+    String s;
+    for (int c; (c = read()) >= 0 && c != terminator;) s += (char)c;
+    return s;
+  }
+
+ protected:
+  unsigned long timeoutMs = 1000;
+};
@@ -0,0 +1,131 @@
+// Arduino String over std::string, with the members the firmware uses
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const __FlashStringHelper* s) : s_(reinterpret_cast<const char*>(s)) {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(int v, unsigned char base = 10) : s_(format((long long)v, base)) {}
+  explicit String(unsigned int v, unsigned char base = 10) : s_(format((unsigned long long)v, base)) {}
+  explicit String(long v, unsigned char base = 10) : s_(format((long long)v, base)) {}
+  explicit String(unsigned long v, unsigned char base = 10) : s_(format((unsigned long long)v, base)) {}
+  explicit String(long long v, unsigned char base = 10) : s_(format(v, base)) {}
+  explicit String(unsigned long long v, unsigned char base = 10) : s_(format(v, base)) {}
+  explicit String(double v, unsigned int decimals = 2) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+  }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.length(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int size) { s_.reserve(size); return true; }
+  char* begin() { return &s_[0]; }
+  char* end() { return &s_[0] + s_.size(); }
+  const std::string& str() const { return s_; }
+
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  char& operator[](unsigned int i) { return s_[i]; }
+
+  String& operator=(const char* s) { s_ = s ? s : ""; return *this; }
+  String& operator+=(const String& s) { s_ += s.s_; return *this; }
+  String& operator+=(const char* s) { if (s) s_ += s; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { s_ += format((long long)v, 10); return *this; }
+  String& operator+=(unsigned int v) { s_ += format((unsigned long long)v, 10); return *this; }
+  String& operator+=(long v) { s_ += format((long long)v, 10); return *this; }
+  String& operator+=(unsigned long v) { s_ += format((unsigned long long)v, 10); return *this; }
+  bool concat(const String& s) { s_ += s.s_; return true; }
+  bool concat(const char* s) { if (s) s_ += s; return true; }
+  bool concat(char c) { s_ += c; return true; }
+  bool concat(const char* s, unsigned int len) { s_.append(s, len); return true; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return !(*this == o); }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String& o) const {
+    if (s_.size() != o.s_.size()) return false;
+    for (size_t i = 0; i < s_.size(); i++) {
+      if (tolower((unsigned char)s_[i]) != tolower((unsigned char)o.s_[i])) return false;
+    }
+    return true;
+  }
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const String& s, unsigned int from = 0) const { return pos(s_.find(s.s_, from)); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s_.c_str(), nullptr); }
+  double toDouble() const { return strtod(s_.c_str(), nullptr); }
+
+  void trim() {
+    size_t b = 0, e = s_.size();
+    while (b < e && isspace((unsigned char)s_[b])) b++;
+    while (e > b && isspace((unsigned char)s_[e - 1])) e--;
+    s_ = s_.substr(b, e - b);
+  }
+  void toLowerCase() { for (char& c : s_) c = tolower((unsigned char)c); }
+  void toUpperCase() { for (char& c : s_) c = toupper((unsigned char)c); }
+  void replace(const String& find, const String& with) {
+    if (find.s_.empty()) return;
+    for (size_t at = s_.find(find.s_); at != std::string::npos; at = s_.find(find.s_, at + with.s_.size())) {
+      s_.replace(at, find.s_.size(), with.s_);
+    }
+  }
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1) {
+    if (index < s_.size()) s_.erase(index, count);
+  }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String& a, const char* b) { return String(a.s_ + (b ? b : "")); }
+  friend String operator+(const char* a, const String& b) { return String((a ? a : "") + b.s_); }
+  friend String operator+(const String& a, char c) { return String(a.s_ + c); }
+  friend bool operator==(const char* a, const String& b) { return b == a; }
+
+ private:
+  std::string s_;
+
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+
+  static std::string format(unsigned long long v, unsigned char base) {
+    if (v == 0) return "0";
+    std::string out;
+    for (; v; v /= base) out.insert(out.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[v % base]);
+    return out;
+  }
+  static std::string format(long long v, unsigned char base) {
+    if (v < 0 && base == 10) return "-" + format((unsigned long long)(-(v + 1)) + 1, base);
+    return format((unsigned long long)v, base);
+  }
+};
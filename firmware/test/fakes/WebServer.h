@@ -0,0 +1,144 @@
+// Arduino-ESP32 WebServer with the request parsing of its Parsing.cpp
+// (2.0.x): the same handler lookup, raw body loop, "plain" body copy and
+// header collection, fed from a byte string instead of a socket.
+// handleRequest() runs one request the way handleClient() would and the
+// response is kept in lastResponse(). Not modelled: socket timeouts, chunked
+// responses, multipart uploads (form bodies are drained) and path arguments.
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "HTTP_Method.h"
+#include "WString.h"
+#include "WiFiClient.h"
+
+#define HTTP_RAW_BUFLEN 1436
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+enum HTTPRawStatus { RAW_START, RAW_WRITE, RAW_END, RAW_ABORTED };
+
+typedef struct {
+  HTTPRawStatus status;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_RAW_BUFLEN];
+} HTTPRaw;
+
+class WebServer;
+
+class RequestHandler {
+ public:
+  virtual ~RequestHandler() {}
+  virtual bool canHandle(HTTPMethod method, String uri) { return false; }
+  virtual bool canUpload(String uri) { return false; }
+  virtual bool canRaw(String uri) { return false; }
+  virtual bool handle(WebServer& server, HTTPMethod requestMethod, String requestUri) { return false; }
+  virtual void raw(WebServer& server, String requestUri, HTTPRaw& raw) {}
+
+  RequestHandler* next() { return _next; }
+  void next(RequestHandler* r) { _next = r; }
+
+ private:
+  RequestHandler* _next = nullptr;
+};
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  struct Response {
+    int code = 0;
+    String contentType;
+    std::string body;
+    std::vector<std::pair<String, String>> headers;
+  };
+
+  explicit WebServer(int port = 80) : _port(port) {}
+  virtual ~WebServer();
+
+  void begin() {}
+  void close() {}
+  void stop() {}
+  void handleClient() {}
+
+  void on(const String& uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn);
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+  void addHandler(RequestHandler* handler);
+  void onNotFound(THandlerFunction fn) { _notFoundHandler = fn; }
+
+  String uri() { return _currentUri; }
+  HTTPMethod method() { return _currentMethod; }
+  WiFiClient& client() { return _currentClient; }
+
+  String arg(const String& name);
+  String arg(int i);
+  String argName(int i);
+  int args() { return (int)_currentArgs.size(); }
+  bool hasArg(const String& name);
+
+  void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+  String header(const String& name);
+  String header(int i);
+  String headerName(int i);
+  int headers() { return (int)_currentHeaders.size(); }
+  bool hasHeader(const String& name);
+  String hostHeader() { return _hostHeader; }
+
+  void send(int code, const char* contentType = nullptr, const String& content = String());
+  void send(int code, char* contentType, const String& content) { send(code, (const char*)contentType, content); }
+  void send(int code, const String& contentType, const String& content) { send(code, contentType.c_str(), content); }
+  void send(int code, const char* contentType, const char* content) { send_P(code, contentType, content); }
+  void send(int code, const char* contentType, const char* content, size_t contentLength) {
+    send_P(code, contentType, content, contentLength);
+  }
+  void send_P(int code, PGM_P contentType, PGM_P content);
+  void send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength);
+  void sendHeader(const String& name, const String& value, bool first = false);
+  void setContentLength(const size_t contentLength) { _contentLength = contentLength; }
+  void sendContent(const String& content) { _response.body += content.str(); }
+  void sendContent(const char* content, size_t size) { _response.body.append(content, size); }
+  void enableCORS(bool enable = true) { _corsEnabled = enable; }
+  void enableDelay(bool value) {}
+
+  // Test side: parse and dispatch one request; false if the request was
+  // rejected or the connection dropped before a handler ran
+  bool handleRequest(const std::string& request);
+  const Response& lastResponse() const { return _response; }
+  size_t plainAllocations() const { return _plainAllocations; }  // Content-Length mallocs for arg("plain")
+
+ protected:
+  struct RequestArgument {
+    String key;
+    String value;
+  };
+
+  bool _parseRequest(WiFiClient& client);
+  void _parseArguments(const String& data);
+  void _handleRequest();
+  void _collectHeader(const char* headerName, const char* headerValue);
+  static String urlDecode(const String& text);
+
+  int _port;
+  RequestHandler* _firstHandler = nullptr;
+  RequestHandler* _lastHandler = nullptr;
+  RequestHandler* _currentHandler = nullptr;
+  THandlerFunction _notFoundHandler;
+  WiFiClient _currentClient;
+  HTTPMethod _currentMethod = HTTP_ANY;
+  String _currentUri;
+  String _hostHeader;
+  std::vector<RequestArgument> _currentArgs;
+  std::vector<RequestArgument> _currentHeaders;  // Collected keys, values filled per request
+  std::unique_ptr<HTTPRaw> _currentRaw;
+  std::vector<std::pair<String, String>> _pendingHeaders;
+  size_t _contentLength = CONTENT_LENGTH_UNKNOWN;
+  bool _corsEnabled = false;
+  Response _response;
+  size_t _plainAllocations = 0;
+};
@@ -0,0 +1,42 @@
+// WiFi station that records connection attempts; tests drive the outcome by
+// setting the status and RSSI and by calling the firmware's event handler
+#pragma once
+
+#include <vector>
+
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiType.h"
+
+class WiFiClass {
+ public:
+  struct Attempt {
+    String ssid;
+    int32_t channel;
+    bool withBssid;
+  };
+
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true) {
+    attempts.push_back({ssid, channel, bssid != nullptr});
+    return currentStatus;
+  }
+  bool disconnect(bool wifiOff = false, bool eraseAp = false) {
+    currentStatus = WL_DISCONNECTED;
+    return true;
+  }
+  bool reconnect() { return true; }
+  wl_status_t status() { return currentStatus; }
+  bool isConnected() { return currentStatus == WL_CONNECTED; }
+  int8_t RSSI() { return rssi; }
+  IPAddress localIP() { return ip; }
+  String SSID() { return attempts.empty() ? String() : attempts.back().ssid; }
+
+  // Test side
+  std::vector<Attempt> attempts;
+  wl_status_t currentStatus = WL_DISCONNECTED;
+  int8_t rssi = -60;
+  IPAddress ip;
+};
+
+extern WiFiClass WiFi;
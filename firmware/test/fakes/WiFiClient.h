@@ -0,0 +1,41 @@
+// TCP client as seen by WebServer: reads come from a byte string the test
+// supplies, and stop() drops whatever is left, like closing the socket
+#pragma once
+
+#include <algorithm>
+#include <string>
+
+#include "Stream.h"
+
+class WiFiClient : public Stream {
+ public:
+  void load(const std::string& bytes) {
+    input = bytes;
+    offset = 0;
+    open = true;
+  }
+  size_t consumed() const { return offset; }
+
+  int available() override { return open ? (int)(input.size() - offset) : 0; }
+  int peek() override { return available() ? (uint8_t)input[offset] : -1; }
+  int read() override { return available() ? (uint8_t)input[offset++] : -1; }
+  size_t readBytes(char* buffer, size_t length) override {
+    size_t n = std::min(length, (size_t)available());
+    memcpy(buffer, input.data() + offset, n);
+    offset += n;
+    return n;
+  }
+  using Stream::readBytes;
+  size_t write(uint8_t c) override { return open ? 1 : 0; }
+  size_t write(const uint8_t* buffer, size_t size) override { return open ? size : 0; }
+  using Print::write;
+
+  uint8_t connected() { return open; }
+  void stop() { open = false; }
+  operator bool() { return open; }
+
+ private:
+  std::string input;
+  size_t offset = 0;
+  bool open = false;
+};
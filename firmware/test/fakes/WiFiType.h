@@ -0,0 +1,79 @@
+// Network events and disconnect reasons as Arduino-ESP32 2.0.x / ESP-IDF 4.4
+// number them
+#pragma once
+
+#include <cstdint>
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_READY = 0,
+  ARDUINO_EVENT_WIFI_SCAN_DONE,
+  ARDUINO_EVENT_WIFI_STA_START,
+  ARDUINO_EVENT_WIFI_STA_STOP,
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP,
+  ARDUINO_EVENT_WIFI_AP_START,
+  ARDUINO_EVENT_WIFI_AP_STOP,
+  ARDUINO_EVENT_WIFI_AP_STACONNECTED,
+  ARDUINO_EVENT_WIFI_AP_STADISCONNECTED,
+  ARDUINO_EVENT_WIFI_AP_STAIPASSIGNED,
+  ARDUINO_EVENT_WIFI_AP_PROBEREQRECVED,
+  ARDUINO_EVENT_WIFI_AP_GOT_IP6,
+  ARDUINO_EVENT_WIFI_FTM_REPORT,
+  ARDUINO_EVENT_ETH_START,
+  ARDUINO_EVENT_ETH_STOP,
+  ARDUINO_EVENT_ETH_CONNECTED,
+  ARDUINO_EVENT_ETH_DISCONNECTED,
+  ARDUINO_EVENT_ETH_GOT_IP,
+  ARDUINO_EVENT_ETH_GOT_IP6,
+  ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+typedef arduino_event_id_t WiFiEvent_t;
+
+typedef enum {
+  WIFI_REASON_UNSPECIFIED = 1,
+  WIFI_REASON_AUTH_EXPIRE = 2,
+  WIFI_REASON_AUTH_LEAVE = 3,
+  WIFI_REASON_ASSOC_EXPIRE = 4,
+  WIFI_REASON_ASSOC_TOOMANY = 5,
+  WIFI_REASON_NOT_AUTHED = 6,
+  WIFI_REASON_NOT_ASSOCED = 7,
+  WIFI_REASON_ASSOC_LEAVE = 8,
+  WIFI_REASON_ASSOC_NOT_AUTHED = 9,
+  WIFI_REASON_MIC_FAILURE = 14,
+  WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT = 15,
+  WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT = 16,
+  WIFI_REASON_IE_IN_4WAY_DIFFERS = 17,
+  WIFI_REASON_802_1X_AUTH_FAILED = 23,
+  WIFI_REASON_BEACON_TIMEOUT = 200,
+  WIFI_REASON_NO_AP_FOUND = 201,
+  WIFI_REASON_AUTH_FAIL = 202,
+  WIFI_REASON_ASSOC_FAIL = 203,
+  WIFI_REASON_HANDSHAKE_TIMEOUT = 204,
+  WIFI_REASON_CONNECTION_FAIL = 205,
+} wifi_err_reason_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t ssid_len;
+  uint8_t bssid[6];
+  uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef union {
+  wifi_event_sta_disconnected_t wifi_sta_disconnected;
+} arduino_event_info_t;
+typedef arduino_event_info_t WiFiEventInfo_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
@@ -0,0 +1,78 @@
+// glibc's allocator entry points stay reachable as __libc_*, so these
+// definitions interpose on every malloc in the process, including the ones
+// made inside libstdc++
+#include "alloc_counter.h"
+
+#include <malloc.h>
+
+#include <atomic>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+std::atomic<uint64_t> allocCount{0};
+std::atomic<uint64_t> allocBytes{0};
+std::atomic<int64_t> liveBytes{0};
+
+inline void count(size_t size) {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+inline int64_t usable(void* ptr) { return ptr ? (int64_t)malloc_usable_size(ptr) : 0; }
+}  // namespace
+
+extern "C" {
+void* malloc(size_t size) {
+  count(size);
+  void* ptr = __libc_malloc(size);
+  liveBytes += usable(ptr);
+  return ptr;
+}
+
+void* calloc(size_t count_, size_t size) {
+  count(count_ * size);
+  void* ptr = __libc_calloc(count_, size);
+  liveBytes += usable(ptr);
+  return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+  count(size);
+  int64_t before = usable(ptr);
+  void* moved = __libc_realloc(ptr, size);
+  if (moved != nullptr || size == 0) liveBytes += usable(moved) - before;
+  return moved;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  count(size);
+  void* ptr = __libc_memalign(alignment, size);
+  liveBytes += usable(ptr);
+  return ptr;
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+  void* ptr = aligned_alloc(alignment, size);
+  if (ptr == nullptr) return 12;  // ENOMEM
+  *out = ptr;
+  return 0;
+}
+
+void free(void* ptr) {
+  liveBytes -= usable(ptr);
+  __libc_free(ptr);
+}
+}
+
+namespace alloc_counter {
+uint64_t allocations() { return allocCount; }
+uint64_t bytes() { return allocBytes; }
+int64_t live() { return liveBytes; }
+}  // namespace alloc_counter
@@ -0,0 +1,28 @@
+// Counts heap calls made by the whole process, the host counterpart of the
+// firmware's --wrap=malloc counters. Linked into the test and benchmark
+// binaries only (sanitizer builds bring their own allocator).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace alloc_counter {
+uint64_t allocations();  // malloc + calloc + realloc calls
+uint64_t bytes();        // Requested by those calls
+int64_t live();          // Bytes allocated and not yet freed
+
+// Counts over a scope
+class Scope {
+ public:
+  Scope()
+      : startAllocs(alloc_counter::allocations()), startBytes(alloc_counter::bytes()), startLive(alloc_counter::live()) {}
+  uint64_t allocations() const { return alloc_counter::allocations() - startAllocs; }
+  uint64_t bytes() const { return alloc_counter::bytes() - startBytes; }
+  int64_t live() const { return alloc_counter::live() - startLive; }
+
+ private:
+  uint64_t startAllocs;
+  uint64_t startBytes;
+  int64_t startLive;
+};
+}  // namespace alloc_counter
@@ -0,0 +1,145 @@
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+
+// ============ Clock ============
+namespace fake_clock {
+namespace {
+std::atomic<uint64_t> manualUs{0};
+std::atomic<bool> real{false};
+std::chrono::steady_clock::time_point realStart = std::chrono::steady_clock::now();
+}  // namespace
+
+uint64_t nowUs() {
+  if (!real) return manualUs;
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - realStart).count();
+}
+
+void setUs(uint64_t us) { manualUs = us; }
+void advanceUs(uint64_t us) { manualUs += us; }
+
+void useRealTime(bool on) {
+  if (on && !real) realStart = std::chrono::steady_clock::now() - std::chrono::microseconds(manualUs.load());
+  if (!on && real) manualUs = nowUs();
+  real = on;
+}
+
+bool realTime() { return real; }
+
+void sleepUs(uint64_t us) {
+  if (real) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  } else {
+    advanceUs(us);
+  }
+}
+}  // namespace fake_clock
+
+// ============ GPIO ============
+namespace {
+std::map<uint8_t, int> pinLevels;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t level) { pinLevels[pin] = level; }
+int digitalRead(uint8_t pin) { return pinLevels.count(pin) ? pinLevels[pin] : LOW; }
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {}
+void detachInterrupt(uint8_t pin) {}
+
+// ============ HardwareSerial ============
+HardwareSerial Serial(0);
+
+void HardwareSerial::begin(unsigned long baudRate, uint32_t config, int8_t rxPin, int8_t txPin, bool invert,
+                           unsigned long timeoutMs, uint8_t rxfifoFullThreshold) {
+  baud = baudRate;
+  started = true;
+}
+
+void HardwareSerial::end(bool fullyTerminate) {
+  started = false;
+  rx.clear();
+}
+
+void HardwareSerial::reset() {
+  rx.clear();
+  pending.clear();
+  replies.clear();
+  tx.clear();
+  txMatched = 0;
+  dropped = 0;
+}
+
+void HardwareSerial::deliver() {
+  unsigned long now = millis();
+  for (size_t i = 0; i < pending.size();) {
+    if (pending[i].atMs > now) {
+      i++;
+      continue;
+    }
+    for (char c : pending[i].bytes) {
+      if (rx.size() < rxBufferSize) {
+        rx.push_back((uint8_t)c);
+      } else {
+        dropped++;
+      }
+    }
+    pending.erase(pending.begin() + i);
+  }
+}
+
+int HardwareSerial::available() {
+  deliver();
+  return (int)rx.size();
+}
+
+int HardwareSerial::peek() {
+  deliver();
+  return rx.empty() ? -1 : rx.front();
+}
+
+int HardwareSerial::read() {
+  deliver();
+  if (rx.empty()) return -1;
+  int c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::read(uint8_t* buffer, size_t size) {
+  deliver();
+  size_t n = 0;
+  for (; n < size && !rx.empty(); n++) {
+    buffer[n] = rx.front();
+    rx.pop_front();
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (uartNum == 0) {
+    // Console: only shown with VDA_HOST_LOG set
+    static const bool log = getenv("VDA_HOST_LOG") != nullptr;
+    if (log || echo) fwrite(buffer, 1, size, stderr);
+    return size;
+  }
+  if (echo) fwrite(buffer, 1, size, stderr);
+  tx.append((const char*)buffer, size);
+
+  for (const Reply& r : replies) {
+    size_t from = txMatched >= r.trigger.size() ? txMatched - r.trigger.size() + 1 : 0;
+    for (size_t at = tx.find(r.trigger, from); at != std::string::npos; at = tx.find(r.trigger, at + 1)) {
+      pending.push_back({millis() + r.afterMs, r.reply});
+    }
+  }
+  txMatched = tx.size();
+  return size;
+}
+
+void HardwareSerial::receiveAt(unsigned long atMs, const std::string& bytes) { pending.push_back({atMs, bytes}); }
+
+void HardwareSerial::replyTo(const std::string& trigger, const std::string& reply, unsigned long afterMs) {
+  replies.push_back({trigger, reply, afterMs});
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// CRC-32 as in IEEE 802.3 and zlib
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
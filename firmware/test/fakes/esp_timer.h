@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+#include "fake_clock.h"
+
+inline int64_t esp_timer_get_time() { return (int64_t)fake_clock::nowUs(); }
@@ -0,0 +1,17 @@
+// Clock behind millis(), micros(), esp_timer_get_time() and FreeRTOS ticks.
+// Manual by default: time only moves when a test advances it or the code
+// under test calls delay()/vTaskDelay(). Real mode follows the steady clock,
+// for tests that run tasks on threads.
+#pragma once
+
+#include <cstdint>
+
+namespace fake_clock {
+uint64_t nowUs();
+void setUs(uint64_t us);
+void advanceUs(uint64_t us);
+inline void advanceMs(uint64_t ms) { advanceUs(ms * 1000); }
+void useRealTime(bool real);
+bool realTime();
+void sleepUs(uint64_t us);  // Advances manual time, sleeps in real mode
+}  // namespace fake_clock
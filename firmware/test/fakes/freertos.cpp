@@ -0,0 +1,80 @@
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "fake_clock.h"
+
+struct QueueDefinition {
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+namespace {
+template <typename Ready>
+bool waitUntil(std::unique_lock<std::mutex>& lock, QueueDefinition* queue, TickType_t ticks, Ready ready) {
+  if (ready()) return true;
+  if (ticks == 0) return false;
+  if (ticks == portMAX_DELAY) {
+    queue->changed.wait(lock, ready);
+    return true;
+  }
+  if (!fake_clock::realTime()) {
+    fake_clock::advanceUs((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+    return false;
+  }
+  return queue->changed.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+}
+}  // namespace
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  QueueHandle_t queue = new QueueDefinition();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitUntil(lock, queue, ticks, [queue]() { return queue->items.size() < queue->length; })) return pdFALSE;
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitUntil(lock, queue, ticks, [queue]() { return !queue->items.empty(); })) return pdFALSE;
+  if (queue->itemSize > 0) memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  xSemaphoreGive(mutex);
+  return mutex;
+}
+
+void vTaskDelay(TickType_t ticks) { fake_clock::sleepUs((uint64_t)ticks * portTICK_PERIOD_MS * 1000); }
+
+TickType_t xTaskGetTickCount() { return (TickType_t)(fake_clock::nowUs() / 1000 / portTICK_PERIOD_MS); }
@@ -0,0 +1,28 @@
+// Host stand-in for the parts of FreeRTOS the firmware modules use. Ticks are
+// milliseconds, as configured for Arduino-ESP32. Blocking calls wait on real
+// threads when the fake clock runs in real time; in manual time a call that
+// can't complete advances the clock by its timeout and fails, since no other
+// task could have made progress.
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Critical sections: the ESP32's spinlocks, as a mutex per lock
+struct portMUX_TYPE {
+  std::mutex lock;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) { mux->lock.lock(); }
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) { mux->lock.unlock(); }
@@ -0,0 +1,14 @@
+// Raw HTTP/1.1 requests for WebServer::handleRequest()
+#pragma once
+
+#include <string>
+
+inline std::string httpRequest(const std::string& method, const std::string& path, const std::string& body = "",
+                               const std::string& contentType = "application/json") {
+  std::string request = method + " " + path + " HTTP/1.1\r\nHost: vda-ir.local\r\n";
+  if (method != "GET") {
+    request += "Content-Type: " + contentType + "\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  }
+  return request + "\r\n" + body;
+}
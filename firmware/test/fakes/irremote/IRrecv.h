@@ -0,0 +1,41 @@
+// IRrecv stand-in: tracks whether the receiver is running and hands out
+// results a test queues with inject()
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include "IRremoteESP8266.h"
+
+class decode_results {
+ public:
+  decode_type_t decode_type = UNKNOWN;
+  uint64_t value = 0;
+  uint16_t bits = 0;
+  uint16_t rawlen = 0;
+  bool overflow = false;
+  bool repeat = false;
+};
+
+class IRrecv {
+ public:
+  explicit IRrecv(uint16_t recvpin, uint16_t bufsize = 100, uint8_t timeout = 15, bool save_buffer = false)
+      : pin(recvpin) {}
+  void enableIRIn(bool pullup = false) { enabled = true; }
+  void disableIRIn() { enabled = false; }
+  void resume() {}
+  bool decode(decode_results* results, void* save = nullptr, uint8_t max_skip = 0, uint16_t noise_floor = 0) {
+    if (!enabled || pending.empty()) return false;
+    *results = pending.front();
+    pending.pop_front();
+    return true;
+  }
+
+  // Test side
+  void inject(const decode_results& result) { pending.push_back(result); }
+  uint16_t pin;
+  bool enabled = false;
+
+ private:
+  std::deque<decode_results> pending;
+};
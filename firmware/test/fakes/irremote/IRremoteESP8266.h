@@ -0,0 +1,72 @@
+// Stand-in for IRremoteESP8266 when the library isn't available to the host
+// build (see CMakeLists.txt). Only the parts the firmware touches.
+#pragma once
+
+#include <cstdint>
+
+enum decode_type_t {
+  UNKNOWN = -1,
+  UNUSED = 0,
+  RC5,
+  RC6,
+  NEC,
+  SONY,
+  PANASONIC,
+  JVC,
+  SAMSUNG,
+  WHYNTER,
+  AIWA_RC_T501,
+  LG,
+  SANYO,
+  MITSUBISHI,
+  DISH,
+  SHARP,
+  COOLIX,
+  DAIKIN,
+  DENON,
+  KELVINATOR,
+  SHERWOOD,
+  MITSUBISHI_AC,
+  RCMM,
+  SANYO_LC7461,
+  RC5X,
+  GREE,
+  PRONTO,
+  NEC_LIKE,
+  ARGO,
+  TROTEC,
+  NIKAI,
+  RAW,
+  GLOBALCACHE,
+  TOSHIBA_AC,
+  FUJITSU_AC,
+  MIDEA,
+  MAGIQUEST,
+  LASERTAG,
+  CARRIER_AC,
+  HAIER_AC,
+  MITSUBISHI2,
+  HITACHI_AC,
+  HITACHI_AC1,
+  HITACHI_AC2,
+  GICABLE,
+  HAIER_AC_YRW02,
+  WHIRLPOOL_AC,
+  SAMSUNG_AC,
+  LUTRON,
+  ELECTRA_AC,
+  PANASONIC_AC,
+  PIONEER,
+};
+
+const uint16_t kNECBits = 32;
+const uint16_t kSamsungBits = 32;
+const uint16_t kSony20Bits = 20;
+const uint16_t kSonyMinRepeat = 2;
+const uint16_t kRC5XBits = 13;
+const uint16_t kRC6Mode0Bits = 20;
+const uint16_t kLgBits = 28;
+const uint16_t kPanasonicBits = 48;
+const uint16_t kPioneerBits = 64;
+const uint16_t kNoRepeat = 0;
+const uint8_t kDutyDefault = 50;
@@ -0,0 +1,79 @@
+// IRsend stand-in. sendRaw(), sendGeneric() and sendData() produce marks and
+// spaces through the virtual mark()/space() like the library's UNIT_TEST
+// build; the protocol senders only record the call, since their encoders live
+// in the library. Tests that need real protocol waveforms require the library.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IRremoteESP8266.h"
+
+#define VDA_FAKE_IRSEND 1
+
+class IRsend {
+ public:
+  struct Call {
+    std::string method;
+    uint64_t data;
+    uint16_t nbits;
+    uint16_t repeat;
+  };
+
+  explicit IRsend(uint16_t pin, bool inverted = false, bool useModulation = true) : pin(pin) {}
+  virtual ~IRsend() {}
+  void begin() {}
+
+  void enableIROut(uint32_t freq, uint8_t duty = kDutyDefault) { frequency = freq < 1000 ? freq * 1000 : freq; }
+  virtual void _delayMicroseconds(uint32_t usec) {}
+  virtual uint16_t mark(uint16_t usec) { return 1; }
+  virtual void space(uint32_t usec) {}
+
+  void sendRaw(const uint16_t buf[], const uint16_t len, const uint16_t hz);
+  void sendData(uint16_t onemark, uint32_t onespace, uint16_t zeromark, uint32_t zerospace, uint64_t data,
+                uint16_t nbits, bool MSBfirst = true);
+  void sendGeneric(const uint16_t headermark, const uint32_t headerspace, const uint16_t onemark,
+                   const uint32_t onespace, const uint16_t zeromark, const uint32_t zerospace,
+                   const uint16_t footermark, const uint32_t gap, const uint64_t data, const uint16_t nbits,
+                   const uint16_t frequency, const bool MSBfirst, const uint16_t repeat, const uint8_t dutycycle);
+
+  void sendNEC(uint64_t data, uint16_t nbits = kNECBits, uint16_t repeat = kNoRepeat) {
+    record("sendNEC", data, nbits, repeat);
+  }
+  void sendSAMSUNG(const uint64_t data, const uint16_t nbits = kSamsungBits, const uint16_t repeat = kNoRepeat) {
+    record("sendSAMSUNG", data, nbits, repeat);
+  }
+  void sendSony(const uint64_t data, const uint16_t nbits = kSony20Bits, const uint16_t repeat = kSonyMinRepeat) {
+    record("sendSony", data, nbits, repeat);
+  }
+  void sendRC5(const uint64_t data, uint16_t nbits = kRC5XBits, const uint16_t repeat = kNoRepeat) {
+    record("sendRC5", data, nbits, repeat);
+  }
+  void sendRC6(const uint64_t data, const uint16_t nbits = kRC6Mode0Bits, const uint16_t repeat = kNoRepeat) {
+    record("sendRC6", data, nbits, repeat);
+  }
+  void sendLG(uint64_t data, uint16_t nbits = kLgBits, uint16_t repeat = kNoRepeat) {
+    record("sendLG", data, nbits, repeat);
+  }
+  void sendPanasonic(const uint16_t address, const uint32_t data, const uint16_t nbits = kPanasonicBits,
+                     const uint16_t repeat = kNoRepeat) {
+    record("sendPanasonic", ((uint64_t)address << 32) | data, nbits, repeat);
+  }
+  void sendPioneer(const uint64_t data, const uint16_t nbits = kPioneerBits, const uint16_t repeat = kNoRepeat) {
+    record("sendPioneer", data, nbits, repeat);
+  }
+
+  uint32_t encodeNEC(uint16_t address, uint16_t command);
+  uint64_t encodePioneer(uint16_t address, uint16_t command);
+
+  // Test side
+  std::vector<Call> calls;
+  uint32_t frequency = 0;  // Hz, from the last enableIROut()
+  uint16_t pin;
+
+ private:
+  void record(const char* method, uint64_t data, uint16_t nbits, uint16_t repeat) {
+    calls.push_back({method, data, nbits, repeat});
+  }
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "IRremoteESP8266.h"
+#include "WString.h"
+
+uint64_t reverseBits(uint64_t input, uint16_t nbits);
+String typeToString(const decode_type_t protocol, const bool isRepeat = false);
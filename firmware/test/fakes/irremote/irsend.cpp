@@ -0,0 +1,102 @@
+#include "IRsend.h"
+
+#include "IRutils.h"
+
+uint64_t reverseBits(uint64_t input, uint16_t nbits) {
+  if (nbits <= 1) return input;
+  nbits = nbits > 64 ? 64 : nbits;
+  uint64_t output = 0;
+  for (uint16_t i = 0; i < nbits; i++) {
+    output = (output << 1) | (input & 1);
+    input >>= 1;
+  }
+  return (input << nbits) | output;
+}
+
+String typeToString(const decode_type_t protocol, const bool isRepeat) {
+  switch (protocol) {
+    case NEC: return "NEC";
+    case SONY: return "SONY";
+    case RC5: return "RC5";
+    case RC6: return "RC6";
+    case SAMSUNG: return "SAMSUNG";
+    case LG: return "LG";
+    case PANASONIC: return "PANASONIC";
+    case PIONEER: return "PIONEER";
+    default: return "UNKNOWN";
+  }
+}
+
+void IRsend::sendRaw(const uint16_t buf[], const uint16_t len, const uint16_t hz) {
+  enableIROut(hz);
+  for (uint16_t i = 0; i < len; i++) {
+    if (i & 1) {
+      space(buf[i]);
+    } else {
+      mark(buf[i]);
+    }
+  }
+}
+
+void IRsend::sendData(uint16_t onemark, uint32_t onespace, uint16_t zeromark, uint32_t zerospace, uint64_t data,
+                      uint16_t nbits, bool MSBfirst) {
+  if (nbits == 0) return;
+  if (MSBfirst) {
+    if (nbits > 64) {
+      for (; nbits > 64; nbits--) {
+        mark(zeromark);
+        space(zerospace);
+      }
+    }
+    for (uint64_t mask = 1ULL << (nbits - 1); mask; mask >>= 1) {
+      if (data & mask) {
+        mark(onemark);
+        space(onespace);
+      } else {
+        mark(zeromark);
+        space(zerospace);
+      }
+    }
+  } else {
+    for (uint16_t bit = 0; bit < nbits; bit++, data >>= 1) {
+      if (data & 1) {
+        mark(onemark);
+        space(onespace);
+      } else {
+        mark(zeromark);
+        space(zerospace);
+      }
+    }
+  }
+}
+
+void IRsend::sendGeneric(const uint16_t headermark, const uint32_t headerspace, const uint16_t onemark,
+                         const uint32_t onespace, const uint16_t zeromark, const uint32_t zerospace,
+                         const uint16_t footermark, const uint32_t gap, const uint64_t data, const uint16_t nbits,
+                         const uint16_t frequency, const bool MSBfirst, const uint16_t repeat,
+                         const uint8_t dutycycle) {
+  enableIROut(frequency, dutycycle);
+  for (uint16_t r = 0; r <= repeat; r++) {
+    if (headermark) mark(headermark);
+    if (headerspace) space(headerspace);
+    sendData(onemark, onespace, zeromark, zerospace, data, nbits, MSBfirst);
+    if (footermark) mark(footermark);
+    space(gap);
+  }
+}
+
+uint32_t IRsend::encodeNEC(uint16_t address, uint16_t command) {
+  command &= 0xFF;
+  command = reverseBits(command, 8);
+  command = (command << 8) + (command ^ 0xFF);
+  if (address > 0xFF) {
+    address = reverseBits(address, 16);
+    return ((uint32_t)address << 16) + command;
+  }
+  address = reverseBits(address, 8);
+  return ((uint32_t)address << 24) + ((uint32_t)(address ^ 0xFF) << 16) + command;
+}
+
+uint64_t IRsend::encodePioneer(uint16_t address, uint16_t command) {
+  return ((uint64_t)encodeNEC(address >> 8, address & 0xFF) << 32) | encodeNEC(command >> 8, command & 0xFF);
+}
@@ -0,0 +1,18 @@
+// mbedtls' SHA-256 with the _ret calls the ESP32 Arduino core uses, so OTA
+// digests can be checked against hashlib's on the host.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct mbedtls_sha256_context {
+  uint32_t state[8];
+  uint64_t total;       // Bytes hashed
+  uint8_t buffer[64];   // Partial block
+};
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len);
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32]);
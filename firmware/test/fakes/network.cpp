@@ -0,0 +1,5 @@
+#include <ETH.h>
+#include <WiFi.h>
+
+WiFiClass WiFi;
+ETHClass ETH;
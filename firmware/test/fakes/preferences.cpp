@@ -0,0 +1,130 @@
+#include <Preferences.h>
+
+namespace fake_nvs {
+namespace {
+Store nvs;
+uint32_t commitCount = 0;
+std::map<std::string, uint32_t> keyCommits;
+bool failing = false;
+}  // namespace
+
+Store& store() { return nvs; }
+
+void reset() {
+  nvs.clear();
+  commitCount = 0;
+  keyCommits.clear();
+  failing = false;
+}
+
+uint32_t commits() { return commitCount; }
+uint32_t commits(const char* key) { return keyCommits.count(key) ? keyCommits[key] : 0; }
+void failWrites(bool fail) { failing = fail; }
+
+static void commit(const std::string& key) {
+  commitCount++;
+  keyCommits[key]++;
+}
+
+static bool writable() { return !failing; }
+}  // namespace fake_nvs
+
+#define NVS_KEY_MAX 15
+
+static bool validKey(const char* key) { return key != nullptr && key[0] != '\0' && strlen(key) <= NVS_KEY_MAX; }
+
+bool Preferences::begin(const char* name, bool ro, const char* partitionLabel) {
+  if (started || !validKey(name)) return false;
+  // Opening a namespace read-only fails until something was written to it
+  if (ro && fake_nvs::store().count(name) == 0) return false;
+  space = name;
+  readOnly = ro;
+  started = true;
+  if (!ro) fake_nvs::store()[space];
+  return true;
+}
+
+void Preferences::end() { started = false; }
+
+bool Preferences::clear() {
+  if (!started || readOnly || !fake_nvs::writable()) return false;
+  fake_nvs::store()[space].clear();
+  fake_nvs::commit("");
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!started || readOnly || !validKey(key) || !fake_nvs::writable()) return false;
+  if (fake_nvs::store()[space].erase(key) == 0) return false;
+  fake_nvs::commit(key);
+  return true;
+}
+
+bool Preferences::isKey(const char* key) { return getType(key) != PT_INVALID; }
+
+PreferenceType Preferences::getType(const char* key) {
+  if (!started || !validKey(key)) return PT_INVALID;
+  auto ns = fake_nvs::store().find(space);
+  if (ns == fake_nvs::store().end()) return PT_INVALID;
+  auto it = ns->second.find(key);
+  return it == ns->second.end() ? PT_INVALID : it->second.type;
+}
+
+bool Preferences::put(const char* key, PreferenceType type, const void* data, size_t len) {
+  if (!started || readOnly || !validKey(key) || data == nullptr || !fake_nvs::writable()) return false;
+  fake_nvs::Entry& e = fake_nvs::store()[space][key];
+  e.type = type;
+  e.data.assign((const uint8_t*)data, (const uint8_t*)data + len);
+  fake_nvs::commit(key);
+  return true;
+}
+
+bool Preferences::get(const char* key, PreferenceType type, void* out, size_t len) {
+  if (getType(key) != type) return false;
+  const fake_nvs::Entry& e = fake_nvs::store()[space][key];
+  if (e.data.size() != len) return false;
+  memcpy(out, e.data.data(), len);
+  return true;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  if (value == nullptr) return 0;
+  size_t len = strlen(value);
+  return put(key, PT_STR, value, len + 1) ? len : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (len == 0) return 0;
+  return put(key, PT_BLOB, value, len) ? len : 0;
+}
+
+float Preferences::getFloat(const char* key, float defaultValue) {
+  float value;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+String Preferences::getString(const char* key, String defaultValue) {
+  if (getType(key) != PT_STR) return defaultValue;
+  return String((const char*)fake_nvs::store()[space][key].data.data());
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  if (getType(key) != PT_STR || value == nullptr) return 0;
+  const std::vector<uint8_t>& data = fake_nvs::store()[space][key].data;
+  if (data.size() > maxLen) return 0;
+  memcpy(value, data.data(), data.size());
+  return data.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (getType(key) != PT_BLOB) return 0;
+  return fake_nvs::store()[space][key].data.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (getType(key) != PT_BLOB || buf == nullptr) return 0;
+  const std::vector<uint8_t>& data = fake_nvs::store()[space][key].data;
+  if (data.size() > maxLen) return 0;  // NVS refuses rather than truncating
+  memcpy(buf, data.data(), data.size());
+  return data.size();
+}
@@ -0,0 +1,63 @@
+#include <zlib.h>
+
+#include <cstring>
+#include <new>
+
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+
+static_assert(sizeof(z_stream) <= sizeof(tinfl_decompressor::stream), "z_stream doesn't fit");
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  return crc32(crc, buf, len);
+}
+
+namespace {
+voidpf heapAlloc(voidpf opaque, uInt items, uInt size) {
+  tinfl_decompressor* r = (tinfl_decompressor*)opaque;
+  size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+  if (r->heapUsed + bytes > sizeof(r->heap)) return Z_NULL;
+  void* p = r->heap + r->heapUsed;
+  r->heapUsed += bytes;
+  return p;
+}
+
+void heapFree(voidpf opaque, voidpf address) {}
+}  // namespace
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize, uint8_t* outStart,
+                              uint8_t* outNext, size_t* outSize, uint32_t flags) {
+  z_stream* zs = (z_stream*)r->stream;
+  if (!r->started) {
+    zs = new (r->stream) z_stream();
+    zs->zalloc = heapAlloc;
+    zs->zfree = heapFree;
+    zs->opaque = r;
+    r->heapUsed = 0;
+    r->done = false;
+    if (inflateInit2(zs, -MAX_WBITS) != Z_OK) return TINFL_STATUS_BAD_PARAM;
+    r->started = true;
+  }
+  if (r->done) {
+    *inSize = 0;
+    *outSize = 0;
+    return TINFL_STATUS_DONE;
+  }
+
+  zs->next_in = (Bytef*)in;
+  zs->avail_in = (uInt)*inSize;
+  zs->next_out = outNext;
+  zs->avail_out = (uInt)*outSize;
+  int rc = inflate(zs, Z_NO_FLUSH);
+  *inSize -= zs->avail_in;
+  *outSize -= zs->avail_out;
+
+  if (rc == Z_STREAM_END) {
+    r->done = true;
+    return TINFL_STATUS_DONE;
+  }
+  if (rc == Z_OK || rc == Z_BUF_ERROR) {
+    return zs->avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+  }
+  return TINFL_STATUS_FAILED;
+}
@@ -0,0 +1,35 @@
+// The ROM's tinfl inflater on top of zlib: raw deflate into the caller's
+// output ring with tinfl's statuses. zlib's state and window live inside
+// tinfl_decompressor, so malloc() and free() of it are all a caller does,
+// as on the target.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+enum tinfl_status {
+  TINFL_STATUS_BAD_PARAM = -3,
+  TINFL_STATUS_ADLER32_MISMATCH = -2,
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2
+};
+
+struct tinfl_decompressor {
+  bool started;
+  bool done;
+  size_t heapUsed;
+  alignas(16) unsigned char stream[256];  // z_stream
+  alignas(16) unsigned char heap[48 * 1024];
+};
+
+inline void tinfl_init(tinfl_decompressor* r) {
+  r->started = false;
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize, uint8_t* outStart,
+                              uint8_t* outNext, size_t* outSize, uint32_t flags);
@@ -0,0 +1,320 @@
+#include <WebServer.h>
+
+namespace {
+const char* const METHOD_NAMES[] = {"DELETE", "GET", "HEAD", "POST", "PUT", "", "OPTIONS"};
+
+bool parseMethod(const String& name, HTTPMethod& method) {
+  for (int i = 0; i < (int)(sizeof(METHOD_NAMES) / sizeof(METHOD_NAMES[0])); i++) {
+    if (METHOD_NAMES[i][0] != '\0' && name == METHOD_NAMES[i]) {
+      method = (HTTPMethod)i;
+      return true;
+    }
+  }
+  if (name == "PATCH") {
+    method = HTTP_PATCH;
+    return true;
+  }
+  return false;
+}
+
+class FunctionRequestHandler : public RequestHandler {
+ public:
+  FunctionRequestHandler(WebServer::THandlerFunction fn, WebServer::THandlerFunction ufn, const String& uri,
+                         HTTPMethod method)
+      : fn(fn), ufn(ufn), uri(uri), method(method) {}
+
+  bool canHandle(HTTPMethod requestMethod, String requestUri) override {
+    if (method != HTTP_ANY && method != requestMethod) return false;
+    return requestUri == uri;
+  }
+
+  bool canUpload(String requestUri) override { return ufn && canHandle(HTTP_POST, requestUri); }
+
+  bool handle(WebServer& server, HTTPMethod requestMethod, String requestUri) override {
+    if (!canHandle(requestMethod, requestUri)) return false;
+    fn();
+    return true;
+  }
+
+ private:
+  WebServer::THandlerFunction fn;
+  WebServer::THandlerFunction ufn;
+  String uri;
+  HTTPMethod method;
+};
+}  // namespace
+
+WebServer::~WebServer() {
+  for (RequestHandler* h = _firstHandler; h != nullptr;) {
+    RequestHandler* next = h->next();
+    delete h;
+    h = next;
+  }
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, nullptr); }
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn) {
+  addHandler(new FunctionRequestHandler(fn, ufn, uri, method));
+}
+
+void WebServer::addHandler(RequestHandler* handler) {
+  if (_lastHandler == nullptr) {
+    _firstHandler = handler;
+  } else {
+    _lastHandler->next(handler);
+  }
+  _lastHandler = handler;
+}
+
+String WebServer::arg(const String& name) {
+  for (const RequestArgument& a : _currentArgs) {
+    if (a.key == name) return a.value;
+  }
+  return String();
+}
+
+String WebServer::arg(int i) { return i >= 0 && i < args() ? _currentArgs[i].value : String(); }
+String WebServer::argName(int i) { return i >= 0 && i < args() ? _currentArgs[i].key : String(); }
+
+bool WebServer::hasArg(const String& name) {
+  for (const RequestArgument& a : _currentArgs) {
+    if (a.key == name) return true;
+  }
+  return false;
+}
+
+void WebServer::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+  _currentHeaders.clear();
+  _currentHeaders.push_back({"Authorization", String()});
+  for (size_t i = 0; i < headerKeysCount; i++) _currentHeaders.push_back({headerKeys[i], String()});
+}
+
+String WebServer::header(const String& name) {
+  for (const RequestArgument& h : _currentHeaders) {
+    if (h.key.equalsIgnoreCase(name)) return h.value;
+  }
+  return String();
+}
+
+String WebServer::header(int i) { return i >= 0 && i < headers() ? _currentHeaders[i].value : String(); }
+String WebServer::headerName(int i) { return i >= 0 && i < headers() ? _currentHeaders[i].key : String(); }
+
+bool WebServer::hasHeader(const String& name) { return header(name).length() > 0; }
+
+void WebServer::_collectHeader(const char* headerName, const char* headerValue) {
+  for (RequestArgument& h : _currentHeaders) {
+    if (h.key.equalsIgnoreCase(headerName)) h.value = headerValue;
+  }
+}
+
+void WebServer::sendHeader(const String& name, const String& value, bool first) {
+  if (first) {
+    _pendingHeaders.insert(_pendingHeaders.begin(), {name, value});
+  } else {
+    _pendingHeaders.push_back({name, value});
+  }
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  send_P(code, contentType, content.c_str(), content.length());
+}
+
+void WebServer::send_P(int code, PGM_P contentType, PGM_P content) {
+  send_P(code, contentType, content, content ? strlen(content) : 0);
+}
+
+void WebServer::send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength) {
+  _response.code = code;
+  _response.contentType = contentType ? contentType : "text/html";
+  _response.headers = _pendingHeaders;
+  _pendingHeaders.clear();
+  if (_corsEnabled) _response.headers.push_back({"Access-Control-Allow-Origin", "*"});
+  _response.body.assign(content ? content : "", content ? contentLength : 0);
+}
+
+String WebServer::urlDecode(const String& text) {
+  String decoded;
+  const char* s = text.c_str();
+  for (size_t i = 0, len = text.length(); i < len; i++) {
+    if (s[i] == '%' && i + 2 < len) {
+      char hex[3] = {s[i + 1], s[i + 2], 0};
+      decoded += (char)strtol(hex, nullptr, 16);
+      i += 2;
+    } else {
+      decoded += s[i] == '+' ? ' ' : s[i];
+    }
+  }
+  return decoded;
+}
+
+void WebServer::_parseArguments(const String& data) {
+  _currentArgs.clear();
+  if (data.length() == 0) return;
+  int pos = 0;
+  while (pos <= (int)data.length()) {
+    int amp = data.indexOf('&', pos);
+    if (amp < 0) amp = data.length();
+    String pair = data.substring(pos, amp);
+    int eq = pair.indexOf('=');
+    if (pair.length() > 0) {
+      if (eq < 0) {
+        _currentArgs.push_back({urlDecode(pair), String()});
+      } else {
+        _currentArgs.push_back({urlDecode(pair.substring(0, eq)), urlDecode(pair.substring(eq + 1))});
+      }
+    }
+    pos = amp + 1;
+  }
+}
+
+// Parsing.cpp's _parseRequest, minus the socket waits
+bool WebServer::_parseRequest(WiFiClient& client) {
+  String req = client.readStringUntil('\r');
+  client.readStringUntil('\n');
+  for (RequestArgument& h : _currentHeaders) h.value = String();
+
+  int addrStart = req.indexOf(' ');
+  int addrEnd = req.indexOf(' ', addrStart + 1);
+  if (addrStart == -1 || addrEnd == -1) return false;
+
+  String methodStr = req.substring(0, addrStart);
+  String url = req.substring(addrStart + 1, addrEnd);
+  String searchStr = "";
+  int hasSearch = url.indexOf('?');
+  if (hasSearch != -1) {
+    searchStr = url.substring(hasSearch + 1);
+    url = url.substring(0, hasSearch);
+  }
+  _currentUri = url;
+
+  HTTPMethod method;
+  if (!parseMethod(methodStr, method)) return false;
+  _currentMethod = method;
+
+  RequestHandler* handler;
+  for (handler = _firstHandler; handler; handler = handler->next()) {
+    if (handler->canHandle(_currentMethod, _currentUri)) break;
+  }
+  _currentHandler = handler;
+
+  if (method == HTTP_POST || method == HTTP_PUT || method == HTTP_PATCH || method == HTTP_DELETE) {
+    bool isForm = false;
+    bool isEncoded = false;
+    uint32_t contentLength = 0;
+    while (true) {
+      req = client.readStringUntil('\r');
+      client.readStringUntil('\n');
+      if (req == "") break;
+      int headerDiv = req.indexOf(':');
+      if (headerDiv == -1) break;
+      String headerName = req.substring(0, headerDiv);
+      String headerValue = req.substring(headerDiv + 1);
+      headerValue.trim();
+      _collectHeader(headerName.c_str(), headerValue.c_str());
+
+      if (headerName.equalsIgnoreCase("Content-Type")) {
+        if (headerValue.startsWith("text/plain")) {
+          isForm = false;
+        } else if (headerValue.startsWith("application/x-www-form-urlencoded")) {
+          isForm = false;
+          isEncoded = true;
+        } else if (headerValue.startsWith("multipart/")) {
+          isForm = true;
+        }
+      } else if (headerName.equalsIgnoreCase("Content-Length")) {
+        contentLength = headerValue.toInt();
+      } else if (headerName.equalsIgnoreCase("Host")) {
+        _hostHeader = headerValue;
+      }
+    }
+
+    if (!isForm && _currentHandler && _currentHandler->canRaw(_currentUri)) {
+      _currentRaw.reset(new HTTPRaw());
+      _currentRaw->status = RAW_START;
+      _currentRaw->totalSize = 0;
+      _currentRaw->currentSize = 0;
+      _currentHandler->raw(*this, _currentUri, *_currentRaw);
+      _currentRaw->status = RAW_WRITE;
+
+      while (_currentRaw->totalSize < contentLength) {
+        _currentRaw->currentSize = client.readBytes(_currentRaw->buf, HTTP_RAW_BUFLEN);
+        _currentRaw->totalSize += _currentRaw->currentSize;
+        if (_currentRaw->currentSize == 0) {
+          _currentRaw->status = RAW_ABORTED;
+          _currentHandler->raw(*this, _currentUri, *_currentRaw);
+          return false;
+        }
+        _currentHandler->raw(*this, _currentUri, *_currentRaw);
+      }
+      _currentRaw->status = RAW_END;
+      _currentHandler->raw(*this, _currentUri, *_currentRaw);
+    } else if (!isForm) {
+      // readBytesWithTimeout(): the whole body in one malloc
+      char* plainBuf = (char*)malloc(contentLength + 1);
+      if (plainBuf == nullptr) return false;
+      _plainAllocations++;
+      size_t plainLength = client.readBytes(plainBuf, contentLength);
+      plainBuf[plainLength] = '\0';
+      if (plainLength < contentLength) {
+        free(plainBuf);
+        return false;
+      }
+      if (contentLength > 0) {
+        if (isEncoded) {
+          if (searchStr != "") searchStr += '&';
+          searchStr += plainBuf;
+        }
+        _parseArguments(searchStr);
+        if (!isEncoded) _currentArgs.push_back({"plain", String(plainBuf)});
+      } else {
+        _parseArguments(searchStr);
+      }
+      free(plainBuf);
+    } else {
+      _parseArguments(searchStr);
+      std::string drained(contentLength, '\0');
+      if (client.readBytes(&drained[0], contentLength) < contentLength) return false;
+    }
+  } else {
+    while (true) {
+      req = client.readStringUntil('\r');
+      client.readStringUntil('\n');
+      if (req == "") break;
+      int headerDiv = req.indexOf(':');
+      if (headerDiv == -1) break;
+      String headerName = req.substring(0, headerDiv);
+      String headerValue = req.substring(headerDiv + 2);
+      _collectHeader(headerName.c_str(), headerValue.c_str());
+      if (headerName.equalsIgnoreCase("Host")) _hostHeader = headerValue;
+    }
+    _parseArguments(searchStr);
+  }
+  return true;
+}
+
+void WebServer::_handleRequest() {
+  bool handled = false;
+  if (_currentHandler) handled = _currentHandler->handle(*this, _currentMethod, _currentUri);
+  if (!handled && _notFoundHandler) {
+    _notFoundHandler();
+    handled = true;
+  }
+  if (!handled) send(404, "text/html", String("Not found: ") + _currentUri);
+  _currentUri = "";
+}
+
+bool WebServer::handleRequest(const std::string& request) {
+  _response = Response();
+  _pendingHeaders.clear();
+  _currentArgs.clear();
+  _currentRaw.reset();
+  _currentClient.load(request);
+  if (!_parseRequest(_currentClient)) {
+    _currentClient.stop();
+    return false;
+  }
+  _handleRequest();
+  _currentClient.stop();
+  return true;
+}
@@ -0,0 +1,130 @@
+// Driver for route_fuzz.cpp where libFuzzer isn't available (GCC builds).
+// Runs every file named on the command line (or found in a named directory)
+// through LLVMFuzzerTestOneInput, then -runs=N inputs mutated from them with
+// a fixed -seed, so a failure reproduces. Inputs are cut at -max_len like
+// libFuzzer does. With no inputs it reads one from stdin, which lets AFL
+// drive it:
+//
+//   afl-fuzz -i firmware/test/fuzz/corpus -o findings -- build/host/vda_fuzz_replay
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+// Fragments that tend to reach the edges of the JSON checks and the HTTP parser
+const char* const TOKENS[] = {
+  "-1", "0", "65535", "65536", "4294967296", "99999999999999999999", "1e308", "NaN", "null", "true",
+  "\"\"", "[", "]", "{", "}", ",", ":", "\\u0000", "\"raw_data\":[", "\"protocol\":\"raw\"",
+  "\"output\":4", "\"duration_ms\":", "\"frequency\":", "\r\n", "Content-Length: ", "POST /send_ir HTTP/1.1",
+};
+
+void readFile(const std::string& path, std::vector<std::string>& inputs) {
+  std::ifstream in(path, std::ios::binary);
+  inputs.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void readPath(const std::string& path, std::vector<std::string>& inputs) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    fprintf(stderr, "vda_fuzz_replay: no such input: %s\n", path.c_str());
+    exit(2);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    readFile(path, inputs);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  std::vector<std::string> names;
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());  // Same order, same mutations
+  for (const std::string& name : names) readFile(path + "/" + name, inputs);
+}
+
+std::string mutate(const std::vector<std::string>& corpus, std::mt19937& rng, size_t maxLen) {
+  std::string out = corpus[rng() % corpus.size()];
+  int edits = 1 + rng() % 4;
+  for (int e = 0; e < edits; e++) {
+    size_t at = out.empty() ? 0 : rng() % (out.size() + 1);
+    switch (rng() % 6) {
+      case 0:  // Flip a bit
+        if (!out.empty()) out[rng() % out.size()] ^= (char)(1 << (rng() % 8));
+        break;
+      case 1:  // Insert a random byte
+        out.insert(at, 1, (char)(rng() & 0xFF));
+        break;
+      case 2:  // Delete a range
+        if (at < out.size()) out.erase(at, 1 + rng() % 16);
+        break;
+      case 3:  // Insert a token
+        out.insert(at, TOKENS[rng() % (sizeof(TOKENS) / sizeof(TOKENS[0]))]);
+        break;
+      case 4: {  // Repeat a chunk, to grow arrays and strings
+        if (at >= out.size()) break;
+        std::string chunk = out.substr(at, 1 + rng() % 32);
+        for (int n = rng() % 64; n > 0; n--) out.insert(at, chunk);
+        break;
+      }
+      case 5: {  // Splice in the tail of another input
+        const std::string& other = corpus[rng() % corpus.size()];
+        if (!other.empty()) out = out.substr(0, at) + other.substr(rng() % other.size());
+        break;
+      }
+    }
+  }
+  if (out.size() > maxLen) out.resize(maxLen);
+  return out;
+}
+
+void run(const std::string& input, size_t maxLen) {
+  size_t len = input.size() < maxLen ? input.size() : maxLen;
+  LLVMFuzzerTestOneInput((const uint8_t*)input.data(), len);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  unsigned long runs = 0;
+  unsigned long seed = 1;
+  size_t maxLen = 16384;
+  std::vector<std::string> corpus;
+
+  LLVMFuzzerInitialize(&argc, &argv);
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-runs=", 6) == 0) {
+      runs = strtoul(argv[i] + 6, nullptr, 10);
+    } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+      seed = strtoul(argv[i] + 6, nullptr, 10);
+    } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+      maxLen = strtoul(argv[i] + 9, nullptr, 10);
+    } else {
+      readPath(argv[i], corpus);
+    }
+  }
+
+  if (corpus.empty()) {
+    corpus.emplace_back(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+  }
+  for (const std::string& input : corpus) run(input, maxLen);
+
+  std::mt19937 rng(seed);
+  for (unsigned long r = 0; r < runs; r++) run(mutate(corpus, rng, maxLen), maxLen);
+
+  printf("vda_fuzz_replay: %zu inputs, %lu mutations, seed %lu: ok\n", corpus.size(), runs, seed);
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Fuzz target for request bodies. An input is "<path>\n<body>":
+//
+//   send_ir, test_output, adopt, learning/start  POSTed through MetricsWebServer
+//                                                 to handlers that parse and
+//                                                 check the body as the
+//                                                 firmware's do; send_ir runs
+//                                                 the job through the real
+//                                                 IR job slot
+//   raw                                           the body is the whole HTTP
+//                                                 request, headers included
+//   hex, base64, text                             decodePayload() in place
+//   anything else                                 POSTed to the catch-all
+//
+// Besides the sanitizers, every input must finish within FUZZ_REQUEST_MAX_MS,
+// must not raise the live heap by more than FUZZ_HEAP_PEAK_MAX while it runs,
+// and must not leave it more than that above where the first input found it.
+// An accepted IR job must go out within the transmit timeout, and nothing may
+// answer 500.
+//
+// The JSON routes need ArduinoJson (VDA_HAVE_ARDUINOJSON); without it only
+// the body path, the catch-all and the codecs are exercised. The handlers
+// here are stand-ins for main.cpp's: they share its request checks
+// (request_checks.h) and IR job slot (ir_tx_queue.h), not its replies.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "http_request.h"
+#include "metrics_web_server.h"
+#include "payload_codec.h"
+#include "port_table.h"
+#include "request_arena.h"
+
+#ifdef VDA_HAVE_ARDUINOJSON
+#include "ir_tx_queue.h"
+#include "request_checks.h"
+typedef BasicJsonDocument<ArenaAllocator> RequestJsonDocument;  // As main.cpp
+#endif
+
+#define FUZZ_REQUEST_MAX_MS 50
+#define FUZZ_HEAP_PEAK_MAX 65536
+#define FUZZ_IR_TX_MAX_US 5000000  // IR_TX_TIMEOUT_MS
+
+extern "C" {
+void __sanitizer_install_malloc_and_free_hooks(void (*mallocHook)(const volatile void*, size_t),
+                                              void (*freeHook)(const volatile void*));
+size_t __sanitizer_get_allocated_size(const volatile void* ptr);
+}
+
+namespace {
+// Live heap as seen through the sanitizer allocator's hooks
+long long liveBytes = 0;
+long long peakBytes = 0;
+
+void onMalloc(const volatile void* ptr, size_t size) {
+  liveBytes += size;
+  if (liveBytes > peakBytes) peakBytes = liveBytes;
+}
+
+void onFree(const volatile void* ptr) {
+  if (ptr != nullptr) liveBytes -= __sanitizer_get_allocated_size(ptr);
+}
+
+long long firstBaseline = -1;
+size_t inputSize = 0;
+
+[[noreturn]] void fail(const char* what, long long value) {
+  fprintf(stderr, "route_fuzz: %s: %lld, input of %zu bytes\n", what, value, inputSize);
+  abort();
+}
+
+#ifdef VDA_HAVE_ARDUINOJSON
+// Carrier time of a job as the IR task would send it
+class TimingIRsend : public IRsend {
+ public:
+  TimingIRsend() : IRsend(4) {}
+  uint16_t mark(uint16_t usec) override {
+    totalUs += usec;
+    return 1;
+  }
+  void space(uint32_t usec) override { totalUs += usec; }
+  uint64_t totalUs = 0;
+};
+
+SemaphoreHandle_t irMutex = nullptr;
+
+// The transmit task's side of the job slot, timed instead of sent
+bool timedTransmit(IrTxJob& job) {
+  TimingIRsend sender;
+  sendIrJob(sender, job);
+  if (sender.totalUs > FUZZ_IR_TX_MAX_US) fail("IR job outlasts the transmit timeout", sender.totalUs);
+  return true;
+}
+#endif
+
+MetricsWebServer* server = nullptr;
+
+void rejectBody(const char* problem) {
+  std::string body = std::string("{\"error\":\"") + problem + "\"}";
+  server->send(400, "application/json", body.c_str());
+}
+
+void setupServer() {
+  server = new MetricsWebServer(80);
+  const char* headers[] = {"Content-Length"};
+  server->collectHeaders(headers, 1);
+
+  // Board as shipped: every output-capable pin an IR output
+  portCount = 0;
+  addMissingPorts();
+  for (int i = 0; i < portCount; i++) {
+    if (ports[i].caps & PORT_CAP_OUTPUT) setPort(i, ports[i].gpio, PORT_IR_OUTPUT, "");
+  }
+  rebuildGpioIndex();
+
+#ifdef VDA_HAVE_ARDUINOJSON
+  initIrTxQueue();
+  irMutex = xSemaphoreCreateMutex();
+
+  server->on("/send_ir", HTTP_POST, []() {
+    RequestJsonDocument doc(SEND_IR_JSON_SIZE);
+    if (deserializeJson(doc, server->body(), server->bodyLength())) return rejectBody("Invalid JSON");
+    SendIrRequest request;
+    const char* problem = checkSendIrRequest(doc.as<JsonObjectConst>(), request);
+    if (problem) return rejectBody(problem);
+
+    if (!claimIrTx()) fail("IR job slot left claimed", 0);
+    fillIrTxJob(request, irTxJob);
+    irTxRunJob(irTxJob, irMutex, timedTransmit);  // As the transmit task, which frees the slot
+    server->send(200, "application/json", irTxResultJson(200));
+  });
+
+  server->on("/test_output", HTTP_POST, []() {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, server->body(), server->bodyLength())) return rejectBody("Invalid JSON");
+    int portIndex;
+    uint32_t durationMs;
+    const char* problem = checkTestOutputRequest(doc.as<JsonObjectConst>(), portIndex, durationMs);
+    if (problem) return rejectBody(problem);
+    if (durationMs > TEST_OUTPUT_MAX_MS) fail("test burst outlasts TEST_OUTPUT_MAX_MS", durationMs);
+    server->send(200, "application/json", "{\"success\":true}");
+  });
+
+  server->on("/adopt", HTTP_POST, []() {
+    StaticJsonDocument<256> doc;
+    if (deserializeJson(doc, server->body(), server->bodyLength())) return rejectBody("Invalid JSON");
+    const char* id;
+    const char* name;
+    const char* problem = checkAdoptRequest(doc.as<JsonObjectConst>(), id, name);
+    if (problem) return rejectBody(problem);
+    server->send(200, "application/json", "{\"success\":true}");
+  });
+
+  server->on("/learning/start", HTTP_POST, []() {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, server->body(), server->bodyLength())) return rejectBody("Invalid JSON");
+    int gpio;
+    const char* problem = checkLearningRequest(doc.as<JsonObjectConst>(), gpio);
+    if (problem) return rejectBody(problem);
+    server->send(200, "application/json", "{\"success\":true}");
+  });
+#endif
+
+  server->onNotFound([]() { server->send(404, "application/json", "{\"error\":\"Not found\"}"); });
+}
+
+void decodeInPlace(const std::string& format, const std::string& payload) {
+  std::string buffer = payload;  // Decoded over itself, as the serial routes do
+  int n = decodePayload(String(format.c_str()), &buffer[0], buffer.size(), (uint8_t*)&buffer[0]);
+  if (n > (int)payload.size()) fail("decoded past the input", n);
+}
+}  // namespace
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+  __sanitizer_install_malloc_and_free_hooks(onMalloc, onFree);
+  setupServer();
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  inputSize = size;
+  if (firstBaseline < 0) firstBaseline = liveBytes;
+  if (liveBytes - firstBaseline > FUZZ_HEAP_PEAK_MAX) {
+    fail("heap left behind by earlier inputs (bytes)", liveBytes - firstBaseline);
+  }
+
+  std::string input((const char*)data, size);
+  size_t newline = input.find('\n');
+  std::string path = input.substr(0, newline);
+  std::string body = newline == std::string::npos ? "" : input.substr(newline + 1);
+  std::string request;
+  if (path == "raw") {
+    request = body;
+  } else if (path != "hex" && path != "base64" && path != "text") {
+    request = httpRequest("POST", "/" + path, body);
+  }
+
+  long long baseline = liveBytes;
+  peakBytes = liveBytes;
+  auto start = std::chrono::steady_clock::now();
+
+  if (request.empty()) {
+    decodeInPlace(path, body);
+  } else {
+    server->handleRequest(request);
+  }
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+  if (ms > FUZZ_REQUEST_MAX_MS) fail("request took too long (ms)", ms);
+  if (peakBytes - baseline > FUZZ_HEAP_PEAK_MAX) fail("request heap peak (bytes)", peakBytes - baseline);
+  if (!request.empty()) {
+    if (server->lastResponse().code == 500) fail("answered 500", 500);
+    if (requestArena.used != 0) fail("arena not reset", requestArena.used);
+  }
+  return 0;
+}
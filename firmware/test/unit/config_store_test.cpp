@@ -0,0 +1,300 @@
+// Debounced configuration commits, the A/B blob and the legacy migration
+// against the in-memory NVS
+#include "config_store.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+class ConfigStoreTest : public ::testing::Test {
+ protected:
+  Preferences prefs;
+
+  void SetUp() override {
+    fake_nvs::reset();
+    fake_clock::setUs(0);
+    configDirty = false;
+    configDirtySince = 0;
+    configLastChange = 0;
+    configGeneration = 0;
+    configSlot = -1;
+    configStats = {0, 0, 0, 0, 0, 0, 0, 0, "defaults"};
+    boardId = "vda-ir-test";
+    boardName = "Rack 1";
+    adopted = false;
+    portCount = 0;
+    addMissingPorts();
+    rebuildGpioIndex();
+  }
+
+  // What loop() does through serviceConfigSave()
+  void service() {
+    if (configSaveDue()) commitConfig(prefs);
+  }
+
+  // One /ports/configure request followed by a loop() pass
+  void configurePort(int gpio, PortMode mode, const char* name) {
+    int index = portForGpio(gpio);
+    ASSERT_GE(index, 0);
+    ports[index].mode = mode;
+    strlcpy(ports[index].name, name, sizeof(ports[index].name));
+    markConfigDirty();
+    service();
+  }
+};
+
+TEST_F(ConfigStoreTest, NothingPendingNothingWritten) {
+  fake_clock::advanceMs(60000);
+  service();
+  EXPECT_FALSE(commitConfig(prefs));
+  EXPECT_EQ(fake_nvs::commits(), 0u);
+}
+
+TEST_F(ConfigStoreTest, BurstOfChangesIsOneCommit) {
+  for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
+    configurePort(OUTPUT_CAPABLE_PINS[i], PORT_IR_OUTPUT, "tv");
+    fake_clock::advanceMs(100);
+  }
+  EXPECT_EQ(fake_nvs::commits(), 0u);
+
+  fake_clock::advanceMs(CONFIG_SAVE_DEBOUNCE_MS - 101);
+  service();
+  EXPECT_EQ(fake_nvs::commits(), 0u);
+  fake_clock::advanceMs(1);
+  service();
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+  EXPECT_EQ(configStats.nvsWrites, 1u);
+  EXPECT_EQ(configStats.commits, 1u);
+  EXPECT_FALSE(configDirty);
+
+  fake_clock::advanceMs(60000);
+  service();
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+}
+
+TEST_F(ConfigStoreTest, SteadyChangesCommitAtTheMaxDelay) {
+  // A change every second never goes quiet for the debounce period
+  uint32_t elapsed = 0;
+  while (fake_nvs::commits() == 0 && elapsed < 60000) {
+    configurePort(OUTPUT_CAPABLE_PINS[elapsed / 1000 % OUTPUT_CAPABLE_COUNT], PORT_IR_OUTPUT, "");
+    fake_clock::advanceMs(1000);
+    elapsed += 1000;
+  }
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+  EXPECT_EQ(elapsed, (uint32_t)CONFIG_SAVE_MAX_DELAY_MS + 1000);
+}
+
+TEST_F(ConfigStoreTest, CommitsAlternateSlots) {
+  for (int i = 0; i < 4; i++) {
+    configurePort(OUTPUT_CAPABLE_PINS[0], i % 2 ? PORT_IR_OUTPUT : PORT_DISABLED, "");
+    fake_clock::advanceMs(CONFIG_SAVE_DEBOUNCE_MS);
+    service();
+  }
+  EXPECT_EQ(fake_nvs::commits(CONFIG_BLOB_KEYS[0]), 2u);
+  EXPECT_EQ(fake_nvs::commits(CONFIG_BLOB_KEYS[1]), 2u);
+  EXPECT_EQ(fake_nvs::commits(), 4u);
+  EXPECT_EQ(configGeneration, 4u);
+  EXPECT_EQ(configSlot, 1);
+}
+
+TEST_F(ConfigStoreTest, FailedWriteStaysPendingAndRetries) {
+  configurePort(OUTPUT_CAPABLE_PINS[0], PORT_IR_OUTPUT, "tv");
+  fake_nvs::failWrites(true);
+  fake_clock::advanceMs(CONFIG_SAVE_DEBOUNCE_MS);
+  service();
+  EXPECT_TRUE(configDirty);
+  EXPECT_EQ(configStats.nvsWrites, 1u);
+  EXPECT_EQ(configStats.commits, 0u);
+  EXPECT_EQ(configSlot, -1);
+
+  // The retry waits for another debounce period
+  fake_nvs::failWrites(false);
+  fake_clock::advanceMs(CONFIG_SAVE_DEBOUNCE_MS - 1);
+  service();
+  EXPECT_EQ(fake_nvs::commits(), 0u);
+  fake_clock::advanceMs(1);
+  service();
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+  EXPECT_FALSE(configDirty);
+  EXPECT_EQ(configGeneration, 1u);
+}
+
+// ============ Blob layout and migration ============
+class ConfigLoadTest : public ConfigStoreTest {
+ protected:
+  // Commit the current table with the given board name
+  void commitAs(const char* name) {
+    boardName = name;
+    markConfigDirty();
+    ASSERT_TRUE(commitConfig(prefs));
+  }
+
+  // Forget the in-memory state, as after a reboot, and load
+  bool reboot() {
+    boardId = "";
+    boardName = "";
+    portCount = 0;
+    configGeneration = 0;
+    configSlot = -1;
+    prefs.begin(CONFIG_NAMESPACE, true);
+    bool persist = loadStoredConfig(prefs);
+    prefs.end();
+    return persist;
+  }
+
+  std::vector<uint8_t>& slotBytes(int slot) {
+    return fake_nvs::store()[CONFIG_NAMESPACE][CONFIG_BLOB_KEYS[slot]].data;
+  }
+
+  // The per-key layout written by firmware before the blob
+  void writeLegacy(int count) {
+    prefs.begin(CONFIG_NAMESPACE, false);
+    prefs.putString("boardId", "vda-ir-legacy");
+    prefs.putString("boardName", "Old rack");
+    prefs.putBool("adopted", true);
+    prefs.putInt("portCount", count);
+    for (int i = 0; i < count; i++) {
+      String key = "port" + String(i);
+      prefs.putInt((key + "_gpio").c_str(), OUTPUT_CAPABLE_PINS[i]);
+      prefs.putString((key + "_mode").c_str(), i % 2 ? "ir_output" : "disabled");
+      prefs.putString((key + "_name").c_str(), ("tv" + String(i)).c_str());
+    }
+    prefs.end();
+  }
+};
+
+TEST_F(ConfigLoadTest, BlobRoundTrips) {
+  adopted = true;
+  setPort(3, ports[3].gpio, PORT_IR_OUTPUT, "Living room TV");
+  setPort(OUTPUT_CAPABLE_COUNT, INPUT_ONLY_PINS[0], PORT_IR_INPUT, "Learner");
+  int count = portCount;
+  commitAs("Rack 1");
+
+  EXPECT_FALSE(reboot());
+  EXPECT_STREQ(configStats.loadSource, "blob");
+  EXPECT_EQ(boardId, "vda-ir-test");
+  EXPECT_EQ(boardName, "Rack 1");
+  EXPECT_TRUE(adopted);
+  ASSERT_EQ(portCount, count);
+  EXPECT_EQ(ports[3].mode, PORT_IR_OUTPUT);
+  EXPECT_STREQ(ports[3].name, "Living room TV");
+  EXPECT_EQ(ports[3].caps, PORT_CAP_OUTPUT | PORT_CAP_INPUT);
+  EXPECT_EQ(ports[OUTPUT_CAPABLE_COUNT].mode, PORT_IR_INPUT);
+  EXPECT_EQ(ports[OUTPUT_CAPABLE_COUNT].caps, PORT_CAP_INPUT);
+  EXPECT_EQ(configGeneration, 1u);
+  EXPECT_EQ(configSlot, 0);
+}
+
+TEST_F(ConfigLoadTest, NewestCopyWins) {
+  commitAs("first");
+  commitAs("second");
+  commitAs("third");  // Slot A again
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(boardName, "third");
+  EXPECT_EQ(configGeneration, 3u);
+  EXPECT_EQ(configSlot, 0);
+
+  // The next commit goes to the other slot
+  commitAs("fourth");
+  EXPECT_EQ(configSlot, 1);
+  EXPECT_EQ(fake_nvs::commits(CONFIG_BLOB_KEYS[1]), 2u);
+}
+
+TEST_F(ConfigLoadTest, CorruptCopyFallsBackToThePreviousOne) {
+  commitAs("older");
+  commitAs("newer");
+  slotBytes(1)[offsetof(ConfigBlob, boardName)] ^= 0x01;  // Bit flip in slot B
+
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(boardName, "older");
+  EXPECT_EQ(configSlot, 0);
+  EXPECT_EQ(configGeneration, 1u);
+
+  // The bad copy is the one overwritten next
+  commitAs("repaired");
+  EXPECT_EQ(configSlot, 1);
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(boardName, "repaired");
+  EXPECT_EQ(configGeneration, 2u);
+}
+
+TEST_F(ConfigLoadTest, TornWriteFallsBackToThePreviousOne) {
+  commitAs("older");
+  commitAs("newer");
+  slotBytes(1).resize(sizeof(ConfigBlob) / 2);  // Power lost mid-write
+
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(boardName, "older");
+}
+
+TEST_F(ConfigLoadTest, OtherLayoutVersionIsIgnored) {
+  commitAs("current");
+  ConfigBlob blob;
+  buildConfigBlob(blob, 7);
+  blob.version = CONFIG_BLOB_VERSION + 1;
+  blob.crc = crc32((const uint8_t*)&blob, offsetof(ConfigBlob, crc));
+  EXPECT_FALSE(configBlobValid(blob));
+  slotBytes(1).assign((uint8_t*)&blob, (uint8_t*)&blob + sizeof(blob));
+
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(configSlot, 0);
+  EXPECT_EQ(configGeneration, 1u);
+}
+
+TEST_F(ConfigLoadTest, BothCopiesBadLoadsNothing) {
+  commitAs("a");
+  commitAs("b");
+  slotBytes(0)[0] ^= 0xFF;
+  slotBytes(1)[0] ^= 0xFF;
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(configSlot, -1);
+  EXPECT_EQ(portCount, 0);
+}
+
+TEST_F(ConfigLoadTest, LegacyLayoutMigrates) {
+  fake_nvs::reset();
+  writeLegacy(6);
+  EXPECT_TRUE(reboot());
+  EXPECT_STREQ(configStats.loadSource, "legacy");
+  EXPECT_EQ(boardId, "vda-ir-legacy");
+  EXPECT_EQ(boardName, "Old rack");
+  EXPECT_TRUE(adopted);
+  ASSERT_EQ(portCount, 6);
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(ports[i].gpio, OUTPUT_CAPABLE_PINS[i]);
+    EXPECT_EQ(ports[i].mode, i % 2 ? PORT_IR_OUTPUT : PORT_DISABLED);
+    EXPECT_EQ(std::string(ports[i].name), "tv" + std::to_string(i));
+  }
+
+  // loadConfig() then adds the missing pins and commits right away
+  EXPECT_EQ(addMissingPorts(), OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT - 6);
+  markConfigDirty();
+  ASSERT_TRUE(commitConfig(prefs));
+
+  // The blob wins from then on; the old keys stay for a downgrade
+  EXPECT_FALSE(reboot());
+  EXPECT_STREQ(configStats.loadSource, "blob");
+  EXPECT_EQ(portCount, OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT);
+  EXPECT_STREQ(ports[5].name, "tv5");
+  prefs.begin(CONFIG_NAMESPACE, true);
+  EXPECT_TRUE(prefs.isKey("port5_name"));
+  prefs.end();
+}
+
+TEST_F(ConfigLoadTest, LegacyUnknownModeIsDisabled) {
+  fake_nvs::reset();
+  writeLegacy(2);
+  prefs.begin(CONFIG_NAMESPACE, false);
+  prefs.putString("port1_mode", "IR Out");
+  prefs.end();
+  EXPECT_TRUE(reboot());
+  EXPECT_EQ(ports[1].mode, PORT_DISABLED);
+}
+
+TEST_F(ConfigLoadTest, EmptyStoreLoadsNothing) {
+  fake_nvs::reset();
+  EXPECT_FALSE(reboot());
+  EXPECT_EQ(portCount, 0);
+  EXPECT_EQ(configSlot, -1);
+}
@@ -0,0 +1,127 @@
+// 100k mixed requests through MetricsWebServer with handlers shaped like the
+// firmware's: String responses, arena-built responses, blocks left for the
+// reset, arena overflow into the heap, 404s and refused bodies. Neither the
+// arena nor the heap may grow once the server is warm. The handlers stand in
+// for main.cpp's, which need ArduinoJson and the board: this covers the
+// server, the arena and the heap, not the route bodies.
+#include "metrics_web_server.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "http_request.h"
+
+#define ENDURANCE_REQUESTS 100000
+#define ENDURANCE_WARMUP 1000
+
+class EnduranceTest : public ::testing::Test {
+ protected:
+  MetricsWebServer server{80};
+
+  void SetUp() override {
+    memset(routeMetrics, 0, sizeof(routeMetrics));
+    routeMetricsCount = 0;
+    memset(&requestArena, 0, sizeof(requestArena));
+    fake_clock::setUs(0);
+
+    const char* headers[] = {"Content-Length"};
+    server.collectHeaders(headers, 1);
+
+    // handleStatus(): a String response
+    server.on("/status", HTTP_GET, [this]() {
+      String json = "{\"uptime\":" + String(millis() / 1000) + ",\"free_heap\":" + String(123456) + "}";
+      server.send(200, "application/json", json);
+    });
+
+    // handleSendIR(): parse the body, respond from the arena
+    server.on("/send_ir", HTTP_POST, [this]() {
+      const char* output = strstr(server.body(), "\"output\":");
+      char* response = (char*)arenaAlloc(64);
+      int len = snprintf(response, 64, "{\"success\":%s}", output ? "true" : "false");
+      server.send_P(output ? 200 : 400, "application/json", response, len);
+      arenaFree(response);
+    });
+
+    // handleLearningStatus(): several blocks, released by the reset
+    server.on("/learning/status", HTTP_GET, [this]() {
+      for (int i = 0; i < 8; i++) memset(arenaAlloc(200 + i * 100), 0, 200 + i * 100);
+      server.send(200, "application/json", "{\"available\":false}");
+    });
+
+    // handleConfigurePortsBulk() with a map too big for what is left of the
+    // arena: the document falls back to the heap
+    server.on("/ports/configure_bulk", HTTP_POST, [this]() {
+      void* doc = arenaAlloc(REQUEST_ARENA_SIZE);
+      memcpy(doc, server.body(), server.bodyLength());
+      server.send(200, "application/json", "{\"success\":true}");
+      arenaFree(doc);
+    });
+
+    server.onNotFound([this]() { server.send(404, "application/json", "{\"error\":\"Not found\"}"); });
+  }
+
+  const RouteMetrics& route(const char* path) {
+    for (int i = 0; i < routeMetricsCount; i++) {
+      if (strcmp(routeMetrics[i].path, path) == 0) return routeMetrics[i];
+    }
+    static RouteMetrics none = {};
+    return none;
+  }
+
+  uint64_t routeCounts() {
+    uint64_t total = 0;
+    for (int i = 0; i < routeMetricsCount; i++) total += routeMetrics[i].latency.count;
+    return total;
+  }
+};
+
+TEST_F(EnduranceTest, HundredThousandMixedRequestsDontGrow) {
+  std::mt19937 rng(2024);
+  std::vector<std::string> requests = {
+    httpRequest("GET", "/status"),
+    httpRequest("POST", "/send_ir", "{\"output\":4,\"protocol\":\"nec\",\"code\":\"0x20DF10EF\"}"),
+    httpRequest("POST", "/send_ir", std::string(1500, ' ') + "{\"output\":5,\"protocol\":\"raw\"}"),
+    httpRequest("GET", "/learning/status"),
+    httpRequest("POST", "/ports/configure_bulk", "{\"ports\":[" + std::string(3000, ' ') + "]}"),
+    httpRequest("GET", "/nope"),
+    httpRequest("POST", "/nope", std::string(2000, 'x')),
+    httpRequest("POST", "/send_ir", std::string(REQUEST_BODY_MAX + 1, ' ')),  // 413
+  };
+  const int weights[] = {30, 30, 5, 15, 5, 5, 5, 5};
+  std::discrete_distribution<int> pick(std::begin(weights), std::end(weights));
+
+  uint32_t bulk = 0, refused = 0;
+  int64_t warmLive = 0;
+  uint64_t warmAllocs = 0, firstAllocs = 0, lastAllocs = 0;
+  for (int i = 0; i < ENDURANCE_REQUESTS; i++) {
+    int kind = pick(rng);
+    if (kind == 4) bulk++;
+    if (kind == 7) refused++;
+    server.handleRequest(requests[kind]);
+    ASSERT_EQ(requestArena.used, 0u) << "request " << i;
+    fake_clock::advanceUs(250);
+
+    if (i == ENDURANCE_WARMUP - 1) {
+      warmLive = alloc_counter::live();
+      warmAllocs = alloc_counter::allocations();
+    } else if (i == ENDURANCE_WARMUP + 10000 - 1) {
+      firstAllocs = alloc_counter::allocations() - warmAllocs;
+    } else if (i == ENDURANCE_REQUESTS - 10000 - 1) {
+      lastAllocs = alloc_counter::allocations();
+    }
+  }
+  lastAllocs = alloc_counter::allocations() - lastAllocs;
+
+  EXPECT_LE(alloc_counter::live() - warmLive, 0) << "heap grew";
+  EXPECT_LE(lastAllocs, firstAllocs + firstAllocs / 20) << "allocations per request crept up";
+  EXPECT_LE(requestArena.highWater, (size_t)REQUEST_ARENA_SIZE);
+  EXPECT_EQ(requestArena.overflows, bulk);
+  EXPECT_EQ(server.plainAllocations(), 0u);
+  EXPECT_EQ(routeCounts(), (uint64_t)ENDURANCE_REQUESTS);
+  EXPECT_EQ(route("/send_ir").latency.errors, refused);
+  EXPECT_EQ(currentRoute, -1);
+}
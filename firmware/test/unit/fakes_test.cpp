@@ -0,0 +1,192 @@
+// The fakes have to behave like the parts of the core the firmware relies on,
+// or the other tests prove nothing
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WebServer.h>
+#include <gtest/gtest.h>
+#include <mbedtls/sha256.h>
+
+#include "http_request.h"
+
+namespace {
+std::string sha256Hex(const std::string& data, size_t piece) {
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  for (size_t pos = 0; pos < data.size(); pos += piece) {
+    mbedtls_sha256_update_ret(&sha, (const unsigned char*)data.data() + pos, std::min(piece, data.size() - pos));
+  }
+  unsigned char digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  char hex[65];
+  for (int i = 0; i < 32; i++) snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  return hex;
+}
+}  // namespace
+
+TEST(FakeClock, DelayAdvancesManualTime) {
+  fake_clock::setUs(5000);
+  EXPECT_EQ(millis(), 5u);
+  delay(20);
+  EXPECT_EQ(millis(), 25u);
+  delayMicroseconds(1500);
+  EXPECT_EQ(micros(), 26500u);
+}
+
+TEST(FakePreferences, ValuesAreTypedLikeNvs) {
+  fake_nvs::reset();
+  Preferences p;
+  ASSERT_TRUE(p.begin("vda-ir"));
+  EXPECT_EQ(p.putUInt("count", 7), 4u);
+  EXPECT_EQ(p.getUInt("count", 1), 7u);
+  EXPECT_EQ(p.getInt("count", -1), -1);  // Wrong type reads as missing
+  EXPECT_EQ(p.putString("name", "lounge"), 6u);
+  EXPECT_EQ(p.getString("name"), "lounge");
+  EXPECT_EQ(p.putUInt("a_key_longer_than_15", 1), 0u);
+  p.end();
+  EXPECT_EQ(fake_nvs::commits(), 2u);
+}
+
+TEST(FakePreferences, BlobsAreNotTruncated) {
+  fake_nvs::reset();
+  Preferences p;
+  ASSERT_FALSE(p.begin("vda-ir", true));  // Nothing written yet
+  ASSERT_TRUE(p.begin("vda-ir"));
+  uint8_t blob[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  EXPECT_EQ(p.putBytes("blob", blob, sizeof(blob)), sizeof(blob));
+  uint8_t small[4];
+  EXPECT_EQ(p.getBytes("blob", small, sizeof(small)), 0u);
+  EXPECT_EQ(p.getBytesLength("blob"), sizeof(blob));
+
+  fake_nvs::failWrites(true);
+  EXPECT_EQ(p.putBytes("blob", blob, 4), 0u);
+  EXPECT_EQ(p.getBytesLength("blob"), sizeof(blob));
+}
+
+TEST(FakeSerial, DeliversScriptedBytesOnTime) {
+  fake_clock::setUs(0);
+  HardwareSerial uart(1);
+  uart.begin(9600);
+  uart.receiveAt(10, "OK\r\n");
+  EXPECT_EQ(uart.available(), 0);
+  delay(10);
+  EXPECT_EQ(uart.available(), 4);
+
+  uart.replyTo("PWR?\r", "PWR1\r", 5);
+  uart.print("PWR?\r");
+  uint8_t buf[16];
+  EXPECT_EQ(uart.read(buf, sizeof(buf)), 4u);
+  EXPECT_EQ(uart.available(), 0);
+  delay(5);
+  EXPECT_EQ(uart.read(buf, sizeof(buf)), 5u);
+  EXPECT_EQ(std::string((char*)buf, 5), "PWR1\r");
+  EXPECT_EQ(uart.written(), "PWR?\r");
+}
+
+TEST(FakeSerial, RxBufferOverflowDropsBytes) {
+  HardwareSerial uart(1);
+  uart.setRxBufferSize(8);
+  uart.receiveAt(0, "0123456789");
+  EXPECT_EQ(uart.available(), 8);
+  EXPECT_EQ(uart.dropped, 2u);
+}
+
+// Raw-capable handler that keeps what WebServer hands it
+class RecordingRawHandler : public RequestHandler {
+ public:
+  bool canHandle(HTTPMethod method, String uri) override { return uri == "/raw"; }
+  bool canRaw(String uri) override { return true; }
+  bool handle(WebServer& server, HTTPMethod method, String uri) override {
+    server.send(200, "text/plain", "ok");
+    return true;
+  }
+  void raw(WebServer& server, String uri, HTTPRaw& raw) override {
+    statuses.push_back(raw.status);
+    if (raw.status == RAW_WRITE) body.append((const char*)raw.buf, raw.currentSize);
+  }
+
+  std::vector<HTTPRawStatus> statuses;
+  std::string body;
+};
+
+TEST(FakeWebServer, RawHandlersGetTheBodyInChunks) {
+  WebServer server(80);
+  auto* handler = new RecordingRawHandler();
+  server.addHandler(handler);
+
+  std::string body(3000, 'x');
+  EXPECT_TRUE(server.handleRequest(httpRequest("POST", "/raw", body)));
+  EXPECT_EQ(handler->body, body);
+  ASSERT_EQ(handler->statuses.size(), 5u);  // START, 3 x WRITE, END
+  EXPECT_EQ(handler->statuses.front(), RAW_START);
+  EXPECT_EQ(handler->statuses.back(), RAW_END);
+  EXPECT_EQ(server.plainAllocations(), 0u);
+}
+
+TEST(FakeWebServer, TruncatedRawBodyAborts) {
+  WebServer server(80);
+  auto* handler = new RecordingRawHandler();
+  server.addHandler(handler);
+
+  std::string request = httpRequest("POST", "/raw", std::string(100, 'x'));
+  EXPECT_FALSE(server.handleRequest(request.substr(0, request.size() - 10)));
+  EXPECT_EQ(handler->statuses.back(), RAW_ABORTED);
+  EXPECT_EQ(server.lastResponse().code, 0);
+}
+
+TEST(FakeWebServer, PlainBodiesAreCopiedIntoArgs) {
+  WebServer server(80);
+  String seen;
+  server.on("/plain", HTTP_POST, [&]() {
+    seen = server.arg("plain");
+    server.send(200, "text/plain", "ok");
+  });
+
+  EXPECT_TRUE(server.handleRequest(httpRequest("POST", "/plain?x=1", "{\"a\":1}")));
+  EXPECT_EQ(seen, "{\"a\":1}");
+  EXPECT_EQ(server.plainAllocations(), 1u);
+  EXPECT_EQ(server.lastResponse().code, 200);
+}
+
+TEST(FakeWebServer, HeadersAreOnlyKeptWhenCollected) {
+  WebServer server(80);
+  String length, type;
+  server.on("/h", HTTP_POST, [&]() {
+    length = server.header("Content-Length");
+    type = server.header("Content-Type");
+  });
+  const char* keys[] = {"Content-Length"};
+  server.collectHeaders(keys, 1);
+
+  server.handleRequest(httpRequest("POST", "/h", "abc"));
+  EXPECT_EQ(length, "3");
+  EXPECT_EQ(type, "");
+}
+
+TEST(FakeWebServer, QueryArgumentsAndNotFound) {
+  WebServer server(80);
+  String port;
+  server.on("/status", HTTP_GET, [&]() {
+    port = server.arg("port");
+    server.send(200, "text/plain", "ok");
+  });
+
+  server.handleRequest(httpRequest("GET", "/status?port=4&x=a%20b"));
+  EXPECT_EQ(port, "4");
+  server.handleRequest(httpRequest("GET", "/missing"));
+  EXPECT_EQ(server.lastResponse().code, 404);
+  EXPECT_FALSE(server.handleRequest("garbage\r\n\r\n"));
+}
+
+TEST(FakeSha256, MatchesTheFipsVectorsInAnyPieces) {
+  EXPECT_EQ(sha256Hex("", 1), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(sha256Hex("abc", 1), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  const std::string twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  for (size_t piece : {1, 7, 55, 56, 64}) {
+    EXPECT_EQ(sha256Hex(twoBlocks, piece), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1")
+        << piece;
+  }
+  EXPECT_EQ(sha256Hex(std::string(1000000, 'a'), 4093),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
@@ -0,0 +1,96 @@
+// The IR job slot between the senders and the transmit task: one claim at a
+// time, completion handed back, and a timed-out job that can't satisfy the
+// next one.
+#include "ir_tx_queue.h"
+
+#include <freertos/task.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace {
+int transmitted = 0;
+
+bool countTransmit(IrTxJob& job) {
+  transmitted++;
+  return job.kind != IR_TX_TEST;
+}
+
+class IrTxQueueTest : public ::testing::Test {
+ protected:
+  SemaphoreHandle_t irMutex = nullptr;
+
+  void SetUp() override {
+    fake_clock::useRealTime(false);
+    fake_clock::setUs(0);
+    initIrTxQueue();
+    irTxBusy = false;
+    irMutex = xSemaphoreCreateMutex();
+    transmitted = 0;
+  }
+
+  void TearDown() override {
+    fake_clock::useRealTime(false);
+    vQueueDelete(irTxQueue);
+    vSemaphoreDelete(irTxDone);
+    vSemaphoreDelete(irMutex);
+  }
+};
+}  // namespace
+
+TEST_F(IrTxQueueTest, OneClaimAtATime) {
+  EXPECT_TRUE(claimIrTx());
+  EXPECT_FALSE(claimIrTx());
+  EXPECT_TRUE(irTxBusy);
+
+  // The transmit task frees the slot
+  IrTxJob* job = &irTxJob;
+  xQueueSend(irTxQueue, &job, 0);
+  ASSERT_TRUE(irTxNextJob(job, 0));
+  EXPECT_TRUE(irTxRunJob(*job, irMutex, countTransmit));
+  EXPECT_FALSE(irTxBusy);
+  EXPECT_TRUE(claimIrTx());
+}
+
+TEST_F(IrTxQueueTest, TransmitTaskCompletesTheJob) {
+  fake_clock::useRealTime(true);
+  std::thread irTask([&]() {
+    IrTxJob* job;
+    if (irTxNextJob(job, 1000)) irTxRunJob(*job, irMutex, countTransmit);
+  });
+
+  ASSERT_TRUE(claimIrTx());
+  irTxJob.kind = IR_TX_NEC;
+  EXPECT_EQ(runIrTxJob(), 200);
+  irTask.join();
+  EXPECT_EQ(transmitted, 1);
+  EXPECT_FALSE(irTxBusy);
+  EXPECT_EQ(xSemaphoreTake(irMutex, 0), pdTRUE);  // Released after the frame
+  xSemaphoreGive(irMutex);
+}
+
+TEST_F(IrTxQueueTest, TimeoutAndStaleCompletion) {
+  ASSERT_TRUE(claimIrTx());
+  uint64_t before = fake_clock::nowUs();
+  EXPECT_EQ(runIrTxJob(), 504);  // No transmit task
+  EXPECT_EQ(fake_clock::nowUs() - before, IR_TX_TIMEOUT_MS * 1000u);
+
+  // The late job finishes; its completion must not answer the next request
+  IrTxJob* job;
+  ASSERT_TRUE(irTxNextJob(job, 0));
+  irTxRunJob(*job, irMutex, countTransmit);
+  ASSERT_TRUE(claimIrTx());
+  EXPECT_EQ(runIrTxJob(), 504);
+  EXPECT_EQ(transmitted, 1);
+}
+
+TEST_F(IrTxQueueTest, FullQueueIsBusy) {
+  IrTxJob* job = &irTxJob;
+  xQueueSend(irTxQueue, &job, 0);
+  ASSERT_TRUE(claimIrTx());
+  EXPECT_EQ(runIrTxJob(), 503);
+  EXPECT_FALSE(irTxBusy);
+  EXPECT_STREQ(irTxResultJson(503), "{\"error\":\"IR transmitter busy\"}");
+  EXPECT_STREQ(irTxResultJson(504), "{\"error\":\"IR transmit timed out\"}");
+  EXPECT_STREQ(irTxResultJson(200), "{\"success\":true}");
+}
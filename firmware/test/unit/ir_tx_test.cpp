@@ -0,0 +1,279 @@
+// IR transmit encoding: protocol names, the dispatch in sendIrJob() and the
+// mark/space waveform of each job against the goldens in ../golden.
+//
+// Goldens hold one token per mark (+us) or space (-us); spaces of 10 ms or
+// more are inter-frame gaps and are written as "gap", since the library pads
+// them out to the message length. Durations match within max(50 us, 10%).
+// Every case needs a golden. After an intended timing change or for a new
+// case, (re)write them with
+//
+//   VDA_UPDATE_GOLDENS=1 ctest --test-dir build/host -R IrTxGolden
+//
+// The stand-in IRsend only records library protocol calls, so those goldens
+// are checked only when the host build uses IRremoteESP8266 itself.
+#include "ir_tx.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+const uint32_t GAP_MIN_US = 10000;
+
+// Marks are positive, spaces negative. Back-to-back calls of the same kind
+// are one pulse on the wire.
+class RecordingIRsend : public IRsend {
+ public:
+  RecordingIRsend() : IRsend(4) {}
+
+  uint16_t mark(uint16_t usec) override {
+    add((int32_t)usec);
+    return 1;
+  }
+  void space(uint32_t usec) override { add(-(int32_t)usec); }
+
+  std::vector<int32_t> pulses;
+
+ private:
+  void add(int32_t us) {
+    if (us == 0) return;
+    if (!pulses.empty() && (pulses.back() > 0) == (us > 0)) {
+      pulses.back() += us;
+    } else {
+      pulses.push_back(us);
+    }
+  }
+};
+
+std::vector<std::string> tokens(const std::vector<int32_t>& pulses) {
+  std::vector<std::string> out;
+  for (int32_t us : pulses) {
+    if (us < 0 && (uint32_t)-us >= GAP_MIN_US) {
+      out.push_back("gap");
+    } else {
+      out.push_back((us > 0 ? "+" : "") + std::to_string(us));
+    }
+  }
+  return out;
+}
+
+bool tokenMatches(const std::string& want, const std::string& got) {
+  if (want == "gap" || got == "gap") return want == got;
+  if ((want[0] == '-') != (got[0] == '-')) return false;
+  long w = labs(strtol(want.c_str(), nullptr, 10));
+  long g = labs(strtol(got.c_str(), nullptr, 10));
+  long tolerance = w / 10 > 50 ? w / 10 : 50;
+  return labs(g - w) <= tolerance;
+}
+
+struct GoldenCase {
+  const char* name;
+  IrTxKind kind;
+  uint64_t code;
+  uint32_t frequency;
+  bool library;  // Encoded by IRremoteESP8266 rather than sendGeneric()/sendRaw()
+};
+
+const uint16_t RAW_FRAME[] = {9000, 4500, 560, 560, 560, 1690, 560, 1690, 560, 560, 560, 40000, 9000, 2250, 560};
+
+const GoldenCase GOLDEN_CASES[] = {
+  {"nec_56k_20DF10EF", IR_TX_NEC, 0x20DF10EF, 56000, false},
+  {"nec_36k_00FF00FF", IR_TX_NEC, 0x00FF00FF, 36000, false},
+  {"samsung_56k_E0E040BF", IR_TX_SAMSUNG, 0xE0E040BF, 56000, false},
+  {"raw_38k", IR_TX_RAW, 0, 38000, false},
+  {"nec_20DF10EF", IR_TX_NEC, 0x20DF10EF, 38000, true},
+  {"samsung_E0E040BF", IR_TX_SAMSUNG, 0xE0E040BF, 38000, true},
+  {"sony_A90", IR_TX_SONY, 0xA90, 38000, true},
+  {"rc5_1A0C", IR_TX_RC5, 0x1A0C, 38000, true},
+  {"rc6_1000C", IR_TX_RC6, 0x1000C, 38000, true},
+  {"lg_88C0051", IR_TX_LG, 0x88C0051, 38000, true},
+  {"panasonic_0100BCBD", IR_TX_PANASONIC, 0x0100BCBD, 38000, true},
+  {"pioneer_A55A38C7", IR_TX_PIONEER, 0xA55A38C7, 38000, true},
+};
+
+IrTxJob jobFor(const GoldenCase& c) {
+  IrTxJob job = {};
+  job.kind = c.kind;
+  job.gpio = 4;
+  job.code = c.code;
+  job.frequency = c.frequency;
+  if (c.kind == IR_TX_RAW) {
+    job.rawLen = sizeof(RAW_FRAME) / sizeof(RAW_FRAME[0]);
+    memcpy(job.raw, RAW_FRAME, sizeof(RAW_FRAME));
+  }
+  return job;
+}
+
+std::string goldenPath(const char* name) {
+  return std::string(VDA_TEST_DATA) + "/golden/" + name + ".txt";
+}
+
+// Tokens of a golden file, or false if there isn't one
+bool readGolden(const char* name, std::vector<std::string>& out) {
+  std::ifstream in(goldenPath(name));
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream words(line);
+    for (std::string word; words >> word;) out.push_back(word);
+  }
+  return true;
+}
+
+void writeGolden(const GoldenCase& c, const std::vector<std::string>& got) {
+  std::ofstream out(goldenPath(c.name));
+  char code[24];
+  snprintf(code, sizeof(code), "0x%llX", (unsigned long long)c.code);
+  out << "# " << irTxKindName(c.kind) << " " << code << " at " << c.frequency << " Hz\n";
+  for (size_t i = 0; i < got.size(); i++) {
+    out << got[i] << ((i % 8 == 7 || i + 1 == got.size()) ? "\n" : " ");
+  }
+}
+}  // namespace
+
+class IrTxGolden : public ::testing::TestWithParam<GoldenCase> {};
+
+TEST_P(IrTxGolden, MatchesWaveform) {
+  const GoldenCase& c = GetParam();
+#ifdef VDA_FAKE_IRSEND
+  if (c.library) GTEST_SKIP() << "needs IRremoteESP8266 (VDA_LIBDEPS)";
+#endif
+  RecordingIRsend sender;
+  sendIrJob(sender, jobFor(c));
+  std::vector<std::string> got = tokens(sender.pulses);
+  ASSERT_FALSE(got.empty());
+
+  if (getenv("VDA_UPDATE_GOLDENS")) {
+    writeGolden(c, got);
+    return;
+  }
+
+  std::vector<std::string> want;
+  ASSERT_TRUE(readGolden(c.name, want)) << "no golden at " << goldenPath(c.name)
+                                       << "; create it with VDA_UPDATE_GOLDENS=1 and review it";
+  ASSERT_EQ(got.size(), want.size()) << c.name;
+  for (size_t i = 0; i < want.size(); i++) {
+    EXPECT_TRUE(tokenMatches(want[i], got[i])) << c.name << " pulse " << i << ": want " << want[i]
+                                               << ", got " << got[i];
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Protocols, IrTxGolden, ::testing::ValuesIn(GOLDEN_CASES),
+                         [](const ::testing::TestParamInfo<GoldenCase>& info) { return std::string(info.param.name); });
+
+// Checked whichever IRsend the build uses, so a case can't go without one
+TEST(IrTxGoldenCompare, EveryCaseHasAGolden) {
+  for (const GoldenCase& c : GOLDEN_CASES) {
+    std::vector<std::string> want;
+    EXPECT_TRUE(readGolden(c.name, want)) << "no golden at " << goldenPath(c.name);
+    EXPECT_FALSE(want.empty()) << c.name;
+  }
+}
+
+TEST(IrTxGoldenCompare, ToleranceIsTenPercentOrFiftyMicroseconds) {
+  EXPECT_TRUE(tokenMatches("+560", "+600"));
+  EXPECT_FALSE(tokenMatches("+560", "+620"));
+  EXPECT_TRUE(tokenMatches("+9000", "+8960"));
+  EXPECT_TRUE(tokenMatches("-4500", "-4950"));
+  EXPECT_FALSE(tokenMatches("-4500", "-5000"));
+  EXPECT_FALSE(tokenMatches("+560", "-560"));
+  EXPECT_FALSE(tokenMatches("gap", "-9000"));
+  EXPECT_TRUE(tokenMatches("gap", "gap"));
+}
+
+TEST(IrTxProtocol, ParsesNamesAndDefaultsToNec) {
+  EXPECT_EQ(parseIrProtocol("samsung"), IR_TX_SAMSUNG);
+  EXPECT_EQ(parseIrProtocol("sony"), IR_TX_SONY);
+  EXPECT_EQ(parseIrProtocol("rc5"), IR_TX_RC5);
+  EXPECT_EQ(parseIrProtocol("rc6"), IR_TX_RC6);
+  EXPECT_EQ(parseIrProtocol("lg"), IR_TX_LG);
+  EXPECT_EQ(parseIrProtocol("panasonic"), IR_TX_PANASONIC);
+  EXPECT_EQ(parseIrProtocol("pioneer"), IR_TX_PIONEER);
+  EXPECT_EQ(parseIrProtocol("raw"), IR_TX_RAW);
+  EXPECT_EQ(parseIrProtocol("nec"), IR_TX_NEC);
+  EXPECT_EQ(parseIrProtocol("sharp"), IR_TX_NEC);
+  for (int kind = IR_TX_NEC; kind < IR_TX_RAW; kind++) {
+    EXPECT_EQ(parseIrProtocol(irTxKindName((IrTxKind)kind)), kind);
+  }
+}
+
+TEST(IrTxProtocol, CustomCarrierUsesGenericTimingsAtThatFrequency) {
+  RecordingIRsend sender;
+  IrTxJob job = jobFor(GOLDEN_CASES[0]);
+  sendIrJob(sender, job);
+  ASSERT_GE(sender.pulses.size(), 2u + 64u + 1u);
+  EXPECT_EQ(sender.pulses[0], 9000);
+  EXPECT_EQ(sender.pulses[1], -4500);
+  EXPECT_EQ(sender.pulses[2 + 64], 562);  // Footer after 32 bits
+#ifdef VDA_FAKE_IRSEND
+  EXPECT_EQ(sender.frequency, 56000u);
+  EXPECT_TRUE(sender.calls.empty());
+#endif
+}
+
+#ifdef VDA_FAKE_IRSEND
+TEST(IrTxDispatch, StockCarrierUsesLibrarySenders) {
+  struct {
+    IrTxKind kind;
+    const char* method;
+  } cases[] = {
+    {IR_TX_NEC, "sendNEC"}, {IR_TX_SAMSUNG, "sendSAMSUNG"}, {IR_TX_SONY, "sendSony"},
+    {IR_TX_RC5, "sendRC5"}, {IR_TX_RC6, "sendRC6"}, {IR_TX_LG, "sendLG"},
+  };
+  for (const auto& c : cases) {
+    IRsend sender(4);
+    IrTxJob job = {};
+    job.kind = c.kind;
+    job.code = 0x1234;
+    job.frequency = 38000;
+    sendIrJob(sender, job);
+    ASSERT_EQ(sender.calls.size(), 1u) << c.method;
+    EXPECT_EQ(sender.calls[0].method, c.method);
+    EXPECT_EQ(sender.calls[0].data, 0x1234u);
+  }
+}
+
+TEST(IrTxDispatch, PanasonicUsesStandardAddress) {
+  IRsend sender(4);
+  IrTxJob job = {};
+  job.kind = IR_TX_PANASONIC;
+  job.code = 0x0100BCBD;
+  sendIrJob(sender, job);
+  ASSERT_EQ(sender.calls.size(), 1u);
+  EXPECT_EQ(sender.calls[0].method, "sendPanasonic");
+  EXPECT_EQ(sender.calls[0].data, 0x40040100BCBDull);
+}
+
+TEST(IrTxDispatch, PioneerEncodesAddressAndCommand) {
+  IRsend sender(4);
+  IrTxJob job = {};
+  job.kind = IR_TX_PIONEER;
+  job.code = 0xA55A38C7;
+  sendIrJob(sender, job);
+  ASSERT_EQ(sender.calls.size(), 1u);
+  EXPECT_EQ(sender.calls[0].method, "sendPioneer");
+  EXPECT_EQ(sender.calls[0].nbits, 64);
+  EXPECT_EQ(sender.calls[0].data, sender.encodePioneer(0xA55A, 0x38C7));
+
+  // 64-bit codes are already encoded
+  sender.calls.clear();
+  job.code = 0x5AA5F50A1CE3E31Cull;
+  sendIrJob(sender, job);
+  ASSERT_EQ(sender.calls.size(), 1u);
+  EXPECT_EQ(sender.calls[0].data, 0x5AA5F50A1CE3E31Cull);
+}
+#endif
+
+TEST(IrTxProtocol, TestJobsAreLeftToTheCaller) {
+  RecordingIRsend sender;
+  IrTxJob job = {};
+  job.kind = IR_TX_TEST;
+  job.durationMs = 100;
+  sendIrJob(sender, job);
+  EXPECT_TRUE(sender.pulses.empty());
+}
@@ -0,0 +1,80 @@
+// Latency histogram bucketing and percentiles
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <initializer_list>
+
+namespace {
+LatencyHistogram record(std::initializer_list<uint32_t> samples) {
+  LatencyHistogram h = {};
+  for (uint32_t us : samples) recordLatency(h, us, false);
+  return h;
+}
+
+int bucketOf(uint32_t us) {
+  LatencyHistogram h = record({us});
+  for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+    if (h.buckets[i]) return i;
+  }
+  return -1;
+}
+}  // namespace
+
+TEST(LatencyHistogram, BucketUpperBoundsAreInclusive) {
+  EXPECT_EQ(bucketOf(0), 0);
+  EXPECT_EQ(bucketOf(1), 0);
+  EXPECT_EQ(bucketOf(64), 0);
+  EXPECT_EQ(bucketOf(65), 1);
+  EXPECT_EQ(bucketOf(128), 1);
+  EXPECT_EQ(bucketOf(129), 2);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    uint32_t bound = 1u << (LATENCY_MIN_SHIFT + i);
+    EXPECT_EQ(bucketOf(bound), i) << bound;
+    EXPECT_EQ(bucketOf(bound + 1), i + 1) << bound;
+  }
+}
+
+TEST(LatencyHistogram, OverflowGoesToInf) {
+  EXPECT_EQ(bucketOf(1u << (LATENCY_MIN_SHIFT + LATENCY_BUCKETS)), LATENCY_BUCKETS);
+  EXPECT_EQ(bucketOf(UINT32_MAX), LATENCY_BUCKETS);
+}
+
+TEST(LatencyHistogram, CountsSumAndErrors) {
+  LatencyHistogram h = {};
+  recordLatency(h, 100, false);
+  recordLatency(h, 300, true);
+  recordLatency(h, 5000000, true);
+  EXPECT_EQ(h.count, 3u);
+  EXPECT_EQ(h.errors, 2u);
+  EXPECT_EQ(h.sumUs, 5000400u);
+  uint32_t total = 0;
+  for (uint32_t b : h.buckets) total += b;
+  EXPECT_EQ(total, h.count);
+}
+
+TEST(LatencyHistogram, SumDoesNotWrapAt32Bits) {
+  LatencyHistogram h = {};
+  for (int i = 0; i < 4; i++) recordLatency(h, 2000000000u, false);
+  EXPECT_EQ(h.sumUs, 8000000000ull);
+}
+
+TEST(LatencyHistogram, PercentileIsTheBucketBound) {
+  EXPECT_EQ(latencyPercentileUs(LatencyHistogram{}, 50), 0u);
+
+  // 90 fast requests, 9 at ~1ms, one at ~40ms
+  LatencyHistogram h = {};
+  for (int i = 0; i < 90; i++) recordLatency(h, 50, false);
+  for (int i = 0; i < 9; i++) recordLatency(h, 1000, false);
+  recordLatency(h, 40000, false);
+  EXPECT_EQ(latencyPercentileUs(h, 50), 64u);
+  EXPECT_EQ(latencyPercentileUs(h, 90), 64u);
+  EXPECT_EQ(latencyPercentileUs(h, 91), 1024u);
+  EXPECT_EQ(latencyPercentileUs(h, 99), 1024u);
+  EXPECT_EQ(latencyPercentileUs(h, 100), 65536u);
+}
+
+TEST(LatencyHistogram, PercentileInInfReportsTheLastBound) {
+  LatencyHistogram h = record({UINT32_MAX});
+  EXPECT_EQ(latencyPercentileUs(h, 50), 1u << (LATENCY_MIN_SHIFT + LATENCY_BUCKETS));
+}
@@ -0,0 +1,96 @@
+#include "metrics_web_server.h"
+
+#include <gtest/gtest.h>
+
+#include "http_request.h"
+
+class MetricsWebServerTest : public ::testing::Test {
+ protected:
+  MetricsWebServer server{80};
+  std::string received;
+
+  void SetUp() override {
+    memset(routeMetrics, 0, sizeof(routeMetrics));
+    routeMetricsCount = 0;
+    memset(&requestArena, 0, sizeof(requestArena));
+    fake_clock::setUs(0);
+
+    // As setupWebServer() does
+    const char* headers[] = {"Content-Length"};
+    server.collectHeaders(headers, 1);
+    server.on("/status", HTTP_GET, [this]() { server.send(200, "application/json", "{}"); });
+    server.on("/send_ir", HTTP_POST, [this]() {
+      received.assign(server.body(), server.bodyLength());
+      fake_clock::advanceUs(300);
+      server.send(received.empty() ? 400 : 200, "application/json", "{}");
+    });
+    server.onNotFound([this]() { server.send(404, "application/json", "{\"error\":\"Not found\"}"); });
+  }
+
+  const RouteMetrics& route(const char* path) {
+    for (int i = 0; i < routeMetricsCount; i++) {
+      if (strcmp(routeMetrics[i].path, path) == 0) return routeMetrics[i];
+    }
+    static RouteMetrics none = {};
+    return none;
+  }
+};
+
+TEST_F(MetricsWebServerTest, RecordsLatencyAndErrorsPerRoute) {
+  server.handleRequest(httpRequest("GET", "/status"));
+  server.handleRequest(httpRequest("POST", "/send_ir", "{\"output\":4}"));
+  server.handleRequest(httpRequest("POST", "/send_ir", ""));
+
+  EXPECT_EQ(route("/status").latency.count, 1u);
+  EXPECT_EQ(route("/send_ir").latency.count, 2u);
+  EXPECT_EQ(route("/send_ir").latency.errors, 1u);
+  EXPECT_EQ(route("/send_ir").latency.sumUs, 600u);
+  EXPECT_EQ(currentRoute, -1);
+}
+
+TEST_F(MetricsWebServerTest, BodyGoesThroughTheArena) {
+  std::string body = "{\"output\":4,\"code\":\"0x20DF10EF\"}";
+  ASSERT_TRUE(server.handleRequest(httpRequest("POST", "/send_ir", body)));
+  EXPECT_EQ(received, body);
+  EXPECT_EQ(server.plainAllocations(), 0u);
+  EXPECT_EQ(requestArena.used, 0u);  // Reset when the route returned
+  EXPECT_GE(requestArena.highWater, body.size() + 1);
+  EXPECT_EQ(requestArena.overflows, 0u);
+}
+
+TEST_F(MetricsWebServerTest, OversizedBodyIsRefusedFromItsHeaders) {
+  std::string request = httpRequest("POST", "/send_ir", std::string(REQUEST_BODY_MAX + 1, ' '));
+  EXPECT_FALSE(server.handleRequest(request));
+  EXPECT_EQ(server.lastResponse().code, 413);
+  EXPECT_TRUE(received.empty());
+  EXPECT_LT(server.client().consumed(), request.size() - REQUEST_BODY_MAX);  // Body never read
+  EXPECT_EQ(requestArena.used, 0u);
+  EXPECT_EQ(route("/send_ir").latency.errors, 1u);
+}
+
+TEST_F(MetricsWebServerTest, TruncatedBodyReleasesItsArenaBlock) {
+  std::string request = httpRequest("POST", "/send_ir", std::string(2000, ' '));
+  EXPECT_FALSE(server.handleRequest(request.substr(0, request.size() - 500)));
+  EXPECT_EQ(requestArena.used, 0u);
+  EXPECT_EQ(route("/send_ir").latency.count, 0u);  // The route never ran
+}
+
+TEST_F(MetricsWebServerTest, UnknownPostIsDrainedByTheCatchAll) {
+  EXPECT_TRUE(server.handleRequest(httpRequest("POST", "/nope", std::string(3000, 'x'))));
+  EXPECT_EQ(server.lastResponse().code, 404);
+  EXPECT_EQ(server.plainAllocations(), 0u);
+  EXPECT_EQ(route("*").latency.count, 1u);
+
+  server.handleRequest(httpRequest("GET", "/nope"));
+  EXPECT_EQ(route("*").latency.count, 2u);
+}
+
+TEST_F(MetricsWebServerTest, RouteTableStopsAtItsLimit) {
+  for (int i = routeMetricsCount; i < ROUTE_METRICS_MAX + 5; i++) {
+    server.on(String("/r") + String(i), HTTP_GET, [this]() { server.send(200, "text/plain", "ok"); });
+  }
+  EXPECT_EQ(routeMetricsCount, ROUTE_METRICS_MAX);
+  String last = String("/r") + String(ROUTE_METRICS_MAX + 4);
+  EXPECT_TRUE(server.handleRequest(httpRequest("GET", last.c_str())));
+  EXPECT_EQ(server.lastResponse().code, 200);
+}
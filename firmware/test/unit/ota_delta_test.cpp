@@ -0,0 +1,210 @@
+// Delta updates: the delta between each pair of adjacent releases in
+// releases/, made by tools/ota_delta.py at build time, is fed through
+// deltaApply() in odd-sized chunks against the older application image, and
+// the rebuilt image must have the newer one's SHA-256.
+#include "ota_delta.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <mbedtls/sha256.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+const size_t MERGED_APP_OFFSET = 0x10000;  // As tools/ota_delta.py
+const uint8_t IMAGE_MAGIC = 0xE9;
+
+// The running image and the rebuilt one, for the read and write callbacks
+const std::string* running = nullptr;
+std::string rebuilt;
+bool failWrites = false;
+
+bool readRunning(uint32_t pos, uint8_t* out, size_t len) {
+  if (pos + len > running->size()) return false;
+  memcpy(out, running->data() + pos, len);
+  return true;
+}
+
+bool writeRebuilt(uint8_t* data, size_t len) {
+  if (failWrites) return false;
+  rebuilt.append((const char*)data, len);
+  return true;
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Application image from an app or merged flash image, as load_app()
+std::string loadApp(const std::string& path) {
+  std::string data = readFile(path);
+  if (data.size() > MERGED_APP_OFFSET && (uint8_t)data[0x1000] == IMAGE_MAGIC &&
+      (uint8_t)data[MERGED_APP_OFFSET] == IMAGE_MAGIC) {
+    return data.substr(MERGED_APP_OFFSET);
+  }
+  return data;
+}
+
+std::string sha256(const std::string& data) {
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  mbedtls_sha256_update_ret(&sha, (const unsigned char*)data.data(), data.size());
+  std::string digest(32, '\0');
+  mbedtls_sha256_finish_ret(&sha, (unsigned char*)&digest[0]);
+  mbedtls_sha256_free(&sha);
+  return digest;
+}
+
+struct ReleasePair {
+  std::string oldPath;
+  std::string newPath;
+  std::string newName;
+};
+
+// Adjacent versions of each board, as `ota_delta.py releases` pairs them
+std::vector<ReleasePair> releasePairs() {
+  const std::regex pattern("firmware-(.+)-v(\\d+)\\.(\\d+)\\.(\\d+)\\.bin");
+  std::map<std::string, std::map<std::vector<int>, std::string>> boards;
+  if (DIR* dir = opendir(VDA_RELEASES_DIR)) {
+    while (dirent* entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      std::smatch m;
+      if (!std::regex_match(name, m, pattern)) continue;
+      boards[m[1]][{std::stoi(m[2]), std::stoi(m[3]), std::stoi(m[4])}] = name;
+    }
+    closedir(dir);
+  }
+
+  std::vector<ReleasePair> pairs;
+  for (const auto& board : boards) {
+    const std::string* previous = nullptr;
+    for (const auto& version : board.second) {
+      if (previous != nullptr) {
+        const std::string& name = version.second;
+        pairs.push_back({std::string(VDA_RELEASES_DIR) + "/" + *previous, std::string(VDA_RELEASES_DIR) + "/" + name,
+                         name});
+      }
+      previous = &version.second;
+    }
+  }
+  return pairs;
+}
+
+// Feeds delta in chunks cycling through the given sizes and returns the first
+// problem reported, or deltaFinish()'s verdict
+const char* applyAll(OtaDelta& d, const std::string& old, std::string delta, const std::vector<size_t>& chunks) {
+  running = &old;
+  rebuilt.clear();
+  deltaBegin(d, old.size(), readRunning, writeRebuilt);
+  const char* problem = nullptr;
+  size_t pos = 0;
+  for (size_t i = 0; pos < delta.size() && problem == nullptr; i++) {
+    size_t n = std::min(chunks[i % chunks.size()], delta.size() - pos);
+    problem = deltaApply(d, (uint8_t*)&delta[pos], n);
+    pos += n;
+  }
+  return problem ? problem : deltaFinish(d);
+}
+
+std::string header(const std::string& old, uint32_t newSize, uint8_t version = OTA_DELTA_VERSION) {
+  DeltaHeader h = {};
+  memcpy(h.magic, "VDAD", 4);
+  h.version = version;
+  h.oldSize = old.size();
+  memcpy(h.oldSha, sha256(old).data(), 32);
+  h.newSize = newSize;
+  return std::string((const char*)&h, sizeof(h));
+}
+
+std::string record(uint32_t diffLen, uint32_t extraLen, int32_t seek) {
+  DeltaRecord r = {diffLen, extraLen, seek};
+  return std::string((const char*)&r, sizeof(r));
+}
+
+class OtaDeltaTest : public ::testing::Test {
+ protected:
+  void SetUp() override { failWrites = false; }
+
+  // Small images for hand-made deltas
+  std::string old = std::string(1000, 'o');
+  OtaDelta d;
+};
+}  // namespace
+
+TEST_F(OtaDeltaTest, ReleasePairsRebuildInOddChunks) {
+#ifndef VDA_DELTA_DIR
+  GTEST_SKIP() << "no Python to make the release deltas with";
+#else
+  std::vector<ReleasePair> pairs = releasePairs();
+  ASSERT_FALSE(pairs.empty()) << "no adjacent releases in " << VDA_RELEASES_DIR;
+
+  for (const ReleasePair& pair : pairs) {
+    SCOPED_TRACE(pair.newName);
+    std::string delta = readFile(std::string(VDA_DELTA_DIR) + "/" + pair.newName.substr(0, pair.newName.size() - 4) +
+                                 ".delta");
+    ASSERT_GE(delta.size(), sizeof(DeltaHeader)) << "delta missing";
+    ASSERT_TRUE(isDeltaMagic((const uint8_t*)delta.data()));
+    std::string oldApp = loadApp(pair.oldPath);
+    std::string newApp = loadApp(pair.newPath);
+
+    // Odd sizes put header, record and block boundaries everywhere
+    EXPECT_EQ(applyAll(d, oldApp, delta, {1, 7, 4093, 3, 509, 1436, 13}), nullptr);
+    EXPECT_EQ(d.written, newApp.size());
+    EXPECT_TRUE(sha256(rebuilt) == sha256(newApp));
+    EXPECT_TRUE(sha256(rebuilt) == std::string((const char*)d.header.newSha, 32));
+  }
+#endif
+}
+
+TEST_F(OtaDeltaTest, DiffsAddToTheRunningImageAndSeek) {
+  for (size_t i = 0; i < old.size(); i++) old[i] = (char)(i * 13);
+  // 600 changed bytes from 0 (crossing a block), 3 literals, then back to 100
+  std::string delta = header(old, 608) + record(600, 3, -500) + std::string(600, '\x01') + "new" + record(5, 0, 0) +
+                      std::string(5, '\0');
+  std::string expected;
+  for (size_t i = 0; i < 600; i++) expected += (char)(old[i] + 1);
+  expected += "new" + old.substr(100, 5);
+
+  for (std::vector<size_t> chunks : {std::vector<size_t>{1}, {2, 511}, {delta.size()}}) {
+    EXPECT_EQ(applyAll(d, old, delta, chunks), nullptr);
+    EXPECT_TRUE(rebuilt == expected);
+  }
+}
+
+TEST_F(OtaDeltaTest, RejectsADeltaForOtherFirmware) {
+  std::string delta = header(old, 4) + record(0, 4, 0) + "new!";
+  std::string other = old;
+  other[500] ^= 1;
+  EXPECT_STREQ(applyAll(d, other, delta, {64}), "Delta is for a different firmware");
+  EXPECT_STREQ(applyAll(d, old.substr(0, 999), delta, {64}), "Delta is for a different firmware");
+  EXPECT_STREQ(applyAll(d, old, header(old, 4, 2) + record(0, 4, 0) + "new!", {64}), "Unsupported delta version");
+  EXPECT_TRUE(rebuilt.empty());
+}
+
+TEST_F(OtaDeltaTest, LengthsThatWrapAreCorrupt) {
+  // 16 + 0xFFFFFFF8 is 8 in 32 bits, which would pass for an 8-byte image
+  EXPECT_STREQ(applyAll(d, old, header(old, 8) + record(16, 0xFFFFFFF8, 0), {64}), "Corrupt delta");
+  EXPECT_STREQ(applyAll(d, old, header(old, 8) + record(1001, 0, 0), {64}), "Corrupt delta");
+  EXPECT_STREQ(applyAll(d, old, header(old, 8) + record(0, 8, -1) + "12345678", {64}), "Corrupt delta");
+  EXPECT_STREQ(applyAll(d, old, header(old, 8) + record(0, 9, 0) + "123456789", {64}), "Corrupt delta");
+}
+
+TEST_F(OtaDeltaTest, TruncationAndWriteFailuresAreReported) {
+  std::string delta = header(old, 8) + record(4, 4, 0) + std::string(4, '\0') + "tail";
+  for (size_t cut : {(size_t)10, sizeof(DeltaHeader), sizeof(DeltaHeader) + 5, delta.size() - 1}) {
+    EXPECT_STREQ(applyAll(d, old, delta.substr(0, cut), {3}), "Truncated delta") << cut;
+  }
+  EXPECT_EQ(applyAll(d, old, delta, {3}), nullptr);
+  EXPECT_EQ(rebuilt, "ooootail");
+
+  failWrites = true;
+  EXPECT_STREQ(applyAll(d, old, delta, {3}), "Cannot write new firmware");
+}
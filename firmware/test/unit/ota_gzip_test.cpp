@@ -0,0 +1,175 @@
+// Streaming OTA decompression: every image in releases/ is gzipped as
+// `gzip -9` would and fed through gzipInflate() in upload-sized chunks; the
+// output must match the image byte for byte.
+#include "ota_gzip.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+const size_t UPLOAD_CHUNK = 2048;  // OTA_CHUNK_SIZE
+
+std::string output;
+size_t largestRun = 0;
+
+void collect(uint8_t* data, size_t len) {
+  output.append((const char*)data, len);
+  largestRun = std::max(largestRun, len);
+}
+
+struct GzipOptions {
+  const char* name = "firmware.bin";
+  const char* comment = nullptr;
+  std::string extra;
+  bool headerCrc = false;
+};
+
+std::string gzip(const std::string& data, const GzipOptions& options = GzipOptions()) {
+  z_stream zs = {};
+  EXPECT_EQ(deflateInit2(&zs, 9, Z_DEFLATED, MAX_WBITS + 16, 9, Z_DEFAULT_STRATEGY), Z_OK);
+  gz_header header = {};
+  header.name = (Bytef*)options.name;
+  header.comment = (Bytef*)options.comment;
+  if (!options.extra.empty()) {
+    header.extra = (Bytef*)options.extra.data();
+    header.extra_len = options.extra.size();
+  }
+  header.hcrc = options.headerCrc;
+  header.os = 3;
+  deflateSetHeader(&zs, &header);
+
+  std::string out(deflateBound(&zs, data.size()) + 256, '\0');
+  zs.next_in = (Bytef*)data.data();
+  zs.avail_in = data.size();
+  zs.next_out = (Bytef*)&out[0];
+  zs.avail_out = out.size();
+  EXPECT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+std::vector<std::string> releaseImages() {
+  std::vector<std::string> paths;
+  if (DIR* dir = opendir(VDA_RELEASES_DIR)) {
+    while (dirent* entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) {
+        paths.push_back(std::string(VDA_RELEASES_DIR) + "/" + name);
+      }
+    }
+    closedir(dir);
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Feeds gz in chunks of the given sizes (the last one repeated) and returns
+// the first problem reported, or gzipFinish()'s verdict
+const char* inflateAll(const std::string& gz, const std::vector<size_t>& chunks, GzipStream& stream) {
+  output.clear();
+  largestRun = 0;
+  if (!gzipBegin(stream)) return "Out of memory for decompression";
+  const char* problem = nullptr;
+  size_t pos = 0;
+  for (size_t i = 0; pos < gz.size() && problem == nullptr; i++) {
+    size_t n = std::min(chunks[std::min(i, chunks.size() - 1)], gz.size() - pos);
+    problem = gzipInflate(stream, (const uint8_t*)gz.data() + pos, n, collect);
+    pos += n;
+  }
+  if (problem == nullptr) problem = gzipFinish(stream);
+  gzipRelease(stream);
+  return problem;
+}
+}  // namespace
+
+TEST(OtaGzip, ReleaseImagesRoundTripInUploadChunks) {
+  std::vector<std::string> images = releaseImages();
+  ASSERT_FALSE(images.empty()) << "no .bin files in " << VDA_RELEASES_DIR;
+
+  for (const std::string& path : images) {
+    SCOPED_TRACE(path);
+    std::string image = readFile(path);
+    std::string gz = gzip(image);
+    GzipStream stream;
+    EXPECT_EQ(inflateAll(gz, {UPLOAD_CHUNK}, stream), nullptr);
+    EXPECT_EQ(stream.size, image.size());
+    EXPECT_EQ(stream.crc, crc32(0, (const Bytef*)image.data(), image.size()));
+    ASSERT_EQ(output.size(), image.size());
+    EXPECT_TRUE(output == image) << "first difference at byte "
+                                 << (std::mismatch(output.begin(), output.end(), image.begin()).first - output.begin());
+    EXPECT_LE(largestRun, (size_t)TINFL_LZ_DICT_SIZE);
+    EXPECT_LT(gz.size(), image.size());
+  }
+}
+
+TEST(OtaGzip, ChunkBoundariesAnywhere) {
+  std::vector<std::string> images = releaseImages();
+  ASSERT_FALSE(images.empty());
+  std::string image = readFile(images.back());
+  std::string gz = gzip(image);
+
+  // The header has to come in one piece; after it, network-sized and single
+  // byte pieces put the window wrap and the trailer at every kind of boundary
+  for (std::vector<size_t> chunks : {std::vector<size_t>{1436}, {64, 7, 4093, 1, 8}, {64, 1}, {gz.size()}}) {
+    GzipStream stream;
+    EXPECT_EQ(inflateAll(gz, chunks, stream), nullptr) << chunks.size() << " chunk sizes, then " << chunks.back();
+    EXPECT_TRUE(output == image);
+  }
+}
+
+TEST(OtaGzip, OptionalHeaderFieldsAreSkipped) {
+  std::string image(100000, '\0');
+  for (size_t i = 0; i < image.size(); i++) image[i] = (char)(i * 7 / 3);
+  GzipOptions options;
+  options.extra = std::string("AB\x04\x00" "data", 8);
+  options.comment = "built by CI";
+  options.headerCrc = true;
+  std::string gz = gzip(image, options);
+
+  EXPECT_EQ(gzipHeaderSize((const uint8_t*)gz.data(), gz.size()),
+            10 + 2 + 8 + (int)strlen("firmware.bin") + 1 + (int)strlen("built by CI") + 1 + 2);
+  GzipStream stream;
+  EXPECT_EQ(inflateAll(gz, {UPLOAD_CHUNK}, stream), nullptr);
+  EXPECT_TRUE(output == image);
+}
+
+TEST(OtaGzip, RejectsBrokenStreams) {
+  std::string image = readFile(releaseImages().front());
+  std::string gz = gzip(image);
+  GzipStream stream;
+
+  EXPECT_STREQ(inflateAll(image, {UPLOAD_CHUNK}, stream), "Invalid gzip header");
+  EXPECT_STREQ(inflateAll(gz.substr(0, 8), {UPLOAD_CHUNK}, stream), "Invalid gzip header");
+  EXPECT_STREQ(inflateAll(gz.substr(0, gz.size() - 3), {UPLOAD_CHUNK}, stream), "Truncated gzip data");
+  EXPECT_STREQ(inflateAll(gz.substr(0, gz.size() / 2), {UPLOAD_CHUNK}, stream), "Truncated gzip data");
+
+  std::string badCrc = gz;
+  badCrc[gz.size() - 8] ^= 0x01;
+  EXPECT_STREQ(inflateAll(badCrc, {UPLOAD_CHUNK}, stream), "gzip CRC mismatch");
+
+  std::string badSize = gz;
+  badSize[gz.size() - 1] ^= 0x01;
+  EXPECT_STREQ(inflateAll(badSize, {UPLOAD_CHUNK}, stream), "gzip CRC mismatch");
+
+  // A flipped bit in the deflate data either breaks the stream or the CRC
+  std::string corrupt = gz;
+  corrupt[gz.size() / 3] ^= 0x10;
+  const char* problem = inflateAll(corrupt, {UPLOAD_CHUNK}, stream);
+  ASSERT_NE(problem, nullptr);
+  EXPECT_TRUE(strcmp(problem, "Corrupt gzip data") == 0 || strcmp(problem, "gzip CRC mismatch") == 0 ||
+              strcmp(problem, "Truncated gzip data") == 0)
+      << problem;
+}
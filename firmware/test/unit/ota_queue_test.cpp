@@ -0,0 +1,290 @@
+// OTA chunk queue and write limit, and /send_ir latency while an upload runs.
+//
+// The latency harness runs the firmware's task loops on threads with the
+// clock in real time: the IR transmit task's irTxNextJob()/irTxRunJob(), the
+// OTA writer's otaWriteNext() with flash writes that take as long as on the
+// ESP32, a receiver pushing an image through otaQueuePut() as fast as the
+// queue takes it, and a /send_ir handler that claims and runs the job slot as
+// handleSendIR() does once the body is parsed. /send_ir must stay within the
+// budget tools/ota_latency.py applies on hardware, and the image must reach
+// the writer intact.
+#include "ota_queue.h"
+
+#include <freertos/task.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_request.h"
+#include "ir_tx_queue.h"
+#include "metrics_web_server.h"
+
+#define SEND_IR_BUDGET_MS 250  // p95, as tools/ota_latency.py --budget-ms
+#define FLASH_WRITE_US 6000    // 2 KB page programs
+#define FLASH_ERASE_US 45000   // 4 KB sector erase, every other chunk
+#define SEND_IR_INTERVAL_MS 250  // tools/ota_latency.py --interval
+#define SCHEDULING_SLACK_MS 50   // Host threads waking late, on top of simulated time
+
+namespace {
+class OtaQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    fake_clock::useRealTime(false);
+    fake_clock::setUs(0);
+    initOtaQueue();
+  }
+
+  void TearDown() override {
+    fake_clock::useRealTime(false);
+    vQueueDelete(otaFreeChunks);
+    vQueueDelete(otaFilledChunks);
+    vSemaphoreDelete(otaWriteDone);
+  }
+};
+
+// Carrier time passes as it would on the pin
+class PacedIRsend : public IRsend {
+ public:
+  PacedIRsend() : IRsend(4) {}
+  uint16_t mark(uint16_t usec) override {
+    delayMicroseconds(usec);
+    return 1;
+  }
+  void space(uint32_t usec) override { delayMicroseconds(usec); }
+};
+
+// Stand-ins for the firmware's transmit and flash write, with the IR mutex
+// and the written image where the tests can see them
+SemaphoreHandle_t irMutex = nullptr;
+std::string written;
+uint32_t irWaitUs = 0;
+int flashWrites = 0;
+std::atomic<unsigned long> jobQueuedUs{0};
+uint32_t maxMutexWaitUs = 0;  // Transmits held back by flash operations
+
+bool pacedTransmit(IrTxJob& job) {
+  maxMutexWaitUs = std::max(maxMutexWaitUs, (uint32_t)(micros() - jobQueuedUs));
+  PacedIRsend sender;
+  sendIrJob(sender, job);
+  return true;
+}
+
+// otaWriteChunk(): Update.write() as long as the flash takes, under the IR mutex
+uint32_t flashChunk(uint8_t* data, size_t len) {
+  irWaitUs += otaTakeIrMutex(irMutex, irTxBusy);
+  delayMicroseconds(FLASH_WRITE_US + (flashWrites++ % 2 ? 0 : FLASH_ERASE_US));
+  xSemaphoreGive(irMutex);
+  written.append((const char*)data, len);
+  return len;
+}
+
+void endImage() {}
+
+uint32_t percentile(std::vector<uint32_t> values, int p) {
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * p / 100];
+}
+}  // namespace
+
+TEST_F(OtaQueueTest, ChunksRoundTripInOrder) {
+  std::string image(OTA_CHUNK_SIZE * 2 + 100, '\0');
+  for (size_t i = 0; i < image.size(); i++) image[i] = (char)(i * 31 + 7);
+  const char* error = nullptr;
+
+  EXPECT_EQ(otaQueuePut((const uint8_t*)image.data(), image.size(), error), 0u);
+  EXPECT_EQ(uxQueueMessagesWaiting(otaFreeChunks), (UBaseType_t)OTA_QUEUE_CHUNKS - 3);
+
+  std::string written;
+  OtaChunk* chunk;
+  while (uxQueueMessagesWaiting(otaFilledChunks) > 0 && otaNextChunk(chunk)) {
+    written.append((const char*)chunk->data, chunk->len);
+    otaReturnChunk(chunk);
+  }
+  EXPECT_TRUE(written == image);
+  EXPECT_EQ(uxQueueMessagesWaiting(otaFreeChunks), (UBaseType_t)OTA_QUEUE_CHUNKS);
+}
+
+TEST_F(OtaQueueTest, NothingIsQueuedAfterAFailure) {
+  uint8_t data[100] = {};
+  const char* error = "Invalid gzip header";
+  otaQueuePut(data, sizeof(data), error);
+  EXPECT_EQ(uxQueueMessagesWaiting(otaFilledChunks), 0u);
+}
+
+TEST_F(OtaQueueTest, ThrottleHoldsTheWriterToTheLimit) {
+  OtaThrottle throttle = {};
+  for (int i = 0; i < 32; i++) otaThrottle(throttle, 64, OTA_CHUNK_SIZE);  // 65536 bytes at 64 bytes/ms
+  EXPECT_NEAR(fake_clock::nowUs(), 1024000, 1000);
+  EXPECT_NEAR(throttle.waitedUs, 1024000, 1000);
+
+  // No limit, no wait
+  uint64_t before = fake_clock::nowUs();
+  otaThrottle(throttle, 0, OTA_CHUNK_SIZE);
+  EXPECT_EQ(fake_clock::nowUs(), before);
+}
+
+TEST_F(OtaQueueTest, ThrottleDoesNotBankIdleTime) {
+  OtaThrottle throttle = {};
+  otaThrottle(throttle, 64, OTA_CHUNK_SIZE);
+  fake_clock::advanceMs(10000);  // A stalled upload
+
+  uint64_t before = fake_clock::nowUs();
+  otaThrottle(throttle, 64, OTA_CHUNK_SIZE);
+  EXPECT_NEAR(fake_clock::nowUs() - before, OTA_CHUNK_SIZE * 1000 / 64, 1000);
+}
+
+TEST_F(OtaQueueTest, WriterWritesThrottlesAndFinishes) {
+  irMutex = xSemaphoreCreateMutex();
+  written.clear();
+  std::string image(OTA_CHUNK_SIZE + 10, 'x');
+  const char* error = nullptr;
+  otaQueuePut((const uint8_t*)image.data(), image.size(), error);
+  OtaChunk* end = nullptr;
+  xQueueSend(otaFilledChunks, &end, 0);
+
+  OtaThrottle throttle = {};
+  uint64_t before = fake_clock::nowUs();
+  EXPECT_TRUE(otaWriteNext(flashChunk, endImage, throttle, 64));
+  EXPECT_TRUE(otaWriteNext(flashChunk, endImage, throttle, 64));
+  EXPECT_EQ(uxQueueMessagesWaiting(otaFreeChunks), (UBaseType_t)OTA_QUEUE_CHUNKS);
+  EXPECT_GE(fake_clock::nowUs() - before, image.size() * 1000 / 64);  // Paced by the limit
+  EXPECT_TRUE(written == image);
+
+  EXPECT_EQ(xSemaphoreTake(otaWriteDone, 0), pdFALSE);
+  EXPECT_TRUE(otaWriteNext(flashChunk, endImage, throttle, 64));
+  EXPECT_EQ(xSemaphoreTake(otaWriteDone, 0), pdTRUE);
+
+  // Nothing queued: the writer gives up after OTA_QUEUE_WAIT_MS to feed the watchdog
+  before = fake_clock::nowUs();
+  EXPECT_FALSE(otaWriteNext(flashChunk, endImage, throttle, 64));
+  EXPECT_EQ(fake_clock::nowUs() - before, OTA_QUEUE_WAIT_MS * 1000u);
+  vSemaphoreDelete(irMutex);
+}
+
+TEST_F(OtaQueueTest, FlashWaitsForATransmitInFlight) {
+  SemaphoreHandle_t irMutex = xSemaphoreCreateMutex();
+  volatile bool irTxBusy = true;
+  std::atomic<unsigned long> clearedUs{0};
+  fake_clock::useRealTime(true);
+
+  // Ordered by events rather than by how long each thread happens to sleep:
+  // the flash side must not get the mutex before the transmit has ended
+  std::thread transmit([&]() {
+    delay(30);
+    clearedUs = micros();
+    irTxBusy = false;
+  });
+  otaTakeIrMutex(irMutex, irTxBusy);
+  unsigned long tookUs = micros();
+  transmit.join();
+  EXPECT_NE(clearedUs.load(), 0u);
+  EXPECT_GE(tookUs, clearedUs.load());
+  EXPECT_EQ(xSemaphoreTake(irMutex, 0), pdFALSE);  // Held for the flash operation
+  xSemaphoreGive(irMutex);
+  vSemaphoreDelete(irMutex);
+}
+
+TEST_F(OtaQueueTest, SendIrStaysWithinBudgetDuringUpload) {
+  const uint32_t writeLimitKbps = 16;  // OTA_WRITE_LIMIT_MIN_KBPS
+  std::string image(32 * 1024, '\0');
+  std::mt19937 rng(1);
+  for (char& c : image) c = (char)rng();
+
+  irMutex = xSemaphoreCreateMutex();
+  initIrTxQueue();
+  irTxBusy = false;
+  written.clear();
+  irWaitUs = 0;
+  flashWrites = 0;
+  maxMutexWaitUs = 0;
+  std::atomic<bool> stop{false};
+
+  // The bounds come from simulated time: the frame as the manual clock counts
+  // it, and the longest flash operation a transmit can queue behind. Host
+  // scheduling only adds SCHEDULING_SLACK_MS on top.
+  IrTxJob frame = {};
+  frame.kind = IR_TX_NEC;
+  frame.code = 0x20DF10EF;
+  frame.frequency = 56000;  // The sendGeneric() path, which paces every pulse
+  uint64_t frameStart = fake_clock::nowUs();
+  pacedTransmit(frame);
+  const uint32_t frameMs = (fake_clock::nowUs() - frameStart + 999) / 1000;
+  const uint32_t flashOpMs = (FLASH_WRITE_US + FLASH_ERASE_US + 999) / 1000;
+  const uint32_t latencyBoundMs = frameMs + flashOpMs + SCHEDULING_SLACK_MS;
+  ASSERT_LE(latencyBoundMs, (uint32_t)SEND_IR_BUDGET_MS) << "the simulated costs alone break the budget";
+  maxMutexWaitUs = 0;
+  fake_clock::useRealTime(true);
+
+  // irTransmitTask()
+  std::thread irTask([&]() {
+    while (!stop) {
+      IrTxJob* job;
+      if (!irTxNextJob(job, 50)) continue;
+      jobQueuedUs = micros();
+      irTxRunJob(*job, irMutex, pacedTransmit);
+    }
+  });
+
+  // otaWriteTask()
+  OtaThrottle throttle = {};
+  std::thread writer([&]() {
+    while (!stop) otaWriteNext(flashChunk, endImage, throttle, writeLimitKbps);
+  });
+
+  // The upload server: TCP segments as fast as the queue takes them
+  std::atomic<bool> uploading{true};
+  std::thread receiver([&]() {
+    const char* error = nullptr;
+    for (size_t pos = 0; pos < image.size(); pos += 1436) {
+      otaQueuePut((const uint8_t*)image.data() + pos, std::min((size_t)1436, image.size() - pos), error);
+    }
+    otaQueueEnd();
+    uploading = false;
+  });
+
+  // handleSendIR() on port 80 after parsing: claim, fill, run
+  MetricsWebServer server(80);
+  server.on("/send_ir", HTTP_POST, [&]() {
+    int status = 503;
+    if (claimIrTx()) {
+      irTxJob = frame;
+      status = runIrTxJob();
+    }
+    server.send(status, "application/json", irTxResultJson(status));
+  });
+
+  std::vector<uint32_t> latencyMs;
+  while (uploading) {
+    unsigned long start = millis();
+    server.handleRequest(httpRequest("POST", "/send_ir", "{\"output\":1,\"code\":\"20DF10EF\"}"));
+    EXPECT_EQ(server.lastResponse().code, 200);
+    unsigned long elapsed = millis() - start;
+    if (uploading) latencyMs.push_back(elapsed);
+    delay(SEND_IR_INTERVAL_MS - min(elapsed, (unsigned long)SEND_IR_INTERVAL_MS));
+  }
+  unsigned long uploadMs = millis();
+
+  stop = true;
+  receiver.join();
+  writer.join();
+  irTask.join();
+
+  ASSERT_GE(latencyMs.size(), 8u) << "too few requests overlapped the upload";
+  EXPECT_LE(percentile(latencyMs, 95), latencyBoundMs)
+      << "p50 " << percentile(latencyMs, 50) << " ms, max " << percentile(latencyMs, 100) << " ms over "
+      << latencyMs.size() << " requests; frame " << frameMs << " ms, flash operation " << flashOpMs << " ms";
+  // A transmit waits for at most the flash operation in progress
+  EXPECT_LE(maxMutexWaitUs, (flashOpMs + SCHEDULING_SLACK_MS) * 1000);
+  EXPECT_GE(uploadMs, image.size() / writeLimitKbps) << "write limit not applied";
+  EXPECT_GT(irWaitUs, 0u);
+  EXPECT_TRUE(written == image);
+
+  vSemaphoreDelete(irMutex);
+  vQueueDelete(irTxQueue);
+  vSemaphoreDelete(irTxDone);
+}
@@ -0,0 +1,124 @@
+#include "payload_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "alloc_counter.h"
+
+struct CodecVector {
+  const char* plain;
+  const char* base64;
+  const char* hex;
+};
+
+// RFC 4648 section 10
+static const CodecVector VECTORS[] = {
+  {"", "", ""},
+  {"f", "Zg==", "66"},
+  {"fo", "Zm8=", "666F"},
+  {"foo", "Zm9v", "666F6F"},
+  {"foob", "Zm9vYg==", "666F6F62"},
+  {"fooba", "Zm9vYmE=", "666F6F6261"},
+  {"foobar", "Zm9vYmFy", "666F6F626172"},
+};
+
+static int decode(int (*decoder)(const char*, size_t, uint8_t*), const std::string& text, std::string* out = nullptr) {
+  std::string buf(text.size() + 1, '\0');
+  int n = decoder(text.data(), text.size(), (uint8_t*)&buf[0]);
+  if (out && n >= 0) *out = buf.substr(0, n);
+  return n;
+}
+
+TEST(PayloadCodec, Rfc4648Vectors) {
+  char text[32];
+  for (const CodecVector& v : VECTORS) {
+    size_t len = strlen(v.plain);
+    EXPECT_EQ(encodeHex((const uint8_t*)v.plain, len, text), strlen(v.hex));
+    EXPECT_STREQ(text, v.hex);
+    EXPECT_EQ(encodeBase64((const uint8_t*)v.plain, len, text), strlen(v.base64));
+    EXPECT_STREQ(text, v.base64);
+
+    std::string decoded;
+    EXPECT_EQ(decode(decodeHex, v.hex, &decoded), (int)len);
+    EXPECT_EQ(decoded, v.plain);
+    EXPECT_EQ(decode(decodeBase64, v.base64, &decoded), (int)len);
+    EXPECT_EQ(decoded, v.plain);
+  }
+}
+
+TEST(PayloadCodec, HexAcceptsEitherCase) {
+  std::string decoded;
+  EXPECT_EQ(decode(decodeHex, "0aFf", &decoded), 2);
+  EXPECT_EQ(decoded, "\x0a\xff");
+}
+
+TEST(PayloadCodec, Base64PaddingIsOptional) {
+  std::string decoded;
+  EXPECT_EQ(decode(decodeBase64, "Zg", &decoded), 1);
+  EXPECT_EQ(decoded, "f");
+  EXPECT_EQ(decode(decodeBase64, "Zm9vYmE", &decoded), 5);
+  EXPECT_EQ(decoded, "fooba");
+}
+
+TEST(PayloadCodec, RejectsMalformedHex) {
+  for (const char* text : {"6", "GG", "6 6", "0x66", "66\n"}) {
+    EXPECT_EQ(decode(decodeHex, text), -1) << text;
+  }
+}
+
+// Only the canonical encoding of each byte string is accepted
+TEST(PayloadCodec, RejectsNonCanonicalBase64) {
+  for (const char* text : {"Zm9v!", "Zm 9v", "Zm9v\n", "Zg=x", "Zg=", "Zm9vY", "Zh==", "Zm9=", "====", "Zg===",
+                           "Z===", "Zm8==", "Zm9v=", "=Zm9"}) {
+    EXPECT_EQ(decode(decodeBase64, text), -1) << text;
+  }
+}
+
+TEST(PayloadCodec, DecodesInPlace) {
+  char hex[] = "48656C6C6F";
+  ASSERT_EQ(decodeHex(hex, strlen(hex), (uint8_t*)hex), 5);
+  EXPECT_EQ(memcmp(hex, "Hello", 5), 0);
+
+  char b64[] = "SGVsbG8sIHdvcmxk";
+  ASSERT_EQ(decodeBase64(b64, strlen(b64), (uint8_t*)b64), 12);
+  EXPECT_EQ(memcmp(b64, "Hello, world", 12), 0);
+
+  char text[] = "PWR?";
+  EXPECT_EQ(decodePayload("text", text, 4, (uint8_t*)text), 4);
+  EXPECT_EQ(memcmp(text, "PWR?", 4), 0);
+}
+
+TEST(PayloadCodec, RandomRoundTrips) {
+  std::mt19937 rng(1234);
+  std::vector<uint8_t> plain(1024), decoded(1024);
+  std::vector<char> text(2 * 1024 + 1);
+  for (int i = 0; i < 500; i++) {
+    size_t len = rng() % plain.size() + 1;
+    for (size_t j = 0; j < len; j++) plain[j] = rng();
+
+    size_t n = encodeHex(plain.data(), len, text.data());
+    ASSERT_EQ(decodeHex(text.data(), n, decoded.data()), (int)len);
+    ASSERT_EQ(memcmp(plain.data(), decoded.data(), len), 0);
+
+    n = encodeBase64(plain.data(), len, text.data());
+    ASSERT_EQ(n, 4 * ((len + 2) / 3));
+    ASSERT_EQ(decodeBase64(text.data(), n, decoded.data()), (int)len);
+    ASSERT_EQ(memcmp(plain.data(), decoded.data(), len), 0);
+  }
+}
+
+// /serial/send decodes into the request body and encodes into a static
+// buffer; the codecs themselves never touch the heap
+TEST(PayloadCodec, NoHeapAllocations) {
+  std::vector<uint8_t> plain(1024, 0xA5), decoded(1024);
+  std::vector<char> text(2 * 1024 + 1);
+  String hex = "hex", base64 = "base64";
+
+  alloc_counter::Scope heap;
+  size_t n = encodeBase64(plain.data(), plain.size(), text.data());
+  decodePayload(base64, text.data(), n, decoded.data());
+  n = encodeHex(plain.data(), plain.size(), text.data());
+  decodePayload(hex, text.data(), n, decoded.data());
+  EXPECT_EQ(heap.allocations(), 0u);
+}
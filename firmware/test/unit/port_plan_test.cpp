@@ -0,0 +1,159 @@
+// Bulk port configuration against a recording IR driver
+#include "port_plan.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+
+// IR driver seams: record what applyPortPlan() asks for
+int activeReceiverPort = -1;
+static bool senderActive[MAX_PORTS];
+static std::vector<std::string> driverCalls;
+
+void initIRSender(int portIndex) {
+  senderActive[portIndex] = true;
+  driverCalls.push_back("send+" + std::to_string(ports[portIndex].gpio));
+}
+void releaseIRSender(int portIndex) {
+  if (!senderActive[portIndex]) return;  // Like main.cpp, nothing to free
+  senderActive[portIndex] = false;
+  driverCalls.push_back("send-" + std::to_string(ports[portIndex].gpio));
+}
+void initIRReceiver(int gpio) {
+  activeReceiverPort = gpio;
+  driverCalls.push_back("recv+" + std::to_string(gpio));
+}
+void stopIRReceiver() {
+  driverCalls.push_back("recv-" + std::to_string(activeReceiverPort));
+  activeReceiverPort = -1;
+}
+
+class PortPlanTest : public ::testing::Test {
+ protected:
+  PortPlan plan;
+  Preferences prefs;
+
+  void SetUp() override {
+    fake_nvs::reset();
+    configDirty = false;
+    configSlot = -1;
+    configStats = {0, 0, 0, 0, 0, 0, 0, 0, "defaults"};
+    portCount = 0;
+    addMissingPorts();
+    rebuildGpioIndex();
+    activeReceiverPort = -1;
+    memset(senderActive, 0, sizeof(senderActive));
+    driverCalls.clear();
+  }
+
+  // What handleConfigurePortsBulk() does after validation
+  int applyAndCommit() {
+    int changed = applyPortPlan(plan);
+    if (changed > 0) {
+      markConfigDirty();
+      commitConfig(prefs);
+    }
+    return changed;
+  }
+};
+
+TEST_F(PortPlanTest, ConfiguresEveryPortWithOneCommit) {
+  beginPortPlan(plan, false);
+  for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
+    ASSERT_EQ(addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[i], "ir_output", "tv"), nullptr);
+  }
+  EXPECT_EQ(applyAndCommit(), OUTPUT_CAPABLE_COUNT);
+  EXPECT_EQ(driverCalls.size(), (size_t)OUTPUT_CAPABLE_COUNT);
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+  EXPECT_EQ(ports[portForGpio(OUTPUT_CAPABLE_PINS[0])].mode, PORT_IR_OUTPUT);
+}
+
+TEST_F(PortPlanTest, UnchangedPortsAreNotTouched) {
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "ir_output", "tv");
+  applyAndCommit();
+  driverCalls.clear();
+
+  // Same map again: nothing to do, nothing written
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "ir_output", "tv");
+  EXPECT_EQ(applyAndCommit(), 0);
+  EXPECT_TRUE(driverCalls.empty());
+  EXPECT_EQ(fake_nvs::commits(), 1u);
+
+  // A rename is committed but doesn't re-initialize the sender
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "ir_output", "bedroom tv");
+  EXPECT_EQ(applyAndCommit(), 1);
+  EXPECT_TRUE(driverCalls.empty());
+  EXPECT_EQ(fake_nvs::commits(), 2u);
+}
+
+TEST_F(PortPlanTest, InvalidEntryRejectsTheWholeMap) {
+  beginPortPlan(plan, false);
+  EXPECT_EQ(addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "ir_output", ""), nullptr);
+  EXPECT_STREQ(addPortPlanEntry(plan, INPUT_ONLY_PINS[0], "ir_output", ""), "GPIO is input-only");
+  EXPECT_STREQ(addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "disabled", ""), "Duplicate GPIO");
+  EXPECT_STREQ(addPortPlanEntry(plan, 1000, "disabled", ""), "Invalid GPIO");
+  EXPECT_STREQ(addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[1], "on", ""), "Invalid mode");
+  std::string name(PORT_NAME_MAX_LEN + 1, 'x');
+  EXPECT_STREQ(addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[1], "disabled", name.c_str()), "name too long (max 32)");
+  EXPECT_EQ(plan.received, 1);  // The handler stops at the first problem and applies nothing
+}
+
+TEST_F(PortPlanTest, LastNewInputWins) {
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, INPUT_ONLY_PINS[0], "ir_input", "");
+  addPortPlanEntry(plan, INPUT_ONLY_PINS[2], "ir_input", "");
+  applyAndCommit();
+  EXPECT_EQ(activeReceiverPort, INPUT_ONLY_PINS[2]);
+  EXPECT_EQ(driverCalls, std::vector<std::string>{"recv+" + std::to_string(INPUT_ONLY_PINS[2])});
+}
+
+TEST_F(PortPlanTest, DisablingTheActiveInputStopsTheReceiver) {
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, INPUT_ONLY_PINS[1], "ir_input", "");
+  applyAndCommit();
+  driverCalls.clear();
+
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, INPUT_ONLY_PINS[1], "disabled", "");
+  EXPECT_EQ(applyAndCommit(), 1);
+  EXPECT_EQ(activeReceiverPort, -1);
+  EXPECT_EQ(driverCalls, std::vector<std::string>{"recv-" + std::to_string(INPUT_ONLY_PINS[1])});
+}
+
+TEST_F(PortPlanTest, ReplaceDropsTheActiveInputAndOutputs) {
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, INPUT_ONLY_PINS[1], "ir_input", "");
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[0], "ir_output", "");
+  applyAndCommit();
+  driverCalls.clear();
+
+  // A map with only one output, replacing the table
+  beginPortPlan(plan, true);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[1], "ir_output", "");
+  EXPECT_EQ(applyAndCommit(), 3);
+  EXPECT_EQ(activeReceiverPort, -1);
+  EXPECT_EQ(driverCalls, (std::vector<std::string>{"send-" + std::to_string(OUTPUT_CAPABLE_PINS[0]),
+                                                   "send+" + std::to_string(OUTPUT_CAPABLE_PINS[1]),
+                                                   "recv-" + std::to_string(INPUT_ONLY_PINS[1])}));
+  EXPECT_EQ(ports[portForGpio(INPUT_ONLY_PINS[1])].mode, PORT_DISABLED);
+}
+
+TEST_F(PortPlanTest, InputMadeOutputStopsTheReceiver) {
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[3], "ir_input", "");
+  applyAndCommit();
+  driverCalls.clear();
+
+  beginPortPlan(plan, false);
+  addPortPlanEntry(plan, OUTPUT_CAPABLE_PINS[3], "ir_output", "");
+  applyAndCommit();
+  EXPECT_EQ(activeReceiverPort, -1);
+  EXPECT_EQ(driverCalls, (std::vector<std::string>{"send+" + std::to_string(OUTPUT_CAPABLE_PINS[3]),
+                                                   "recv-" + std::to_string(OUTPUT_CAPABLE_PINS[3])}));
+}
@@ -0,0 +1,89 @@
+// Port table: compile-time pin capabilities and the GPIO-to-port index
+#include "port_table.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+class PortTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    portCount = 0;
+    addMissingPorts();
+    rebuildGpioIndex();
+  }
+};
+
+TEST(PortCaps, MatchBoardPinTables) {
+  static_assert(GPIO_CAPS[OUTPUT_CAPABLE_PINS[0]] == (PORT_CAP_OUTPUT | PORT_CAP_INPUT), "computed at compile time");
+  int outputs = 0, inputs = 0;
+  for (int gpio = 0; gpio < GPIO_COUNT; gpio++) {
+    if (GPIO_CAPS[gpio] & PORT_CAP_OUTPUT) outputs++;
+    if (GPIO_CAPS[gpio] & PORT_CAP_INPUT) inputs++;
+  }
+  EXPECT_EQ(outputs, OUTPUT_CAPABLE_COUNT);
+  EXPECT_EQ(inputs, OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT);
+  for (int gpio : INPUT_ONLY_PINS) EXPECT_EQ(GPIO_CAPS[gpio], PORT_CAP_INPUT) << gpio;
+}
+
+TEST(PortMode, NamesRoundTrip) {
+  for (PortMode mode : {PORT_DISABLED, PORT_IR_OUTPUT, PORT_IR_INPUT}) {
+    EXPECT_EQ(parsePortMode(portModeName(mode)), mode);
+  }
+  EXPECT_EQ(parsePortMode(""), PORT_DISABLED);
+  EXPECT_EQ(parsePortMode("IR_OUTPUT"), -1);
+  EXPECT_EQ(parsePortMode("ir_out"), -1);
+}
+
+TEST_F(PortTableTest, DefaultsCoverEveryPinOnce) {
+  ASSERT_EQ(portCount, OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT);
+  for (int i = 0; i < OUTPUT_CAPABLE_COUNT; i++) {
+    EXPECT_EQ(ports[i].gpio, OUTPUT_CAPABLE_PINS[i]);
+    EXPECT_EQ(ports[i].mode, PORT_DISABLED);
+  }
+  EXPECT_EQ(ports[OUTPUT_CAPABLE_COUNT].gpio, INPUT_ONLY_PINS[0]);
+  EXPECT_EQ(addMissingPorts(), 0);
+}
+
+TEST_F(PortTableTest, IndexResolvesEveryGpio) {
+  for (int gpio = 0; gpio < GPIO_COUNT; gpio++) {
+    int index = portForGpio(gpio);
+    if (GPIO_CAPS[gpio] == 0) {
+      EXPECT_EQ(index, -1) << gpio;
+    } else {
+      ASSERT_GE(index, 0) << gpio;
+      EXPECT_EQ(ports[index].gpio, gpio);
+      EXPECT_EQ(ports[index].caps, GPIO_CAPS[gpio]);
+    }
+  }
+  EXPECT_EQ(portForGpio(-1), -1);
+  EXPECT_EQ(portForGpio(GPIO_COUNT), -1);
+  EXPECT_EQ(portForGpio(255), -1);
+}
+
+TEST_F(PortTableTest, UpdateAddsOnlyNewPins) {
+  // A table saved by firmware that knew fewer pins, in another order
+  portCount = 0;
+  setPort(portCount++, INPUT_ONLY_PINS[1], PORT_IR_INPUT, "rx");
+  setPort(portCount++, OUTPUT_CAPABLE_PINS[2], PORT_IR_OUTPUT, "tv");
+  EXPECT_EQ(addMissingPorts(), OUTPUT_CAPABLE_COUNT + INPUT_ONLY_COUNT - 2);
+  rebuildGpioIndex();
+
+  EXPECT_EQ(portForGpio(INPUT_ONLY_PINS[1]), 0);
+  EXPECT_EQ(ports[0].mode, PORT_IR_INPUT);
+  EXPECT_STREQ(ports[portForGpio(OUTPUT_CAPABLE_PINS[2])].name, "tv");
+  EXPECT_EQ(ports[portForGpio(OUTPUT_CAPABLE_PINS[0])].mode, PORT_DISABLED);
+}
+
+TEST_F(PortTableTest, StoredGpioOutOfRangeHasNoCapsOrIndex) {
+  setPort(0, 200, PORT_IR_OUTPUT, "bad");
+  rebuildGpioIndex();
+  EXPECT_EQ(ports[0].caps, 0);
+  EXPECT_EQ(portForGpio(OUTPUT_CAPABLE_PINS[0]), -1);
+}
+
+TEST_F(PortTableTest, LongNamesAreTruncated) {
+  std::string name(PORT_NAME_MAX_LEN + 10, 'x');
+  setPort(0, OUTPUT_CAPABLE_PINS[0], PORT_IR_OUTPUT, name.c_str());
+  EXPECT_EQ(strlen(ports[0].name), (size_t)PORT_NAME_MAX_LEN);
+}
@@ -0,0 +1,244 @@
+// Request arena behaviour, and a fragmentation comparison against per-request
+// heap allocation on a simulated first-fit heap
+#include "request_arena.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "alloc_counter.h"
+
+class RequestArenaTest : public ::testing::Test {
+ protected:
+  void SetUp() override { memset(&requestArena, 0, sizeof(requestArena)); }
+};
+
+TEST_F(RequestArenaTest, BlocksAreAlignedAndPacked) {
+  void* a = arenaAlloc(1);
+  void* b = arenaAlloc(13);
+  EXPECT_EQ((uintptr_t)a % 8, 0u);
+  EXPECT_EQ((uintptr_t)b % 8, 0u);
+  EXPECT_EQ((uint8_t*)b - (uint8_t*)a, ARENA_HEADER + 8);
+  EXPECT_EQ(requestArena.used, (size_t)(ARENA_HEADER + 8 + ARENA_HEADER + 16));
+}
+
+TEST_F(RequestArenaTest, FreeingTheLastBlockGivesItBack) {
+  void* a = arenaAlloc(100);
+  void* b = arenaAlloc(100);
+  size_t afterA = requestArena.used / 2;
+  arenaFree(a);  // Not the last block: stays until the reset
+  EXPECT_EQ(requestArena.used, 2 * afterA);
+  arenaFree(b);
+  EXPECT_EQ(requestArena.used, afterA);
+  arenaFree(nullptr);
+}
+
+TEST_F(RequestArenaTest, ReallocGrowsTheLastBlockInPlace) {
+  char* a = (char*)arenaAlloc(16);
+  strcpy(a, "keep");
+  EXPECT_EQ(arenaRealloc(a, 1000), a);
+  EXPECT_EQ(requestArena.used, (size_t)(ARENA_HEADER + 1000));
+  EXPECT_EQ(arenaRealloc(a, 10), a);  // And shrinks it
+  EXPECT_EQ(requestArena.used, (size_t)(ARENA_HEADER + 16));
+  EXPECT_STREQ(a, "keep");
+}
+
+TEST_F(RequestArenaTest, ReallocOfAnOlderBlockMoves) {
+  char* a = (char*)arenaAlloc(16);
+  strcpy(a, "moved");
+  arenaAlloc(16);
+  char* b = (char*)arenaRealloc(a, 64);
+  EXPECT_NE(b, a);
+  EXPECT_STREQ(b, "moved");
+  EXPECT_EQ(arenaRealloc(b, 8), b);  // Shrinking never moves
+}
+
+TEST_F(RequestArenaTest, OverflowFallsBackToTheHeap) {
+  arenaAlloc(REQUEST_ARENA_SIZE / 2);
+  alloc_counter::Scope heap;
+  void* big = arenaAlloc(REQUEST_ARENA_SIZE);
+  ASSERT_NE(big, nullptr);
+  memset(big, 0, REQUEST_ARENA_SIZE);
+  EXPECT_EQ(requestArena.overflows, 1u);
+  EXPECT_EQ(requestArena.fallbackBytes, (uint32_t)REQUEST_ARENA_SIZE);
+  EXPECT_EQ(heap.allocations(), 1u);
+
+  // Heap blocks grow with realloc and go back with free
+  big = arenaRealloc(big, 2 * REQUEST_ARENA_SIZE);
+  ASSERT_NE(big, nullptr);
+  arenaFree(big);
+  EXPECT_LE(heap.live(), 0);
+}
+
+TEST_F(RequestArenaTest, ReallocPastTheEndFallsBack) {
+  void* a = arenaAlloc(REQUEST_ARENA_SIZE - 64);
+  memset(a, 'x', 16);
+  void* b = arenaRealloc(a, REQUEST_ARENA_SIZE);
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(memcmp(b, "xxxxxxxxxxxxxxxx", 16), 0);
+  EXPECT_EQ(requestArena.overflows, 1u);
+  arenaFree(b);
+}
+
+TEST_F(RequestArenaTest, ResetCountsRequestsAndKeepsTheHighWater) {
+  arenaAlloc(4000);
+  size_t high = requestArena.highWater;
+  arenaReset();
+  arenaAlloc(10);
+  arenaReset();
+  EXPECT_EQ(requestArena.used, 0u);
+  EXPECT_EQ(requestArena.requests, 2u);
+  EXPECT_EQ(requestArena.highWater, high);
+}
+
+// ============ Fragmentation comparison ============
+namespace {
+// First-fit heap with coalescing and 8-byte granules over a fixed size, the
+// shape of the ESP32's multi_heap for this purpose
+class FirstFitHeap {
+ public:
+  explicit FirstFitHeap(size_t size) { freeBlocks[0] = size; }
+
+  // Returns the offset, or SIZE_MAX when no free block fits
+  size_t alloc(size_t size) {
+    ops++;
+    size = (size + 7) & ~(size_t)7;
+    for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+      if (it->second < size) continue;
+      size_t offset = it->first, left = it->second - size;
+      freeBlocks.erase(it);
+      if (left) freeBlocks[offset + size] = left;
+      used[offset] = size;
+      return offset;
+    }
+    return SIZE_MAX;
+  }
+
+  void free(size_t offset) {
+    size_t size = used[offset];
+    used.erase(offset);
+    auto next = freeBlocks.find(offset + size);
+    if (next != freeBlocks.end()) {
+      size += next->second;
+      freeBlocks.erase(next);
+    }
+    auto it = freeBlocks.emplace(offset, size).first;
+    if (it != freeBlocks.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == offset) {
+        prev->second += size;
+        freeBlocks.erase(it);
+      }
+    }
+  }
+
+  // Free memory outside the largest free block: stranded in holes that only
+  // smaller allocations can use
+  size_t strandedBytes() const {
+    size_t total = 0, largest = 0;
+    for (auto& b : freeBlocks) {
+      total += b.second;
+      largest = std::max(largest, b.second);
+    }
+    return total - largest;
+  }
+
+  uint64_t ops = 0;
+
+ private:
+  std::map<size_t, size_t> freeBlocks;  // Offset -> size
+  std::map<size_t, size_t> used;
+};
+
+struct FragmentationResult {
+  double meanStranded;  // Sampled mid-request, while handlers hold their memory
+  size_t peakStranded;
+  uint64_t requestHeapOps;  // Allocations made for request temporaries
+  uint32_t failures;
+};
+
+// Each request builds a handful of temporaries (JSON document, body copy,
+// String growth) freed in no particular order, while other tasks allocate
+// network buffers that outlive the request. Now and then a request also
+// leaves a long-lived object behind (a sender re-created, an MQTT buffer,
+// a learned code), which replaces one created earlier. With the arena the
+// temporaries stay off the heap, which gives up REQUEST_ARENA_SIZE at boot.
+FragmentationResult runRequestMix(bool useArena, int requests) {
+  FirstFitHeap heap(96 * 1024);
+  if (useArena) heap.alloc(REQUEST_ARENA_SIZE);
+
+  std::mt19937 rng(99);
+  std::vector<size_t> longLived(48, SIZE_MAX);
+  std::vector<std::pair<int, size_t>> inFlight;  // Network buffers: request to free them at, offset
+  FragmentationResult result = {};
+  double strandedSum = 0;
+
+  for (int r = 0; r < requests; r++) {
+    // Buffers the network stack queued for earlier requests go back
+    for (size_t i = 0; i < inFlight.size();) {
+      if (inFlight[i].first > r) {
+        i++;
+        continue;
+      }
+      heap.free(inFlight[i].second);
+      inFlight[i] = inFlight.back();
+      inFlight.pop_back();
+    }
+
+    std::vector<size_t> temps;
+    int count = 2 + rng() % 6;
+    for (int i = 0; i < count; i++) {
+      size_t size = 32 + rng() % (i == 0 ? 4096 : 600);
+      if (!useArena) {
+        size_t offset = heap.alloc(size);
+        result.requestHeapOps++;
+        if (offset == SIZE_MAX) result.failures++;
+        else temps.push_back(offset);
+      }
+      // Other tasks allocate in between
+      if (rng() % 3 == 0) {
+        size_t offset = heap.alloc(200 + rng() % 1400);
+        if (offset == SIZE_MAX) result.failures++;
+        else inFlight.push_back({r + 1 + (int)(rng() % 4), offset});
+      }
+    }
+
+    if (rng() % 8 == 0) {
+      size_t& slot = longLived[rng() % longLived.size()];
+      if (slot != SIZE_MAX) heap.free(slot);
+      slot = heap.alloc(48 + rng() % 400);
+      if (slot == SIZE_MAX) result.failures++;
+    }
+
+    size_t stranded = heap.strandedBytes();
+    strandedSum += stranded;
+    result.peakStranded = std::max(result.peakStranded, stranded);
+
+    // Temporaries go back when the handler returns, not in LIFO order
+    std::shuffle(temps.begin(), temps.end(), rng);
+    for (size_t offset : temps) heap.free(offset);
+  }
+  result.meanStranded = strandedSum / requests;
+  return result;
+}
+}  // namespace
+
+TEST(RequestArenaFragmentation, ArenaStrandsLessOfTheHeap) {
+  const int requests = 200000;
+  FragmentationResult heap = runRequestMix(false, requests);
+  FragmentationResult arena = runRequestMix(true, requests);
+
+  ::testing::Test::RecordProperty("heap_mean_stranded_bytes", std::to_string(heap.meanStranded));
+  ::testing::Test::RecordProperty("arena_mean_stranded_bytes", std::to_string(arena.meanStranded));
+  printf("Per-request heap: %.0f bytes stranded on average, %zu at peak, %.1f heap allocations per request\n",
+         heap.meanStranded, heap.peakStranded, (double)heap.requestHeapOps / requests);
+  printf("Request arena:    %.0f bytes stranded on average, %zu at peak, %.1f heap allocations per request\n",
+         arena.meanStranded, arena.peakStranded, (double)arena.requestHeapOps / requests);
+
+  EXPECT_EQ(heap.failures, 0u);
+  EXPECT_EQ(arena.failures, 0u);
+  EXPECT_EQ(arena.requestHeapOps, 0u);
+  EXPECT_LT(arena.meanStranded, heap.meanStranded);
+}
@@ -0,0 +1,195 @@
+// Batch scripts against a scripted UART on the fake clock
+#include "serial_script.h"
+
+#include <gtest/gtest.h>
+
+class SerialScriptTest : public ::testing::Test {
+ protected:
+  HardwareSerial uart{1};
+  SerialScript script;
+
+  void SetUp() override {
+    memset(&script, 0, sizeof(script));
+    fake_clock::setUs(0);
+    uart.begin(9600);
+    uart.setRxBufferSize(4096);
+  }
+
+  SerialStep& addStep(SerialStepOp op, const std::string& data, uint32_t ms = 0, int8_t onMatch = BATCH_NEXT,
+                      int8_t onFail = BATCH_ABORT) {
+    SerialStep& step = script.steps[script.stepCount++];
+    step.op = op;
+    step.dataOffset = script.dataUsed;
+    step.dataLen = data.size();
+    EXPECT_TRUE(appendBatchData(script, (const uint8_t*)data.data(), data.size()));
+    step.ms = ms;
+    step.onMatch = onMatch;
+    step.onFail = onFail;
+    return step;
+  }
+
+  std::string response(int i) {
+    const SerialStepResult& r = script.results[i];
+    EXPECT_LT(r.responseOffset + r.responseLen, SERIAL_BATCH_RESPONSE_SIZE);
+    EXPECT_EQ(script.responses[r.responseOffset + r.responseLen], '\0');
+    return std::string(script.responses + r.responseOffset, r.responseLen);
+  }
+};
+
+TEST_F(SerialScriptTest, SendThenWaitForPattern) {
+  uart.replyTo("PWR?\r", "#PWR=ON", 30);
+  uart.replyTo("PWR?\r", "\r\n#END\r\n", 80);
+  addStep(STEP_SEND, "PWR?\r");
+  addStep(STEP_WAIT, "#END\r\n", 1000);
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(uart.written(), "PWR?\r");
+  ASSERT_EQ(script.resultCount, 2);
+  EXPECT_TRUE(script.results[1].matched);
+  EXPECT_EQ(response(1), "#PWR=ON\r\n#END\r\n");
+  EXPECT_GE(script.results[1].elapsedMs, 80u);
+  EXPECT_LT(script.results[1].elapsedMs, 100u);
+}
+
+TEST_F(SerialScriptTest, WaitWithoutPatternEndsAfterALine) {
+  uart.receiveAt(10, "OK\r");
+  uart.receiveAt(40, "\n");     // Within the 50ms grace period
+  uart.receiveAt(500, "late");  // After it
+  addStep(STEP_WAIT, "", 1000);
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(response(0), "OK\r\n");
+  EXPECT_EQ(uart.available(), 0);
+}
+
+TEST_F(SerialScriptTest, TimeoutTakesTheFailTarget) {
+  uart.receiveAt(10, "ERR");
+  addStep(STEP_WAIT, "OK", 200);
+
+  EXPECT_FALSE(runSerialScript(uart, script));
+  EXPECT_STREQ(script.error, "Timed out waiting for response");
+  EXPECT_FALSE(script.results[0].matched);
+  EXPECT_EQ(response(0), "ERR");
+  EXPECT_GE(millis(), 200u);
+}
+
+TEST_F(SerialScriptTest, BranchesOnTheLastCapture) {
+  uart.receiveAt(0, "STATE=STANDBY\n");
+  addStep(STEP_WAIT, "\n", 100);
+  addStep(STEP_BRANCH, "STANDBY", 0, 3, BATCH_END);
+  addStep(STEP_SEND, "never");
+  addStep(STEP_SEND, "PWR ON\r");
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(uart.written(), "PWR ON\r");
+  ASSERT_EQ(script.resultCount, 3);
+  EXPECT_EQ(script.results[2].step, 3);
+}
+
+TEST_F(SerialScriptTest, GotoLoopsStopAtTheStepLimit) {
+  addStep(STEP_SEND, "x");
+  addStep(STEP_BRANCH, "nothing", 0, BATCH_NEXT, 0);
+
+  EXPECT_FALSE(runSerialScript(uart, script));
+  EXPECT_STREQ(script.error, "Step limit reached");
+  EXPECT_EQ(script.resultCount, SERIAL_BATCH_MAX_EXECUTED);
+}
+
+TEST_F(SerialScriptTest, LongDelaysRunInSlices) {
+  addStep(STEP_DELAY, "", 2500);
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(millis(), 2500u);
+  EXPECT_EQ(script.results[0].elapsedMs, 2500u);
+}
+
+// The response pool fills up: later waits still run and see their pattern,
+// but capture nothing, and nothing is written past the pool
+TEST_F(SerialScriptTest, FullResponsePoolStaysInBounds) {
+  std::string chunk(700, 'a');
+  for (int i = 0; i < 5; i++) {
+    uart.receiveAt(i * 100 + 10, chunk + "\n");
+    addStep(STEP_WAIT, "\n", 150, BATCH_NEXT, BATCH_NEXT);
+  }
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  ASSERT_EQ(script.resultCount, 5);
+  EXPECT_EQ(response(0), chunk + "\n");
+  EXPECT_EQ(response(1), chunk + "\n");
+  EXPECT_EQ(response(2).size(), SERIAL_BATCH_RESPONSE_SIZE - 1 - 2 * 702u);  // Truncated to the room left
+  EXPECT_EQ(response(3), "");
+  EXPECT_EQ(response(4), "");
+  for (int i = 0; i < 5; i++) EXPECT_TRUE(script.results[i].matched) << i;  // Stored or not
+  EXPECT_LE(script.responsesUsed, SERIAL_BATCH_RESPONSE_SIZE);
+}
+
+TEST_F(SerialScriptTest, PoolFilledExactlyToItsLastByte) {
+  std::string first(SERIAL_BATCH_RESPONSE_SIZE - 2, 'b');
+  uart.receiveAt(0, first);
+  uart.receiveAt(50, "tail");
+  addStep(STEP_WAIT, std::string(1, 'b') + "", 20, BATCH_NEXT, BATCH_NEXT);
+  addStep(STEP_WAIT, "tail", 100, BATCH_NEXT, BATCH_NEXT);
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(script.results[0].responseLen, 1u);  // Matched on the first byte
+  EXPECT_EQ(response(1).size(), SERIAL_BATCH_RESPONSE_SIZE - 3u);
+  EXPECT_TRUE(script.results[1].matched);  // "tail" didn't fit, but was received
+  EXPECT_LE(script.responsesUsed, SERIAL_BATCH_RESPONSE_SIZE);
+}
+
+TEST_F(SerialScriptTest, PatternMatchesAcrossPartialRepeats) {
+  uart.receiveAt(0, "OOOK>OK");
+  addStep(STEP_WAIT, "OOK", 100, BATCH_NEXT, BATCH_ABORT);
+  addStep(STEP_WAIT, "OK", 100, BATCH_NEXT, BATCH_ABORT);
+
+  ASSERT_TRUE(runSerialScript(uart, script));
+  EXPECT_EQ(response(0), "OOOK");
+  EXPECT_EQ(response(1), ">OK");
+}
+
+TEST_F(SerialScriptTest, DataPoolRejectsOverflow) {
+  std::string big(SERIAL_BATCH_DATA_SIZE, 'x');
+  EXPECT_TRUE(appendBatchData(script, (const uint8_t*)big.data(), big.size()));
+  EXPECT_FALSE(appendBatchData(script, (const uint8_t*)"y", 1));
+  EXPECT_EQ(script.dataUsed, SERIAL_BATCH_DATA_SIZE);
+}
+
+// /serial/send returns with the first burst instead of waiting out the timeout
+class SerialResponseTest : public ::testing::Test {
+ protected:
+  HardwareSerial uart{1};
+  uint8_t buf[64];
+
+  void SetUp() override {
+    fake_clock::setUs(0);
+    uart.begin(9600);
+  }
+};
+
+TEST_F(SerialResponseTest, ReturnsWithTheFirstBurst) {
+  uart.receiveAt(30, "ACK");
+  uart.receiveAt(200, "more");
+  EXPECT_EQ(readSerialResponse(uart, buf, sizeof(buf), 1000), 3u);
+  EXPECT_EQ(memcmp(buf, "ACK", 3), 0);
+  EXPECT_LT(millis(), 50u);
+}
+
+TEST_F(SerialResponseTest, TerminatorWaitsForTrailingBytes) {
+  uart.receiveAt(10, "PWR=1\r");
+  uart.receiveAt(40, "\n");
+  EXPECT_EQ(readSerialResponse(uart, buf, sizeof(buf), 1000), 7u);
+  EXPECT_EQ(memcmp(buf, "PWR=1\r\n", 7), 0);
+  EXPECT_LT(millis(), 100u);
+}
+
+TEST_F(SerialResponseTest, NothingBeforeTheTimeout) {
+  uart.receiveAt(600, "late");
+  EXPECT_EQ(readSerialResponse(uart, buf, sizeof(buf), 500), 0u);
+  EXPECT_GE(millis(), 500u);
+  EXPECT_LT(millis(), 520u);
+}
+
+TEST_F(SerialResponseTest, StopsAtTheBufferSize) {
+  uart.receiveAt(0, std::string(40, 'x') + "\n" + std::string(40, 'y'));
+  EXPECT_EQ(readSerialResponse(uart, buf, 32, 100), 32u);
+  EXPECT_EQ(uart.available(), 81 - 32);
+}
@@ -0,0 +1,242 @@
+// Transmit self-check math on synthetic carrier edges: frames are built as
+// the ISR would see them and folded in through txCaptureAddEdge()
+#include "tx_check.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+// Edge timestamps for marks and spaces modulated on a carrier with the given
+// period and high time. Each mark ends on a falling edge exactly at its
+// duration, so a clean capture measures the input timings back.
+class EdgeSynth {
+ public:
+  EdgeSynth(TxCapture& capture, uint32_t periodUs, uint32_t highUs, uint32_t startUs)
+      : c(capture), period(periodUs), high(highUs), now(startUs) {
+    memset(&c, 0, sizeof(c));
+    c.startUs = startUs;
+  }
+
+  void mark(uint32_t us) {
+    uint32_t end = now + us;
+    for (uint32_t rise = now; rise + high < end; rise += period) {
+      edge(rise);
+      edge(rise + high);
+    }
+    edge(end - high);  // Last pulse, ending the mark on time
+    edge(end);
+    now = end;
+  }
+  void space(uint32_t us) { now += us; }
+
+  void frame(const std::vector<uint16_t>& timings) {
+    for (size_t i = 0; i < timings.size(); i++) {
+      if (i & 1) space(timings[i]); else mark(timings[i]);
+    }
+  }
+
+ private:
+  TxCapture& c;
+  uint32_t period, high, now;
+  uint32_t last = 0;
+
+  void edge(uint32_t t) {
+    if (c.edges > 0 && t <= last) return;  // Short mark: pulses overlap
+    txCaptureAddEdge(c, t);
+    last = t;
+  }
+};
+
+IrTxJob necJob(uint32_t code, uint32_t frequency = 38000) {
+  IrTxJob job = {};
+  job.kind = IR_TX_NEC;
+  job.code = code;
+  job.frequency = frequency;
+  return job;
+}
+
+std::vector<uint16_t> expected(const IrTxJob& job) {
+  std::vector<uint16_t> out(IR_RAW_MAX);
+  out.resize(buildExpectedTimings(job, out.data()));
+  return out;
+}
+}  // namespace
+
+class TxCheckTest : public ::testing::Test {
+ protected:
+  TxCapture capture;
+
+  void SetUp() override {
+    txCheck = TxCheckStats();
+    memset(txTiming, 0, sizeof(txTiming));
+  }
+};
+
+TEST_F(TxCheckTest, NecReferenceShape) {
+  std::vector<uint16_t> t = expected(necJob(0x80000001));
+  ASSERT_EQ(t.size(), 2u + 64 + 1);
+  EXPECT_EQ(t[0], 8960);
+  EXPECT_EQ(t[1], 4480);
+  EXPECT_EQ(t[3], 1680);  // MSB first: bit 31 is a one
+  EXPECT_EQ(t[5], 560);
+  EXPECT_EQ(t[65], 1680);
+  EXPECT_EQ(t.back(), 560);
+
+  // Other carriers go through sendGeneric() and its rounder timings
+  EXPECT_EQ(expected(necJob(0, 40000))[0], 9000);
+}
+
+TEST_F(TxCheckTest, CleanFrameMatchesExactly) {
+  IrTxJob job = necJob(0x20DF10EF);
+  EdgeSynth synth(capture, 26, 9, 1000);
+  synth.frame(expected(job));
+  recordTxFrame(job, capture);
+
+  const TxFrameCheck& f = txCheck.last;
+  EXPECT_TRUE(f.compared);
+  EXPECT_EQ(f.captured, f.expected);
+  EXPECT_EQ(f.maxMarkErrUs, 0);
+  EXPECT_EQ(f.maxSpaceErrUs, 0);
+  EXPECT_FLOAT_EQ(f.meanMarkErrUs, 0);
+  EXPECT_EQ(txCheck.compared, 1u);
+  EXPECT_EQ(txCheck.unchecked + txCheck.lengthMismatches, 0u);
+}
+
+TEST_F(TxCheckTest, CarrierFrequencyAndDuty) {
+  // Marks a whole number of 26 us periods plus the 9 us high time, so every
+  // pulse sits on the carrier grid: 38461 Hz, about 1.2% fast for 38 kHz
+  IrTxJob job = {};
+  job.kind = IR_TX_RAW;
+  job.frequency = 38000;
+  uint16_t raw[] = {345 * 26 + 9, 4480, 21 * 26 + 9, 1680, 21 * 26 + 9, 560, 21 * 26 + 9};
+  job.rawLen = 7;
+  memcpy(job.raw, raw, sizeof(raw));
+
+  EdgeSynth synth(capture, 26, 9, 0);
+  synth.frame(std::vector<uint16_t>(raw, raw + 7));
+  recordTxFrame(job, capture);
+
+  EXPECT_EQ(txCheck.last.carrierHz, 38461u);
+  EXPECT_NEAR(txCheck.last.carrierErrPercent, 1.213, 0.01);
+  EXPECT_NEAR(txCheck.last.dutyPercent, 100.0 * 9 / 26, 0.01);
+  EXPECT_FLOAT_EQ(txCheck.worstCarrierErrPercent, fabsf(txCheck.last.carrierErrPercent));
+  EXPECT_EQ(txCheck.last.maxMarkErrUs, 0);
+}
+
+TEST_F(TxCheckTest, StretchedMarkAndSpaceAreReported) {
+  IrTxJob job = necJob(0xFFFF0000);
+  std::vector<uint16_t> t = expected(job);
+  t[10] += 40;  // A mark stretched by an interrupt
+  t[11] -= 40;  // The space after it, shortened to match
+  t[20] += 12;
+
+  EdgeSynth synth(capture, 26, 9, 0);
+  synth.frame(t);
+  recordTxFrame(job, capture);
+
+  const TxFrameCheck& f = txCheck.last;
+  ASSERT_TRUE(f.compared);
+  EXPECT_EQ(f.maxMarkErrUs, 40);
+  EXPECT_EQ(f.maxSpaceErrUs, 40);
+  EXPECT_FLOAT_EQ(f.meanMarkErrUs, 52.0f / 34);  // 34 marks
+  EXPECT_FLOAT_EQ(f.meanSpaceErrUs, 40.0f / 33);
+  EXPECT_EQ(txCheck.worstMarkErrUs, 40);
+}
+
+TEST_F(TxCheckTest, StatsAccumulateOverFrames) {
+  IrTxJob job = necJob(1);
+  for (int shift : {0, 20}) {
+    std::vector<uint16_t> t = expected(job);
+    t[0] += shift;
+    EdgeSynth synth(capture, 26, 9, 0);
+    synth.frame(t);
+    recordTxFrame(job, capture);
+  }
+  EXPECT_EQ(txCheck.frames, 2u);
+  EXPECT_EQ(txCheck.compared, 2u);
+  EXPECT_EQ(txCheck.worstMarkErrUs, 20);
+  EXPECT_FLOAT_EQ(txCheck.sumMeanMarkErrUs, 20.0f / 34);
+}
+
+TEST_F(TxCheckTest, MissingBitsAreALengthMismatch) {
+  IrTxJob job = necJob(0x12345678);
+  std::vector<uint16_t> t = expected(job);
+  t.resize(t.size() - 4);  // Two bits lost
+
+  EdgeSynth synth(capture, 26, 9, 0);
+  synth.frame(t);
+  recordTxFrame(job, capture);
+  EXPECT_FALSE(txCheck.last.compared);
+  EXPECT_EQ(txCheck.lengthMismatches, 1u);
+  EXPECT_EQ(txCheck.compared, 0u);
+}
+
+TEST_F(TxCheckTest, RawDropsTheTrailingSpace) {
+  IrTxJob job = {};
+  job.kind = IR_TX_RAW;
+  job.frequency = 36000;
+  uint16_t raw[] = {2400, 600, 1200, 600, 600, 600, 1200, 25000};
+  job.rawLen = 8;
+  memcpy(job.raw, raw, sizeof(raw));
+  ASSERT_EQ(expected(job), std::vector<uint16_t>(raw, raw + 7));
+
+  EdgeSynth synth(capture, 28, 9, 0);
+  synth.frame(std::vector<uint16_t>(raw, raw + 8));
+  recordTxFrame(job, capture);
+  EXPECT_TRUE(txCheck.last.compared);
+  EXPECT_EQ(txCheck.last.maxMarkErrUs, 0);
+}
+
+TEST_F(TxCheckTest, ProtocolsWithoutReferenceAreUnchecked) {
+  IrTxJob job = {};
+  job.kind = IR_TX_SONY;
+  job.frequency = 40000;
+  EdgeSynth synth(capture, 25, 8, 0);
+  synth.frame({2400, 600, 1200, 600, 600});
+  recordTxFrame(job, capture);
+  EXPECT_EQ(txCheck.unchecked, 1u);
+  EXPECT_EQ(txCheck.last.captured, 5);
+  EXPECT_NEAR(txCheck.last.carrierHz, 40000, 500);
+}
+
+TEST_F(TxCheckTest, OverflowIsNotCompared) {
+  IrTxJob job = {};
+  job.kind = IR_TX_RAW;
+  job.frequency = 38000;
+  job.rawLen = IR_RAW_MAX - 1;
+  for (int i = 0; i < job.rawLen; i++) job.raw[i] = 300;
+
+  EdgeSynth synth(capture, 26, 9, 0);
+  std::vector<uint16_t> t(IR_RAW_MAX + 20, 300);  // More than the capture holds
+  synth.frame(t);
+  recordTxFrame(job, capture);
+  EXPECT_TRUE(capture.overflow);
+  EXPECT_EQ(txCheck.lengthMismatches, 1u);
+}
+
+TEST_F(TxCheckTest, SetupAndAirtimePerProtocol) {
+  IrTxJob job = necJob(0);
+  std::vector<uint16_t> t = expected(job);
+  EdgeSynth synth(capture, 26, 9, 5000);
+  synth.space(350);  // Encoder setup before the first edge
+  synth.frame(t);
+  recordTxFrame(job, capture);
+
+  uint32_t airtime = 0;
+  for (uint16_t d : t) airtime += d;
+  const TxProtocolTiming& timing = txTiming[IR_TX_NEC];
+  EXPECT_EQ(timing.frames, 1u);
+  EXPECT_EQ(timing.setupUs, 350u);
+  EXPECT_EQ(timing.maxSetupUs, 350u);
+  EXPECT_EQ(timing.airtimeUs, airtime);
+}
+
+TEST_F(TxCheckTest, NoEdgesIsALengthMismatch) {
+  IrTxJob job = necJob(0);
+  memset(&capture, 0, sizeof(capture));
+  recordTxFrame(job, capture);
+  EXPECT_EQ(txCheck.last.captured, 0);
+  EXPECT_EQ(txCheck.lengthMismatches, 1u);
+  EXPECT_EQ(txTiming[IR_TX_NEC].frames, 0u);
+}
@@ -0,0 +1,129 @@
+// WiFi reconnect backoff, driven the way the firmware does: the event handler
+// reports each failed attempt with its disconnect reason, and the net task
+// polls wifiReconnectDue() as the fake clock moves on.
+#include "wifi_reconnect.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+class WifiReconnectTest : public ::testing::Test {
+ protected:
+  WifiReconnect r = {false, 0, 0, 0, WIFI_FAIL_OTHER, true};
+
+  void SetUp() override {
+    fake_clock::useRealTime(false);
+    fake_clock::setUs(1000000);
+  }
+
+  // Reports a failed attempt, then waits until the next one is due. Returns
+  // the delay in ms; the step the attempt took is left in step.
+  uint32_t failAndWait(uint8_t reason, int8_t rssi = -60, bool fast = false) {
+    wifiReconnectFailed(r, reason, rssi, fast);
+    unsigned long start = millis();
+    if (r.dueMs > start) {
+      fake_clock::advanceMs(r.dueMs - start - 1);
+      EXPECT_EQ(wifiReconnectDue(r), WIFI_RECONNECT_WAIT) << "due early";
+      fake_clock::advanceMs(1);
+    }
+    step = wifiReconnectDue(r);
+    return millis() - start;
+  }
+
+  WifiReconnectStep step = WIFI_RECONNECT_WAIT;
+};
+}  // namespace
+
+TEST(WifiRetryDelay, DoublesToTheCapOfEachCause) {
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_OTHER, 0), 1000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_OTHER, 3), 8000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_OTHER, 5), 30000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_WEAK_SIGNAL, 1), 2000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AP_MISSING, 0), 2000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AP_MISSING, 4), 32000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AP_MISSING, 5), 60000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AUTH, 0), 10000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AUTH, 5), 300000u);
+  EXPECT_EQ(wifiRetryDelayMs(WIFI_FAIL_AUTH, 1000), 300000u);  // No overflow past the shift limit
+}
+
+TEST(WifiRetryDelay, ClassifiesDisconnectReasons) {
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_NO_AP_FOUND, -50), WIFI_FAIL_AP_MISSING);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_AUTH_FAIL, -50), WIFI_FAIL_AUTH);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT, -50), WIFI_FAIL_AUTH);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_BEACON_TIMEOUT, -50), WIFI_FAIL_WEAK_SIGNAL);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_UNSPECIFIED, -85), WIFI_FAIL_WEAK_SIGNAL);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_UNSPECIFIED, -50), WIFI_FAIL_OTHER);
+  EXPECT_EQ(classifyWifiDisconnect(WIFI_REASON_UNSPECIFIED, 0), WIFI_FAIL_OTHER);  // Not sampled yet
+}
+
+TEST_F(WifiReconnectTest, MissingApBacksOffAndScans) {
+  const uint32_t expected[] = {2000, 4000, 8000, 16000, 32000, 60000, 60000};
+  for (uint32_t delayMs : expected) {
+    EXPECT_EQ(failAndWait(WIFI_REASON_NO_AP_FOUND), delayMs);
+    EXPECT_EQ(step, WIFI_RECONNECT_NOW);
+    EXPECT_FALSE(r.withCache);
+    EXPECT_FALSE(r.pending);
+    EXPECT_EQ(wifiReconnectDue(r), WIFI_RECONNECT_WAIT);  // One attempt per failure
+  }
+  EXPECT_EQ(r.total, 7);
+}
+
+TEST_F(WifiReconnectTest, FailedCachedAttemptScansRightAway) {
+  EXPECT_EQ(failAndWait(WIFI_REASON_UNSPECIFIED, -60, true), 0u);
+  EXPECT_EQ(step, WIFI_RECONNECT_NOW);
+  EXPECT_FALSE(r.withCache);
+
+  // The scan failed too: back off as usual
+  EXPECT_EQ(failAndWait(WIFI_REASON_UNSPECIFIED), 2000u);
+  EXPECT_TRUE(r.withCache);
+}
+
+TEST_F(WifiReconnectTest, WeakSignalScansAfterOneRetry) {
+  EXPECT_EQ(failAndWait(WIFI_REASON_BEACON_TIMEOUT), 1000u);
+  EXPECT_TRUE(r.withCache);
+  EXPECT_EQ(failAndWait(WIFI_REASON_BEACON_TIMEOUT), 2000u);
+  EXPECT_FALSE(r.withCache);
+}
+
+TEST_F(WifiReconnectTest, ChangeOfCauseRestartsTheBackoff) {
+  failAndWait(WIFI_REASON_NO_AP_FOUND);
+  failAndWait(WIFI_REASON_NO_AP_FOUND);
+  EXPECT_EQ(failAndWait(WIFI_REASON_NO_AP_FOUND), 8000u);
+  EXPECT_EQ(failAndWait(WIFI_REASON_AUTH_FAIL), 10000u);
+  EXPECT_EQ(r.total, 4);
+}
+
+TEST_F(WifiReconnectTest, AlternatingCausesStillReachTheRebootLimit) {
+  int attempts = 0;
+  unsigned long start = millis();
+  do {
+    failAndWait(attempts % 2 ? WIFI_REASON_UNSPECIFIED : WIFI_REASON_NO_AP_FOUND);
+    attempts++;
+  } while (step == WIFI_RECONNECT_NOW && attempts < 1000);
+
+  EXPECT_EQ(step, WIFI_RECONNECT_REBOOT);
+  EXPECT_EQ(attempts, WIFI_RECONNECT_MAX_ATTEMPTS);
+  // Every retry is a first retry for its cause
+  EXPECT_EQ(millis() - start, (unsigned long)(WIFI_RECONNECT_MAX_ATTEMPTS / 2) * (2000 + 1000));
+}
+
+TEST_F(WifiReconnectTest, AuthFailuresNeverReboot) {
+  for (int i = 0; i < WIFI_RECONNECT_MAX_ATTEMPTS * 2; i++) {
+    failAndWait(WIFI_REASON_AUTH_FAIL);
+    ASSERT_EQ(step, WIFI_RECONNECT_NOW) << "attempt " << i;
+  }
+  EXPECT_EQ(failAndWait(WIFI_REASON_AUTH_FAIL), 300000u);
+  EXPECT_TRUE(r.withCache);
+}
+
+TEST_F(WifiReconnectTest, ConnectingClearsTheCounts) {
+  for (int i = 0; i < WIFI_RECONNECT_MAX_ATTEMPTS - 1; i++) failAndWait(WIFI_REASON_UNSPECIFIED);
+  wifiReconnectReset(r);
+  EXPECT_FALSE(r.pending);
+  EXPECT_EQ(r.total, 0);
+
+  // The next drop starts over: first delay, far from the limit
+  EXPECT_EQ(failAndWait(WIFI_REASON_UNSPECIFIED), 1000u);
+  EXPECT_EQ(step, WIFI_RECONNECT_NOW);
+  EXPECT_EQ(r.total, 1);
+}
@@ -0,0 +1,365 @@
+#!/usr/bin/env python3
+"""Listen to, query and simulate the UDP fleet beacon of VDA IR Control boards.
+
+Boards multicast a status packet to 239.255.86.73:48673 every 30 s (and soon
+after their state changes), and answer queries sent to the same group with
+the same packet, unicast to the querier. One socket sees the whole fleet:
+
+    python3 tools/fleet_beacon.py listen
+    python3 tools/fleet_beacon.py query --window 1000
+    python3 tools/fleet_beacon.py query --board-id living-room
+
+simulate runs many virtual boards in one process, announcing and answering
+queries like the firmware does, to try controllers against a large fleet
+without hardware:
+
+    python3 tools/fleet_beacon.py simulate --boards 500 --interval 30
+    python3 tools/fleet_beacon.py query --window 2000 --expect 500
+
+test checks the packet encoder and decoder, including a golden packet that
+the firmware's POST /diagnostics/selftest checks as well, so the two stay in
+step. Use --interface <local address> to pick the network interface
+(127.0.0.1 keeps a simulation on the loopback interface).
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import time
+import zlib
+
+GROUP = "239.255.86.73"
+PORT = 48673
+MAGIC = 0x42414456  # "VDAB"
+VERSION = 1
+
+ANNOUNCE, QUERY, RESPONSE = 1, 2, 3
+TYPE_NAMES = {ANNOUNCE: "announce", QUERY: "query", RESPONSE: "response"}
+
+FLAGS = ["adopted", "ethernet", "ap_mode", "ota_active", "config_pending", "firmware_pending"]
+
+HEADER = "<IBBHI"
+# Must match BeaconStatus and BeaconQuery in firmware/src/main.cpp
+STATUS = struct.Struct(HEADER + "6sBB33s12sIIQQBBBbBBHIII")
+QUERY_PACKET = struct.Struct(HEADER + "H33s")
+CRC_SIZE = 4
+STATUS_SIZE = STATUS.size + CRC_SIZE
+QUERY_SIZE = QUERY_PACKET.size + CRC_SIZE
+
+STATUS_FIELDS = ["magic", "version", "type", "size", "nonce", "mac", "flags", "reset_reason", "board_id",
+                 "firmware", "config_generation", "uptime_s", "output_mask", "input_mask", "port_count",
+                 "output_count", "input_count", "rssi", "idle_core0", "idle_core1", "seq", "free_heap",
+                 "min_free_heap", "largest_block"]
+
+# Status packet built the same way by the firmware self-test
+GOLDEN = {
+    "type": ANNOUNCE, "nonce": 0, "mac": bytes.fromhex("240AC4123456"), "flags": 3, "reset_reason": 1,
+    "board_id": "vda-ir-golden", "firmware": "1.0.0", "config_generation": 42, "uptime_s": 3600,
+    "output_mask": (1 << 4) | (1 << 5), "input_mask": 1 << 36, "port_count": 3, "output_count": 2,
+    "input_count": 1, "rssi": -60, "idle_core0": 90, "idle_core1": 75, "seq": 7, "free_heap": 180000,
+    "min_free_heap": 150000, "largest_block": 110000,
+}
+GOLDEN_CRC = 0x1D0C64EB
+
+
+def seal(body):
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def encode_status(status):
+    body = STATUS.pack(MAGIC, VERSION, status["type"], STATUS_SIZE, status["nonce"], status["mac"],
+                       status["flags"], status["reset_reason"], status["board_id"].encode(),
+                       status["firmware"].encode(), status["config_generation"], status["uptime_s"],
+                       status["output_mask"], status["input_mask"], status["port_count"],
+                       status["output_count"], status["input_count"], status["rssi"], status["idle_core0"],
+                       status["idle_core1"], status["seq"], status["free_heap"], status["min_free_heap"],
+                       status["largest_block"])
+    return seal(body)
+
+
+def encode_query(nonce, window_ms, board_id=""):
+    return seal(QUERY_PACKET.pack(MAGIC, VERSION, QUERY, QUERY_SIZE, nonce, window_ms, board_id.encode()))
+
+
+def check_packet(data, packet_type, size):
+    """Returns the packet without its CRC, or None if it isn't a valid
+    packet of the given type."""
+    if len(data) != size:
+        return None
+    magic, version, kind, declared, _ = struct.unpack_from(HEADER, data)
+    if magic != MAGIC or version != VERSION or kind != packet_type or declared != size:
+        return None
+    if struct.unpack_from("<I", data, size - CRC_SIZE)[0] != zlib.crc32(data[:-CRC_SIZE]):
+        return None
+    return data[:-CRC_SIZE]
+
+
+def decode_status(data):
+    """Decodes an announcement or response, or returns None."""
+    if len(data) < 6:
+        return None
+    body = check_packet(data, data[5], STATUS_SIZE)
+    if body is None or data[5] not in (ANNOUNCE, RESPONSE):
+        return None
+    status = dict(zip(STATUS_FIELDS, STATUS.unpack(body)))
+    for key in ("board_id", "firmware"):
+        status[key] = status[key].split(b"\0", 1)[0].decode(errors="replace")
+    return status
+
+
+def decode_query(data):
+    body = check_packet(data, QUERY, QUERY_SIZE)
+    if body is None:
+        return None
+    _, _, _, _, nonce, window_ms, board_id = QUERY_PACKET.unpack(body)
+    return {"nonce": nonce, "window_ms": window_ms, "board_id": board_id.split(b"\0", 1)[0].decode()}
+
+
+def gpios(mask):
+    return [gpio for gpio in range(64) if mask >> gpio & 1]
+
+
+def describe(status):
+    flags = [name for bit, name in enumerate(FLAGS) if status["flags"] >> bit & 1]
+    return (f"{status['board_id']:<24} {status['mac'].hex(':')} v{status['firmware']:<8} "
+            f"gen {status['config_generation']:<5} out {gpios(status['output_mask'])} in {gpios(status['input_mask'])} "
+            f"heap {status['free_heap'] // 1024}K rssi {status['rssi']} up {status['uptime_s']}s "
+            f"{','.join(flags)}")
+
+
+def open_socket(interface, join=True):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(interface))
+    if join:
+        sock.bind(("", PORT))
+        membership = socket.inet_aton(GROUP) + socket.inet_aton(interface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    else:
+        sock.bind(("", 0))
+    return sock
+
+
+# ---------------------------------------------------------------- test
+
+def run_tests():
+    failures = 0
+
+    def check(name, ok):
+        nonlocal failures
+        print(f"{'ok  ' if ok else 'FAIL'} {name}")
+        failures += not ok
+
+    golden = encode_status(GOLDEN)
+    check(f"status packet is {STATUS_SIZE} bytes", len(golden) == STATUS_SIZE == 113)
+    check(f"query packet is {QUERY_SIZE} bytes", QUERY_SIZE == 51)
+    check("golden packet CRC", struct.unpack_from("<I", golden, STATUS_SIZE - CRC_SIZE)[0] == GOLDEN_CRC)
+
+    decoded = decode_status(golden)
+    check("status round trip", decoded is not None and all(decoded[k] == v for k, v in GOLDEN.items()))
+
+    corrupt = bytearray(golden)
+    corrupt[20] ^= 1
+    check("rejects bad CRC", decode_status(bytes(corrupt)) is None)
+    check("rejects truncated packet", decode_status(golden[:-1]) is None)
+    check("rejects bad magic", decode_status(seal(b"XDAB" + golden[4:-CRC_SIZE])) is None)
+    check("rejects newer version", decode_status(seal(golden[:4] + b"\x02" + golden[5:-CRC_SIZE])) is None)
+
+    query = encode_query(0xDEADBEEF, 1500, "living-room")
+    check("query round trip", decode_query(query) == {"nonce": 0xDEADBEEF, "window_ms": 1500, "board_id": "living-room"})
+    check("query is not a status", decode_status(query) is None)
+    check("status is not a query", decode_query(golden) is None)
+
+    rng = random.Random(1)
+    ok = True
+    for _ in range(1000):
+        status = VirtualBoard(rng.randrange(1 << 16), rng, time.monotonic()).status(RESPONSE, rng.getrandbits(32))
+        ok = ok and decode_status(encode_status(status)) == {**status, "magic": MAGIC, "version": VERSION,
+                                                             "size": STATUS_SIZE}
+    check("1000 random round trips", ok)
+
+    print(f"{failures} failure(s)")
+    return 1 if failures else 0
+
+
+# ---------------------------------------------------------------- simulate
+
+class VirtualBoard:
+    OUTPUT_PINS = [4, 5, 13, 14, 15, 16, 32, 33]
+    INPUT_PINS = [34, 35, 36, 39]
+
+    def __init__(self, index, rng, now):
+        self.rng = rng
+        self.mac = bytes([0x02, 0x56, 0x44]) + index.to_bytes(3, "big")  # Locally administered
+        self.board_id = f"sim-{index:04d}"
+        self.boot = now - rng.uniform(0, 86400)
+        self.generation = rng.randint(1, 50)
+        self.outputs = rng.sample(self.OUTPUT_PINS, rng.randint(0, len(self.OUTPUT_PINS)))
+        self.inputs = rng.sample(self.INPUT_PINS, rng.randint(0, 1))
+        self.seq = 0
+        self.next_announce = now + rng.uniform(0, 2)
+        self.replies = []  # (due, address, nonce)
+
+    def status(self, packet_type, nonce):
+        self.seq = (self.seq + 1) & 0xFFFF
+        free_heap = self.rng.randint(120000, 200000)
+        return {
+            "type": packet_type, "nonce": nonce, "mac": self.mac, "flags": 1, "reset_reason": 1,
+            "board_id": self.board_id, "firmware": "sim", "config_generation": self.generation,
+            "uptime_s": int(time.monotonic() - self.boot),
+            "output_mask": sum(1 << gpio for gpio in self.outputs),
+            "input_mask": sum(1 << gpio for gpio in self.inputs),
+            "port_count": len(self.OUTPUT_PINS) + len(self.INPUT_PINS), "output_count": len(self.outputs),
+            "input_count": len(self.inputs), "rssi": 0, "idle_core0": self.rng.randint(80, 99),
+            "idle_core1": self.rng.randint(80, 99), "seq": self.seq, "free_heap": free_heap,
+            "min_free_heap": free_heap - self.rng.randint(0, 20000), "largest_block": free_heap // 2,
+        }
+
+
+def jittered(interval, percent=20):
+    return interval * (1 + random.uniform(-percent, percent) / 100)
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    now = time.monotonic()
+    boards = [VirtualBoard(i, rng, now) for i in range(args.boards)]
+    sock = open_socket(args.interface)
+    sock.setblocking(False)
+    next_change = now + args.change_every if args.change_every else None
+    sent = answered = 0
+    next_report = now + 10
+    print(f"{args.boards} virtual boards on {GROUP}:{PORT}, announcing every {args.interval:g}s")
+
+    while True:
+        now = time.monotonic()
+        for board in boards:
+            if now >= board.next_announce:
+                sock.sendto(encode_status(board.status(ANNOUNCE, 0)), (GROUP, PORT))
+                board.next_announce = now + jittered(args.interval)
+                sent += 1
+            while board.replies and board.replies[0][0] <= now:
+                _, address, nonce = board.replies.pop(0)
+                sock.sendto(encode_status(board.status(RESPONSE, nonce)), address)
+                answered += 1
+
+        if next_change is not None and now >= next_change:
+            board = rng.choice(boards)
+            board.generation += 1
+            board.next_announce = now + 1  # Like BEACON_MIN_GAP_MS after a config commit
+            next_change = now + args.change_every
+
+        while True:
+            try:
+                data, address = sock.recvfrom(512)
+            except BlockingIOError:
+                break
+            query = decode_query(data)
+            if query is None:
+                continue
+            window = min(query["window_ms"], 5000) / 1000
+            for board in boards:
+                if not query["board_id"] or query["board_id"] == board.board_id:
+                    board.replies.append((now + rng.uniform(0, window), address, query["nonce"]))
+                    board.replies.sort()
+
+        due = [b.next_announce for b in boards] + [b.replies[0][0] for b in boards if b.replies]
+        if next_change is not None:
+            due.append(next_change)
+        time.sleep(max(0.0, min(min(due) - time.monotonic(), 0.05)))
+        if args.verbose and now >= next_report:
+            print(f"{sent} announcements, {answered} query responses")
+            next_report = now + 10
+
+
+# ---------------------------------------------------------------- listen / query
+
+def listen(args):
+    sock = open_socket(args.interface)
+    seen = set()
+    start = time.monotonic()
+    while True:
+        data, address = sock.recvfrom(512)
+        status = decode_status(data)
+        if status is None:
+            continue
+        new = status["mac"] not in seen
+        seen.add(status["mac"])
+        print(f"{time.monotonic() - start:8.2f}s {address[0]:<15} {TYPE_NAMES[status['type']]:<8} "
+              f"{'new ' if new else '    '}{describe(status)}")
+
+
+def query(args):
+    sock = open_socket(args.interface, join=False)
+    nonce = random.getrandbits(32)
+    start = time.monotonic()
+    sock.sendto(encode_query(nonce, args.window, args.board_id), (GROUP, PORT))
+
+    deadline = start + args.window / 1000 + args.grace
+    boards = {}
+    last = start
+    while time.monotonic() < deadline and (not args.expect or len(boards) < args.expect):
+        sock.settimeout(max(0.001, deadline - time.monotonic()))
+        try:
+            data, address = sock.recvfrom(512)
+        except socket.timeout:
+            break
+        status = decode_status(data)
+        if status is None or status["type"] != RESPONSE or status["nonce"] != nonce:
+            continue
+        if status["mac"] not in boards:
+            last = time.monotonic()
+        boards[status["mac"]] = (address[0], status)
+
+    for address, status in sorted(boards.values(), key=lambda item: item[1]["board_id"]):
+        if not args.quiet:
+            print(f"{address:<15} {describe(status)}")
+    elapsed = (last - start) * 1000
+    print(f"{len(boards)} board(s), last response after {elapsed:.0f} ms"
+          + (f" ({len(boards) * 1000 / elapsed:.0f} boards/s)" if boards and elapsed > 0 else ""))
+    return 0 if not args.expect or len(boards) >= args.expect else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--interface", default="0.0.0.0", help="local address to use for multicast")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    commands.add_parser("test", help="check the packet encoder and decoder")
+    commands.add_parser("listen", help="print announcements and responses")
+
+    q = commands.add_parser("query", help="ask every board (or one) for its status")
+    q.add_argument("--window", type=int, default=1000, help="reply window in ms, max 5000 (default 1000)")
+    q.add_argument("--board-id", default="", help="only ask this board")
+    q.add_argument("--expect", type=int, default=0, help="stop after this many boards; fail if fewer answer")
+    q.add_argument("--grace", type=float, default=0.5, help="seconds to wait after the window (default 0.5)")
+    q.add_argument("--quiet", action="store_true", help="print the summary only")
+
+    s = commands.add_parser("simulate", help="run virtual boards")
+    s.add_argument("--boards", type=int, default=100)
+    s.add_argument("--interval", type=float, default=30, help="announcement interval in s (default 30)")
+    s.add_argument("--change-every", type=float, default=0, help="bump a random board's config generation "
+                   "every N seconds")
+    s.add_argument("--seed", type=int, default=None)
+    s.add_argument("--verbose", action="store_true")
+
+    args = parser.parse_args()
+    if args.command == "test":
+        return run_tests()
+    try:
+        if args.command == "listen":
+            listen(args)
+        elif args.command == "query":
+            return query(args)
+        else:
+            simulate(args)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
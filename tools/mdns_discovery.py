@@ -0,0 +1,364 @@
+#!/usr/bin/env python3
+"""Measure discovery-to-ready time for VDA IR Control boards over mDNS.
+
+A controller browses for _vda-ir._tcp and counts a board as ready once it
+knows its firmware, ports and config generation. Boards publish those in
+their TXT records, so the browse alone is enough; boards without them
+(older firmware) need a GET /info each. measure reports how long the whole
+fleet takes to become ready and how many /info requests that cost:
+
+    python3 tools/mdns_discovery.py measure --expect 12
+    python3 tools/mdns_discovery.py measure --expect 12 --always-fetch
+
+simulate answers browses for many virtual boards, each with its own /info
+endpoint, to compare both cases at fleet scale on one Linux host:
+
+    python3 tools/mdns_discovery.py --interface 127.0.0.1 simulate --boards 300
+    python3 tools/mdns_discovery.py --interface 127.0.0.1 measure --expect 300
+    python3 tools/mdns_discovery.py --interface 127.0.0.1 simulate --boards 300 --legacy
+
+Queries are sent from an ephemeral port, so responders answer by unicast
+(RFC 6762 section 6.7). Only the Python standard library is used.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import socket
+import struct
+import sys
+import time
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+MDNS_GROUP = "224.0.0.251"
+MDNS_PORT = 5353
+SERVICE = "_vda-ir._tcp.local"
+
+TYPE_A, TYPE_PTR, TYPE_TXT, TYPE_SRV = 1, 12, 16, 33
+CLASS_IN = 1
+CACHE_FLUSH = 0x8000
+
+# Keys a controller needs before it can use a board without asking /info
+READY_KEYS = ("fw", "ports", "out", "in", "gen")
+
+
+# ---------------------------------------------------------------- DNS wire format
+
+def encode_name(name):
+    out = b""
+    for label in name.rstrip(".").split("."):
+        out += bytes([len(label)]) + label.encode()
+    return out + b"\0"
+
+
+def read_name(data, offset):
+    """Returns (name, offset after the name), following compression pointers."""
+    labels, end = [], None
+    for _ in range(128):  # Bounds pointer loops
+        length = data[offset]
+        if length & 0xC0 == 0xC0:
+            if end is None:
+                end = offset + 2
+            offset = struct.unpack_from(">H", data, offset)[0] & 0x3FFF
+            continue
+        offset += 1
+        if length == 0:
+            break
+        labels.append(data[offset:offset + length].decode(errors="replace"))
+        offset += length
+    return ".".join(labels), end if end is not None else offset
+
+
+def build_query(name, qtype=TYPE_PTR):
+    return struct.pack(">HHHHHH", random.getrandbits(16), 0, 1, 0, 0, 0) + encode_name(name) + \
+        struct.pack(">HH", qtype, CLASS_IN)
+
+
+def parse_message(data):
+    """Returns (id, is_response, questions, records) with records as
+    (name, type, rdata offset, rdata length) tuples."""
+    msg_id, flags, qd, an, ns, ar = struct.unpack_from(">HHHHHH", data)
+    offset, questions, records = 12, [], []
+    for _ in range(qd):
+        name, offset = read_name(data, offset)
+        qtype, _ = struct.unpack_from(">HH", data, offset)
+        questions.append((name, qtype))
+        offset += 4
+    for _ in range(an + ns + ar):
+        name, offset = read_name(data, offset)
+        rtype, _, _, length = struct.unpack_from(">HHIH", data, offset)
+        offset += 10
+        records.append((name, rtype, offset, length))
+        offset += length
+    return msg_id, bool(flags & 0x8000), questions, records
+
+
+def parse_txt(data, offset, length):
+    txt, end = {}, offset + length
+    while offset < end:
+        size = data[offset]
+        item = data[offset + 1:offset + 1 + size].decode(errors="replace")
+        offset += 1 + size
+        if item:
+            key, _, value = item.partition("=")
+            txt[key] = value
+    return txt
+
+
+def record(name, rtype, rdata, ttl=120, flush=False):
+    return encode_name(name) + struct.pack(">HHIH", rtype, CLASS_IN | (CACHE_FLUSH if flush else 0),
+                                           ttl, len(rdata)) + rdata
+
+
+def encode_txt(txt):
+    if not txt:
+        return b"\0"
+    return b"".join(bytes([len(item)]) + item for item in (f"{k}={v}".encode() for k, v in txt.items()))
+
+
+# ---------------------------------------------------------------- simulate
+
+class VirtualBoard:
+    def __init__(self, index, rng, address, port, legacy):
+        self.board_id = f"sim-{index:04d}"
+        self.instance = f"{self.board_id}.{SERVICE}"
+        self.host = f"{self.board_id}.local"
+        self.address = address
+        self.port = port
+        outputs = rng.randint(0, 12)
+        inputs = rng.randint(0, 1)
+        self.info = {
+            "board_id": self.board_id, "board_name": self.board_id,
+            "mac_address": ":".join(f"{b:02X}" for b in bytes([0x02, 0x56, 0x44]) + index.to_bytes(3, "big")),
+            "ip_address": address, "firmware_version": "sim", "board_type": "esp32-poe-iso", "adopted": True,
+            "total_ports": 16, "config_generation": rng.randint(1, 50), "connection_type": "ethernet",
+            "output_count": outputs, "input_count": inputs,
+        }
+        self.txt = {} if legacy else {
+            "txtvers": "1", "id": self.board_id, "fw": "sim", "board": "esp32-poe-iso", "conn": "ethernet",
+            "mac": self.info["mac_address"], "adopted": "1", "ports": "16", "out": str(outputs),
+            "in": str(inputs), "gen": str(self.info["config_generation"]),
+        }
+
+    def answer(self, msg_id, service, unicast):
+        """Response to a PTR query: the PTR answer, with SRV, TXT and A as
+        additional records, as ESP-IDF's responder sends them."""
+        answers = [record(service, TYPE_PTR, encode_name(self.instance.replace(SERVICE, service)), 4500)]
+        instance = self.instance.replace(SERVICE, service)
+        additional = [
+            record(instance, TYPE_SRV, struct.pack(">HHH", 0, 0, self.port) + encode_name(self.host), flush=True),
+            record(instance, TYPE_TXT, encode_txt(self.txt), 4500, flush=True),
+            record(self.host, TYPE_A, socket.inet_aton(self.address), flush=True),
+        ]
+        header = struct.pack(">HHHHHH", msg_id if unicast else 0, 0x8400, 0, len(answers), 0, len(additional))
+        return header + b"".join(answers) + b"".join(additional)
+
+
+class MdnsResponder(asyncio.DatagramProtocol):
+    def __init__(self, boards, rng):
+        self.boards = boards
+        self.rng = rng
+        self.transport = None
+        self.queries = 0
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, address):
+        try:
+            msg_id, is_response, questions, _ = parse_message(data)
+        except (struct.error, IndexError):
+            return
+        if is_response:
+            return
+        loop = asyncio.get_running_loop()
+        unicast = address[1] != MDNS_PORT
+        for name, qtype in questions:
+            if qtype != TYPE_PTR or name.lower() not in (SERVICE, "_http._tcp.local"):
+                continue
+            self.queries += 1
+            for board in self.boards:
+                # Shared records are answered after 20-120 ms (RFC 6762 section 6)
+                packet = board.answer(msg_id, name.lower(), unicast)
+                target = address if unicast else (MDNS_GROUP, MDNS_PORT)
+                loop.call_later(self.rng.uniform(0.02, 0.12), self.transport.sendto, packet, target)
+
+
+async def serve_info(board, info_delay, counter):
+    async def handle(reader, writer):
+        try:
+            request = await reader.readuntil(b"\r\n\r\n")
+        except (asyncio.IncompleteReadError, asyncio.LimitOverrunError):
+            writer.close()
+            return
+        counter["info"] += 1
+        await asyncio.sleep(info_delay)
+        found = request.startswith(b"GET /info ")
+        body = json.dumps(board.info).encode() if found else b'{"error":"Not found"}'
+        writer.write(b"HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                     b"Connection: close\r\n\r\n" % (200 if found else 404, b"OK" if found else b"Not Found", len(body)))
+        writer.write(body)
+        await writer.drain()
+        writer.close()
+
+    return await asyncio.start_server(handle, board.address, board.port)
+
+
+async def simulate(args):
+    rng = random.Random(args.seed)
+    address = args.interface if args.interface != "0.0.0.0" else "127.0.0.1"
+    boards = [VirtualBoard(i, rng, address, args.base_port + i, args.legacy) for i in range(args.boards)]
+    counter = {"info": 0}
+    servers = [await serve_info(board, args.info_delay / 1000, counter) for board in boards]
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", MDNS_PORT))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                    socket.inet_aton(MDNS_GROUP) + socket.inet_aton(args.interface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+    _, responder = await asyncio.get_running_loop().create_datagram_endpoint(
+        lambda: MdnsResponder(boards, rng), sock=sock)
+
+    kind = "without TXT metadata (legacy)" if args.legacy else "with TXT metadata"
+    print(f"{args.boards} virtual boards {kind}, /info on {address}:{args.base_port}-"
+          f"{args.base_port + args.boards - 1}, {args.info_delay:g} ms per /info")
+    try:
+        while True:
+            await asyncio.sleep(10)
+            print(f"{responder.queries} browse queries, {counter['info']} /info requests")
+    finally:
+        for server in servers:
+            server.close()
+
+
+# ---------------------------------------------------------------- measure
+
+def fetch_info(address, port, timeout):
+    with urllib.request.urlopen(f"http://{address}:{port}/info", timeout=timeout) as response:
+        return json.loads(response.read().decode())
+
+
+def measure(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("", 0))
+
+    instances = {}   # Instance name -> {"srv": (host, port), "txt": {...}}
+    hosts = {}       # Host name -> address
+    discovered = {}  # Instance -> seconds until its records were complete
+    ready = {}       # Instance -> seconds until ready
+    fetching = set()
+    pool = ThreadPoolExecutor(max_workers=args.parallel)
+    futures = {}
+    failures = http_requests = 0
+
+    start = time.monotonic()
+    next_query = start
+    deadline = start + args.timeout
+    while time.monotonic() < deadline and (not args.expect or len(ready) < args.expect):
+        now = time.monotonic()
+        if now >= next_query:
+            sock.sendto(build_query(SERVICE), (MDNS_GROUP, MDNS_PORT))
+            next_query = now + 1
+
+        sock.settimeout(0.01)
+        try:
+            data, _ = sock.recvfrom(9000)
+            _, is_response, _, records = parse_message(data)
+        except socket.timeout:
+            data = None
+        except (struct.error, IndexError):
+            continue
+
+        if data is not None and is_response:
+            for name, rtype, offset, length in records:
+                if rtype == TYPE_PTR and name.lower() == SERVICE:
+                    instances.setdefault(read_name(data, offset)[0], {})
+                elif rtype == TYPE_SRV:
+                    port = struct.unpack_from(">H", data, offset + 4)[0]
+                    instances.setdefault(name, {})["srv"] = (read_name(data, offset + 6)[0], port)
+                elif rtype == TYPE_TXT:
+                    instances.setdefault(name, {})["txt"] = parse_txt(data, offset, length)
+                elif rtype == TYPE_A and length == 4:
+                    hosts[name] = socket.inet_ntoa(data[offset:offset + 4])
+
+        elapsed = time.monotonic() - start
+        for instance, info in instances.items():
+            if instance in ready or instance in fetching or "srv" not in info or "txt" not in info:
+                continue
+            host, port = info["srv"]
+            if host not in hosts:
+                continue
+            discovered.setdefault(instance, elapsed)
+            if not args.always_fetch and all(key in info["txt"] for key in READY_KEYS):
+                ready[instance] = elapsed
+            else:
+                fetching.add(instance)
+                http_requests += 1
+                futures[instance] = pool.submit(fetch_info, hosts[host], port, args.http_timeout)
+
+        for instance, future in list(futures.items()):
+            if future.done():
+                del futures[instance]
+                fetching.discard(instance)
+                if future.exception() is None:
+                    ready[instance] = time.monotonic() - start
+                else:
+                    failures += 1
+                    instances[instance].pop("txt", None)  # Retried after the next browse
+
+    pool.shutdown(wait=False, cancel_futures=True)
+    times = sorted(ready.values())
+    waits = sorted(ready[i] - discovered[i] for i in ready)
+    if not times:
+        print("no boards ready")
+        return 1
+
+    def pct(values, p):
+        return values[min(len(values) - 1, int(len(values) * p / 100))] * 1000
+
+    print(f"{len(ready)} board(s) ready, {len(instances)} discovered, {http_requests} /info request(s), "
+          f"{failures} failed")
+    print(f"discovery-to-ready: all {times[-1] * 1000:.0f} ms, p50 {pct(times, 50):.0f} ms, "
+          f"p95 {pct(times, 95):.0f} ms after the first browse")
+    print(f"wait after discovery: p50 {pct(waits, 50):.0f} ms, p95 {pct(waits, 95):.0f} ms")
+    return 0 if not args.expect or len(ready) >= args.expect else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--interface", default="0.0.0.0", help="local address to use for multicast")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    m = commands.add_parser("measure", help="browse and time until every board is ready")
+    m.add_argument("--expect", type=int, default=0, help="stop once this many boards are ready")
+    m.add_argument("--timeout", type=float, default=15, help="seconds (default 15)")
+    m.add_argument("--always-fetch", action="store_true", help="GET /info from every board, ignoring TXT records")
+    m.add_argument("--parallel", type=int, default=8, help="concurrent /info requests (default 8)")
+    m.add_argument("--http-timeout", type=float, default=3)
+
+    s = commands.add_parser("simulate", help="answer browses for virtual boards")
+    s.add_argument("--boards", type=int, default=100)
+    s.add_argument("--legacy", action="store_true", help="no TXT metadata, like firmware without TXT records")
+    s.add_argument("--info-delay", type=float, default=40, help="ms to answer /info (default 40)")
+    s.add_argument("--base-port", type=int, default=18000, help="/info port of the first board")
+    s.add_argument("--seed", type=int, default=None)
+
+    args = parser.parse_args()
+    try:
+        if args.command == "measure":
+            return measure(args)
+        asyncio.run(simulate(args))
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,475 @@
+#!/usr/bin/env python3
+"""Check the MQTT interface of VDA IR Control boards against a broker.
+
+Boards with MQTT enabled (POST /mqtt) publish their availability, health,
+received IR codes and Home Assistant discovery configs, and take IR and
+serial commands on <base>/cmd/... topics. check connects to the broker,
+validates what one board has published and optionally sends it commands,
+timing each round trip through <base>/result:
+
+    python3 tools/mqtt_check.py check --base vda-ir/a4cf12b3c4d5
+    python3 tools/mqtt_check.py check --base vda-ir/a4cf12b3c4d5 --send 4=nec:20DF10EF --count 20
+    python3 tools/mqtt_check.py check --base vda-ir/a4cf12b3c4d5 --serial "PWR?" --line-ending cr
+
+watch prints every message on a topic filter (default: everything):
+
+    python3 tools/mqtt_check.py watch --topic 'vda-ir/#'
+
+simulate connects virtual boards that behave like the firmware, to try Home
+Assistant or the checks above at fleet scale without hardware:
+
+    mosquitto -p 1883 &
+    python3 tools/mqtt_check.py simulate --boards 50 --event-interval 5
+    python3 tools/mqtt_check.py check --base vda-ir/sim0001 --send 4=nec:20DF10EF --count 50
+
+Only the Python standard library is used (a minimal MQTT 3.1.1 client with
+QoS 0 and 1).
+"""
+
+import argparse
+import asyncio
+import itertools
+import json
+import random
+import struct
+import sys
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK, SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 1, 2, 3, 4, 8, 9, 12, 13, 14
+
+
+# ---------------------------------------------------------------- client
+
+def encode_length(length):
+    out = bytearray()
+    while True:
+        byte, length = length % 128, length // 128
+        out.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(out)
+
+
+def encode_string(value):
+    data = value.encode() if isinstance(value, str) else value
+    return struct.pack(">H", len(data)) + data
+
+
+def packet(kind, flags, body):
+    return bytes([kind << 4 | flags]) + encode_length(len(body)) + body
+
+
+class Client:
+    """One broker connection. Received publishes go to self.messages as
+    (topic, payload bytes, retained) tuples; QoS 1 ones are acknowledged."""
+
+    def __init__(self, client_id, username=None, password=None, clean=True, will=None, keepalive=30):
+        self.client_id = client_id
+        self.username = username
+        self.password = password
+        self.clean = clean
+        self.will = will  # (topic, payload, retain), sent at QoS 1
+        self.keepalive = keepalive
+        self.messages = asyncio.Queue()
+        self.session_present = False
+        self._ids = itertools.cycle(range(1, 65536))
+        self._pending = {}
+        self._connack = None
+        self._tasks = []
+
+    async def connect(self, host, port):
+        self.reader, self.writer = await asyncio.open_connection(host, port)
+        flags = 0 if self.clean is False else 0x02
+        payload = encode_string(self.client_id)
+        if self.will:
+            topic, message, retain = self.will
+            flags |= 0x04 | 0x08 | (0x20 if retain else 0)
+            payload += encode_string(topic) + encode_string(message)
+        if self.username:
+            flags |= 0x80
+            payload += encode_string(self.username)
+        if self.password:
+            flags |= 0x40
+            payload += encode_string(self.password)
+        body = encode_string("MQTT") + bytes([4, flags]) + struct.pack(">H", self.keepalive) + payload
+        self._connack = asyncio.get_running_loop().create_future()
+        self.writer.write(packet(CONNECT, 0, body))
+        self._tasks = [asyncio.create_task(self._read()), asyncio.create_task(self._ping())]
+        code = await asyncio.wait_for(self._connack, 10)
+        if code != 0:
+            raise ConnectionError(f"connection refused (code {code})")
+
+    async def subscribe(self, *topics):
+        packet_id = next(self._ids)
+        body = struct.pack(">H", packet_id) + b"".join(encode_string(t) + b"\x01" for t in topics)
+        await self._request(packet_id, packet(SUBSCRIBE, 0x2, body))
+
+    async def publish(self, topic, payload, retain=False, qos=1):
+        data = payload.encode() if isinstance(payload, str) else payload
+        flags = qos << 1 | (1 if retain else 0)
+        if qos == 0:
+            self.writer.write(packet(PUBLISH, flags, encode_string(topic) + data))
+            return
+        packet_id = next(self._ids)
+        await self._request(packet_id, packet(PUBLISH, flags, encode_string(topic) + struct.pack(">H", packet_id) + data))
+
+    async def close(self):
+        try:
+            self.writer.write(packet(DISCONNECT, 0, b""))
+            await self.writer.drain()
+        except ConnectionError:
+            pass
+        for task in self._tasks:
+            task.cancel()
+        self.writer.close()
+
+    async def _request(self, packet_id, data):
+        future = asyncio.get_running_loop().create_future()
+        self._pending[packet_id] = future
+        self.writer.write(data)
+        await asyncio.wait_for(future, 10)
+
+    async def _ping(self):
+        while True:
+            await asyncio.sleep(self.keepalive / 2)
+            self.writer.write(packet(PINGREQ, 0, b""))
+
+    async def _read(self):
+        try:
+            while True:
+                header = (await self.reader.readexactly(1))[0]
+                length, shift = 0, 0
+                while True:
+                    byte = (await self.reader.readexactly(1))[0]
+                    length |= (byte & 0x7F) << shift
+                    shift += 7
+                    if not byte & 0x80:
+                        break
+                body = await self.reader.readexactly(length)
+                self._handle(header >> 4, header & 0x0F, body)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            self.messages.put_nowait(None)
+
+    def _handle(self, kind, flags, body):
+        if kind == CONNACK:
+            self.session_present = bool(body[0] & 1)
+            self._connack.set_result(body[1])
+        elif kind in (PUBACK, SUBACK):
+            future = self._pending.pop(struct.unpack_from(">H", body)[0], None)
+            if future and not future.done():
+                future.set_result(body[2:])
+        elif kind == PUBLISH:
+            (topic_len,) = struct.unpack_from(">H", body)
+            topic = body[2:2 + topic_len].decode()
+            offset = 2 + topic_len
+            if flags & 0x06:
+                (packet_id,) = struct.unpack_from(">H", body, offset)
+                offset += 2
+                self.writer.write(packet(PUBACK, 0, struct.pack(">H", packet_id)))
+            self.messages.put_nowait((topic, body[offset:], bool(flags & 1)))
+
+
+def parse_broker(value):
+    host, _, port = value.rpartition(":") if ":" in value else (value, "", "1883")
+    return host, int(port)
+
+
+async def open_client(args, client_id, **kwargs):
+    client = Client(client_id, args.username, args.password, **kwargs)
+    await client.connect(*parse_broker(args.broker))
+    return client
+
+
+async def collect(client, seconds):
+    """Messages received within the given time"""
+    messages, deadline = [], time.monotonic() + seconds
+    while (remaining := deadline - time.monotonic()) > 0:
+        try:
+            message = await asyncio.wait_for(client.messages.get(), remaining)
+        except asyncio.TimeoutError:
+            break
+        if message is None:
+            raise ConnectionError("broker closed the connection")
+        messages.append(message)
+    return messages
+
+
+async def wait_for(client, topic, match=lambda body: True, timeout=10):
+    deadline = time.monotonic() + timeout
+    while (remaining := deadline - time.monotonic()) > 0:
+        try:
+            message = await asyncio.wait_for(client.messages.get(), remaining)
+        except asyncio.TimeoutError:
+            break
+        if message is None:
+            raise ConnectionError("broker closed the connection")
+        if message[0] == topic:
+            body = json.loads(message[1])
+            if match(body):
+                return body
+    return None
+
+
+def pct(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))] if values else 0
+
+
+# ---------------------------------------------------------------- check
+
+def check_discovery(configs, base, problems):
+    """Validate discovery configs whose "~" is the board's base topic"""
+    devices, unique_ids, kinds = set(), set(), {}
+    for topic, config in configs.items():
+        kind = topic.split("/")[-4]
+        kinds[kind] = kinds.get(kind, 0) + 1
+        expand = lambda value: value.replace("~", base, 1) if value.startswith("~") else value
+        if expand(config.get("avty_t", "")) != f"{base}/availability":
+            problems.append(f"{topic}: availability topic is {config.get('avty_t')}")
+        if config.get("uniq_id") in unique_ids:
+            problems.append(f"{topic}: duplicate unique id {config.get('uniq_id')}")
+        unique_ids.add(config.get("uniq_id"))
+        devices.add(json.dumps(config.get("dev", {}).get("ids")))
+        if kind == "text" and not expand(config.get("cmd_t", "")).startswith(f"{base}/cmd/ir/"):
+            problems.append(f"{topic}: command topic is {config.get('cmd_t')}")
+        if kind == "sensor" and not expand(config.get("stat_t", "")).startswith(base + "/"):
+            problems.append(f"{topic}: state topic is {config.get('stat_t')}")
+    if len(devices) > 1:
+        problems.append(f"configs name {len(devices)} different devices")
+    return kinds
+
+
+async def check(args):
+    base, problems = args.base.rstrip("/"), []
+    client = await open_client(args, f"vda-check-{random.getrandbits(32):08x}")
+    await client.subscribe(f"{base}/#", f"{args.prefix}/+/+/+/config")
+
+    # Retained state arrives right after subscribing
+    retained = {topic: payload for topic, payload, _ in await collect(client, args.settle)}
+    availability = retained.get(f"{base}/availability", b"").decode()
+    print(f"availability: {availability or 'missing'}")
+    if availability != "online":
+        problems.append("board is not online")
+
+    status = retained.get(f"{base}/status")
+    if status:
+        status = json.loads(status)
+        print(f"status: up {status.get('uptime_s')} s, firmware {status.get('firmware')}, "
+              f"free heap {status.get('free_heap')}, config generation {status.get('config_generation')}")
+    else:
+        problems.append("no retained status")
+
+    configs = {}
+    for topic, payload in retained.items():
+        if topic.startswith(args.prefix + "/") and payload:
+            config = json.loads(payload)
+            if config.get("~") == base:
+                configs[topic] = config
+    kinds = check_discovery(configs, base, problems)
+    name = next(iter(configs.values()), {}).get("dev", {}).get("name", "?")
+    print(f"discovery: {len(configs)} configs ({', '.join(f'{n} {k}' for k, n in sorted(kinds.items()))}) "
+          f"for device \"{name}\"")
+    if not configs:
+        problems.append("no discovery configs")
+
+    if args.send:
+        gpio, _, payload = args.send.partition("=")
+        times, failures = [], 0
+        for i in range(args.count):
+            start = time.monotonic()
+            await client.publish(f"{base}/cmd/ir/{gpio}", payload)
+            result = await wait_for(client, f"{base}/result", lambda r: r.get("command") == f"ir/{gpio}")
+            if result is None or not result.get("success"):
+                failures += 1
+                print(f"  send {i}: {result}")
+                continue
+            times.append((time.monotonic() - start) * 1000)
+        print(f"send ir/{gpio} x{args.count}: p50 {pct(times, 50):.0f} ms, p95 {pct(times, 95):.0f} ms, "
+              f"max {max(times, default=0):.0f} ms, failures {failures}")
+        if failures:
+            problems.append(f"{failures} IR sends failed")
+
+    if args.serial:
+        request_id = f"check-{random.getrandbits(32):08x}"
+        body = {"id": request_id, "data": args.serial, "line_ending": args.line_ending, "timeout": args.timeout}
+        start = time.monotonic()
+        await client.publish(f"{base}/cmd/serial/send", json.dumps(body))
+        result = await wait_for(client, f"{base}/result", lambda r: r.get("id") == request_id)
+        response = await wait_for(client, f"{base}/serial/response", lambda r: r.get("id") == request_id,
+                                  timeout=args.timeout / 1000 + 5) if result and result.get("success") else None
+        elapsed = (time.monotonic() - start) * 1000
+        if response is None:
+            problems.append(f"serial command failed: {result}")
+        else:
+            print(f"serial: batch {response.get('batch_id')}, response {response.get('response')!r} "
+                  f"in {elapsed:.0f} ms")
+
+    await client.close()
+    for problem in problems:
+        print(f"PROBLEM: {problem}")
+    return 1 if problems else 0
+
+
+# ---------------------------------------------------------------- watch
+
+async def watch(args):
+    client = await open_client(args, f"vda-watch-{random.getrandbits(32):08x}")
+    await client.subscribe(args.topic)
+    while (message := await client.messages.get()) is not None:
+        topic, payload, retained = message
+        print(f"{time.strftime('%H:%M:%S')} {topic}{' (retained)' if retained else ''} "
+              f"{payload.decode(errors='replace')}")
+    return 1
+
+
+# ---------------------------------------------------------------- simulate
+
+class VirtualBoard:
+    def __init__(self, index, args, rng):
+        self.node = f"vda_ir_sim{index:04d}"
+        self.base = f"vda-ir/sim{index:04d}"
+        self.args = args
+        self.rng = rng
+        self.outputs = list(range(4, 4 + args.outputs))
+        self.inputs = [36 + i for i in range(args.inputs)]
+        self.started = time.monotonic()
+        self.batch_id = 0
+
+    def discovery(self):
+        device = {"ids": [self.node], "name": f"Simulated {self.node[-4:]}", "mf": "VDA Solutions",
+                  "mdl": "esp32-poe-iso", "sw": "sim"}
+        prefix, common = self.args.prefix, {"~": self.base, "avty_t": "~/availability", "dev": device}
+        for gpio in self.outputs:
+            yield f"{prefix}/text/{self.node}/ir_{gpio}/config", {
+                **common, "name": f"IR output GPIO{gpio}", "uniq_id": f"{self.node}_ir_{gpio}",
+                "ic": "mdi:remote", "cmd_t": f"~/cmd/ir/{gpio}", "mode": "text", "max": 255}
+        for gpio in self.inputs:
+            yield f"{prefix}/sensor/{self.node}/ir_{gpio}/config", {
+                **common, "name": f"IR input GPIO{gpio}", "uniq_id": f"{self.node}_ir_{gpio}", "ic": "mdi:remote",
+                "stat_t": f"~/ir/{gpio}/received", "json_attr_t": f"~/ir/{gpio}/received",
+                "val_tpl": "{{ value_json.code }}"}
+        yield f"{prefix}/sensor/{self.node}/status/config", {
+            **common, "name": "Uptime", "uniq_id": f"{self.node}_uptime", "stat_t": "~/status",
+            "val_tpl": "{{ value_json.uptime_s }}", "json_attr_t": "~/status", "dev_cla": "duration",
+            "unit_of_meas": "s", "ent_cat": "diagnostic"}
+
+    async def run(self):
+        self.client = await open_client(self.args, self.node, clean=False,
+                                        will=(f"{self.base}/availability", "offline", True))
+        await self.client.subscribe(f"{self.base}/cmd/#", f"{self.args.prefix}/status")
+        await self.client.publish(f"{self.base}/availability", "online", retain=True)
+        await self.publish_discovery()
+        tasks = [asyncio.create_task(self.status_loop())]
+        if self.inputs and self.args.event_interval:
+            tasks.append(asyncio.create_task(self.event_loop()))
+        while (message := await self.client.messages.get()) is not None:
+            await self.command(*message)
+        for task in tasks:
+            task.cancel()
+
+    async def publish_discovery(self):
+        for topic, config in self.discovery():
+            await self.client.publish(topic, json.dumps(config), retain=True)
+
+    async def status_loop(self):
+        while True:
+            status = {"uptime_s": int(time.monotonic() - self.started), "firmware": "sim", "board_id": self.node,
+                      "config_generation": 1, "free_heap": 180000 + self.rng.randint(-2000, 2000),
+                      "min_free_heap": 150000, "idle_percent": [90, 95], "mqtt_dropped": 0}
+            await self.client.publish(f"{self.base}/status", json.dumps(status), retain=True)
+            await asyncio.sleep(60)
+
+    async def event_loop(self):
+        while True:
+            await asyncio.sleep(self.rng.expovariate(1 / self.args.event_interval))
+            gpio = self.rng.choice(self.inputs)
+            event = {"port": gpio, "protocol": "NEC", "code": f"{self.rng.getrandbits(32):08X}", "bits": 32}
+            await self.client.publish(f"{self.base}/ir/{gpio}/received", json.dumps(event))
+
+    async def command(self, topic, payload, retained):
+        if topic == f"{self.args.prefix}/status":
+            if payload == b"online":
+                await self.publish_discovery()
+            return
+        name = topic[len(self.base) + len("/cmd/"):]
+        try:
+            body = json.loads(payload) if payload.startswith(b"{") else {"code": payload.decode()}
+        except ValueError:
+            body = None
+        result = {"command": name, "status": 200}
+        if isinstance(body, dict) and "id" in body:
+            result["id"] = body["id"]
+        if body is None:
+            result.update(status=400, error="Invalid JSON")
+        elif name == "ir/send" or name.startswith("ir/"):
+            output = body.get("output") if name == "ir/send" else int(name[3:])
+            if output not in self.outputs:
+                result.update(status=400, error="Invalid output or not configured")
+            else:
+                await asyncio.sleep(self.args.ir_delay / 1000)
+        elif name == "serial/send":
+            self.batch_id += 1
+            result.update(status=202, batch_id=self.batch_id)
+        else:
+            result.update(status=404, error="Unknown command")
+        result["success"] = result["status"] < 300
+        await self.client.publish(f"{self.base}/result", json.dumps(result))
+        if name == "serial/send" and result["success"]:
+            await asyncio.sleep(self.args.ir_delay / 1000)
+            response = {"batch_id": self.batch_id, "success": True, "response": "OK", "response_format": "text",
+                        "response_length": 2, "truncated": False, "elapsed_ms": int(self.args.ir_delay)}
+            if isinstance(body.get("id"), str):
+                response["id"] = body["id"]
+            await self.client.publish(f"{self.base}/serial/response", json.dumps(response))
+
+
+async def simulate(args):
+    rng = random.Random(args.seed)
+    boards = [VirtualBoard(i + 1, args, random.Random(rng.getrandbits(32))) for i in range(args.boards)]
+    print(f"{len(boards)} boards: vda-ir/sim0001 .. vda-ir/sim{len(boards):04d}, "
+          f"outputs GPIO4..{3 + args.outputs}, inputs {[36 + i for i in range(args.inputs)]}")
+    await asyncio.gather(*(board.run() for board in boards))
+    return 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="127.0.0.1:1883", help="host[:port] (default 127.0.0.1:1883)")
+    parser.add_argument("--username")
+    parser.add_argument("--password")
+    parser.add_argument("--prefix", default="homeassistant", help="discovery prefix (default homeassistant)")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    c = commands.add_parser("check", help="validate one board's topics and time commands")
+    c.add_argument("--base", required=True, help="the board's base topic, as shown by GET /mqtt")
+    c.add_argument("--settle", type=float, default=2, help="seconds to collect retained messages (default 2)")
+    c.add_argument("--send", help="GPIO=PAYLOAD to send to cmd/ir/<GPIO>, e.g. 4=nec:20DF10EF")
+    c.add_argument("--count", type=int, default=1, help="number of IR sends (default 1)")
+    c.add_argument("--serial", help="data to send with cmd/serial/send")
+    c.add_argument("--line-ending", default="none", help="none, cr, lf, crlf or ! (default none)")
+    c.add_argument("--timeout", type=int, default=1000, help="serial response timeout in ms (default 1000)")
+
+    w = commands.add_parser("watch", help="print messages")
+    w.add_argument("--topic", default="#", help="topic filter (default #)")
+
+    s = commands.add_parser("simulate", help="connect virtual boards")
+    s.add_argument("--boards", type=int, default=10)
+    s.add_argument("--outputs", type=int, default=8, help="IR outputs per board (default 8)")
+    s.add_argument("--inputs", type=int, default=1, help="IR inputs per board (default 1)")
+    s.add_argument("--event-interval", type=float, default=0,
+                   help="mean seconds between received IR codes per board (default 0, none)")
+    s.add_argument("--ir-delay", type=float, default=60, help="ms to answer a command (default 60)")
+    s.add_argument("--seed", type=int, default=None)
+
+    args = parser.parse_args()
+    run = {"check": check, "watch": watch, "simulate": simulate}[args.command]
+    try:
+        return asyncio.run(run(args))
+    except KeyboardInterrupt:
+        return 0
+    except (ConnectionError, OSError, asyncio.TimeoutError) as error:
+        print(f"{args.broker}: {error or type(error).__name__}", file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
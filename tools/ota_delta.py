@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+"""Build and check delta OTA updates for VDA IR Control firmware.
+
+A delta reconstructs a new application image from the one the board is
+running, so moving between adjacent versions only transfers what changed.
+
+    # Create a delta (gzip it, the board decompresses on the fly)
+    python3 tools/ota_delta.py make old.bin new.bin -o update.delta.gz
+
+    # Rebuild the new image from a delta, as the board does
+    python3 tools/ota_delta.py apply old.bin update.delta.gz -o rebuilt.bin
+
+    # Size and time comparison across every pair of adjacent releases, keeping
+    # each delta as <dir>/<new release>.delta (the host tests apply these)
+    python3 tools/ota_delta.py releases releases/ --out deltas/
+
+Inputs can be application images (.pio/build/<env>/firmware.bin) or merged
+flash images as published in releases/; the application is extracted from
+merged images.
+
+Delta format (little endian), applied as a stream with bounded RAM:
+
+    header:  "VDAD", u8 version, 3 reserved bytes,
+             u32 old_size, old_sha256[32], u32 new_size, new_sha256[32]
+    records: u32 diff_len, u32 extra_len, i32 seek,
+             diff_len bytes added (mod 256) to the old image at the read
+             position, then extra_len literal bytes; the read position
+             advances by diff_len and then by seek.
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import struct
+import sys
+import time
+
+MAGIC = b"VDAD"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xI32sI32s")
+RECORD = struct.Struct("<IIi")
+
+IMAGE_MAGIC = 0xE9
+MERGED_APP_OFFSET = 0x10000
+MATCH_LEN = 8       # Bytes hashed to find a match
+INDEX_STEP = 4      # Old image positions indexed
+EXTEND_SLACK = 64   # Give up extending after this many bytes without gain
+
+
+def load_app(path):
+    """Application image from an app or merged flash image."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) > MERGED_APP_OFFSET and data[0x1000] == IMAGE_MAGIC and data[MERGED_APP_OFFSET] == IMAGE_MAGIC:
+        return data[MERGED_APP_OFFSET:]
+    if data and data[0] == IMAGE_MAGIC:
+        return data
+    sys.exit(f"{path}: not an ESP32 firmware image")
+
+
+def extend(old, new, o, n):
+    """Length of an approximate match starting at old[o], new[n] that
+    maximizes 2 * matching bytes - length (as in bsdiff)."""
+    limit = min(len(old) - o, len(new) - n)
+    matches = best = best_score = 0
+    i = 0
+    while i < limit:
+        if old[o + i] == new[n + i]:
+            matches += 1
+        i += 1
+        score = 2 * matches - i
+        if score > best_score:
+            best_score, best = score, i
+        elif i - best > EXTEND_SLACK:
+            break
+    return best
+
+
+def make_delta(old, new):
+    index = {}
+    for i in range(0, len(old) - MATCH_LEN + 1, INDEX_STEP):
+        index.setdefault(old[i:i + MATCH_LEN], i)
+
+    records = []  # (new_start, diff_len, old_start, extra_start, extra_len)
+    pos = 0       # End of the last match in new
+    old_end = 0   # Matching end in old
+    scan = 0
+    while scan < len(new):
+        # Prefer continuing at the previous offset, which keeps seeks at zero
+        o = old_end + (scan - pos)
+        length = 0
+        if o + MATCH_LEN <= len(old) and old[o:o + MATCH_LEN] == new[scan:scan + MATCH_LEN]:
+            length = extend(old, new, o, scan)
+        if length == 0:
+            o = index.get(new[scan:scan + MATCH_LEN], -1)
+            if o >= 0:
+                length = extend(old, new, o, scan)
+        if length < MATCH_LEN:
+            scan += 1
+            continue
+
+        if records:
+            n_start, d_len, o_start, _, _ = records[-1]
+            records[-1] = (n_start, d_len, o_start, n_start + d_len, scan - (n_start + d_len))
+        elif scan > 0:
+            records.append((0, 0, 0, 0, scan))
+        records.append((scan, length, o, scan + length, 0))
+        pos = scan = scan + length
+        old_end = o + length
+
+    if records:
+        n_start, d_len, o_start, _, _ = records[-1]
+        records[-1] = (n_start, d_len, o_start, n_start + d_len, len(new) - (n_start + d_len))
+    else:
+        records.append((0, 0, 0, 0, len(new)))
+
+    out = bytearray(HEADER.pack(MAGIC, VERSION, len(old), hashlib.sha256(old).digest(),
+                                len(new), hashlib.sha256(new).digest()))
+    read_pos = 0
+    last_record = None
+    for n_start, d_len, o_start, e_start, e_len in records:
+        if d_len and o_start != read_pos:
+            # Fold the jump into the previous record's seek
+            if last_record is None:
+                last_record = len(out)
+                out += RECORD.pack(0, 0, 0)
+            prev = RECORD.unpack_from(out, last_record)
+            RECORD.pack_into(out, last_record, prev[0], prev[1], prev[2] + o_start - read_pos)
+            read_pos = o_start
+        last_record = len(out)
+        out += RECORD.pack(d_len, e_len, 0)
+        out += bytes((new[n_start + k] - old[o_start + k]) & 0xFF for k in range(d_len))
+        out += new[e_start:e_start + e_len]
+        read_pos += d_len
+    return bytes(out)
+
+
+def apply_delta(old, delta):
+    magic, version, old_size, old_sha, new_size, new_sha = HEADER.unpack_from(delta)
+    if magic != MAGIC or version != VERSION:
+        sys.exit("not a VDAD delta")
+    if old_size != len(old) or hashlib.sha256(old).digest() != old_sha:
+        sys.exit("delta was made against a different old image")
+
+    new = bytearray()
+    pos, read_pos = HEADER.size, 0
+    while pos < len(delta):
+        d_len, e_len, seek = RECORD.unpack_from(delta, pos)
+        pos += RECORD.size
+        if read_pos + d_len > len(old):
+            sys.exit("delta reads past the old image")
+        new += bytes((delta[pos + k] + old[read_pos + k]) & 0xFF for k in range(d_len))
+        pos += d_len
+        new += delta[pos:pos + e_len]
+        pos += e_len
+        read_pos += d_len + seek
+
+    if len(new) != new_size or hashlib.sha256(new).digest() != new_sha:
+        sys.exit("reconstructed image does not match")
+    return bytes(new)
+
+
+def read_delta(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    return gzip.decompress(data) if data[:2] == b"\x1f\x8b" else data
+
+
+def compare(old, new, label):
+    """Build a delta, check it rebuilds new byte-for-byte and print sizes."""
+    start = time.time()
+    delta = make_delta(old, new)
+    made = time.time() - start
+    if apply_delta(old, delta) != new:
+        sys.exit(f"{label}: reconstruction mismatch")
+    full_gz = len(gzip.compress(new, 9))
+    delta_gz = len(gzip.compress(delta, 9))
+    print(f"{label:<34} {len(new):>9} {full_gz:>9} {len(delta):>9} {delta_gz:>9} "
+          f"{100.0 * delta_gz / len(new):>6.1f}% {made:>6.1f}s")
+    return delta
+
+
+def print_table_header():
+    print(f"{'':<34} {'full':>9} {'full.gz':>9} {'delta':>9} {'delta.gz':>9} {'sent':>7} {'make':>7}")
+
+
+def cmd_make(args):
+    old, new = load_app(args.old), load_app(args.new)
+    print_table_header()
+    delta = compare(old, new, os.path.basename(args.new))
+    if args.output.endswith(".gz"):
+        delta = gzip.compress(delta, 9)
+    with open(args.output, "wb") as f:
+        f.write(delta)
+
+
+def cmd_apply(args):
+    new = apply_delta(load_app(args.old), read_delta(args.delta))
+    with open(args.output, "wb") as f:
+        f.write(new)
+    print(f"{args.output}: {len(new)} bytes, sha256 {hashlib.sha256(new).hexdigest()}")
+
+
+def version_key(name):
+    return tuple(int(x) for x in re.search(r"v(\d+)\.(\d+)\.(\d+)", name).groups())
+
+
+def cmd_releases(args):
+    boards = {}
+    for name in os.listdir(args.dir):
+        m = re.match(r"firmware-(.+)-v\d+\.\d+\.\d+\.bin$", name)
+        if m:
+            boards.setdefault(m.group(1), []).append(name)
+
+    print_table_header()
+    for board in sorted(boards):
+        names = sorted(boards[board], key=version_key)
+        for old_name, new_name in zip(names, names[1:]):
+            old = load_app(os.path.join(args.dir, old_name))
+            new = load_app(os.path.join(args.dir, new_name))
+            versions = [".".join(map(str, version_key(n))) for n in (old_name, new_name)]
+            delta = compare(old, new, f"{board} {versions[0]} -> {versions[1]}")
+            if args.out:
+                with open(os.path.join(args.out, new_name[:-len(".bin")] + ".delta"), "wb") as f:
+                    f.write(delta)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("make", help="create a delta from OLD to NEW")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("-o", "--output", required=True, help="delta file (gzip compressed if it ends in .gz)")
+    p.set_defaults(func=cmd_make)
+
+    p = sub.add_parser("apply", help="rebuild NEW from OLD and a delta")
+    p.add_argument("old")
+    p.add_argument("delta")
+    p.add_argument("-o", "--output", required=True)
+    p.set_defaults(func=cmd_apply)
+
+    p = sub.add_parser("releases", help="compare full and delta updates between adjacent releases")
+    p.add_argument("dir")
+    p.add_argument("--out", help="directory to write each delta to, named after its new release")
+    p.set_defaults(func=cmd_releases)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
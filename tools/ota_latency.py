@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Measure /send_ir latency on a VDA IR Control board during a firmware upload.
+
+Sends IR codes at a steady rate, first with the board idle and then while a
+firmware image is uploaded to the upload port, and compares the latencies
+against a budget:
+
+    python3 tools/ota_latency.py 192.168.1.50 .pio/build/esp32-poe-iso/firmware.bin.gz \\
+      --port 1 --code 20DF10EF
+
+The upload is sent with a deliberately wrong sha256, so the board writes the
+whole image to its inactive slot, rejects it at the end and keeps running the
+current firmware. Pass --install to install the image instead. --legacy
+uploads to POST /update on port 80 for comparison.
+
+Exits with status 1 if the p95 latency during the upload exceeds --budget-ms.
+"""
+
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+import urllib.error
+import urllib.request
+import uuid
+
+UPLOAD_PORT = 8266
+
+
+def send_ir(host, body, timeout):
+    """Returns the request latency in ms, or None on failure."""
+    request = urllib.request.Request(f"http://{host}/send_ir", data=body,
+                                     headers={"Content-Type": "application/json"})
+    start = time.monotonic()
+    try:
+        with urllib.request.urlopen(request, timeout=timeout) as response:
+            response.read()
+    except (urllib.error.URLError, OSError):
+        return None
+    return (time.monotonic() - start) * 1000
+
+
+def upload(url, image, name, result):
+    boundary = uuid.uuid4().hex
+    body = (f"--{boundary}\r\nContent-Disposition: form-data; name=\"firmware\"; filename=\"{name}\"\r\n"
+            f"Content-Type: application/octet-stream\r\n\r\n").encode() + image + f"\r\n--{boundary}--\r\n".encode()
+    request = urllib.request.Request(url, data=body,
+                                     headers={"Content-Type": f"multipart/form-data; boundary={boundary}"})
+    start = time.monotonic()
+    try:
+        with urllib.request.urlopen(request, timeout=300) as response:
+            result["status"], result["text"] = response.status, response.read().decode()
+    except urllib.error.HTTPError as e:
+        result["status"], result["text"] = e.code, e.read().decode()
+    except (urllib.error.URLError, OSError) as e:
+        result["status"], result["text"] = None, str(e)
+    result["seconds"] = time.monotonic() - start
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(label, latencies, failures):
+    if not latencies:
+        print(f"{label:<16} no successful requests, {failures} failed")
+        return None
+    p95 = percentile(latencies, 95)
+    print(f"{label:<16} n={len(latencies):<4} p50={percentile(latencies, 50):7.1f}ms "
+          f"p95={p95:7.1f}ms max={max(latencies):7.1f}ms failed={failures}")
+    return p95
+
+
+def measure(host, body, interval, timeout, until):
+    latencies, failures = [], 0
+    while not until():
+        start = time.monotonic()
+        latency = send_ir(host, body, timeout)
+        if latency is None:
+            failures += 1
+        else:
+            latencies.append(latency)
+        time.sleep(max(0.0, interval - (time.monotonic() - start)))
+    return latencies, failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="board address")
+    parser.add_argument("image", help="firmware image to upload (.bin, .gz or delta)")
+    parser.add_argument("--port", type=int, default=1, help="IR output port (default 1)")
+    parser.add_argument("--protocol", default="NEC")
+    parser.add_argument("--code", default="20DF10EF")
+    parser.add_argument("--bits", type=int, default=32)
+    parser.add_argument("--interval", type=float, default=0.25, help="seconds between sends (default 0.25)")
+    parser.add_argument("--baseline", type=float, default=5, help="seconds measured before the upload (default 5)")
+    parser.add_argument("--budget-ms", type=float, default=250, help="p95 budget during the upload (default 250)")
+    parser.add_argument("--install", action="store_true", help="install the image instead of rejecting it")
+    parser.add_argument("--legacy", action="store_true", help="upload to port 80 instead of the upload port")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    body = json.dumps({"port": args.port, "protocol": args.protocol, "code": args.code,
+                       "bits": args.bits}).encode()
+    timeout = 30
+
+    deadline = time.monotonic() + args.baseline
+    baseline = measure(args.host, body, args.interval, timeout, lambda: time.monotonic() >= deadline)
+
+    url = f"http://{args.host}/update" if args.legacy else f"http://{args.host}:{UPLOAD_PORT}/update"
+    if not args.install:
+        url += "?sha256=" + "0" * 64
+    result = {}
+    uploader = threading.Thread(target=upload, args=(url, image, os.path.basename(args.image), result))
+    uploader.start()
+    during = measure(args.host, body, args.interval, timeout, lambda: not uploader.is_alive())
+    uploader.join()
+
+    print(f"upload: {len(image)} bytes in {result['seconds']:.1f}s -> {result['status']} {result['text']}")
+    report("idle", *baseline)
+    p95 = report("during upload", *during)
+    if p95 is None or p95 > args.budget_ms:
+        print(f"FAIL: p95 during upload above {args.budget_ms:g}ms budget")
+        sys.exit(1)
+    print(f"OK: p95 during upload within {args.budget_ms:g}ms budget")
+
+
+if __name__ == "__main__":
+    main()
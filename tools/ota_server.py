@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Local update server for testing pull OTA on VDA IR Control boards.
+
+Serves a firmware image (plain, .gz or a delta from ota_delta.py) and a
+manifest describing it. HTTP Range requests are supported so boards can
+resume interrupted downloads.
+
+    python3 tools/ota_server.py firmware.bin.gz --version 1.2.6
+
+Then point a board at it:
+
+    curl -X POST http://<board-ip>/ota/pull \\
+      -d '{"enabled": true, "manifest_url": "http://<this-host>:8080/manifest.json", "check_now": true}'
+
+--drop-after N closes each image response after N bytes to exercise resume,
+and --no-range makes the server ignore Range headers, like some proxies do.
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import os
+import re
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+def image_sha256(data):
+    """SHA-256 of the firmware image the board ends up with. For a delta,
+    that is stored in its header."""
+    if data[:2] == b"\x1f\x8b":
+        data = gzip.decompress(data)
+    if data[:4] == b"VDAD":
+        return data[48:80].hex()
+    return hashlib.sha256(data).hexdigest()
+
+
+class Handler(BaseHTTPRequestHandler):
+    def do_GET(self):
+        if self.path == "/manifest.json":
+            body = json.dumps(self.server.manifest).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        elif self.path == "/" + self.server.image_name:
+            self.send_image()
+        else:
+            self.send_error(404)
+
+    def send_image(self):
+        data = self.server.image
+        start = 0
+        match = re.match(r"bytes=(\d+)-$", self.headers.get("Range", ""))
+        if match and not self.server.no_range:
+            start = int(match.group(1))
+            if start >= len(data):
+                self.send_error(416)
+                return
+            self.send_response(206)
+            self.send_header("Content-Range", f"bytes {start}-{len(data) - 1}/{len(data)}")
+        else:
+            self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(data) - start))
+        self.end_headers()
+
+        end = len(data)
+        if self.server.drop_after:
+            end = min(end, start + self.server.drop_after)
+        self.wfile.write(data[start:end])
+        if end < len(data):
+            self.log_message("dropped connection at byte %d", end)
+            self.close_connection = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", help="firmware image, .gz or delta to serve")
+    parser.add_argument("--version", required=True, help="firmware version announced in the manifest")
+    parser.add_argument("--rollout", type=int, default=100, help="rollout_percent (default 100)")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop-after", type=int, default=0, metavar="N",
+                        help="close image responses after N bytes")
+    parser.add_argument("--no-range", action="store_true", help="ignore Range requests")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    server = ThreadingHTTPServer(("", args.port), Handler)
+    server.image = image
+    server.image_name = os.path.basename(args.image)
+    server.drop_after = args.drop_after
+    server.no_range = args.no_range
+    server.manifest = {
+        "version": args.version,
+        "url": server.image_name,
+        "size": len(image),
+        "sha256": image_sha256(image),
+        "rollout_percent": args.rollout,
+    }
+    print(json.dumps(server.manifest, indent=2))
+    print(f"Serving on port {args.port}")
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
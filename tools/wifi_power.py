@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Compare request latency across the WiFi power profiles of a VDA IR Control board.
+
+Switches the board to each profile in turn and times GET /info requests sent
+after an idle gap, so the radio has time to doze between requests:
+
+    python3 tools/wifi_power.py 192.168.1.50 --count 40 --gap 1.5
+
+The delay that modem sleep adds to the first packet of a request only shows
+up at the client, so it is measured here rather than on the board. The
+board's own per-profile numbers are printed alongside (see "power" in GET
+/diagnostics). The original profile is restored at the end.
+"""
+
+import argparse
+import json
+import time
+import urllib.error
+import urllib.request
+
+PROFILES = ["lowest_latency", "balanced", "low_power"]
+
+
+def request(host, path, body=None, timeout=10):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(f"http://{host}{path}", data=data,
+                                 headers={"Content-Type": "application/json"})
+    with urllib.request.urlopen(req, timeout=timeout) as response:
+        return json.loads(response.read().decode())
+
+
+def timed_get(host, timeout):
+    """Returns the request latency in ms, or None on failure."""
+    start = time.monotonic()
+    try:
+        request(host, "/info", timeout=timeout)
+    except (urllib.error.URLError, OSError, ValueError):
+        return None
+    return (time.monotonic() - start) * 1000
+
+
+def wait_ready(host, settle):
+    """Waits until the board has answered for `settle` seconds without a
+    failure, to get past the reassociation when switching to or from
+    low_power."""
+    deadline = time.monotonic() + settle
+    while time.monotonic() < deadline:
+        time.sleep(0.5)
+        if timed_get(host, 2) is None:
+            deadline = time.monotonic() + settle
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="board address")
+    parser.add_argument("--profiles", nargs="+", choices=PROFILES, default=PROFILES)
+    parser.add_argument("--count", type=int, default=30, help="requests per profile (default 30)")
+    parser.add_argument("--gap", type=float, default=1.0, help="idle seconds between requests (default 1.0)")
+    parser.add_argument("--settle", type=float, default=5, help="seconds to wait after switching (default 5)")
+    args = parser.parse_args()
+
+    original = request(args.host, "/wifi/power")["profile"]
+    results = {}
+    try:
+        for profile in args.profiles:
+            request(args.host, "/wifi/power", {"profile": profile})
+            wait_ready(args.host, args.settle)
+            latencies, failures = [], 0
+            for _ in range(args.count):
+                time.sleep(args.gap)
+                latency = timed_get(args.host, 10)
+                if latency is None:
+                    failures += 1
+                else:
+                    latencies.append(latency)
+            results[profile] = (latencies, failures)
+            print(f"{profile}: {len(latencies)} requests, {failures} failed")
+    finally:
+        request(args.host, "/wifi/power", {"profile": original})
+
+    board = {p["profile"]: p for p in request(args.host, "/wifi/power").get("profiles", [])}
+    print(f"\n{'profile':<16}{'p50':>9}{'p95':>9}{'max':>9}{'failed':>8}   board probe p50/p95")
+    for profile, (latencies, failures) in results.items():
+        probe = board.get(profile, {}).get("probe", {})
+        probe_text = f"{probe.get('p50_ms', 0):g}/{probe.get('p95_ms', 0):g}ms" if probe.get("count") else "-"
+        if latencies:
+            print(f"{profile:<16}{percentile(latencies, 50):7.1f}ms{percentile(latencies, 95):7.1f}ms"
+                  f"{max(latencies):7.1f}ms{failures:>8}   {probe_text}")
+        else:
+            print(f"{profile:<16}{'-':>9}{'-':>9}{'-':>9}{failures:>8}   {probe_text}")
+
+
+if __name__ == "__main__":
+    main()